@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+
+#include <TROOT.h>
+#include <TFile.h>
+#include <TSystem.h>
+#include <TStopwatch.h>
+#include <RVersion.h>
+
+#include "FWCore/FWLite/interface/AutoLibraryLoader.h"
+#include "MuonAnalysis/MomentumScaleCalibration/interface/RootTreeHandler.h"
+
+/**
+ * Writes the muon pairs of a tree with each of the compression codecs and levels used by MuScleFit
+ * (see the TreeCompression parameters) and reports the write time, the file size and the read time. <br>
+ * The codecs not available in the ROOT release in use are listed as such and not measured, since ROOT
+ * would write them as ZLIB. <br>
+ * Usage: CompressionBenchmark file genInfo [basketSize] <br>
+ * The file name must start with file: or rfio: as needed. The benchmark files are written in the
+ * current directory and removed at the end.
+ */
+
+int main(int argc, char* argv[])
+{
+  if( argc < 3 || argc > 4 ) {
+    std::cout << "Please provide the name of the file (with file: or rfio: as needed), if there is generator information (0 is false)" << std::endl;
+    std::cout << "and optionally the basket size" << std::endl;
+    exit(1);
+  }
+  std::string fileName(argv[1]);
+  if( fileName.find("file:") != 0 && fileName.find("rfio:") != 0 ) {
+    std::cout << "Please provide the name of the file with file: or rfio: as needed" << std::endl;
+    exit(1);
+  }
+  std::stringstream ss;
+  ss << argv[2];
+  bool genInfo = false;
+  ss >> genInfo;
+  int basketSize = 32000;
+  if( argc > 3 ) {
+    std::stringstream ssBasket;
+    ssBasket << argv[3];
+    ssBasket >> basketSize;
+  }
+
+  // load framework libraries
+  gSystem->Load( "libFWCoreFWLite" );
+  AutoLibraryLoader::enable();
+
+  std::vector<MuonPair> pairVector;
+  std::vector<GenMuonPair> genPairVector;
+  RootTreeHandler reader;
+  reader.readTree(-1, fileName, &pairVector, 0, genInfo ? &genPairVector : 0);
+  std::cout << "Benchmarking " << pairVector.size() << " pairs" << (genInfo ? " with genInfo" : "")
+            << " and basket size " << basketSize << std::endl;
+
+  std::vector<std::pair<std::string, int> > settings;
+  settings.push_back(std::make_pair(std::string(""), 1));
+  settings.push_back(std::make_pair(std::string("ZLIB"), 1));
+  settings.push_back(std::make_pair(std::string("ZLIB"), 6));
+  settings.push_back(std::make_pair(std::string("LZMA"), 1));
+  settings.push_back(std::make_pair(std::string("LZMA"), 9));
+  settings.push_back(std::make_pair(std::string("LZ4"), 1));
+  settings.push_back(std::make_pair(std::string("LZ4"), 4));
+  settings.push_back(std::make_pair(std::string("ZSTD"), 1));
+  settings.push_back(std::make_pair(std::string("ZSTD"), 5));
+
+  std::cout << "codec level settings writeReal(s) writeCpu(s) size(MB) readReal(s)" << std::endl;
+  for( unsigned int i=0; i<settings.size(); ++i ) {
+    if( !RootTreeHandler::codecAvailable(settings[i].first) ) {
+      std::cout << settings[i].first << " " << settings[i].second << " not available in ROOT " << ROOT_RELEASE << std::endl;
+      continue;
+    }
+    int compression = RootTreeHandler::compressionSettings(settings[i].first, settings[i].second);
+    std::stringstream name;
+    name << "CompressionBenchmark_" << i << ".root";
+
+    RootTreeHandler writer;
+    writer.setCompression(compression);
+    writer.setBasketSize(basketSize);
+    TStopwatch writeTimer;
+    writer.writeTree(name.str().c_str(), &pairVector, 0, genInfo ? &genPairVector : 0, true);
+    writeTimer.Stop();
+
+    Long_t id, flags, modTime;
+    Long64_t size = 0;
+    gSystem->GetPathInfo(name.str().c_str(), &id, &size, &flags, &modTime);
+
+    std::vector<MuonPair> readPairs;
+    std::vector<GenMuonPair> readGenPairs;
+    TStopwatch readTimer;
+    reader.readTree(-1, ("file:"+name.str()).c_str(), &readPairs, 0, genInfo ? &readGenPairs : 0);
+    readTimer.Stop();
+
+    std::cout << (settings[i].first.empty() ? "default" : settings[i].first) << " " << settings[i].second << " "
+              << compression << " " << writeTimer.RealTime() << " " << writeTimer.CpuTime() << " "
+              << size/(1024.*1024.) << " " << readTimer.RealTime() << std::endl;
+    gSystem->Unlink(name.str().c_str());
+  }
+
+  return 0;
+}
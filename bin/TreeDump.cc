@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdio.h>
 
 #include <TH1F.h>
 #include <TROOT.h>
@@ -6,17 +7,26 @@
 #include <TSystem.h>
 #include <sstream>
 #include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <boost/thread/thread.hpp>
 
 #include "FWCore/FWLite/interface/AutoLibraryLoader.h"
-#include "MuonAnalysis/MomentumScaleCalibration/interface/RootTreeHandler.h"
+#include "MuonAnalysis/MomentumScaleCalibration/interface/MuonPairTreeStream.h"
 
 /**
  * Dumps the content of a tree to a local TreeDump.txt file. <br>
  * The txt file contains one pair per row and the values are: <br>
  * - for genInfo = 0 <br>
- * pt1 eta1 phi1 pt2 eta2 phi2 <br>
+ * pt1 eta1 phi1 pt2 eta2 phi2  event run <br>
  * - for genInfo != 0 <br>
- * pt1 eta1 phi1 pt2 eta2 phi2 genPt1 genEta1 genPhi1 genPt2 genEta2 genPhi2.
+ * pt1 eta1 phi1 pt2 eta2 phi2 genPt1 genEta1 genPhi1 genPt2 genEta2 genPhi2  event run. <br>
+ * The tree is read in chunks of pairs, so the memory used does not depend on the size of the tree.
+ * Each chunk is split among numberOfThreads threads (default 1) that convert the pairs to text. <br>
+ * If the fourth argument is "bin" the pairs are written to TreeDump.bin in the binary format
+ * described in MuonPairTreeStream.h instead.
  */
 
 // Useful function to convert 4-vector coordinates
@@ -33,11 +43,72 @@ lorentzVector fromPtEtaPhiToPxPyPz( const double* ptEtaPhiE )
   return lorentzVector(px,py,pz,E);
 }
 
+/**
+ * Converts the pairs in the range [first, last) of a chunk to text or binary records.
+ */
+class ChunkFormatter
+{
+public:
+  ChunkFormatter( const std::vector<MuonPair> & pairs, const std::vector<GenMuonPair> * genPairs,
+                  const unsigned int first, const unsigned int last, const bool binary, std::string * output ) :
+    pairs_(pairs), genPairs_(genPairs), first_(first), last_(last), binary_(binary), output_(output)
+  {}
+
+  void operator()()
+  {
+    const bool genInfo = (genPairs_ != 0);
+    const unsigned int recordSize = MuonPairDumpRecord::size(genInfo);
+    output_->clear();
+    output_->reserve((last_ - first_)*(binary_ ? recordSize : 160));
+    char buffer[512];
+    double values[12];
+    for( unsigned int i=first_; i<last_; ++i ) {
+      const MuonPair & muonPair = pairs_[i];
+      fillValues(muonPair.mu1, muonPair.mu2, values);
+      if( genInfo ) fillValues((*genPairs_)[i].mu1, (*genPairs_)[i].mu2, &(values[6]));
+      if( binary_ ) {
+        MuonPairDumpRecord::encode(values, genInfo, muonPair.event, muonPair.run, buffer);
+        output_->append(buffer, recordSize);
+      }
+      else {
+        // %g gives the same text as the default ostream formatting
+        int length = snprintf(buffer, sizeof(buffer), "%g %g %g %g %g %g ",
+                              values[0], values[1], values[2], values[3], values[4], values[5]);
+        if( genInfo ) {
+          length += snprintf(buffer + length, sizeof(buffer) - length, "%g %g %g %g %g %g ",
+                             values[6], values[7], values[8], values[9], values[10], values[11]);
+        }
+        length += snprintf(buffer + length, sizeof(buffer) - length, " %u %u\n", muonPair.event, muonPair.run);
+        output_->append(buffer, length);
+      }
+    }
+  }
+
+protected:
+  void fillValues( const lorentzVector & mu1, const lorentzVector & mu2, double * values )
+  {
+    values[0] = mu1.pt();
+    values[1] = mu1.eta();
+    values[2] = mu1.phi();
+    values[3] = mu2.pt();
+    values[4] = mu2.eta();
+    values[5] = mu2.phi();
+  }
+
+  const std::vector<MuonPair> & pairs_;
+  const std::vector<GenMuonPair> * genPairs_;
+  unsigned int first_;
+  unsigned int last_;
+  bool binary_;
+  std::string * output_;
+};
+
 int main(int argc, char* argv[]) 
 {
 
-  if( argc != 3 ) {
+  if( argc < 3 || argc > 5 ) {
     std::cout << "Please provide the name of the file (with file: or rfio: as needed) and if there is generator information (0 is false)" << std::endl;
+    std::cout << "Optionally provide the number of threads and the output format (txt or bin)" << std::endl;
     exit(1);
   }
   std::string fileName(argv[1]);
@@ -49,52 +120,67 @@ int main(int argc, char* argv[])
   ss << argv[2];
   bool genInfo = false;
   ss >> genInfo;
-  std::cout << "Dumping tree with genInfo = " << genInfo << std::endl;
+  unsigned int numberOfThreads = 1;
+  if( argc > 3 ) {
+    std::stringstream ssThreads;
+    ssThreads << argv[3];
+    ssThreads >> numberOfThreads;
+    if( numberOfThreads == 0 ) numberOfThreads = 1;
+  }
+  bool binary = false;
+  if( argc > 4 ) {
+    binary = (std::string(argv[4]) == "bin");
+  }
+  std::cout << "Dumping tree with genInfo = " << genInfo << " using " << numberOfThreads << " threads"
+            << (binary ? " in binary format" : "") << std::endl;
 
   // load framework libraries
   gSystem->Load( "libFWCoreFWLite" );
   AutoLibraryLoader::enable();
   
   // open input file (can be located on castor)
-  TFile* inFile = TFile::Open(fileName.c_str());
-
-  // MuonPairVector pairVector;
-  MuonPairVector pairVector;
-  MuonPairVector genPairVector;
-
-  // Create the RootTreeHandler to save the events in the root tree
-  RootTreeHandler treeHandler;
-  // treeHandler.readTree(-1, fileName, &pairVector, &genPairVector);
-  std::vector<std::pair<int, int> > evtRun;
-  treeHandler.readTree(-1, fileName, &pairVector, -20, &evtRun, &genPairVector);
+  MuonPairTreeReader reader(fileName.c_str(), genInfo);
+  if( !reader.isOpen() ) exit(1);
 
-  if( (pairVector.size() != genPairVector.size()) && genInfo ) {
-    std::cout << "Error: the size of pairVector and genPairVector is different" << std::endl;
+  std::ofstream outputFile;
+  if( binary ) {
+    outputFile.open("TreeDump.bin", std::ios::out | std::ios::binary);
+    outputFile.write(MuonPairDumpRecord::tag, MuonPairDumpRecord::tagSize);
+    outputFile.put(genInfo ? 1 : 0);
+  }
+  else {
+    outputFile.open("TreeDump.txt");
   }
 
-  ofstream outputFile;
-  outputFile.open("TreeDump.txt");
-
-  MuonPairVector::const_iterator it = pairVector.begin();
-  MuonPairVector::const_iterator genIt = genPairVector.begin();
-  std::vector<std::pair<int, int> >::iterator evtRunIt = evtRun.begin();
-  for( ; it != pairVector.end(); ++it, ++genIt, ++evtRunIt ) {
-    // Write the information to a txt file
-    outputFile << it->first.pt()  << " " << it->first.eta()  << " " << it->first.phi()  << " "
-               << it->second.pt() << " " << it->second.eta() << " " << it->second.phi() << " ";
-    if( genInfo ) {
-      outputFile << genIt->first.pt()  << " " << genIt->first.eta()  << " " << genIt->first.phi()  << " "
-		 << genIt->second.pt() << " " << genIt->second.eta() << " " << genIt->second.phi() << " ";
+  const unsigned int chunkSize = 100000;
+  std::vector<MuonPair> pairVector;
+  std::vector<GenMuonPair> genPairVector;
+  std::vector<std::string> outputs(numberOfThreads);
+  Long64_t dumpedPairs = 0;
+  while( reader.readChunk(pairVector, genInfo ? &genPairVector : 0, chunkSize) > 0 ) {
+    if( (pairVector.size() != genPairVector.size()) && genInfo ) {
+      std::cout << "Error: the size of pairVector and genPairVector is different" << std::endl;
+      exit(1);
+    }
+    // Each thread converts a contiguous slice and the slices are written in order
+    const unsigned int slice = (pairVector.size() + numberOfThreads - 1)/numberOfThreads;
+    boost::thread_group threads;
+    for( unsigned int iThread=0; iThread<numberOfThreads; ++iThread ) {
+      unsigned int first = std::min(iThread*slice, (unsigned int)pairVector.size());
+      unsigned int last = std::min(first + slice, (unsigned int)pairVector.size());
+      ChunkFormatter formatter(pairVector, genInfo ? &genPairVector : 0, first, last, binary, &(outputs[iThread]));
+      if( numberOfThreads == 1 ) formatter();
+      else threads.create_thread(formatter);
     }
-    outputFile << " " << evtRunIt->first << " " << evtRunIt->second;
-    outputFile << std::endl;
+    threads.join_all();
+    for( unsigned int iThread=0; iThread<numberOfThreads; ++iThread ) {
+      outputFile.write(outputs[iThread].data(), outputs[iThread].size());
+    }
+    dumpedPairs += pairVector.size();
   }
-  
-  // size_t namePos = fileName.find_last_of("/");
-  // treeHandler.writeTree(("tree_"+fileName.substr(namePos+1, fileName.size())).c_str(), &pairVector);
+  std::cout << "Dumped " << dumpedPairs << " pairs" << std::endl;
 
-  // close input and output files
-  inFile->Close();
+  // close output file (the input file is closed by the reader)
   outputFile.close();
 
   return 0;
@@ -4,6 +4,7 @@
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 #include <stdlib.h>
 
 #include <TH1F.h>
@@ -11,11 +12,17 @@
 #include <TFile.h>
 #include <TSystem.h>
 
+#include <boost/thread/thread.hpp>
+
 #include "FWCore/FWLite/interface/AutoLibraryLoader.h"
-#include "MuonAnalysis/MomentumScaleCalibration/interface/RootTreeHandler.h"
+#include "MuonAnalysis/MomentumScaleCalibration/interface/MuonPairTreeStream.h"
 
 /**
- * Builds a tree from the dump in the TreeDump.txt file produced by the TreeDump macro.
+ * Builds a tree from the dump in the TreeDump.txt file produced by the TreeDump macro. <br>
+ * The dump is read in chunks of pairs that are parsed by numberOfThreads threads (default 1) and
+ * written to the tree before reading the next chunk, so the memory used does not depend on the size of the dump. <br>
+ * Binary dumps (TreeDump.bin) are recognized from their tag. The event and run numbers are taken from the
+ * dump when present, otherwise they are set to 0.
  */
 
 // Useful function to convert 4-vector coordinates
@@ -32,11 +39,66 @@ lorentzVector fromPtEtaPhiToPxPyPz( const double* ptEtaPhiE )
   return lorentzVector(px,py,pz,E);
 }
 
+/**
+ * Parses the entries in the range [first, last) of a chunk, given either as text lines or as binary records.
+ */
+class ChunkParser
+{
+public:
+  ChunkParser( const std::vector<std::string> * lines, const std::vector<char> * records, const bool genInfo,
+               const unsigned int first, const unsigned int last,
+               std::vector<MuonPair> * pairs, std::vector<GenMuonPair> * genPairs ) :
+    lines_(lines), records_(records), genInfo_(genInfo), first_(first), last_(last), pairs_(pairs), genPairs_(genPairs)
+  {}
+
+  void operator()()
+  {
+    const unsigned int nValues = genInfo_ ? 12 : 6;
+    const unsigned int recordSize = MuonPairDumpRecord::size(genInfo_);
+    double values[12];
+    for( unsigned int i=first_; i<last_; ++i ) {
+      uint32_t event = 0;
+      uint32_t run = 0;
+      if( records_ != 0 ) {
+        MuonPairDumpRecord::decode(&((*records_)[i*recordSize]), genInfo_, values, event, run);
+      }
+      else {
+        // strtod is much faster than the stringstream extraction
+        const char * pos = (*lines_)[i].c_str();
+        char * end = 0;
+        for( unsigned int iValue=0; iValue<nValues; ++iValue ) {
+          values[iValue] = strtod(pos, &end);
+          pos = end;
+        }
+        event = strtoul(pos, &end, 10);
+        if( end != pos ) {
+          pos = end;
+          run = strtoul(pos, &end, 10);
+        }
+      }
+      (*pairs_)[i] = MuonPair(fromPtEtaPhiToPxPyPz(values), fromPtEtaPhiToPxPyPz(&(values[3])), run, event);
+      if( genInfo_ ) {
+        (*genPairs_)[i] = GenMuonPair(fromPtEtaPhiToPxPyPz(&(values[6])), fromPtEtaPhiToPxPyPz(&(values[9])), 0);
+      }
+    }
+  }
+
+protected:
+  const std::vector<std::string> * lines_;
+  const std::vector<char> * records_;
+  bool genInfo_;
+  unsigned int first_;
+  unsigned int last_;
+  std::vector<MuonPair> * pairs_;
+  std::vector<GenMuonPair> * genPairs_;
+};
+
 int main(int argc, char* argv[]) 
 {
 
-  if( argc != 3 ) {
+  if( argc < 3 || argc > 4 ) {
     std::cout << "Please provide the name of the file and if there is generator information (0 is false)" << std::endl;
+    std::cout << "Optionally provide the number of threads" << std::endl;
     exit(1);
   }
   std::string fileName(argv[1]);
@@ -44,59 +106,88 @@ int main(int argc, char* argv[])
   ss << argv[2];
   bool genInfo = false;
   ss >> genInfo;
-  std::cout << "Reading tree dump with genInfo = " << genInfo << std::endl;
+  unsigned int numberOfThreads = 1;
+  if( argc > 3 ) {
+    std::stringstream ssThreads;
+    ssThreads << argv[3];
+    ssThreads >> numberOfThreads;
+    if( numberOfThreads == 0 ) numberOfThreads = 1;
+  }
 
   // load framework libraries
   gSystem->Load( "libFWCoreFWLite" );
   AutoLibraryLoader::enable();
   
-  // MuonPairVector pairVector;
+  std::ifstream inputFile;
+  inputFile.open(fileName.c_str(), std::ios::in | std::ios::binary);
+  if( !inputFile.is_open() ) {
+    std::cout << "Error: cannot open " << fileName << std::endl;
+    exit(1);
+  }
+
+  // Binary dumps start with a tag followed by the genInfo flag, which takes precedence on the one given
+  bool binary = false;
+  char tag[MuonPairDumpRecord::tagSize];
+  inputFile.read(tag, MuonPairDumpRecord::tagSize);
+  if( inputFile.gcount() == (std::streamsize)MuonPairDumpRecord::tagSize &&
+      std::string(tag, MuonPairDumpRecord::tagSize) == MuonPairDumpRecord::tag ) {
+    binary = true;
+    genInfo = (inputFile.get() == 1);
+  }
+  else {
+    inputFile.clear();
+    inputFile.seekg(0);
+  }
+  std::cout << "Reading " << (binary ? "binary " : "") << "tree dump with genInfo = " << genInfo
+            << " using " << numberOfThreads << " threads" << std::endl;
+
+  // The tree is filled chunk by chunk
+  MuonPairTreeWriter writer("TreeFromDump.root", genInfo);
+
+  const unsigned int chunkSize = 100000;
+  const unsigned int recordSize = MuonPairDumpRecord::size(genInfo);
+  std::vector<std::string> lines;
+  std::vector<char> records;
   std::vector<MuonPair> pairVector;
   std::vector<GenMuonPair> genPairVector;
-
-  // Create the RootTreeHandler to save the events in the root tree
-  RootTreeHandler treeHandler;
-
-  ifstream inputFile;
-  inputFile.open(fileName.c_str());
-
-  std::string line;
-  double value[6];
-  double genValue[6];
-  // Read the information from a txt file
-  while( !inputFile.eof() ) {
-    getline(inputFile, line);
-    if( line != "" ) {
-      // std::cout << "line = " << line << std::endl;
-      std::stringstream ss(line);
-      for( int i=0; i<6; ++i ) {
-	ss >> value[i];
-	// std::cout << "value["<<i<<"] = " << value[i] << std::endl;
-      }
-      pairVector.push_back(MuonPair(fromPtEtaPhiToPxPyPz(value), fromPtEtaPhiToPxPyPz(&(value[3])), 0, 0));
-      if( genInfo ) {
-	for( int i=0; i<6; ++i ) {
-	  ss >> genValue[i];
-	  // std::cout << "genValue["<<i<<"] = " << genValue[i] << std::endl;
-	}
-	genPairVector.push_back(GenMuonPair(fromPtEtaPhiToPxPyPz(genValue), fromPtEtaPhiToPxPyPz(&(genValue[3])), 0));
+  Long64_t filledPairs = 0;
+  while( inputFile.good() ) {
+    unsigned int chunkEntries = 0;
+    if( binary ) {
+      records.resize(chunkSize*recordSize);
+      inputFile.read(&(records[0]), records.size());
+      chunkEntries = inputFile.gcount()/recordSize;
+    }
+    else {
+      lines.resize(chunkSize);
+      // Read the information from a txt file
+      while( chunkEntries < chunkSize && getline(inputFile, lines[chunkEntries]) ) {
+        if( lines[chunkEntries] != "" ) ++chunkEntries;
       }
     }
-  }
-  inputFile.close();
-  
-  if( (pairVector.size() != genPairVector.size()) && genInfo ) {
-    std::cout << "Error: the size of pairVector and genPairVector is different" << std::endl;
-  }
+    if( chunkEntries == 0 ) break;
 
-  if( genInfo ) {
-    treeHandler.writeTree("TreeFromDump.root", &pairVector, 0, &genPairVector);
-    std::cout << "Filling tree with genInfo" << std::endl;
-  }
-  else {
-    treeHandler.writeTree("TreeFromDump.root", &pairVector);
-    std::cout << "Filling tree" << std::endl;
+    pairVector.resize(chunkEntries);
+    if( genInfo ) genPairVector.resize(chunkEntries);
+    const unsigned int slice = (chunkEntries + numberOfThreads - 1)/numberOfThreads;
+    boost::thread_group threads;
+    for( unsigned int iThread=0; iThread<numberOfThreads; ++iThread ) {
+      unsigned int first = std::min(iThread*slice, chunkEntries);
+      unsigned int last = std::min(first + slice, chunkEntries);
+      ChunkParser parser(binary ? 0 : &lines, binary ? &records : 0, genInfo, first, last, &pairVector, &genPairVector);
+      if( numberOfThreads == 1 ) parser();
+      else threads.create_thread(parser);
+    }
+    threads.join_all();
+
+    for( unsigned int i=0; i<chunkEntries; ++i ) {
+      writer.fill(pairVector[i], genInfo ? &(genPairVector[i]) : 0);
+    }
+    filledPairs += chunkEntries;
   }
+  writer.close();
+  std::cout << "Filled tree" << (genInfo ? " with genInfo" : "") << " with " << filledPairs << " pairs" << std::endl;
+
   // close input file
   inputFile.close();
 
@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+
+#include <TROOT.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TSystem.h>
+#include <TStopwatch.h>
+
+#include "FWCore/FWLite/interface/AutoLibraryLoader.h"
+#include "MuonAnalysis/MomentumScaleCalibration/interface/RootTreeHandler.h"
+
+/**
+ * Compares the time needed to read the muon pairs of a tree as MuScleFit does before the first likelihood
+ * evaluation: <br>
+ * - legacy: TTree::GetEntry of all the branches, no TTreeCache and vectors growing with push_back
+ *   (the readTree of the previous versions); <br>
+ * - readTree with reserved vectors and only the needed branches, without cache (TreeCacheSize = 0); <br>
+ * - the same with the TTreeCache of the given size (TreeCacheSize); <br>
+ * - the same with the baskets decompressed by a separate thread (ParallelUnzip). <br>
+ * Usage: TreeReadBenchmark file genInfo [cacheSize] <br>
+ * The file is read once before the measurements, so that all the modes find it in the page cache.
+ * The time to the first likelihood evaluation printed by MuScleFit is this read time plus the
+ * selection of the pairs, which does not depend on the mode.
+ */
+
+/// The reading loop of the previous versions of RootTreeHandler::readTree
+void legacyRead( const TString & fileName, const bool genInfo, MuonPairVector * savedPair,
+                 std::vector<std::pair<int, int> > * evtRun, MuonPairVector * genPair )
+{
+  TFile * file = TFile::Open(fileName, "READ");
+  TTree * tree = (TTree*)file->Get("T");
+  MuonPair * muonPair = 0;
+  GenMuonPair * genMuonPair = 0;
+  tree->SetBranchAddress("event", &muonPair);
+  if( genInfo ) tree->SetBranchAddress("genEvent", &genMuonPair);
+  Long64_t nentries = tree->GetEntries();
+  for( Long64_t i=0; i<nentries; ++i ) {
+    tree->GetEntry(i);
+    savedPair->push_back(std::make_pair(muonPair->mu1, muonPair->mu2));
+    evtRun->push_back(std::make_pair(muonPair->event, muonPair->run));
+    if( genInfo ) genPair->push_back(std::make_pair(genMuonPair->mu1, genMuonPair->mu2));
+  }
+  file->Close();
+  delete file;
+}
+
+int main(int argc, char* argv[])
+{
+  if( argc < 3 || argc > 4 ) {
+    std::cout << "Please provide the name of the file (with file: or rfio: as needed), if there is generator information (0 is false)" << std::endl;
+    std::cout << "and optionally the cache size in bytes" << std::endl;
+    exit(1);
+  }
+  std::string fileName(argv[1]);
+  if( fileName.find("file:") != 0 && fileName.find("rfio:") != 0 ) {
+    std::cout << "Please provide the name of the file with file: or rfio: as needed" << std::endl;
+    exit(1);
+  }
+  std::stringstream ss;
+  ss << argv[2];
+  bool genInfo = false;
+  ss >> genInfo;
+  Long64_t cacheSize = 30000000;
+  if( argc > 3 ) {
+    std::stringstream ssCache;
+    ssCache << argv[3];
+    ssCache >> cacheSize;
+  }
+
+  // load framework libraries
+  gSystem->Load( "libFWCoreFWLite" );
+  AutoLibraryLoader::enable();
+
+  {
+    MuonPairVector savedPair, genPair;
+    std::vector<std::pair<int, int> > evtRun;
+    RootTreeHandler warmUp(0);
+    warmUp.readTree(-1, fileName, &savedPair, 0, &evtRun, genInfo ? &genPair : 0);
+    std::cout << "Benchmarking " << savedPair.size() << " pairs" << (genInfo ? " with genInfo" : "") << std::endl;
+  }
+
+  std::cout << "mode real(s) cpu(s)" << std::endl;
+  for( int mode=0; mode<4; ++mode ) {
+    MuonPairVector savedPair, genPair;
+    std::vector<std::pair<int, int> > evtRun;
+    TStopwatch timer;
+    if( mode == 0 ) {
+      legacyRead(fileName, genInfo, &savedPair, &evtRun, &genPair);
+    }
+    else {
+      RootTreeHandler reader(mode == 1 ? 0 : cacheSize, mode == 3);
+      reader.readTree(-1, fileName, &savedPair, 0, &evtRun, genInfo ? &genPair : 0);
+    }
+    timer.Stop();
+    const char * modeName[] = { "legacy", "noCache", "cache", "cache+parallelUnzip" };
+    std::cout << modeName[mode] << " " << timer.RealTime() << " " << timer.CpuTime() << std::endl;
+  }
+
+  return 0;
+}
@@ -4,20 +4,37 @@
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 
 #include <TH1F.h>
 #include <TROOT.h>
 #include <TFile.h>
+#include <TTree.h>
+#include <TBranch.h>
+#include <TObjArray.h>
 #include <TSystem.h>
+#include <TThread.h>
 
-#include "DataFormats/Common/interface/Handle.h"
-#include "DataFormats/FWLite/interface/Event.h"
-#include "DataFormats/PatCandidates/interface/Muon.h"
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "DataFormats/Common/interface/Wrapper.h"
 #include "FWCore/FWLite/interface/AutoLibraryLoader.h"
-#include "DataFormats/FWLite/interface/Handle.h"
-#include "DataFormats/Common/interface/Handle.h"
 #include "PhysicsTools/FWLite/interface/TFileService.h"
-#include "MuonAnalysis/MomentumScaleCalibration/interface/RootTreeHandler.h"
+#include "MuonAnalysis/MomentumScaleCalibration/interface/MuonPairTreeStream.h"
+
+/**
+ * Converts the Z ntuples to the muon pairs tree. <br>
+ * Usage: ZntupleToTreeConverter [-o outputFile] [-j threads] [-b blockSize] file1 [file2 ...] <br>
+ * The entries of the Events trees of the input files are split in blocks of blockSize entries (default 10000).
+ * The blocks are read and converted by the given number of threads (default 1), each with its own TFile,
+ * directly from the branches of the ntuple products (fwlite is not thread safe). The blocks are written to
+ * the tree by the main thread in the order of the files and of the entries, so the output does not depend on
+ * the number of threads. At most two blocks per thread wait to be written, so the memory used does not depend
+ * on the size of the input. <br>
+ * The default output name is tree_ followed by the name of the first input file.
+ */
 
 // Useful function to convert 4-vector coordinates
 // -----------------------------------------------
@@ -37,40 +54,310 @@ lorentzVector fromPtEtaPhiToPxPyPz( const double* ptEtaPhiE )
   return lorentzVector(px,py,pz,E);
 }
 
-int main(int argc, char* argv[]) 
+typedef edm::Wrapper<std::vector<float> > FloatsWrapper;
+
+/// Instances of the goodZToMuMuEdmNtupleLoose products used, in the order of the branches of NtupleBranches
+static const char * productInstances[6] = { "zGoldenDau1Pt", "zGoldenDau1Eta", "zGoldenDau1Phi",
+                                            "zGoldenDau2Pt", "zGoldenDau2Eta", "zGoldenDau2Phi" };
+
+/// Entries [first, last) of the Events tree of one input file
+struct Block
 {
+  Block( const unsigned int file, const Long64_t first, const Long64_t last ) : file(file), first(first), last(last) {}
+  unsigned int file;
+  Long64_t first;
+  Long64_t last;
+};
 
-  if( argc != 2 ) {
-    std::cout << "Please provide the name of the file with file: or rfio: as needed" << std::endl;
+/// Pairs converted from a block, in the order of the entries
+struct BlockContent
+{
+  BlockContent() : events(0), skippedEvents(0) {}
+
+  /// Releases the memory (clear would keep the capacity)
+  void release()
+  {
+    std::vector<MuonPair>().swap(pairs);
+    std::vector<float>().swap(kinematics);
+  }
+
+  std::vector<MuonPair> pairs;
+  // pt, eta and phi of the first and of the second muon of each pair, for the histograms
+  std::vector<float> kinematics;
+  unsigned int events;
+  // Events with a different number of first and second muons
+  unsigned int skippedEvents;
+};
+
+/// State shared by the main thread and the threads converting the blocks. All the members but the content of the blocks being read are used under the lock.
+struct ConversionState
+{
+  ConversionState( const std::vector<std::string> & fileNames, const std::vector<Block> & blocks, const unsigned int maxPending ) :
+    fileNames(fileNames), blocks(blocks), contents(blocks.size()), done(blocks.size(), false),
+    nextBlock(0), nextToWrite(0), maxPending(maxPending)
+  {}
+
+  const std::vector<std::string> & fileNames;
+  const std::vector<Block> & blocks;
+  std::vector<BlockContent> contents;
+  std::vector<bool> done;
+  unsigned int nextBlock;
+  unsigned int nextToWrite;
+  // Maximum number of blocks read ahead of the next one to write
+  unsigned int maxPending;
+  // First error found by a thread. When it is set no more blocks are read.
+  std::string error;
+  boost::mutex mutex;
+  boost::condition_variable changed;
+  // Serializes the opening and closing of the input files, which modify the list of files of gROOT
+  boost::mutex fileMutex;
+};
+
+/**
+ * Branches of the ntuple products in the Events tree of one input file. The products are looked up by the
+ * label and the instance with any process name: if there are several, the last one is used.
+ */
+class NtupleBranches
+{
+public:
+  NtupleBranches() : file_(0), tree_(0)
+  {
+    for( int i=0; i<6; ++i ) {
+      branches_[i] = 0;
+      wrappers_[i] = 0;
+    }
+  }
+
+  ~NtupleBranches()
+  {
+    for( int i=0; i<6; ++i ) delete wrappers_[i];
+  }
+
+  /// Opens the file and sets the branches. Returns the error, or an empty string if the file can be read.
+  std::string open( const std::string & fileName, boost::mutex & fileMutex )
+  {
+    boost::mutex::scoped_lock lock(fileMutex);
+    file_ = TFile::Open(fileName.c_str(), "READ");
+    if( file_ == 0 || !(file_->IsOpen()) ) {
+      delete file_;
+      file_ = 0;
+      return "cannot open " + fileName;
+    }
+    tree_ = (TTree*)file_->Get("Events");
+    if( tree_ == 0 ) return "no Events tree in " + fileName;
+    for( int i=0; i<6; ++i ) {
+      branches_[i] = findBranch(std::string("floats_goodZToMuMuEdmNtupleLoose_") + productInstances[i] + "_");
+      if( branches_[i] != 0 ) branches_[i]->SetAddress(&(wrappers_[i]));
+    }
+    return "";
+  }
+
+  void close( boost::mutex & fileMutex )
+  {
+    boost::mutex::scoped_lock lock(fileMutex);
+    if( file_ != 0 ) {
+      file_->Close();
+      delete file_;
+    }
+    file_ = 0;
+    tree_ = 0;
+  }
+
+  /**
+   * Reads the products of the entry. Returns false if any of them is missing in the file or in this event,
+   * as the fwlite::Handle would not be valid.
+   */
+  bool read( const Long64_t entry, std::string & error )
+  {
+    Long64_t localEntry = tree_->LoadTree(entry);
+    if( localEntry < 0 ) {
+      std::stringstream ss;
+      ss << "cannot load entry " << entry << " of the Events tree";
+      error = ss.str();
+      return false;
+    }
+    for( int i=0; i<6; ++i ) {
+      if( branches_[i] == 0 ) return false;
+      branches_[i]->GetEntry(localEntry);
+      if( wrappers_[i] == 0 || !(wrappers_[i]->isPresent()) ) return false;
+    }
+    return true;
+  }
+
+  const std::vector<float> & product( const int i ) const { return *(wrappers_[i]->product()); }
+
+protected:
+  TBranch * findBranch( const std::string & prefix ) const
+  {
+    TBranch * found = 0;
+    TObjArray * branches = tree_->GetListOfBranches();
+    for( int i=0; i<branches->GetEntriesFast(); ++i ) {
+      TBranch * branch = (TBranch*)branches->At(i);
+      if( std::string(branch->GetName()).find(prefix) == 0 ) found = branch;
+    }
+    return found;
+  }
+
+  TFile * file_;
+  TTree * tree_;
+  TBranch * branches_[6];
+  FloatsWrapper * wrappers_[6];
+};
+
+/// Thread body: takes the next block until all of them are read, keeping the file open while the blocks are in the same file
+class BlockConverter
+{
+public:
+  BlockConverter( ConversionState * state ) : state_(state) {}
+
+  void operator()()
+  {
+    NtupleBranches ntuple;
+    int openFile = -1;
+    while( true ) {
+      unsigned int iBlock = 0;
+      {
+        boost::mutex::scoped_lock lock(state_->mutex);
+        while( state_->error.empty() && state_->nextBlock < state_->blocks.size() &&
+               state_->nextBlock >= state_->nextToWrite + state_->maxPending ) {
+          state_->changed.wait(lock);
+        }
+        if( !(state_->error.empty()) || state_->nextBlock >= state_->blocks.size() ) break;
+        iBlock = (state_->nextBlock)++;
+      }
+      const Block & block = state_->blocks[iBlock];
+      std::string error;
+      if( int(block.file) != openFile ) {
+        ntuple.close(state_->fileMutex);
+        openFile = block.file;
+        error = ntuple.open(state_->fileNames[block.file], state_->fileMutex);
+      }
+      if( error.empty() ) error = convert(ntuple, block, state_->contents[iBlock]);
+      boost::mutex::scoped_lock lock(state_->mutex);
+      if( !error.empty() ) {
+        // Reported by the main thread once all the threads are joined
+        if( state_->error.empty() ) state_->error = error + " (" + state_->fileNames[block.file] + ")";
+      }
+      else {
+        state_->done[iBlock] = true;
+      }
+      state_->changed.notify_all();
+      if( !error.empty() ) break;
+    }
+    ntuple.close(state_->fileMutex);
+  }
+
+protected:
+  std::string convert( NtupleBranches & ntuple, const Block & block, BlockContent & content )
+  {
+    std::string error;
+    for( Long64_t entry=block.first; entry<block.last; ++entry ) {
+      ++(content.events);
+      if( !ntuple.read(entry, error) ) {
+        if( !error.empty() ) return error;
+        continue;
+      }
+      const std::vector<float> & muon1pt = ntuple.product(0);
+      const std::vector<float> & muon1eta = ntuple.product(1);
+      const std::vector<float> & muon1phi = ntuple.product(2);
+      const std::vector<float> & muon2pt = ntuple.product(3);
+      const std::vector<float> & muon2eta = ntuple.product(4);
+      const std::vector<float> & muon2phi = ntuple.product(5);
+      if( muon1pt.size() != muon2pt.size() ) {
+        ++(content.skippedEvents);
+        continue;
+      }
+      for( unsigned i=0; i<muon1pt.size(); ++i ) {
+        double muon1[3] = {muon1pt[i], muon1eta[i], muon1phi[i]};
+        double muon2[3] = {muon2pt[i], muon2eta[i], muon2phi[i]};
+        content.pairs.push_back(MuonPair(fromPtEtaPhiToPxPyPz(muon1), fromPtEtaPhiToPxPyPz(muon2), 0, 0));
+        content.kinematics.push_back(muon1pt[i]);
+        content.kinematics.push_back(muon1eta[i]);
+        content.kinematics.push_back(muon1phi[i]);
+        content.kinematics.push_back(muon2pt[i]);
+        content.kinematics.push_back(muon2eta[i]);
+        content.kinematics.push_back(muon2phi[i]);
+      }
+    }
+    return "";
+  }
+
+  ConversionState * state_;
+};
+
+/// Reads an unsigned number following an option, exiting if it is not valid
+unsigned int optionValue( const std::string & option, const char * value )
+{
+  std::stringstream ss(value);
+  unsigned int number = 0;
+  if( !(ss >> number) || number == 0 ) {
+    std::cout << "Please provide a positive number after " << option << std::endl;
     exit(1);
   }
-  std::string fileName(argv[1]);
-  if( fileName.find("file:") != 0 && fileName.find("rfio:") != 0 ) {
+  return number;
+}
+
+int main(int argc, char* argv[])
+{
+
+  std::string outputName;
+  unsigned int numberOfThreads = 1;
+  unsigned int blockSize = 10000;
+  std::vector<std::string> fileNames;
+  for( int iArg=1; iArg<argc; ++iArg ) {
+    std::string arg(argv[iArg]);
+    if( arg == "-o" && iArg+1 < argc ) {
+      outputName = argv[++iArg];
+      continue;
+    }
+    if( arg == "-j" && iArg+1 < argc ) {
+      numberOfThreads = optionValue(arg, argv[++iArg]);
+      continue;
+    }
+    if( arg == "-b" && iArg+1 < argc ) {
+      blockSize = optionValue(arg, argv[++iArg]);
+      continue;
+    }
+    if( arg.find("file:") != 0 && arg.find("rfio:") != 0 ) {
+      std::cout << "Please provide the name of the file with file: or rfio: as needed" << std::endl;
+      exit(1);
+    }
+    fileNames.push_back(arg);
+  }
+  if( fileNames.empty() ) {
     std::cout << "Please provide the name of the file with file: or rfio: as needed" << std::endl;
+    std::cout << "Usage: ZntupleToTreeConverter [-o outputFile] [-j threads] [-b blockSize] file1 [file2 ...]" << std::endl;
     exit(1);
   }
+  if( outputName.empty() ) {
+    size_t namePos = fileNames[0].find_last_of("/");
+    // Without a directory the name starts after the file: or rfio: prefix
+    if( namePos == std::string::npos ) namePos = fileNames[0].find(":");
+    outputName = "tree_"+fileNames[0].substr(namePos+1, fileNames[0].size());
+  }
 
   // ----------------------------------------------------------------------
   // First Part:
   //
-  //  * enable the AutoLibraryLoader 
-  //  * book the histograms of interest 
-  //  * open the input file
+  //  * enable the AutoLibraryLoader
+  //  * book the histograms of interest
+  //  * split the entries of the input files in blocks
   // ----------------------------------------------------------------------
 
-  // load framework libraries
+  // load framework libraries (also the dictionaries of the ntuple products)
   gSystem->Load( "libFWCoreFWLite" );
   AutoLibraryLoader::enable();
-  
+  // Needed before ROOT is used by more than one thread
+  TThread::Initialize();
+
   // book a set of histograms
   fwlite::TFileService fs = fwlite::TFileService("analyzeBasics.root");
   TFileDirectory theDir = fs.mkdir("analyzeBasic");
   TH1F* muonPt_  = theDir.make<TH1F>("muonPt", "pt",    100,  0.,300.);
   TH1F* muonEta_ = theDir.make<TH1F>("muonEta","eta",   100, -3.,  3.);
-  TH1F* muonPhi_ = theDir.make<TH1F>("muonPhi","phi",   100, -5.,  5.);  
-  
-  // open input file (can be located on castor)
-  TFile* inFile = TFile::Open(fileName.c_str());
+  TH1F* muonPhi_ = theDir.make<TH1F>("muonPhi","phi",   100, -5.,  5.);
+
+  // open input files (can be located on castor)
 
 //   TFile* inFile = TFile::Open("rfio:/castor/cern.ch/user/f/fabozzi/36XSkimData/run_139791-140159/NtupleLoose_139791-140159_v2.root");
 //   TFile* inFile = TFile::Open("rfio:/castor/cern.ch/user/f/fabozzi/36XSkimData/run_140160-140182/NtupleLoose_140160-140182.root");
@@ -78,87 +365,87 @@ int main(int argc, char* argv[])
 //   TFile* inFile = TFile::Open("rfio:/castor/cern.ch/user/d/degrutto/36XSkimData/run_140440-141961/NtupleLoose_140440-141961.root");
 //   TFile* inFile = TFile::Open("rfio:/castor/cern.ch/user/d/degrutto/36XSkimData/run_142035-142664/NtupleLoose_142035-142664.root");
 
+  std::vector<Block> blocks;
+  for( unsigned int iFile=0; iFile<fileNames.size(); ++iFile ) {
+    TFile * inFile = TFile::Open(fileNames[iFile].c_str(), "READ");
+    if( inFile == 0 || !(inFile->IsOpen()) ) {
+      std::cout << "Error: cannot open " << fileNames[iFile] << std::endl;
+      exit(1);
+    }
+    TTree * events = (TTree*)inFile->Get("Events");
+    Long64_t entries = (events != 0) ? events->GetEntries() : 0;
+    inFile->Close();
+    delete inFile;
+    for( Long64_t first=0; first<entries; first+=blockSize ) {
+      blocks.push_back(Block(iFile, first, std::min(entries, first+blockSize)));
+    }
+  }
+  std::cout << "Converting " << blocks.size() << " blocks of up to " << blockSize << " events using "
+            << numberOfThreads << " threads" << std::endl;
 
   // ----------------------------------------------------------------------
-  // Second Part: 
+  // Second Part:
   //
-  //  * loop the events in the input file 
-  //  * receive the collections of interest via fwlite::Handle
-  //  * fill the histograms
-  //  * after the loop close the input file
+  //  * read and convert the blocks in the threads
+  //  * fill the histograms and write the pairs of each block to the tree,
+  //    in the order of the blocks
   // ----------------------------------------------------------------------
 
-  // Create the RootTreeHandler to save the events in the root tree
-  RootTreeHandler treeHandler;
-  // MuonPairVector pairVector;
-  std::vector<MuonPair> pairVector;
-
-  // loop the events
-  unsigned int iEvent=0;
-  fwlite::Event ev(inFile);
-  for(ev.toBegin(); !ev.atEnd(); ++ev, ++iEvent){
-    
-    // simple event counter
-    if(iEvent>0 && iEvent%100==0){
-      std::cout << "  processing event: " << iEvent << std::endl;
-    }
-
-    // Handle to the muon collection
-    fwlite::Handle<std::vector<float> > muon1pt;
-    fwlite::Handle<std::vector<float> > muon1eta;
-    fwlite::Handle<std::vector<float> > muon1phi;
-    fwlite::Handle<std::vector<float> > muon2pt;
-    fwlite::Handle<std::vector<float> > muon2eta;
-    fwlite::Handle<std::vector<float> > muon2phi;
-    muon1pt.getByLabel(ev, "goodZToMuMuEdmNtupleLoose", "zGoldenDau1Pt");
-    muon1eta.getByLabel(ev, "goodZToMuMuEdmNtupleLoose", "zGoldenDau1Eta");
-    muon1phi.getByLabel(ev, "goodZToMuMuEdmNtupleLoose", "zGoldenDau1Phi");
-    muon2pt.getByLabel(ev, "goodZToMuMuEdmNtupleLoose", "zGoldenDau2Pt");
-    muon2eta.getByLabel(ev, "goodZToMuMuEdmNtupleLoose", "zGoldenDau2Eta");
-    muon2phi.getByLabel(ev, "goodZToMuMuEdmNtupleLoose", "zGoldenDau2Phi");
-
-    if( !muon1pt.isValid() ) continue;
-    if( !muon1eta.isValid() ) continue;
-    if( !muon1phi.isValid() ) continue;
-    if( !muon2pt.isValid() ) continue;
-    if( !muon2eta.isValid() ) continue;
-    if( !muon2phi.isValid() ) continue;
-    // std::cout << "muon1pt = " << muon1pt->size() << std::endl;
-
-    // loop muon collection and fill histograms
-    if( muon1pt->size() != muon2pt->size() ) {
-      std::cout << "Error: size of muon1 and muon2 is different. Skipping event" << std::endl;
-      continue;
-    }
-    for(unsigned i=0; i<muon1pt->size(); ++i){
-      muonPt_->Fill( (*muon1pt)[i] );
-      muonEta_->Fill( (*muon1eta)[i] );
-      muonPhi_->Fill( (*muon1phi)[i] );
-      muonPt_->Fill( (*muon2pt)[i] );
-      muonEta_->Fill( (*muon2eta)[i] );
-      muonPhi_->Fill( (*muon2phi)[i] );
+  // The pairs are written to the root tree as they are converted
+  MuonPairTreeWriter writer(outputName.c_str(), false);
 
-      double muon1[3] = {(*muon1pt)[i], (*muon1eta)[i], (*muon1phi)[i]};
-      double muon2[3] = {(*muon2pt)[i], (*muon2eta)[i], (*muon2phi)[i]};
+  ConversionState state(fileNames, blocks, 2*numberOfThreads);
+  boost::thread_group threads;
+  for( unsigned int i=0; i<numberOfThreads; ++i ) {
+    threads.create_thread(BlockConverter(&state));
+  }
 
-      // pairVector.push_back( std::make_pair( fromPtEtaPhiToPxPyPz(muon1), fromPtEtaPhiToPxPyPz(muon2) ) );
-      pairVector.push_back( MuonPair(fromPtEtaPhiToPxPyPz(muon1), fromPtEtaPhiToPxPyPz(muon2), 0, 0 ) );
+  unsigned int iEvent = 0;
+  for( unsigned int iBlock=0; iBlock<blocks.size(); ++iBlock ) {
+    {
+      boost::mutex::scoped_lock lock(state.mutex);
+      while( state.error.empty() && !state.done[iBlock] ) state.changed.wait(lock);
+      if( !state.error.empty() ) break;
+    }
+    // The threads do not use a block once it is done
+    BlockContent & content = state.contents[iBlock];
+    for( unsigned int i=0; i<content.skippedEvents; ++i ) {
+      std::cout << "Error: size of muon1 and muon2 is different. Skipping event" << std::endl;
     }
+    for( unsigned int i=0; i<content.pairs.size(); ++i ) {
+      const float * kinematics = &(content.kinematics[6*i]);
+      muonPt_->Fill( kinematics[0] );
+      muonEta_->Fill( kinematics[1] );
+      muonPhi_->Fill( kinematics[2] );
+      muonPt_->Fill( kinematics[3] );
+      muonEta_->Fill( kinematics[4] );
+      muonPhi_->Fill( kinematics[5] );
+      writer.fill(content.pairs[i]);
+    }
+    iEvent += content.events;
+    std::cout << "  processed events: " << iEvent << std::endl;
+    content.release();
+    boost::mutex::scoped_lock lock(state.mutex);
+    ++(state.nextToWrite);
+    state.changed.notify_all();
+  }
+  threads.join_all();
+  if( !state.error.empty() ) {
+    std::cout << "Error: " << state.error << std::endl;
+    exit(1);
   }
-  size_t namePos = fileName.find_last_of("/");
-  treeHandler.writeTree(("tree_"+fileName.substr(namePos+1, fileName.size())).c_str(), &pairVector);
 
-  // close input file
-  inFile->Close();
+  // save the tree
+  writer.close();
 
   // ----------------------------------------------------------------------
-  // Third Part: 
+  // Third Part:
   //
   //  * never forget to free the memory of objects you created
   // ----------------------------------------------------------------------
 
-  // in this example there is nothing to do 
-  
+  // in this example there is nothing to do
+
   // that's it!
   return 0;
 }
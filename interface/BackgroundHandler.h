@@ -5,6 +5,7 @@
 #include "FWCore/MessageLogger/interface/MessageLogger.h"
 #include <vector>
 #include "MuonAnalysis/MomentumScaleCalibration/interface/MassWindow.h"
+#include "MuonAnalysis/MomentumScaleCalibration/interface/MuonPairEvents.h"
 #include "DataFormats/HepMCCandidate/interface/GenParticle.h"
 #include "SimDataFormats/Track/interface/SimTrack.h"
 #include "DataFormats/Candidate/interface/LeafCandidate.h"
@@ -51,8 +52,9 @@ public:
     return backgroundWindow_[iRegion].isIn(mass);
   }
 
-  void countEventsInAllWindows(const std::vector<std::pair<reco::Particle::LorentzVector,reco::Particle::LorentzVector> > & muonPairs,
-                               const double & weight);
+  /// If indexes is given only the muonPairs at those positions are counted
+  void countEventsInAllWindows(const MuonPairEvents & muonPairs,
+                               const double & weight, const std::vector<unsigned int> * indexes = 0);
 
   /// Sets initial parameters for all the functions
   void setParameters(double* Start, double* Step, double* Mini, double* Maxi, int* ind, TString* parname, const std::vector<double> & parBgr, const std::vector<int> & parBgrOrder, const int muonType);
@@ -74,11 +76,12 @@ public:
    * Computes the rescaled parameters from the regions functions to the
    * resonances functions. It takes into account the difference in intervals
    * and rescales the parameters so that the fraction of events is correctly accounted for. <br>
-   * It uses the list of all muon pairs to compute the number of events in each resonance window.
+   * It uses the list of all muon pairs to compute the number of events in each resonance window
+   * (or only the pairs at the given indexes, if any).
    */
   void rescale( std::vector<double> & parBgr, const double * ResMass, const double * massWindowHalfWidth,
-                const std::vector<std::pair<reco::Particle::LorentzVector,reco::Particle::LorentzVector> > & muonPairs,
-                const double & weight = 1. );
+                const MuonPairEvents & muonPairs,
+                const double & weight = 1., const std::vector<unsigned int> * indexes = 0 );
 
   /**
    * Returns the background fraction parameter (parBgr[0], but shifted to the correct function) and
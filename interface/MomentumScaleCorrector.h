@@ -8,6 +8,7 @@
 
 #include <fstream>
 #include <sstream>
+#include <vector>
 #include "MuonAnalysis/MomentumScaleCalibration/interface/BaseFunction.h"
 #include "MuonAnalysis/MomentumScaleCalibration/interface/Functions.h"
 #include "FWCore/ParameterSet/interface/FileInPath.h"
@@ -21,6 +22,10 @@
  * different iterations.
  *
  * ATTENTION: it is important that iterations numbers in the txt file start from 0.
+ *
+ * With setGrid the composed correction of all the iterations is sampled on a (pt, eta, phi, charge) grid
+ * and the following corrections are interpolated (multilinear in pt, eta and phi), with a cost independent
+ * of the functions and of the number of iterations. Outside the grid the functions are evaluated.
  */
 class MomentumScaleCorrector : public BaseFunction
 {
@@ -31,7 +36,9 @@ class MomentumScaleCorrector : public BaseFunction
    * correction function and saves the corresponding pointer. It then fills the
    * vector of parameters.
    */
-  MomentumScaleCorrector( TString identifier )
+  MomentumScaleCorrector( TString identifier ) :
+    useGrid_(false),
+    gridMaxError_(0.)
   {
     identifier.Prepend("MuonAnalysis/MomentumScaleCalibration/data/");
     identifier.Append(".txt");
@@ -43,7 +50,9 @@ class MomentumScaleCorrector : public BaseFunction
    * It receives a pointer to an object of type MuScleFitDBobject containing
    * the parameters and the functions identifiers.
    */
-  MomentumScaleCorrector( const MuScleFitDBobject * dbObject ) : BaseFunction( dbObject )
+  MomentumScaleCorrector( const MuScleFitDBobject * dbObject ) : BaseFunction( dbObject ),
+    useGrid_(false),
+    gridMaxError_(0.)
   {
     std::vector<int>::const_iterator id = functionId_.begin();
     for( ; id != functionId_.end(); ++id ) {
@@ -71,14 +80,84 @@ class MomentumScaleCorrector : public BaseFunction
   /// Method to do the corrections. It is templated to work with all the track types.
   template <class U>
   double operator()( const U & track ) {
+    if( useGrid_ ) return gridCorrection( track.pt(), track.eta(), track.phi(), track.charge() );
+    return exactCorrection( track.pt(), track.eta(), track.phi(), track.charge() );
+  }
 
-    // Loop on all the functions and apply them iteratively on the pt corrected by the previous function.
-    double pt = track.pt();
+  /// Applies all the functions iteratively, each on the pt corrected by the previous one.
+  double exactCorrection( const double & pt, const double & eta, const double & phi, const int charge ) const {
+    double correctedPt = pt;
     for( int i=0; i<=iterationNum_; ++i ) {
       // return ( scaleFunction_->scale( track.pt(), track.eta(), track.phi(), track.charge(), parScale_) );
-      pt = ( scaleFunction_[i]->scale( pt, track.eta(), track.phi(), track.charge(), parArray_[i]) );
+      correctedPt = ( scaleFunction_[i]->scale( correctedPt, eta, phi, charge, parArray_[i]) );
     }
-    return pt;
+    return correctedPt;
+  }
+
+  /**
+   * Samples the correction on a grid with the given bins in pt and eta, phiBins bins in (-pi, pi) and both charges.
+   * The interpolation is then compared with the exact correction in each cell at the center, at the centers of the
+   * faces and of the edges and at randomSamples random points: if the maximum relative difference exceeds
+   * maxRelativeError the grid is not used and false is returned. The difference is printed. <br>
+   * It is an estimate: a narrow structure of the correction (e.g. a discontinuity between two bins of the functions)
+   * falling between the sampled points is not seen.
+   */
+  bool setGrid( const unsigned int ptBins, const double & ptMin, const double & ptMax,
+                const unsigned int etaBins, const double & etaMin, const double & etaMax,
+                const unsigned int phiBins, const double & maxRelativeError,
+                const unsigned int randomSamples = 4 );
+  /// Maximum relative difference between interpolated and exact correction found at the points checked by setGrid
+  double gridMaxError() const { return gridMaxError_; }
+  bool useGrid() const { return useGrid_; }
+
+  /// Interpolation of the correction on the grid. Falls back to the exact correction outside the grid.
+  double gridCorrection( const double & pt, const double & eta, const double & phi, const int charge ) const {
+    if( charge != 1 && charge != -1 ) return exactCorrection(pt, eta, phi, charge);
+    const double x[3] = {pt, eta, phi};
+    int index[3];
+    double frac[3];
+    for( int d=0; d<3; ++d ) {
+      const double u = (x[d] - gridMin_[d])/gridStep_[d];
+      // Written so that a NaN also falls back to the exact correction
+      if( !(u >= 0. && u <= gridBins_[d]) ) return exactCorrection(pt, eta, phi, charge);
+      index[d] = int(u);
+      if( index[d] == gridBins_[d] ) --index[d];
+      frac[d] = u - index[d];
+    }
+    // The grid stores the ratio of corrected and uncorrected pt
+    return pt*interpolate(charge, index, frac);
+  }
+
+  /**
+   * Batch version of operator(): corrects in place the pt of n muons. Each function is applied to all the muons
+   * before the next one, so that the parameters and the function are looked up once per iteration.
+   */
+  void correct( const unsigned int n, double * pt, const double * eta, const double * phi, const int * charge ) {
+    if( useGrid_ ) {
+      for( unsigned int k=0; k<n; ++k ) pt[k] = gridCorrection(pt[k], eta[k], phi[k], charge[k]);
+      return;
+    }
+    for( int i=0; i<=iterationNum_; ++i ) {
+      scaleFunction_[i]->scaleBatch(n, pt, eta, phi, charge, parArray_[i]);
+    }
+  }
+
+  /// Batch version of operator() for a collection of tracks (or muons): fills pt with the corrected values.
+  template <class C>
+  void correct( const C & tracks, std::vector<double> & pt ) {
+    const unsigned int n = tracks.size();
+    pt.resize(n);
+    std::vector<double> eta(n);
+    std::vector<double> phi(n);
+    std::vector<int> charge(n);
+    unsigned int k = 0;
+    for( typename C::const_iterator track = tracks.begin(); track != tracks.end(); ++track, ++k ) {
+      pt[k] = track->pt();
+      eta[k] = track->eta();
+      phi[k] = track->phi();
+      charge[k] = track->charge();
+    }
+    if( n > 0 ) correct(n, &(pt[0]), &(eta[0]), &(phi[0]), &(charge[0]));
   }
 
   /// Alternative method that can be used with lorentzVectors.
@@ -86,6 +165,7 @@ class MomentumScaleCorrector : public BaseFunction
   double correct( const U & lorentzVector ) {
 
     // Loop on all the functions and apply them iteratively on the pt corrected by the previous function.
+    if( useGrid_ ) return gridCorrection( lorentzVector.Pt(), lorentzVector.Eta(), lorentzVector.Phi(), 1 );
     double pt = lorentzVector.Pt();
     for( int i=0; i<=iterationNum_; ++i ) {
       pt = ( scaleFunction_[i]->scale( pt, lorentzVector.Eta(), lorentzVector.Phi(), 1, parArray_[i]) );
@@ -97,8 +177,39 @@ class MomentumScaleCorrector : public BaseFunction
   /// Parser of the parameters file
   void readParameters( TString fileName );
 
+  /// Multilinear interpolation of the ratio in the cell starting at index, at the fractions frac of the cell
+  double interpolate( const int charge, const int * index, const double * frac ) const {
+    const double * values = &(grid_[charge > 0 ? 0 : grid_.size()/2]);
+    double result = 0.;
+    for( int corner=0; corner<8; ++corner ) {
+      double weight = 1.;
+      int node[3];
+      for( int d=0; d<3; ++d ) {
+        const int up = (corner >> d) & 1;
+        node[d] = index[d] + up;
+        weight *= up ? frac[d] : 1. - frac[d];
+      }
+      result += weight*values[gridNode(node[0], node[1], node[2])];
+    }
+    return result;
+  }
+  /// Compares interpolated and exact correction at the fractions frac of the cell, updating gridMaxError_
+  void checkGridPoint( const int charge, const int * index, const double * frac );
+  /// Position of the node in the grid of one charge
+  int gridNode( const int iPt, const int iEta, const int iPhi ) const {
+    return (iPt*(gridBins_[1]+1) + iEta)*(gridBins_[2]+1) + iPhi;
+  }
+
   scaleFunctionBase<double * > ** scaleFunction_;
   std::vector<scaleFunctionBase<double * > * > scaleFunctionVec_;
+
+  // Grid of the ratio of corrected and uncorrected pt (nodes of charge +1, then of charge -1)
+  bool useGrid_;
+  int gridBins_[3];
+  double gridMin_[3];
+  double gridStep_[3];
+  double gridMaxError_;
+  std::vector<double> grid_;
 };
 
 #endif // MomentumScaleCorrector_h
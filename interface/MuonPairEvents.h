@@ -0,0 +1,119 @@
+#ifndef MuonPairEvents_h
+#define MuonPairEvents_h
+
+#include <vector>
+#include <utility>
+
+#include <boost/shared_ptr.hpp>
+
+#include "DataFormats/Candidate/interface/Particle.h"
+
+/**
+ * The muon pairs used by the fit: a read-only view on the pairs and a private copy made only when they are modified. <br>
+ * The pairs can be in a vector owned by this object, in a vector shared with other MuonPairEvents (the copies of an
+ * object share its pairs) or in memory owned by somebody else, e.g. a segment of the MuonPairSharedStore mapped
+ * read-only, which is kept alive by the owner given to attach. <br>
+ * Reading does not copy anything. The first modification (push_back, set, swap, ...) copies the pairs to a private
+ * vector if they are shared or not owned, so that the other users of the same pairs never see the change. <br>
+ * The modifications of an object are not thread safe, but different objects sharing the same pairs can be read and
+ * modified in different threads.
+ */
+
+class MuonPairEvents
+{
+public:
+  typedef std::pair<reco::Particle::LorentzVector, reco::Particle::LorentzVector> value_type;
+  typedef const value_type * const_iterator;
+
+  MuonPairEvents() : begin_(0), size_(0) {}
+
+  /**
+   * View on the pairs of the vector, which must not be modified or destroyed while the view is used.
+   * It allows to pass a vector of pairs where a MuonPairEvents is expected, e.g. f(MuonPairEvents(pairs)).
+   */
+  explicit MuonPairEvents( const std::vector<value_type> & pairs ) :
+    begin_(pairs.empty() ? 0 : &(pairs[0])),
+    size_(pairs.size())
+  {}
+
+  /// View on n pairs starting at pairs, in memory kept alive by owner
+  void attach( const boost::shared_ptr<const void> & owner, const value_type * pairs, const size_t n )
+  {
+    data_.reset();
+    owner_ = owner;
+    begin_ = (n == 0) ? 0 : pairs;
+    size_ = n;
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const value_type & operator[]( const size_t i ) const { return begin_[i]; }
+  const_iterator begin() const { return begin_; }
+  const_iterator end() const { return begin_ + size_; }
+
+  /// True if the pairs are in a vector used only by this object, i.e. the modifications do not copy them
+  bool isPrivate() const { return data_.get() != 0 && data_.unique(); }
+
+  void set( const size_t i, const value_type & pair )
+  {
+    privateData()[i] = pair;
+  }
+
+  void push_back( const value_type & pair )
+  {
+    privateData().push_back(pair);
+    update();
+  }
+
+  void reserve( const size_t n )
+  {
+    privateData().reserve(n);
+    update();
+  }
+
+  /// Replaces the pairs with the content of the vector, which takes the previous pairs
+  void swap( std::vector<value_type> & pairs )
+  {
+    if( !isPrivate() ) {
+      data_.reset(new std::vector<value_type>(begin_, begin_ + size_));
+      owner_.reset();
+    }
+    data_->swap(pairs);
+    update();
+  }
+
+  void clear()
+  {
+    data_.reset();
+    owner_.reset();
+    begin_ = 0;
+    size_ = 0;
+  }
+
+protected:
+  /// The vector of the pairs of this object, copied from the view if they are shared or not owned
+  std::vector<value_type> & privateData()
+  {
+    if( !isPrivate() ) {
+      data_.reset(new std::vector<value_type>(begin_, begin_ + size_));
+      owner_.reset();
+      update();
+    }
+    return *data_;
+  }
+
+  void update()
+  {
+    begin_ = data_->empty() ? 0 : &((*data_)[0]);
+    size_ = data_->size();
+  }
+
+  // Pairs owned by this object, possibly shared with its copies
+  boost::shared_ptr<std::vector<value_type> > data_;
+  // Owner of the memory of the pairs when they are not in data_
+  boost::shared_ptr<const void> owner_;
+  const value_type * begin_;
+  size_t size_;
+};
+
+#endif
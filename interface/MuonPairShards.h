@@ -0,0 +1,117 @@
+#ifndef MuonPairShards_h
+#define MuonPairShards_h
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <TRandom3.h>
+
+#include <MuonAnalysis/MomentumScaleCalibration/interface/MuonPairEvents.h>
+
+/**
+ * Builds shards of the muon pairs event store without writing them to disk. <br>
+ * A shard is a view on the store: the ordered list of the indexes of the pairs it contains.
+ * Shards can be built by index range, by modulo of the index, by run range or by random assignment
+ * with a given seed. The views can be used directly by a fit in the same process or passed
+ * to select to obtain a compact copy of any of the vectors of the store (pairs, gen pairs, event and run numbers),
+ * which can then be written to a tree if needed.
+ */
+
+class MuonPairShards
+{
+public:
+  typedef std::vector<unsigned int> View;
+
+  /// Pairs from first to first+maxPairs-1 (up to the end of the store)
+  static View byIndexRange( const unsigned int storeSize, const unsigned int first, const unsigned int maxPairs )
+  {
+    View view;
+    for( unsigned int i=first; i<storeSize && i-first<maxPairs; ++i ) view.push_back(i);
+    return view;
+  }
+
+  /// Pairs whose index modulo numberOfShards is shardIndex
+  static View byModulo( const unsigned int storeSize, const unsigned int numberOfShards, const unsigned int shardIndex )
+  {
+    View view;
+    if( numberOfShards == 0 ) return view;
+    view.reserve(storeSize/numberOfShards + 1);
+    for( unsigned int i=shardIndex; i<storeSize; i+=numberOfShards ) view.push_back(i);
+    return view;
+  }
+
+  /// Pairs with firstRun <= run <= lastRun. The evtRun vector contains the (event, run) pairs of the store
+  static View byRunRange( const std::vector<std::pair<int, int> > & evtRun, const int firstRun, const int lastRun )
+  {
+    View view;
+    for( unsigned int i=0; i<evtRun.size(); ++i ) {
+      if( evtRun[i].second >= firstRun && evtRun[i].second <= lastRun ) view.push_back(i);
+    }
+    return view;
+  }
+
+  /// Assigns each pair to one of numberOfShards shards at random. The same seed always gives the same shards
+  static std::vector<View> byRandom( const unsigned int storeSize, const unsigned int numberOfShards, const unsigned int seed )
+  {
+    std::vector<View> views(numberOfShards);
+    if( numberOfShards == 0 ) return views;
+    TRandom3 random(seed);
+    for( unsigned int i=0; i<storeSize; ++i ) {
+      views[random.Integer(numberOfShards)].push_back(i);
+    }
+    return views;
+  }
+
+  /**
+   * Builds the view for the given mode: "range" (first, maxPairs), "modulo" (numberOfShards, shardIndex),
+   * "run" (firstRun, lastRun) or "random" (numberOfShards, shardIndex, seed). <br>
+   * Returns false for an unknown mode.
+   */
+  static bool build( const std::string & mode, const std::vector<std::pair<int, int> > & evtRun,
+                     const unsigned int first, const unsigned int maxPairs,
+                     const unsigned int numberOfShards, const unsigned int shardIndex,
+                     const int firstRun, const int lastRun, const unsigned int seed, View & view )
+  {
+    const unsigned int storeSize = evtRun.size();
+    if( mode == "range" ) view = byIndexRange(storeSize, first, maxPairs);
+    else if( mode == "modulo" ) view = byModulo(storeSize, numberOfShards, shardIndex);
+    else if( mode == "run" ) view = byRunRange(evtRun, firstRun, lastRun);
+    else if( mode == "random" ) {
+      if( shardIndex >= numberOfShards ) view.clear();
+      else view = byRandom(storeSize, numberOfShards, seed)[shardIndex];
+    }
+    else {
+      std::cout << "Unknown shard mode " << mode << ". Valid modes are range, modulo, run and random" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  /// Keeps in the vector only the elements in the view, in the order of the view
+  template <class T>
+  static void select( std::vector<T> & store, const View & view )
+  {
+    std::vector<T> selected;
+    selected.reserve(view.size());
+    for( View::const_iterator it = view.begin(); it != view.end(); ++it ) {
+      if( *it < store.size() ) selected.push_back(store[*it]);
+    }
+    store.swap(selected);
+  }
+
+  /// Keeps only the pairs in the view, in the order of the view. The selected pairs are copied to a private vector.
+  static void select( MuonPairEvents & store, const View & view )
+  {
+    std::vector<MuonPairEvents::value_type> selected;
+    selected.reserve(view.size());
+    for( View::const_iterator it = view.begin(); it != view.end(); ++it ) {
+      if( *it < store.size() ) selected.push_back(store[*it]);
+    }
+    store.clear();
+    store.swap(selected);
+  }
+};
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef MuonPairSharedStore_h
+#define MuonPairSharedStore_h
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdint.h>
+
+#include <TSystem.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <MuonAnalysis/MomentumScaleCalibration/interface/RootTreeHandler.h>
+#include <MuonAnalysis/MomentumScaleCalibration/interface/MuonPairEvents.h>
+
+/**
+ * Node-local store of the selected muon pairs, shared by the jobs running on the same input. <br>
+ * The first job publishes the pairs it read (with event and run numbers and gen pairs, if any) in a file
+ * of the given directory, e.g. /dev/shm for a memory-backed segment. The name of the file is a hash of the
+ * input file names (with their size and modification time when available) and of a string describing
+ * the selection, so a different input or a different selection gives a different segment. <br>
+ * The following jobs map the segment read-only and use the pairs in place, without reading and decompressing
+ * the tree: the MuonPairEvents given to attach keep the mapping alive and copy the pairs only when they are
+ * first modified (e.g. when the corrections of a loop are applied). Until then the pages of the segment are
+ * shared among all the jobs of the node. The event and run numbers are always copied.
+ * The segment is written to a temporary file and renamed, so a job never attaches a partial segment. <br>
+ * The data are stored with the native layout of the node and are not meant to be moved to other machines. <br>
+ * The segments are not removed by the jobs that publish them: removeOldSegments keeps only the most recent ones
+ * (see the MaxSharedStoreSegments parameter of MuScleFit), otherwise they must be removed by hand (rm /dev/shm/MuScleFitStore_*).
+ */
+
+class MuonPairSharedStore
+{
+public:
+  MuonPairSharedStore( const std::string & directory ) : directory_(directory) {}
+
+  /// Name of the segment for the given input files and selection
+  std::string segmentName( const std::vector<std::string> & fileNames, const std::string & selection ) const
+  {
+    std::stringstream key;
+    for( std::vector<std::string>::const_iterator it = fileNames.begin(); it != fileNames.end(); ++it ) {
+      key << *it << ";";
+      std::string localName(*it);
+      if( localName.find("file:") == 0 ) localName = localName.substr(5);
+      Long_t id, flags, modTime;
+      Long64_t size;
+      if( gSystem->GetPathInfo(localName.c_str(), &id, &size, &flags, &modTime) == 0 ) {
+        key << size << ";" << modTime << ";";
+      }
+    }
+    key << selection;
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)fnv1a(key.str()));
+    return directory_ + "/MuScleFitStore_" + hash;
+  }
+
+  /**
+   * Sets savedPair (and genPair, if not null) to the pairs of the segment, if it exists, and replaces the content
+   * of evtRun with its event and run numbers. The pairs are used in place in the mapped segment, which stays mapped
+   * as long as savedPair, genPair or any of their copies use it. <br>
+   * Returns false if there is no segment or if it does not contain the gen pairs requested.
+   */
+  bool attach( const std::string & segment, MuonPairEvents * savedPair, std::vector<std::pair<int, int> > * evtRun,
+               MuonPairEvents * genPair ) const
+  {
+    if( gSystem->AccessPathName(segment.c_str()) ) return false;
+    try {
+      boost::interprocess::file_mapping mapping(segment.c_str(), boost::interprocess::read_only);
+      boost::shared_ptr<boost::interprocess::mapped_region> region(new boost::interprocess::mapped_region(mapping, boost::interprocess::read_only));
+      const char * data = static_cast<const char*>(region->get_address());
+      Header header;
+      if( region->get_size() < sizeof(Header) ) return false;
+      std::memcpy(&header, data, sizeof(Header));
+      if( std::strncmp(header.tag, "MSFSTOR1", 8) != 0 ) return false;
+      if( genPair != 0 && header.hasGen == 0 ) return false;
+      const uint64_t n = header.pairs;
+      if( region->get_size() < segmentSize(n, header.hasGen != 0) ) return false;
+
+      const double * pairs = reinterpret_cast<const double*>(data + sizeof(Header));
+      const int32_t * numbers = reinterpret_cast<const int32_t*>(pairs + 8*n);
+      const double * genPairs = reinterpret_cast<const double*>(numbers + 2*n);
+      std::vector<std::pair<int, int> > segmentEvtRun;
+      segmentEvtRun.reserve(n);
+      for( uint64_t i=0; i<n; ++i ) {
+        segmentEvtRun.push_back(std::make_pair(numbers[2*i], numbers[2*i+1]));
+      }
+      evtRun->swap(segmentEvtRun);
+      if( inPlace() ) {
+        // The region is unmapped when the last MuonPairEvents using it is cleared or destroyed
+        savedPair->attach(region, reinterpret_cast<const MuonPairEvents::value_type*>(pairs), n);
+        if( genPair != 0 ) genPair->attach(region, reinterpret_cast<const MuonPairEvents::value_type*>(genPairs), n);
+      }
+      else {
+        copyPairs(pairs, n, savedPair);
+        if( genPair != 0 ) copyPairs(genPairs, n, genPair);
+      }
+    }
+    catch( boost::interprocess::interprocess_exception & e ) {
+      std::cout << "Warning: cannot attach the shared store " << segment << ": " << e.what() << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Removes the oldest segments of the directory, so that at most maxSegments are left, and the temporary files
+   * older than an hour, left by the jobs that stopped while publishing. Returns the number of files removed. <br>
+   * The jobs that already attached a removed segment keep using it: its memory is freed when the last of them unmaps it.
+   */
+  unsigned int removeOldSegments( const unsigned int maxSegments ) const
+  {
+    std::vector<std::pair<Long_t, std::string> > segments;
+    std::vector<std::string> staleFiles;
+    const Long_t now = time(0);
+    void * dir = gSystem->OpenDirectory(directory_.c_str());
+    if( dir == 0 ) return 0;
+    const char * entry = 0;
+    while( (entry = gSystem->GetDirEntry(dir)) != 0 ) {
+      const std::string name(entry);
+      if( name.find("MuScleFitStore_") != 0 ) continue;
+      const std::string path(directory_ + "/" + name);
+      Long_t id, flags, modTime;
+      Long64_t size;
+      if( gSystem->GetPathInfo(path.c_str(), &id, &size, &flags, &modTime) != 0 ) continue;
+      if( name.find(".tmp") != std::string::npos ) {
+        if( now - modTime > 3600 ) staleFiles.push_back(path);
+      }
+      else segments.push_back(std::make_pair(modTime, path));
+    }
+    gSystem->FreeDirectory(dir);
+
+    // The most recent segments first
+    std::sort(segments.rbegin(), segments.rend());
+    for( unsigned int i=maxSegments; i<segments.size(); ++i ) staleFiles.push_back(segments[i].second);
+    unsigned int removed = 0;
+    for( std::vector<std::string>::const_iterator it = staleFiles.begin(); it != staleFiles.end(); ++it ) {
+      if( remove(it->c_str()) == 0 ) {
+        std::cout << "Removed shared store " << *it << std::endl;
+        ++removed;
+      }
+    }
+    return removed;
+  }
+
+  /// Writes the segment. Returns false if it could not be written.
+  bool publish( const std::string & segment, const MuonPairEvents & savedPair, const std::vector<std::pair<int, int> > & evtRun,
+                const MuonPairEvents * genPair ) const
+  {
+    if( savedPair.size() != evtRun.size() || (genPair != 0 && genPair->size() != savedPair.size()) ) {
+      std::cout << "Error: inconsistent sizes, the shared store " << segment << " is not written" << std::endl;
+      return false;
+    }
+    std::stringstream tmpName;
+    tmpName << segment << ".tmp" << gSystem->GetPid();
+    FILE * file = fopen(tmpName.str().c_str(), "wb");
+    if( file == 0 ) {
+      std::cout << "Warning: cannot create the shared store " << tmpName.str() << std::endl;
+      return false;
+    }
+    Header header;
+    std::memcpy(header.tag, "MSFSTOR1", 8);
+    header.pairs = savedPair.size();
+    header.hasGen = (genPair != 0) ? 1 : 0;
+    header.padding = 0;
+    bool ok = fwrite(&header, sizeof(Header), 1, file) == 1;
+    double values[8];
+    for( unsigned int i=0; ok && i<savedPair.size(); ++i ) {
+      fromPair(savedPair[i], values);
+      ok = fwrite(values, sizeof(values), 1, file) == 1;
+    }
+    for( unsigned int i=0; ok && i<evtRun.size(); ++i ) {
+      int32_t numbers[2] = { evtRun[i].first, evtRun[i].second };
+      ok = fwrite(numbers, sizeof(numbers), 1, file) == 1;
+    }
+    for( unsigned int i=0; ok && genPair != 0 && i<genPair->size(); ++i ) {
+      fromPair((*genPair)[i], values);
+      ok = fwrite(values, sizeof(values), 1, file) == 1;
+    }
+    ok = (fclose(file) == 0) && ok;
+    // The rename is atomic: concurrent jobs see either no segment or the complete one
+    if( !ok || rename(tmpName.str().c_str(), segment.c_str()) != 0 ) {
+      std::cout << "Warning: cannot write the shared store " << segment << std::endl;
+      remove(tmpName.str().c_str());
+      return false;
+    }
+    return true;
+  }
+
+protected:
+  struct Header
+  {
+    char tag[8];
+    uint64_t pairs;
+    uint32_t hasGen;
+    uint32_t padding;
+  };
+
+  // The pairs are used in place in the segment: they must be two blocks of four doubles, following a header
+  // that keeps the doubles aligned. The order of the components is checked at run time by inPlace.
+  BOOST_STATIC_ASSERT( sizeof(lorentzVector) == 4*sizeof(double) );
+  BOOST_STATIC_ASSERT( sizeof(MuonPairEvents::value_type) == 8*sizeof(double) );
+  BOOST_STATIC_ASSERT( sizeof(Header) % sizeof(double) == 0 );
+
+  static uint64_t fnv1a( const std::string & key )
+  {
+    uint64_t hash = 14695981039346656037ULL;
+    for( std::string::const_iterator it = key.begin(); it != key.end(); ++it ) {
+      hash ^= (unsigned char)(*it);
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  static size_t segmentSize( const uint64_t pairs, const bool hasGen )
+  {
+    return sizeof(Header) + pairs*(8*sizeof(double) + 2*sizeof(int32_t) + (hasGen ? 8*sizeof(double) : 0));
+  }
+
+  /// True if a pair has the layout of the segment (px, py, pz, E of the two muons), so that the pairs can be used in place
+  static bool inPlace()
+  {
+    const lorentzVector vector(1., 2., 3., 4.);
+    double values[4];
+    std::memcpy(values, &vector, sizeof(values));
+    return values[0] == 1. && values[1] == 2. && values[2] == 3. && values[3] == 4.;
+  }
+
+  static void copyPairs( const double * values, const uint64_t n, MuonPairEvents * pairs )
+  {
+    MuonPairVector copy;
+    copy.reserve(n);
+    for( uint64_t i=0; i<n; ++i ) copy.push_back(toPair(values + 8*i));
+    pairs->swap(copy);
+  }
+
+  static std::pair<lorentzVector, lorentzVector> toPair( const double * values )
+  {
+    return std::make_pair(lorentzVector(values[0], values[1], values[2], values[3]),
+                          lorentzVector(values[4], values[5], values[6], values[7]));
+  }
+
+  static void fromPair( const std::pair<lorentzVector, lorentzVector> & pair, double * values )
+  {
+    values[0] = pair.first.px();
+    values[1] = pair.first.py();
+    values[2] = pair.first.pz();
+    values[3] = pair.first.e();
+    values[4] = pair.second.px();
+    values[5] = pair.second.py();
+    values[6] = pair.second.pz();
+    values[7] = pair.second.e();
+  }
+
+  std::string directory_;
+};
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef MuonPairTreeStream_h
+#define MuonPairTreeStream_h
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+
+#include <TFile.h>
+#include <TTree.h>
+#include <TBranch.h>
+#include <TH1F.h>
+
+#include <MuonAnalysis/MomentumScaleCalibration/interface/MuonPair.h>
+#include <MuonAnalysis/MomentumScaleCalibration/interface/GenMuonPair.h>
+#include <MuonAnalysis/MomentumScaleCalibration/interface/MuScleFitProvenance.h>
+
+/**
+ * Sequential access to the muon pairs tree in the format of the RootTreeHandler. <br>
+ * Unlike the RootTreeHandler, which reads or writes all the pairs at once, these classes
+ * read and write the pairs in chunks, so that samples of any size can be converted with
+ * bounded memory.
+ */
+
+class MuonPairTreeReader
+{
+public:
+  MuonPairTreeReader( const TString & fileName, const bool readGen, const Long64_t cacheSize = 30000000 ) :
+    file_(TFile::Open(fileName, "READ")),
+    tree_(0),
+    muonPair_(0),
+    genMuonPair_(0),
+    eventBranch_(0),
+    genEventBranch_(0),
+    entries_(0),
+    nextEntry_(0)
+  {
+    if( file_ == 0 || !(file_->IsOpen()) ) {
+      std::cout << "ERROR: no file " << fileName << " found." << std::endl;
+      return;
+    }
+    tree_ = (TTree*)file_->Get("T");
+    tree_->SetBranchAddress("event", &muonPair_);
+    eventBranch_ = tree_->GetBranch("event");
+    if( readGen ) {
+      tree_->SetBranchAddress("genEvent", &genMuonPair_);
+      genEventBranch_ = tree_->GetBranch("genEvent");
+    }
+    entries_ = tree_->GetEntries();
+    if( cacheSize > 0 ) {
+      tree_->SetCacheSize(cacheSize);
+      tree_->AddBranchToCache(eventBranch_, true);
+      if( genEventBranch_ != 0 ) tree_->AddBranchToCache(genEventBranch_, true);
+      tree_->StopCacheLearningPhase();
+    }
+  }
+
+  ~MuonPairTreeReader()
+  {
+    if( file_ != 0 ) {
+      file_->Close();
+      delete file_;
+    }
+  }
+
+  bool isOpen() const { return tree_ != 0; }
+  Long64_t entries() const { return entries_; }
+
+  /**
+   * Replaces the content of pairs (and genPairs if not null) with the next maxPairs pairs in the tree.
+   * Returns the number of pairs read, 0 when the end of the tree is reached.
+   */
+  unsigned int readChunk( std::vector<MuonPair> & pairs, std::vector<GenMuonPair> * genPairs, const unsigned int maxPairs )
+  {
+    pairs.clear();
+    if( genPairs != 0 ) genPairs->clear();
+    for( ; nextEntry_ < entries_ && pairs.size() < maxPairs; ++nextEntry_ ) {
+      Long64_t localEntry = tree_->LoadTree(nextEntry_);
+      if( localEntry < 0 ) {
+        std::cout << "ERROR: cannot load entry " << nextEntry_ << " of the tree." << std::endl;
+        exit(1);
+      }
+      eventBranch_->GetEntry(localEntry);
+      pairs.push_back(*muonPair_);
+      if( genPairs != 0 && genEventBranch_ != 0 ) {
+        genEventBranch_->GetEntry(localEntry);
+        genPairs->push_back(*genMuonPair_);
+      }
+    }
+    return pairs.size();
+  }
+
+protected:
+  TFile * file_;
+  TTree * tree_;
+  MuonPair * muonPair_;
+  GenMuonPair * genMuonPair_;
+  TBranch * eventBranch_;
+  TBranch * genEventBranch_;
+  Long64_t entries_;
+  Long64_t nextEntry_;
+};
+
+class MuonPairTreeWriter
+{
+public:
+  /// compressionSettings as given by RootTreeHandler::compressionSettings (-1 = ROOT default)
+  MuonPairTreeWriter( const TString & fileName, const bool writeGen, const int compressionSettings = -1,
+                      const int basketSize = 32000 ) :
+    file_(new TFile(fileName, "RECREATE")),
+    tree_(0),
+    muonPair_(new MuonPair),
+    genMuonPair_(new GenMuonPair),
+    writeGen_(writeGen)
+  {
+    // Set before creating the tree, the branches take the compression of the file
+    if( compressionSettings >= 0 ) file_->SetCompressionSettings(compressionSettings);
+    tree_ = new TTree("T", "Muon pairs");
+    tree_->Branch("event", "MuonPair", &muonPair_, basketSize);
+    if( writeGen_ ) {
+      tree_->Branch("genEvent", "GenMuonPair", &genMuonPair_, basketSize);
+    }
+  }
+
+  /// Closes the file if close was not called (the provenance is then saved with muonType = 0)
+  ~MuonPairTreeWriter()
+  {
+    close();
+    delete muonPair_;
+    delete genMuonPair_;
+  }
+
+  void fill( const MuonPair & muonPair, const GenMuonPair * genMuonPair = 0 )
+  {
+    muonPair_->copy(muonPair);
+    if( writeGen_ && genMuonPair != 0 ) {
+      genMuonPair_->copy(*genMuonPair);
+    }
+    tree_->Fill();
+  }
+
+  /// Saves the provenance information and closes the file. Only the first call has an effect.
+  void close( const int muonType = 0 )
+  {
+    if( file_ == 0 ) return;
+    file_->cd();
+    TH1F muonTypeHisto("MuonType", "MuonType", 40, -20, 20);
+    muonTypeHisto.Fill(muonType);
+    muonTypeHisto.Write();
+    MuScleFitProvenance provenance(muonType);
+    provenance.Write();
+
+    file_->Write();
+    file_->Close();
+    // The tree belongs to the file and is deleted with it
+    delete file_;
+    file_ = 0;
+    tree_ = 0;
+  }
+
+protected:
+  TFile * file_;
+  TTree * tree_;
+  MuonPair * muonPair_;
+  GenMuonPair * genMuonPair_;
+  bool writeGen_;
+};
+
+/**
+ * Binary record format of the tree dump. <br>
+ * The file starts with the tag "MSFDUMP1" followed by one byte set to 1 if the generator information is present.
+ * Each record contains pt eta phi of the two muons (and of the two gen muons, if present) as little-endian
+ * IEEE 754 doubles followed by the event and run numbers as little-endian 32 bit unsigned integers.
+ */
+namespace MuonPairDumpRecord
+{
+  static const char tag[] = "MSFDUMP1";
+  static const unsigned int tagSize = 8;
+
+  inline unsigned int size( const bool genInfo ) { return (genInfo ? 12 : 6)*8 + 2*4; }
+
+  inline void encodeDouble( const double value, char * buffer )
+  {
+    uint64_t bits;
+    std::memcpy(&bits, &value, 8);
+    for( int i=0; i<8; ++i ) buffer[i] = char((bits >> (8*i)) & 0xff);
+  }
+
+  inline double decodeDouble( const char * buffer )
+  {
+    uint64_t bits = 0;
+    for( int i=0; i<8; ++i ) bits |= uint64_t((unsigned char)buffer[i]) << (8*i);
+    double value;
+    std::memcpy(&value, &bits, 8);
+    return value;
+  }
+
+  inline void encodeUInt( const uint32_t value, char * buffer )
+  {
+    for( int i=0; i<4; ++i ) buffer[i] = char((value >> (8*i)) & 0xff);
+  }
+
+  inline uint32_t decodeUInt( const char * buffer )
+  {
+    uint32_t value = 0;
+    for( int i=0; i<4; ++i ) value |= uint32_t((unsigned char)buffer[i]) << (8*i);
+    return value;
+  }
+
+  /// Writes the values (6 or 12) and the event and run numbers to buffer, which must hold size(genInfo) bytes
+  inline void encode( const double * values, const bool genInfo, const uint32_t event, const uint32_t run, char * buffer )
+  {
+    const int nValues = genInfo ? 12 : 6;
+    for( int i=0; i<nValues; ++i ) encodeDouble(values[i], buffer + 8*i);
+    encodeUInt(event, buffer + 8*nValues);
+    encodeUInt(run, buffer + 8*nValues + 4);
+  }
+
+  inline void decode( const char * buffer, const bool genInfo, double * values, uint32_t & event, uint32_t & run )
+  {
+    const int nValues = genInfo ? 12 : 6;
+    for( int i=0; i<nValues; ++i ) values[i] = decodeDouble(buffer + 8*i);
+    event = decodeUInt(buffer + 8*nValues);
+    run = decodeUInt(buffer + 8*nValues + 4);
+  }
+}
+
+#endif
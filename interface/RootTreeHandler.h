@@ -2,13 +2,26 @@
 
 #include <TFile.h>
 #include <TTree.h>
+#include <TBranch.h>
+#include <TTreeCacheUnzip.h>
+#include <TSystem.h>
+#include <TRegexp.h>
+#include <TThread.h>
+#include <RVersion.h>
 
 #include <MuonAnalysis/MomentumScaleCalibration/interface/MuonPair.h>
 #include <MuonAnalysis/MomentumScaleCalibration/interface/GenMuonPair.h>
 #include <MuonAnalysis/MomentumScaleCalibration/interface/MuScleFitProvenance.h>
+#include <MuonAnalysis/MomentumScaleCalibration/interface/MuonPairEvents.h>
 #include <TH1F.h>
 #include <stdlib.h>
 #include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 
 typedef std::vector<std::pair<lorentzVector,lorentzVector> > MuonPairVector;
 
@@ -17,58 +30,328 @@ typedef std::vector<std::pair<lorentzVector,lorentzVector> > MuonPairVector;
  * The writeTree method gets the name of the file to store the tree and the savedPair (and possibly genPair)
  * vector of muon pairs. <br>
  * Likewise, the readTree method takes the same arguments. It reads back from the file with the given name the
- * pairs and stores them in the given savedPair (and genPair) vector.
+ * pairs and stores them in the given savedPair (and genPair) vector. <br>
+ * When reading, only the needed branches are loaded and a TTreeCache of cacheSize bytes is used for the
+ * sequential access (cacheSize = 0 disables it). If parallelUnzip is true the baskets are decompressed
+ * by a separate thread: the mode of TTreeCacheUnzip is process-wide, so it is enabled by readTree and readTrees
+ * only while they read and the previous mode is then restored. <br>
+ * The readTrees method reads a list of files (see expandFileNames) concurrently and merges them in the
+ * order of the list. <br>
+ * When writing, the compression of the file and the basket size of the branches can be set with setCompression
+ * and setBasketSize (see compressionSettings for the available codecs).
  */
 
 class RootTreeHandler
 {
 public:
+  /// Interface for a selection applied to the muon pairs while they are read. Rejected pairs are not stored.
+  class PairSelector
+  {
+  public:
+    virtual ~PairSelector() {}
+    virtual bool operator()( const lorentzVector & mu1, const lorentzVector & mu2 ) const = 0;
+  };
+
+  RootTreeHandler( const Long64_t cacheSize = 30000000, const bool parallelUnzip = false ) :
+    cacheSize_(cacheSize),
+    parallelUnzip_(parallelUnzip),
+    compressionSettings_(-1),
+    basketSize_(32000)
+  {}
+
+  /**
+   * Returns the ROOT compression settings (100*algorithm + level) for the codec ZLIB, LZMA, LZ4 or ZSTD
+   * and the level (0-9). An empty codec returns -1, meaning the ROOT default. An unknown codec, or a codec
+   * not available in the ROOT version in use (see codecAvailable), returns -2: ROOT would silently write it as ZLIB.
+   */
+  static int compressionSettings( const std::string & codec, const int level )
+  {
+    if( codec.empty() ) return -1;
+    int algorithm = 0;
+    if( codec == "ZLIB" ) algorithm = 1;
+    else if( codec == "LZMA" ) algorithm = 2;
+    else if( codec == "LZ4" ) algorithm = 4;
+    else if( codec == "ZSTD" ) algorithm = 5;
+    else {
+      std::cout << "Unknown compression codec " << codec << ". Valid codecs are ZLIB, LZMA, LZ4 and ZSTD" << std::endl;
+      return -2;
+    }
+    if( !codecAvailable(codec) ) {
+      std::cout << "Compression codec " << codec << " is not available in ROOT " << ROOT_RELEASE
+                << ", it would be written as ZLIB. Please choose another codec." << std::endl;
+      return -2;
+    }
+    return 100*algorithm + std::max(0, std::min(9, level));
+  }
+
+  /// True if the ROOT version in use can write the codec: ZLIB (and the default) always, LZMA from 5.30, LZ4 from 6.04, ZSTD from 6.20
+  static bool codecAvailable( const std::string & codec )
+  {
+    if( codec.empty() || codec == "ZLIB" ) return true;
+    if( codec == "LZMA" ) return ROOT_VERSION_CODE >= ROOT_VERSION(5,30,0);
+    if( codec == "LZ4" ) return ROOT_VERSION_CODE >= ROOT_VERSION(6,4,0);
+    if( codec == "ZSTD" ) return ROOT_VERSION_CODE >= ROOT_VERSION(6,20,0);
+    return false;
+  }
+
+  /// Compression settings of the files written by writeTree (-1 = ROOT default)
+  void setCompression( const int compressionSettings ) { compressionSettings_ = compressionSettings; }
+  /// Basket size in bytes of the branches written by writeTree
+  void setBasketSize( const int basketSize ) { basketSize_ = basketSize; }
+
   // void writeTree( const TString & fileName, const MuonPairVector * savedPair, const int muonType = 0,
   //                 const MuonPairVector * genPair = 0, const bool saveAll = false )
   void writeTree( const TString & fileName, const std::vector<MuonPair> * savedPair, const int muonType = 0,
 		  const std::vector<GenMuonPair> * genPair = 0, const bool saveAll = false )
+  {
+    writePairs(fileName, MuonPairColumns(savedPair, genPair), muonType, saveAll);
+  }
+
+  /**
+   * Writes the tree from the columns of the fit event store: the pairs with the corresponding (event, run) numbers
+   * and, if given, the gen pairs with their motherId (the motherId is set to 0 if genMotherId is not given).
+   */
+  void writeTree( const TString & fileName, const MuonPairEvents * savedPair, const std::vector<std::pair<int, int> > * evtRun,
+                  const int muonType = 0, const MuonPairEvents * genPair = 0, const std::vector<int> * genMotherId = 0,
+                  const bool saveAll = false )
+  {
+    if( savedPair->size() != evtRun->size() ) {
+      std::cout << "Error: savedPair size (" << savedPair->size() << ") and evtRun size (" << evtRun->size()
+                << ") are different. This is severe and I will not write the tree." << std::endl;
+      exit(1);
+    }
+    writePairs(fileName, EventStoreColumns(savedPair, evtRun, genPair, genMotherId), muonType, saveAll);
+  }
+
+  // void readTree( const int maxEvents, const TString & fileName, MuonPairVector * savedPair,
+  //           	    const int muonType, MuonPairVector * genPair = 0 )
+  /**
+   * If a selector is given only the pairs passing it are stored (with their event and run numbers
+   * and gen pairs) and maxEvents is the maximum number of pairs passing the selection.
+   */
+  void readTree( const int maxEvents, const TString & fileName, MuonPairVector * savedPair,
+		 const int muonType, std::vector<std::pair<int, int> > * evtRun, MuonPairVector * genPair = 0,
+                 const PairSelector * selector = 0 )
+  {
+    ParallelUnzipMode unzipMode(parallelUnzip_ && cacheSize_ > 0);
+    exitOnError(readFile(maxEvents, fileName, savedPair, muonType, evtRun, genPair, selector));
+  }
+
+  /// Used to read the external trees
+  void readTree( const int maxEvents, const TString & fileName, std::vector<MuonPair> * savedPair,
+		 const int muonType, std::vector<GenMuonPair> * genPair = 0 )
+  {
+    ParallelUnzipMode unzipMode(parallelUnzip_ && cacheSize_ > 0);
+    TFile * file = TFile::Open(fileName, "READ");
+    if( file != 0 && file->IsOpen() ) {
+      TTree * tree = (TTree*)file->Get("T");
+      if( tree == 0 ) exitOnError(std::string("no tree T in the file ") + fileName.Data() + ".");
+      MuonPair * muonPair = 0;
+      GenMuonPair * genMuonPair = 0;
+      tree->SetBranchAddress("event",&muonPair);
+      TBranch * eventBranch = tree->GetBranch("event");
+      TBranch * genEventBranch = 0;
+      if( genPair != 0 ) {
+        tree->SetBranchAddress("genEvent",&genMuonPair);
+        genEventBranch = tree->GetBranch("genEvent");
+      }
+
+      Long64_t nentries = tree->GetEntries();
+      if( (maxEvents != -1) && (nentries > maxEvents) ) nentries = maxEvents;
+      savedPair->reserve(savedPair->size() + nentries);
+      if( genPair != 0 ) genPair->reserve(genPair->size() + nentries);
+      setupCache(tree, eventBranch, genEventBranch);
+
+      for( Long64_t i=0; i<nentries; ++i ) {
+        Long64_t localEntry = tree->LoadTree(i);
+        exitOnError(entryError(localEntry, i, fileName));
+        eventBranch->GetEntry(localEntry);
+        savedPair->push_back(*muonPair);
+        if( genPair != 0 ) {
+          genEventBranch->GetEntry(localEntry);
+          genPair->push_back(*genMuonPair);
+        }
+      }
+    }
+    else {
+      std::cout << "ERROR: no file " << fileName << " found. Please, correct the file name or specify an empty field in the InputRootTreeFileName parameter to read events from the edm source." << std::endl;
+      exit(1);
+    }
+    file->Close();
+  }
+
+  /**
+   * Splits a list of file names separated by commas or spaces. Names containing the wildcards * or ?
+   * are expanded with the matching files in their directory, sorted alphabetically.
+   */
+  static std::vector<std::string> expandFileNames( const std::string & fileNames )
+  {
+    std::string names(fileNames);
+    std::replace(names.begin(), names.end(), ',', ' ');
+    std::stringstream ss(names);
+    std::vector<std::string> expanded;
+    std::string name;
+    while( ss >> name ) {
+      if( name.find_first_of("*?") == std::string::npos ) {
+        expanded.push_back(name);
+        continue;
+      }
+      TString dirName(gSystem->DirName(name.c_str()));
+      TRegexp regexp(gSystem->BaseName(name.c_str()), kTRUE);
+      std::vector<std::string> matching;
+      void * dir = gSystem->OpenDirectory(dirName);
+      if( dir != 0 ) {
+        const char * entry = 0;
+        while( (entry = gSystem->GetDirEntry(dir)) != 0 ) {
+          TString entryName(entry);
+          Ssiz_t length = 0;
+          if( entryName.Index(regexp, &length) == 0 && length == entryName.Length() ) {
+            matching.push_back(std::string((dirName + "/" + entryName).Data()));
+          }
+        }
+        gSystem->FreeDirectory(dir);
+      }
+      if( matching.empty() ) {
+        std::cout << "ERROR: no file matching " << name << " found. Please, correct the InputRootTreeFileName parameter." << std::endl;
+        exit(1);
+      }
+      std::sort(matching.begin(), matching.end());
+      expanded.insert(expanded.end(), matching.begin(), matching.end());
+    }
+    return expanded;
+  }
+
+  /**
+   * Reads the trees in all the given files using up to numberOfThreads threads, one file per thread at a time.
+   * The events are appended in the order of the fileNames and at most maxEvents (-1 = all) are read in total. <br>
+   * If a file cannot be read the threads stop at the end of the file they are reading and the error is reported,
+   * ending the job, only after all of them are joined.
+   */
+  void readTrees( const int maxEvents, const std::vector<std::string> & fileNames, MuonPairVector * savedPair,
+                  const int muonType, std::vector<std::pair<int, int> > * evtRun, MuonPairVector * genPair = 0,
+                  const unsigned int numberOfThreads = 1, const PairSelector * selector = 0 )
+  {
+    exitOnError(readFiles(maxEvents, fileNames, savedPair, muonType, evtRun, genPair, numberOfThreads, selector));
+  }
+
+  /**
+   * As readTrees, but the error is returned instead of ending the job (an empty string if all the files are read),
+   * so that the reading can run in a thread other than the one running the job.
+   */
+  std::string readFiles( const int maxEvents, const std::vector<std::string> & fileNames, MuonPairVector * savedPair,
+                         const int muonType, std::vector<std::pair<int, int> > * evtRun, MuonPairVector * genPair = 0,
+                         const unsigned int numberOfThreads = 1, const PairSelector * selector = 0 )
+  {
+    // Set here, before the threads create their caches
+    ParallelUnzipMode unzipMode(parallelUnzip_ && cacheSize_ > 0);
+    if( fileNames.size() == 1 || numberOfThreads <= 1 ) {
+      std::vector<std::string>::const_iterator fileName = fileNames.begin();
+      for( ; fileName != fileNames.end(); ++fileName ) {
+        int missingEvents = -1;
+        if( maxEvents != -1 ) {
+          missingEvents = maxEvents - int(savedPair->size());
+          if( missingEvents <= 0 ) break;
+        }
+        std::string error(readFile(missingEvents, fileName->c_str(), savedPair, muonType, evtRun, genPair, selector));
+        if( !error.empty() ) return error;
+      }
+      return "";
+    }
+
+    // Each file is read in its own slot. A slot is appended to the output and freed as soon as all the
+    // previous ones are, and no more files are given to the threads once the output holds maxEvents pairs.
+    ReadState state(maxEvents, fileNames, savedPair, evtRun, genPair);
+    TThread::Initialize();
+    boost::thread_group threads;
+    for( unsigned int i=0; i<std::min(numberOfThreads, (unsigned int)(fileNames.size())); ++i ) {
+      threads.create_thread(FileReader(this, &state, muonType, selector));
+    }
+    threads.join_all();
+    return state.error;
+  }
+
+protected:
+  /// Pairs written by writeTree from vectors of MuonPair and GenMuonPair
+  struct MuonPairColumns
+  {
+    MuonPairColumns( const std::vector<MuonPair> * savedPair, const std::vector<GenMuonPair> * genPair ) :
+      savedPair(savedPair), genPair(genPair)
+    {}
+    size_t size() const { return savedPair->size(); }
+    bool hasGen() const { return genPair != 0; }
+    size_t genSize() const { return genPair->size(); }
+    const lorentzVector & mu1( const size_t iev ) const { return (*savedPair)[iev].mu1; }
+    const lorentzVector & mu2( const size_t iev ) const { return (*savedPair)[iev].mu2; }
+    void copy( const size_t iev, MuonPair * muonPair ) const { muonPair->copy((*savedPair)[iev]); }
+    void copyGen( const size_t iev, GenMuonPair * genMuonPair ) const { genMuonPair->copy((*genPair)[iev]); }
+
+    const std::vector<MuonPair> * savedPair;
+    const std::vector<GenMuonPair> * genPair;
+  };
+
+  /// Pairs written by writeTree from the columns of the fit event store
+  struct EventStoreColumns
+  {
+    EventStoreColumns( const MuonPairEvents * savedPair, const std::vector<std::pair<int, int> > * evtRun,
+                       const MuonPairEvents * genPair, const std::vector<int> * genMotherId ) :
+      savedPair(savedPair), evtRun(evtRun), genPair(genPair), genMotherId(genMotherId)
+    {}
+    size_t size() const { return savedPair->size(); }
+    bool hasGen() const { return genPair != 0; }
+    size_t genSize() const { return genPair->size(); }
+    const lorentzVector & mu1( const size_t iev ) const { return (*savedPair)[iev].first; }
+    const lorentzVector & mu2( const size_t iev ) const { return (*savedPair)[iev].second; }
+    void copy( const size_t iev, MuonPair * muonPair ) const
+    {
+      muonPair->copy(MuonPair((*savedPair)[iev].first, (*savedPair)[iev].second, (*evtRun)[iev].second, (*evtRun)[iev].first));
+    }
+    void copyGen( const size_t iev, GenMuonPair * genMuonPair ) const
+    {
+      int motherId = ( genMotherId != 0 && iev < genMotherId->size() ) ? (*genMotherId)[iev] : 0;
+      genMuonPair->copy(GenMuonPair((*genPair)[iev].first, (*genPair)[iev].second, motherId));
+    }
+
+    const MuonPairEvents * savedPair;
+    const std::vector<std::pair<int, int> > * evtRun;
+    const MuonPairEvents * genPair;
+    const std::vector<int> * genMotherId;
+  };
+
+  /**
+   * Body of the writeTree methods: the Columns give the number of pairs, the muons of each pair (to skip the
+   * pairs with an empty muon unless saveAll is true) and copy a pair and its gen pair to the tree branches.
+   */
+  template <class Columns>
+  void writePairs( const TString & fileName, const Columns & pairs, const int muonType, const bool saveAll )
   {
     lorentzVector emptyLorentzVector(0,0,0,0);
     TFile * f1 = new TFile(fileName, "RECREATE");
+    if( compressionSettings_ >= 0 ) f1->SetCompressionSettings(compressionSettings_);
     TTree * tree = new TTree("T", "Muon pairs");
     MuonPair * muonPair = new MuonPair;
     GenMuonPair * genMuonPair = new GenMuonPair;
     // MuonPair * genMuonPair = new MuonPair;
-    tree->Branch("event", "MuonPair", &muonPair);
-    if( genPair != 0 ) {
-      tree->Branch("genEvent", "GenMuonPair", &genMuonPair);
+    tree->Branch("event", "MuonPair", &muonPair, basketSize_);
+    if( pairs.hasGen() ) {
+      tree->Branch("genEvent", "GenMuonPair", &genMuonPair, basketSize_);
       // tree->Branch("genEvent", "MuonPair", &genMuonPair);
-      
-      if( savedPair->size() != genPair->size() ) {
+
+      if( pairs.size() != pairs.genSize() ) {
 	std::cout << "Error: savedPair size ("
-	<< savedPair->size() <<") and genPair size ("
-	<< genPair->size() <<") are different. This is severe and I will not write the tree." << std::endl;
+	<< pairs.size() <<") and genPair size ("
+	<< pairs.genSize() <<") are different. This is severe and I will not write the tree." << std::endl;
 	exit(1);
       }
     }
-    std::cout << "savedPair->size() is "<<savedPair->size()<< std::endl;
-    std::vector<MuonPair>::const_iterator muonPairIt = savedPair->begin();
-    unsigned int iev = 0;
-    for( ; muonPairIt != savedPair->end(); ++muonPairIt, ++iev ) {
-
-      if( saveAll || ( (muonPairIt->mu1 != emptyLorentzVector) && (muonPairIt->mu2 != emptyLorentzVector) ) ) {
-
-	// muonPair->setPair(muonType, std::make_pair(muonPairIt->first, muonPairIt->second));
-	muonPair->copy(*muonPairIt);
-
-	// if( genPair != 0 && genPair->size() != 0 ) {
-	//   genMuonPair->setPair(muonId, std::make_pair((*genPair)[iev].first, (*genPair)[iev].second));
-	//   genMuonPair->mu1 = ((*genPair)[iev].first);
-	//   genMuonPair->mu2 = ((*genPair)[iev].second);
-        // }
-	if( genPair != 0 ) {
-	  genMuonPair->copy((*genPair)[iev]);
+    std::cout << "savedPair->size() is "<<pairs.size()<< std::endl;
+    for( size_t iev = 0; iev < pairs.size(); ++iev ) {
+      if( saveAll || ( (pairs.mu1(iev) != emptyLorentzVector) && (pairs.mu2(iev) != emptyLorentzVector) ) ) {
+	pairs.copy(iev, muonPair);
+	if( pairs.hasGen() ) {
+	  pairs.copyGen(iev, genMuonPair);
 	}
-
 	tree->Fill();
       }
-      // // Tree filled. Clear the map for the next event.
-      // muonPair->muonPairs.clear();
     }
 
     // Save provenance information in the TFile
@@ -82,71 +365,233 @@ public:
     f1->Close();
   }
 
-  // void readTree( const int maxEvents, const TString & fileName, MuonPairVector * savedPair,
-  //           	    const int muonType, MuonPairVector * genPair = 0 )
-  void readTree( const int maxEvents, const TString & fileName, MuonPairVector * savedPair,
-		 const int muonType, std::vector<std::pair<int, int> > * evtRun, MuonPairVector * genPair = 0 )
+  /**
+   * Sets the parallel unzip mode of TTreeCacheUnzip, used by all the caches created afterwards in the process,
+   * and restores the previous mode when destroyed. It is used by the thread starting the reading, never by the
+   * threads reading the files, which would change the mode under each other.
+   */
+  class ParallelUnzipMode
+  {
+  public:
+    ParallelUnzipMode( const bool parallelUnzip ) :
+      previous_(TTreeCacheUnzip::GetParallelUnzip()),
+      changed_(parallelUnzip && previous_ == TTreeCacheUnzip::kDisable)
+    {
+      if( changed_ ) TTreeCacheUnzip::SetParallelUnzip(TTreeCacheUnzip::kEnable);
+    }
+    ~ParallelUnzipMode()
+    {
+      if( changed_ ) TTreeCacheUnzip::SetParallelUnzip(previous_);
+    }
+  private:
+    TTreeCacheUnzip::EParUnzipMode previous_;
+    bool changed_;
+  };
+
+  /**
+   * Body of readTree, without changing the parallel unzip mode. It does not exit on errors, so that it can be used
+   * by the threads of readTrees: it returns an empty string if the file is read, otherwise the error.
+   */
+  std::string readFile( const int maxEvents, const TString & fileName, MuonPairVector * savedPair,
+                        const int muonType, std::vector<std::pair<int, int> > * evtRun, MuonPairVector * genPair,
+                        const PairSelector * selector )
   {
     TFile * file = TFile::Open(fileName, "READ");
-    if( file->IsOpen() ) {
-      TTree * tree = (TTree*)file->Get("T");
-      MuonPair * muonPair = 0;
-      GenMuonPair * genMuonPair = 0;
-      // MuonPair * genMuonPair = 0;
-      tree->SetBranchAddress("event",&muonPair);
-      if( genPair != 0 ) {
-        tree->SetBranchAddress("genEvent",&genMuonPair);
-      }
+    // TFile::Open returns 0 when the file cannot be opened at all
+    if( file == 0 || !file->IsOpen() ) {
+      delete file;
+      return std::string("no file ") + fileName.Data() + " found. Please, correct the file name or specify an empty field in the InputRootTreeFileName parameter to read events from the edm source.";
+    }
+    TTree * tree = (TTree*)file->Get("T");
+    if( tree == 0 ) {
+      closeFile(file);
+      return std::string("no tree T in the file ") + fileName.Data() + ".";
+    }
+    MuonPair * muonPair = 0;
+    GenMuonPair * genMuonPair = 0;
+    // MuonPair * genMuonPair = 0;
+    tree->SetBranchAddress("event",&muonPair);
+    TBranch * eventBranch = tree->GetBranch("event");
+    TBranch * genEventBranch = 0;
+    if( genPair != 0 ) {
+      tree->SetBranchAddress("genEvent",&genMuonPair);
+      genEventBranch = tree->GetBranch("genEvent");
+    }
 
-      Long64_t nentries = tree->GetEntries();
+    Long64_t nentries = tree->GetEntries();
+    if( selector == 0 ) {
       if( (maxEvents != -1) && (nentries > maxEvents) ) nentries = maxEvents;
-      for( Long64_t i=0; i<nentries; ++i ) {
-        tree->GetEntry(i);
-        savedPair->push_back(std::make_pair(muonPair->mu1, muonPair->mu2));
-	evtRun->push_back(std::make_pair(muonPair->event, muonPair->run));
-        // savedPair->push_back(muonPair->getPair(muonType));
-        if( genPair != 0 ) {
-          genPair->push_back(std::make_pair(genMuonPair->mu1, genMuonPair->mu2));
-          // genPair->push_back(genMuonPair->getPair(muonId));
-        }
+      savedPair->reserve(savedPair->size() + nentries);
+      evtRun->reserve(evtRun->size() + nentries);
+      if( genPair != 0 ) genPair->reserve(genPair->size() + nentries);
+    }
+    setupCache(tree, eventBranch, genEventBranch);
+
+    Long64_t storedPairs = 0;
+    for( Long64_t i=0; i<nentries && (maxEvents == -1 || storedPairs < maxEvents); ++i ) {
+      // Only the selected branches are read. LoadTree keeps the cache informed of the current entry.
+      Long64_t localEntry = tree->LoadTree(i);
+      std::string error(entryError(localEntry, i, fileName));
+      if( !error.empty() ) {
+        closeFile(file);
+        return error;
+      }
+      eventBranch->GetEntry(localEntry);
+      if( selector != 0 && !((*selector)(muonPair->mu1, muonPair->mu2)) ) continue;
+      ++storedPairs;
+      savedPair->push_back(std::make_pair(muonPair->mu1, muonPair->mu2));
+      evtRun->push_back(std::make_pair(muonPair->event, muonPair->run));
+      // savedPair->push_back(muonPair->getPair(muonType));
+      if( genPair != 0 ) {
+        genEventBranch->GetEntry(localEntry);
+        genPair->push_back(std::make_pair(genMuonPair->mu1, genMuonPair->mu2));
+        // genPair->push_back(genMuonPair->getPair(muonId));
       }
     }
-    else {
-      std::cout << "ERROR: no file " << fileName << " found. Please, correct the file name or specify an empty field in the InputRootTreeFileName parameter to read events from the edm source." << std::endl;
+    closeFile(file);
+    return "";
+  }
+
+  /// Closes and deletes the file with its tree and cache
+  static void closeFile( TFile * file )
+  {
+    file->Close();
+    delete file;
+  }
+
+  /// Ends the job if there is an error. Only used by the thread running the job, never by the threads of readTrees.
+  static void exitOnError( const std::string & error )
+  {
+    if( !error.empty() ) {
+      std::cout << "ERROR: " << error << std::endl;
       exit(1);
     }
-    file->Close();
   }
 
-  /// Used to read the external trees
-  void readTree( const int maxEvents, const TString & fileName, std::vector<MuonPair> * savedPair,
-		 const int muonType, std::vector<GenMuonPair> * genPair = 0 )
+  /// Events read from one file
+  struct FileContent
   {
-    TFile * file = TFile::Open(fileName, "READ");
-    if( file->IsOpen() ) {
-      TTree * tree = (TTree*)file->Get("T");
-      MuonPair * muonPair = 0;
-      GenMuonPair * genMuonPair = 0;
-      tree->SetBranchAddress("event",&muonPair);
-      if( genPair != 0 ) {
-        tree->SetBranchAddress("genEvent",&genMuonPair);
-      }
+    MuonPairVector savedPair;
+    std::vector<std::pair<int, int> > evtRun;
+    MuonPairVector genPair;
 
-      Long64_t nentries = tree->GetEntries();
-      if( (maxEvents != -1) && (nentries > maxEvents) ) nentries = maxEvents;
-      for( Long64_t i=0; i<nentries; ++i ) {
-        tree->GetEntry(i);
-        savedPair->push_back(*muonPair);
+    /// Releases the memory (clear would keep the capacity)
+    void release()
+    {
+      MuonPairVector().swap(savedPair);
+      std::vector<std::pair<int, int> >().swap(evtRun);
+      MuonPairVector().swap(genPair);
+    }
+  };
+
+  /// State shared by the threads of readTrees. All the members but the content of the slots being read are used under the lock.
+  struct ReadState
+  {
+    ReadState( const int maxEvents, const std::vector<std::string> & fileNames, MuonPairVector * savedPair,
+               std::vector<std::pair<int, int> > * evtRun, MuonPairVector * genPair ) :
+      maxEvents(maxEvents), fileNames(fileNames), contents(fileNames.size()), done(fileNames.size(), false),
+      nextFile(0), nextToMerge(0), savedPair(savedPair), evtRun(evtRun), genPair(genPair)
+    {}
+
+    /// True when the output holds maxEvents pairs: the files not yet started are not needed
+    bool full() const { return maxEvents != -1 && int(savedPair->size()) >= maxEvents; }
+
+    /// Appends to the output, in the order of the files, the slots whose previous slots are all appended, and frees them
+    void mergeCompleted()
+    {
+      for( ; nextToMerge < contents.size() && done[nextToMerge]; ++nextToMerge ) {
+        FileContent & content = contents[nextToMerge];
+        size_t events = content.savedPair.size();
+        if( maxEvents != -1 ) events = std::min(events, size_t(std::max(0, maxEvents - int(savedPair->size()))));
+        savedPair->insert(savedPair->end(), content.savedPair.begin(), content.savedPair.begin() + events);
+        evtRun->insert(evtRun->end(), content.evtRun.begin(), content.evtRun.begin() + events);
         if( genPair != 0 ) {
-          genPair->push_back(*genMuonPair);
+          genPair->insert(genPair->end(), content.genPair.begin(), content.genPair.begin() + events);
         }
+        content.release();
       }
     }
-    else {
-      std::cout << "ERROR: no file " << fileName << " found. Please, correct the file name or specify an empty field in the InputRootTreeFileName parameter to read events from the edm source." << std::endl;
-      exit(1);
+
+    int maxEvents;
+    const std::vector<std::string> & fileNames;
+    std::vector<FileContent> contents;
+    std::vector<bool> done;
+    unsigned int nextFile;
+    unsigned int nextToMerge;
+    // First error found by a thread. When it is set no more files are read.
+    std::string error;
+    MuonPairVector * savedPair;
+    std::vector<std::pair<int, int> > * evtRun;
+    MuonPairVector * genPair;
+    boost::mutex mutex;
+  };
+
+  /// Thread body: takes the next file from the list until all of them are read or enough pairs are merged
+  class FileReader
+  {
+  public:
+    FileReader( RootTreeHandler * handler, ReadState * state, const int muonType, const PairSelector * selector ) :
+      handler_(handler), state_(state), muonType_(muonType), selector_(selector)
+    {}
+    void operator()()
+    {
+      while( true ) {
+        unsigned int iFile = 0;
+        int fileMaxEvents = -1;
+        {
+          boost::mutex::scoped_lock lock(state_->mutex);
+          if( state_->nextFile >= state_->fileNames.size() || state_->full() || !state_->error.empty() ) return;
+          iFile = (state_->nextFile)++;
+          // The pairs already merged precede this file, so it cannot contribute more than the missing ones
+          if( state_->maxEvents != -1 ) fileMaxEvents = state_->maxEvents - int(state_->savedPair->size());
+        }
+        FileContent & content = state_->contents[iFile];
+        std::string error(handler_->readFile(fileMaxEvents, state_->fileNames[iFile].c_str(), &(content.savedPair), muonType_,
+                                             &(content.evtRun), state_->genPair != 0 ? &(content.genPair) : 0, selector_));
+        boost::mutex::scoped_lock lock(state_->mutex);
+        if( !error.empty() ) {
+          // Reported by readTrees once all the threads are joined
+          if( state_->error.empty() ) state_->error = error;
+          return;
+        }
+        state_->done[iFile] = true;
+        state_->mergeCompleted();
+      }
     }
-    file->Close();
+  private:
+    RootTreeHandler * handler_;
+    ReadState * state_;
+    int muonType_;
+    const PairSelector * selector_;
+  };
+
+  /**
+   * A negative value from LoadTree means that the entry cannot be read: the branches would still hold the previous one.
+   * Returns the error, or an empty string if the entry can be read.
+   */
+  static std::string entryError( const Long64_t localEntry, const Long64_t entry, const TString & fileName )
+  {
+    if( localEntry >= 0 ) return "";
+    std::stringstream error;
+    error << "cannot load entry " << entry << " of the tree in " << fileName.Data()
+          << " (LoadTree returned " << localEntry << ").";
+    return error.str();
+  }
+
+  /// Enables the TTreeCache for sequential reading of the given branches (and their sub-branches) only
+  void setupCache( TTree * tree, TBranch * eventBranch, TBranch * genEventBranch )
+  {
+    if( cacheSize_ <= 0 ) return;
+    // The parallel unzip mode, if requested, was set by readTree or readTrees before the cache is created
+    tree->SetCacheSize(cacheSize_);
+    tree->AddBranchToCache(eventBranch, true);
+    if( genEventBranch != 0 ) tree->AddBranchToCache(genEventBranch, true);
+    // The branches are known, no need for the learning phase
+    tree->StopCacheLearningPhase();
   }
 
+  Long64_t cacheSize_;
+  bool parallelUnzip_;
+  int compressionSettings_;
+  int basketSize_;
 };
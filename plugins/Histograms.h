@@ -31,6 +31,7 @@
 #include "TLorentzVector.h"
 #include <vector>
 #include <string>
+#include <map>
 #include <iostream>
 #include "TMath.h"
 
@@ -128,6 +129,17 @@ private:
 
 };
 
+/**
+ * Returns the histograms booked with the given name in the map or 0 if there is none. <br>
+ * Used to resolve the histograms once after the booking, so that the event loops fill them
+ * through the pointers without building strings and looking up the map.
+ */
+inline Histograms * findHistogram( const std::map<std::string, Histograms*> & histoMap, const std::string & name )
+{
+  std::map<std::string, Histograms*>::const_iterator it = histoMap.find(name);
+  return( it == histoMap.end() ? 0 : it->second );
+}
+
 /// A wrapper for the TH2D histogram to allow it to be put inside the same map as all the other classes in this file
 class HTH2D : public Histograms
 {
@@ -126,8 +126,14 @@
 #include "MuScleFitBase.h"
 #include "Histograms.h"
 #include "MuScleFitPlotter.h"
+#include "MuScleFitHistogramsWriter.h"
 #include "MuonAnalysis/MomentumScaleCalibration/interface/Functions.h"
 #include "MuonAnalysis/MomentumScaleCalibration/interface/RootTreeHandler.h"
+#include "MuonAnalysis/MomentumScaleCalibration/interface/MuonPairShards.h"
+#include "MuonAnalysis/MomentumScaleCalibration/interface/MuonPairSharedStore.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
 #include "MuScleFitMuonSelector.h"
 
 #include "DataFormats/TrackReco/interface/Track.h"
@@ -143,6 +149,8 @@
 #include "DataFormats/Candidate/interface/LeafCandidate.h"
 #include "DataFormats/Common/interface/TriggerResults.h"
 #include "FWCore/Common/interface/TriggerNames.h"
+#include "DataFormats/Provenance/interface/ParameterSetID.h"
+#include "DataFormats/Provenance/interface/RunID.h"
 
 #include "HLTrigger/HLTcore/interface/HLTConfigProvider.h"
 
@@ -159,8 +167,14 @@
 #include "SimDataFormats/GeneratorProducts/interface/HepMCProduct.h"
 
 #include "TFile.h"
+#include "TMemFile.h"
 #include "TTree.h"
 #include "TMinuit.h"
+#include "TStopwatch.h"
+#include "TThread.h"
+#include "TSystem.h"
+
+#include <sys/resource.h>
 
 
 // To use callgrind for code profiling uncomment also the following define.
@@ -181,6 +195,61 @@ namespace edm {
   class EventSetup;
 }
 
+/**
+ * Pt, eta and deltaPhi cuts on the muon pairs read from a tree, configured in MuScleFitUtils.
+ * It can be passed to the RootTreeHandler to apply the cuts while reading.
+ */
+class MuScleFitPairCuts : public RootTreeHandler::PairSelector
+{
+public:
+  virtual bool operator()( const lorentzVector & mu1, const lorentzVector & mu2 ) const
+  {
+    double pt1 = mu1.pt();
+    double pt2 = mu2.pt();
+    double eta1 = mu1.eta();
+    double eta2 = mu2.eta();
+    bool dontPass = false;
+    bool eta1InFirstRange;
+    bool eta2InFirstRange;
+    bool eta1InSecondRange;
+    bool eta2InSecondRange;
+
+    if( MuScleFitUtils::separateRanges_ ) {
+      eta1InFirstRange = eta1 >= MuScleFitUtils::minMuonEtaFirstRange_ && eta1 < MuScleFitUtils::maxMuonEtaFirstRange_;
+      eta2InFirstRange = eta2 >= MuScleFitUtils::minMuonEtaFirstRange_ && eta2 < MuScleFitUtils::maxMuonEtaFirstRange_;
+      eta1InSecondRange = eta1 >= MuScleFitUtils::minMuonEtaSecondRange_ && eta1 < MuScleFitUtils::maxMuonEtaSecondRange_;
+      eta2InSecondRange = eta2 >= MuScleFitUtils::minMuonEtaSecondRange_ && eta2 < MuScleFitUtils::maxMuonEtaSecondRange_;
+
+      // This is my logic, which should be erroneous, but certainly simpler...
+      if( !(pt1 >= MuScleFitUtils::minMuonPt_ && pt1 < MuScleFitUtils::maxMuonPt_ &&
+	    pt2 >= MuScleFitUtils::minMuonPt_ && pt2 < MuScleFitUtils::maxMuonPt_ &&
+	    eta1InFirstRange && eta2InSecondRange ) ) {
+	dontPass = true;
+      }
+    }
+    else {
+      eta1 = fabs(eta1);
+      eta2 = fabs(eta2);
+      eta1InFirstRange = eta1 >= MuScleFitUtils::minMuonEtaFirstRange_ && eta1 < MuScleFitUtils::maxMuonEtaFirstRange_;
+      eta2InFirstRange = eta2 >= MuScleFitUtils::minMuonEtaFirstRange_ && eta2 < MuScleFitUtils::maxMuonEtaFirstRange_;
+      eta1InSecondRange = eta1 >= MuScleFitUtils::minMuonEtaSecondRange_ && eta1 < MuScleFitUtils::maxMuonEtaSecondRange_;
+      eta2InSecondRange = eta2 >= MuScleFitUtils::minMuonEtaSecondRange_ && eta2 < MuScleFitUtils::maxMuonEtaSecondRange_;
+      if( !(pt1 >= MuScleFitUtils::minMuonPt_ && pt1 < MuScleFitUtils::maxMuonPt_ &&
+	    pt2 >= MuScleFitUtils::minMuonPt_ && pt2 < MuScleFitUtils::maxMuonPt_ &&
+	    ( ((eta1InFirstRange && !eta2InFirstRange) && (eta2InSecondRange && !eta1InSecondRange)) ||
+	      ((eta2InFirstRange && !eta1InFirstRange) && (eta1InSecondRange && !eta2InSecondRange)) )) ) {
+	dontPass = true;
+      }
+    }
+
+    // Additional check on deltaPhi
+    double deltaPhi = MuScleFitUtils::deltaPhi(mu1.phi(), mu2.phi());
+    if( (deltaPhi <= MuScleFitUtils::deltaPhiMinCut_) || (deltaPhi >= MuScleFitUtils::deltaPhiMaxCut_) ) dontPass = true;
+
+    return !dontPass;
+  }
+};
+
 
 class MuScleFit: public edm::EDLooper, MuScleFitBase
 {
@@ -229,6 +298,12 @@ class MuScleFit: public edm::EDLooper, MuScleFitBase
    */
   void selectMuons(const int maxEvents, const TString & treeFileName);
 
+  /**
+   * Matches the names of the trigger paths with the patterns in triggerPath_ and stores the indices of the matching paths
+   * in triggerIndices_. Called on the first event of each run or when the trigger names change.
+   */
+  void resolveTriggerPaths(const edm::Event & event, const edm::EventSetup & eventSetup, const edm::TriggerNames & triggerNames);
+
   /// Template method used to fill the track collection starting from reco::muons or pat::muons
   template<typename T>
   void takeSelectedMuonType(const T & muon, std::vector<reco::Track> & tracks);
@@ -237,9 +312,9 @@ class MuScleFit: public edm::EDLooper, MuScleFitBase
   bool selTrackerMuon(const pat::Muon* aMuon);  
 
   /// Check if two lorentzVector are near in deltaR
-  bool checkDeltaR( reco::Particle::LorentzVector& genMu, reco::Particle::LorentzVector& recMu );
-  /// Fill the reco vs gen and reco vs sim comparison histograms
-  void fillComparisonHistograms( const reco::Particle::LorentzVector & genMu, const reco::Particle::LorentzVector & recoMu, const std::string & inputName, const int charge );
+  bool checkDeltaR( const reco::Particle::LorentzVector & genMu, const reco::Particle::LorentzVector & recMu );
+  /// Fill the reco vs gen (comparison = 0) and reco vs sim (comparison = 1) histograms
+  void fillComparisonHistograms( const reco::Particle::LorentzVector & genMu, const reco::Particle::LorentzVector & recoMu, const int comparison, const int charge );
 
   /// Apply the smearing if needed using the function in MuScleFitUtils
   void applySmearing( reco::Particle::LorentzVector & mu );
@@ -252,6 +327,18 @@ class MuScleFit: public edm::EDLooper, MuScleFitBase
    */
   void checkParameters();
 
+  /// Saves the selected muon pairs (before any correction) to the output root tree, if requested
+  void writeOutputTree();
+  /**
+   * Reads the muon pairs from the input files (or the shared store). Run in the prefetch thread if enabled:
+   * it does not end the job on a read error, which is set in error and reported by selectMuons.
+   */
+  void readInputTree( const int maxEvents, const std::vector<std::string> fileNames, std::string * error );
+  /// Joins the prefetch thread, if running, and prints the startup breakdown
+  void waitForInputTree();
+  /// Prints the resident and the peak resident memory of the process, with the growth of the peak since the first call
+  void printMemoryUsage( const std::string & step );
+
   MuonServiceProxy *theService;
 
   // Counters
@@ -290,15 +377,71 @@ class MuScleFit: public edm::EDLooper, MuScleFitBase
   std::string genParticlesName_;
 
   // Input Root Tree file name. If empty events are read from the edm root file.
+  // It can be a list of files separated by commas and can contain wildcards.
   std::string inputRootTreeFileName_;
+  // Number of threads used to read the input files
+  unsigned int inputRootTreeThreads_;
+  // If true the cuts are applied while reading the tree and the pairs not passing them are dropped
+  bool applyCutsWhileReading_;
+  // If true the input tree is read by a background thread started at the end of the constructor
+  bool prefetchInputTree_;
+  std::auto_ptr<boost::thread> prefetchThread_;
+  bool inputTreePrefetched_;
+  std::string prefetchError_;
+  // Startup breakdown
+  double configurationTime_;
+  double tablesLoadingTime_;
+  double readRealTime_;
+  // If not empty the pairs read from the tree are shared with the other jobs of the node through this directory
+  std::string sharedStoreDirectory_;
+  // Maximum number of segments left in sharedStoreDirectory_ after publishing one (0 means no limit)
+  unsigned int maxSharedStoreSegments_;
+  // If not empty only one shard of the pairs read from the tree is fitted (see MuonPairShards)
+  std::string shardMode_;
+  unsigned int shardFirstEvent_;
+  unsigned int shardMaxEvents_;
+  unsigned int numberOfShards_;
+  unsigned int shardIndex_;
+  int shardFirstRun_;
+  int shardLastRun_;
+  unsigned int shardSeed_;
   // Output Root Tree file name. If not empty events are dumped to this file at the end of the last iteration.
   std::string outputRootTreeFileName_;
   // Maximum number of events from root tree. It works in the same way as the maxEvents to configure a input source.
   int maxEventsFromRootTree_;
+  // Size in bytes of the TTreeCache used to read the input tree (0 = no cache) and parallel unzipping of the baskets
+  int treeCacheSize_;
+  bool parallelUnzip_;
+  // Compression settings (see RootTreeHandler::compressionSettings) of the output tree and of the histogram files
+  // and basket size of the output tree
+  int treeCompression_;
+  int treeBasketSize_;
+  int histogramsCompression_;
+  // Histograms of the loops in per-loop files ("perLoop") or in one file with a directory per loop ("singleFile"),
+  // written by a separate thread if asyncHistogramsWriter_ is true, with at most histogramsWriterQueue_ loops waiting
+  std::string histogramsOutput_;
+  bool asyncHistogramsWriter_;
+  unsigned int histogramsWriterQueue_;
+  std::auto_ptr<MuScleFitHistogramsWriter> histogramsWriter_;
+  // Held while this module does ROOT I/O, which must not overlap the one of the asynchronous histograms writer
+  boost::mutex rootMutex_;
+  // Time from the construction to the first likelihood minimization
+  TStopwatch startupTimer_;
+  bool firstMinimization_;
+  // Time spent selecting the muon pairs from the edm events in the first loop
+  TStopwatch selectionTimer_;
+  // Peak resident memory (KB) at the first printMemoryUsage, before the event selection
+  long peakMemoryBefore_;
 
   std::string triggerResultsLabel_;
   std::string triggerResultsProcess_;
   std::vector<std::string> triggerPath_;
+  // Trigger paths matching triggerPath_ (index and pattern), resolved once per run and trigger menu
+  HLTConfigProvider hltConfig_;
+  std::vector<std::pair<unsigned int, unsigned int> > triggerIndices_;
+  bool triggerIndicesValid_;
+  edm::RunNumber_t triggerIndicesRun_;
+  edm::ParameterSetID triggerNamesID_;
   bool negateTrigger_;
   bool saveAllToTree_;
 
@@ -358,8 +501,15 @@ void MuScleFit::takeSelectedMuonType(const T & muon, std::vector<reco::Track> &
 // -----------
 MuScleFit::MuScleFit( const edm::ParameterSet& pset ) :
   MuScleFitBase( pset ),
-  totalEvents_(0)
+  totalEvents_(0),
+  configurationTime_(0.),
+  tablesLoadingTime_(0.),
+  readRealTime_(0.),
+  firstMinimization_(true),
+  peakMemoryBefore_(-1)
 {
+  startupTimer_.Start();
+  selectionTimer_.Reset();
   MuScleFitUtils::debug = debug_;
   if (debug_>0) std::cout << "[MuScleFit]: Constructor" << std::endl;
 
@@ -454,6 +604,8 @@ MuScleFit::MuScleFit( const edm::ParameterSet& pset ) :
   triggerResultsLabel_ = pset.getUntrackedParameter<std::string>("TriggerResultsLabel");
   triggerResultsProcess_ = pset.getUntrackedParameter<std::string>("TriggerResultsProcess");
   triggerPath_ = pset.getUntrackedParameter<std::vector<std::string> >("TriggerPath");
+  triggerIndicesValid_ = false;
+  triggerIndicesRun_ = 0;
   negateTrigger_ = pset.getUntrackedParameter<bool>("NegateTrigger", false);
   saveAllToTree_ = pset.getUntrackedParameter<bool>("SaveAllToTree", false);
 
@@ -564,33 +716,93 @@ MuScleFit::MuScleFit( const edm::ParameterSet& pset ) :
   inputRootTreeFileName_ = pset.getParameter<std::string>("InputRootTreeFileName");
   outputRootTreeFileName_ = pset.getParameter<std::string>("OutputRootTreeFileName");
   maxEventsFromRootTree_ = pset.getParameter<int>("MaxEventsFromRootTree");
+  treeCacheSize_ = pset.getUntrackedParameter<int>("TreeCacheSize", 30000000);
+  parallelUnzip_ = pset.getUntrackedParameter<bool>("ParallelUnzip", false);
+  treeCompression_ = RootTreeHandler::compressionSettings(pset.getUntrackedParameter<std::string>("TreeCompression", ""),
+                                                          pset.getUntrackedParameter<int>("TreeCompressionLevel", 1));
+  treeBasketSize_ = pset.getUntrackedParameter<int>("TreeBasketSize", 32000);
+  histogramsCompression_ = RootTreeHandler::compressionSettings(pset.getUntrackedParameter<std::string>("HistogramsCompression", ""),
+                                                                pset.getUntrackedParameter<int>("HistogramsCompressionLevel", 1));
+  if( treeCompression_ == -2 || histogramsCompression_ == -2 ) {
+    exit(1);
+  }
+  histogramsOutput_ = pset.getUntrackedParameter<std::string>("HistogramsOutput", "perLoop");
+  if( histogramsOutput_ != "perLoop" && histogramsOutput_ != "singleFile" ) {
+    std::cout << "Unknown HistogramsOutput " << histogramsOutput_ << ". Valid values are perLoop and singleFile" << std::endl;
+    exit(1);
+  }
+  asyncHistogramsWriter_ = pset.getUntrackedParameter<bool>("AsyncHistogramsWriter", false);
+  histogramsWriterQueue_ = pset.getUntrackedParameter<unsigned int>("HistogramsWriterQueue", 1);
+  inputRootTreeThreads_ = pset.getUntrackedParameter<unsigned int>("InputRootTreeThreads", 4);
+  applyCutsWhileReading_ = pset.getUntrackedParameter<bool>("ApplyCutsWhileReading", false);
+  prefetchInputTree_ = pset.getUntrackedParameter<bool>("PrefetchInputTree", false);
+  sharedStoreDirectory_ = pset.getUntrackedParameter<std::string>("SharedStoreDirectory", "");
+  maxSharedStoreSegments_ = pset.getUntrackedParameter<unsigned int>("MaxSharedStoreSegments", 0);
+  shardMode_ = pset.getUntrackedParameter<std::string>("ShardMode", "");
+  shardFirstEvent_ = pset.getUntrackedParameter<unsigned int>("ShardFirstEvent", 0);
+  shardMaxEvents_ = pset.getUntrackedParameter<unsigned int>("ShardMaxEvents", 0);
+  numberOfShards_ = pset.getUntrackedParameter<unsigned int>("NumberOfShards", 1);
+  shardIndex_ = pset.getUntrackedParameter<unsigned int>("ShardIndex", 0);
+  shardFirstRun_ = pset.getUntrackedParameter<int>("ShardFirstRun", 0);
+  shardLastRun_ = pset.getUntrackedParameter<int>("ShardLastRun", 0);
+  shardSeed_ = pset.getUntrackedParameter<unsigned int>("ShardSeed", 4357);
 
   MuScleFitUtils::startWithSimplex_ = pset.getParameter<bool>("StartWithSimplex");
   MuScleFitUtils::computeMinosErrors_ = pset.getParameter<bool>("ComputeMinosErrors");
   MuScleFitUtils::minimumShapePlots_ = pset.getParameter<bool>("MinimumShapePlots");
 
+  configurationTime_ = startupTimer_.RealTime();
+  startupTimer_.Continue();
+
+  TStopwatch tablesTimer;
   beginOfJobInConstructor();
+  tablesLoadingTime_ = tablesTimer.RealTime();
+
+  // Start reading the tree while the framework completes the startup. The reading changes the current ROOT
+  // directory and the global lists of files, so it must not overlap the ROOT I/O of this module: it is started
+  // after the probability tables are loaded and the output files created, and joined in startingNewLoop,
+  // before the histograms are booked.
+  // Without the fast loop the edm events are also read in the first loop, so the tree is read there.
+  inputTreePrefetched_ = false;
+  if( prefetchInputTree_ && fastLoop && !(inputRootTreeFileName_.empty()) ) {
+    TThread::Initialize();
+    std::cout << "Reading muon pairs from Root Tree in " << inputRootTreeFileName_ << " in the background" << std::endl;
+    // Expanded here: a missing file ends the job in this thread
+    std::vector<std::string> fileNames(RootTreeHandler::expandFileNames(inputRootTreeFileName_));
+    prefetchThread_.reset(new boost::thread(boost::bind(&MuScleFit::readInputTree, this,
+                                                        maxEventsFromRootTree_, fileNames, &prefetchError_)));
+    inputTreePrefetched_ = true;
+  }
 }
 
 // Destructor
 // ----------
 MuScleFit::~MuScleFit () {
   if (debug_>0) std::cout << "[MuScleFit]: Destructor" << std::endl;
+  if( prefetchThread_.get() != 0 ) prefetchThread_->join();
+  if( histogramsWriter_.get() != 0 ) histogramsWriter_->finish();
   std::cout << "Total number of analyzed events = " << totalEvents_ << std::endl;
+}
 
+void MuScleFit::writeOutputTree()
+{
   if( !(outputRootTreeFileName_.empty()) ) {
     // Save the events to a root tree unless we are reading from the edm root file and the SavedPair size is different from the totalEvents_
     if( !(inputRootTreeFileName_.empty() && (int(MuScleFitUtils::SavedPair.size()) != totalEvents_)) ) {
       std::cout << "Saving muon pairs to root tree" << std::endl;
+      TStopwatch writeTimer;
       RootTreeHandler rootTreeHandler;
+      rootTreeHandler.setCompression(treeCompression_);
+      rootTreeHandler.setBasketSize(treeBasketSize_);
       if( MuScleFitUtils::speedup ) {
-        // rootTreeHandler.writeTree(outputRootTreeFileName_, &(MuScleFitUtils::SavedPair), theMuonType_, 0, saveAllToTree_);
-        rootTreeHandler.writeTree(outputRootTreeFileName_, &(muonPairs_), theMuonType_, 0, saveAllToTree_);
+        rootTreeHandler.writeTree(outputRootTreeFileName_, &(MuScleFitUtils::SavedPair), &evtRun_, theMuonType_, 0, 0, saveAllToTree_);
       }
       else {
-        // rootTreeHandler.writeTree(outputRootTreeFileName_, &(MuScleFitUtils::SavedPair), theMuonType_, &(MuScleFitUtils::genPair), saveAllToTree_ );
-        rootTreeHandler.writeTree(outputRootTreeFileName_, &(muonPairs_), theMuonType_, &(genMuonPairs_), saveAllToTree_ );
+        rootTreeHandler.writeTree(outputRootTreeFileName_, &(MuScleFitUtils::SavedPair), &evtRun_, theMuonType_,
+                                  &(MuScleFitUtils::genPair), genMotherId_.empty() ? 0 : &genMotherId_, saveAllToTree_ );
       }
+      writeTimer.Stop();
+      std::cout << "Muon pairs written in real = " << writeTimer.RealTime() << " s, cpu = " << writeTimer.CpuTime() << " s" << std::endl;
     }
     else {
       std::cout << "ERROR: events in the vector = " << MuScleFitUtils::SavedPair.size() << " != totalEvents = " << totalEvents_ << std::endl;
@@ -598,6 +810,25 @@ MuScleFit::~MuScleFit () {
   }
 }
 
+void MuScleFit::printMemoryUsage( const std::string & step )
+{
+  ProcInfo_t procInfo;
+  gSystem->GetProcInfo(&procInfo);
+  // ru_maxrss is the peak resident memory, in KB on linux and in bytes on mac
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  long peakMemory = usage.ru_maxrss/1024;
+#else
+  long peakMemory = usage.ru_maxrss;
+#endif
+  std::cout << "[MuScleFit]: memory " << step << ": resident = " << procInfo.fMemResident/1024.
+            << " MB, peak = " << peakMemory/1024. << " MB";
+  if( peakMemoryBefore_ < 0 ) peakMemoryBefore_ = peakMemory;
+  else std::cout << " (peak increase = " << (peakMemory - peakMemoryBefore_)/1024. << " MB)";
+  std::cout << std::endl;
+}
+
 // Begin job
 // ---------
 void MuScleFit::beginOfJobInConstructor()
@@ -614,14 +845,32 @@ void MuScleFit::beginOfJobInConstructor()
 
   // Create the root file
   // --------------------
+  // With a single output file the loops are booked in memory files copied to the output file by the writer
+  TFile * outputFile = 0;
+  if( histogramsOutput_ == "singleFile" ) {
+    outputFile = new TFile(theRootFileName_.c_str(), "RECREATE");
+    if( histogramsCompression_ >= 0 ) outputFile->SetCompressionSettings(histogramsCompression_);
+  }
   for (unsigned int i=0; i<(maxLoopNumber); i++) {
     std::stringstream ss;
     ss << i;
     std::string rootFileName = ss.str() + "_" + theRootFileName_;
-    theFiles_.push_back (new TFile(rootFileName.c_str(), "RECREATE"));
+    if( outputFile != 0 ) {
+      theFiles_.push_back (new TMemFile(rootFileName.c_str(), "RECREATE"));
+      theFiles_.back()->SetCompressionSettings(0);
+    }
+    else {
+      theFiles_.push_back (new TFile(rootFileName.c_str(), "RECREATE"));
+      if( histogramsCompression_ >= 0 ) theFiles_.back()->SetCompressionSettings(histogramsCompression_);
+    }
   }
   if (debug_>0) std::cout << "[MuScleFit]: Root file created" << std::endl;
 
+  if( outputFile != 0 || asyncHistogramsWriter_ ) {
+    if( asyncHistogramsWriter_ ) TThread::Initialize();
+    histogramsWriter_.reset(new MuScleFitHistogramsWriter(asyncHistogramsWriter_, histogramsWriterQueue_, rootMutex_, outputFile));
+  }
+
   std::cout << "creating plotter" << std::endl;
   plotter = new MuScleFitPlotter(theGenInfoRootFileName_);
   plotter->debug = debug_;
@@ -639,6 +888,9 @@ void MuScleFit::startingNewLoop( unsigned int iLoop )
 {
   if (debug_>0) std::cout << "[MuScleFit]: Starting loop # " << iLoop << std::endl;
 
+  // No ROOT I/O while the prefetch thread reads the tree
+  waitForInputTree();
+
   // Number of muons used
   // --------------------
   MuScleFitUtils::goodmuon = 0;
@@ -649,7 +901,10 @@ void MuScleFit::startingNewLoop( unsigned int iLoop )
 
   // Create the root file
   // --------------------
-  fillHistoMap(theFiles_[iLoop], iLoop);
+  {
+    boost::mutex::scoped_lock rootLock(rootMutex_);
+    fillHistoMap(theFiles_[iLoop], iLoop);
+  }
 
   loopCounter = iLoop;
   MuScleFitUtils::loopCounter = loopCounter;
@@ -658,6 +913,8 @@ void MuScleFit::startingNewLoop( unsigned int iLoop )
   MuScleFitUtils::iev_ = 0;
 
   MuScleFitUtils::oldNormalization_ = 0;
+
+  if( iLoop == 0 ) printMemoryUsage("before the event selection");
 }
 
 // End of loop routine
@@ -677,6 +934,17 @@ edm::EDLooper::Status MuScleFit::endOfLoop( const edm::EventSetup& eventSetup, u
     endOfFastLoop(iLoop);
   }
 
+  // The pairs in SavedPair are corrected in place by the following loops, save them now
+  if( iLoop == 0 ) {
+    if( inputRootTreeFileName_.empty() && totalEvents_ > 0 ) {
+      std::cout << "[MuScleFit]: muon selection on " << totalEvents_ << " edm events: real = " << selectionTimer_.RealTime()
+                << " s, cpu = " << selectionTimer_.CpuTime() << " s (" << totalEvents_/selectionTimer_.CpuTime()
+                << " events/cpu s)" << std::endl;
+    }
+    printMemoryUsage("after the event selection");
+    writeOutputTree();
+  }
+
   // If a fastLoop is required we do all the remaining iterations here
   if( fastLoop == true ) {
     for( ; iFastLoop<maxLoopNumber; ++iFastLoop ) {
@@ -703,6 +971,8 @@ edm::EDLooper::Status MuScleFit::endOfLoop( const edm::EventSetup& eventSetup, u
   }
 
   if (iFastLoop>=maxLoopNumber-1) {
+    // Wait for the histograms of the last loops to be written
+    if( histogramsWriter_.get() != 0 ) histogramsWriter_->finish();
     return kStop;
   } else {
     return kContinue;
@@ -713,6 +983,9 @@ void MuScleFit::endOfFastLoop( const unsigned int iLoop )
 {
   // std::cout<< "Inside endOfFastLoop, iLoop = " << iLoop << " and loopCounter = " << loopCounter << std::endl;
 
+  // The plots, the minimization and the closing of the files do ROOT I/O: the asynchronous writer waits
+  boost::unique_lock<boost::mutex> rootLock(rootMutex_);
+
   if( loopCounter == 0 ) {
     // plotter->writeHistoMap();
     // The destructor will call the writeHistoMap after the cd to the output file
@@ -723,15 +996,36 @@ void MuScleFit::endOfFastLoop( const unsigned int iLoop )
 
   // Write the histos to file
   // ------------------------
+  // With the writer the histograms are written after the minimization, which uses the same file,
+  // by the writer (while the next loop runs, if asynchronous)
   // theFiles_[iLoop]->cd();
-  writeHistoMap(iLoop);
+  if( histogramsWriter_.get() == 0 ) writeHistoMap(iLoop);
 
   // Likelihood minimization to compute corrections
   // ----------------------------------------------
   // theFiles_[iLoop]->cd();
   TDirectory * likelihoodDir = theFiles_[iLoop]->mkdir("likelihood");
   likelihoodDir->cd();
+  if( firstMinimization_ ) {
+    startupTimer_.Stop();
+    std::cout << "[MuScleFit]: time to first likelihood evaluation: real = " << startupTimer_.RealTime()
+              << " s, cpu = " << startupTimer_.CpuTime() << " s" << std::endl;
+    firstMinimization_ = false;
+  }
   MuScleFitUtils::minimizeLikelihood();
+  if( iLoop == 0 ) printMemoryUsage("after the first likelihood minimization");
+
+  if( histogramsWriter_.get() != 0 ) {
+    std::stringstream directory;
+    directory << "loop_" << iLoop;
+    // The current directory is in the file handed over to the writer
+    gROOT->cd();
+    // Released before write, which can wait for the writer to finish a loop
+    rootLock.unlock();
+    histogramsWriter_->write(releaseHistoMap(), theFiles_[iLoop], directory.str());
+    theFiles_[iLoop] = 0;
+    return;
+  }
 
   // ATTENTION, this was put BEFORE the minimizeLikelihood. Check for problems.
   theFiles_[iLoop]->Close();
@@ -743,6 +1037,30 @@ void MuScleFit::endOfFastLoop( const unsigned int iLoop )
   clearHistoMap();
 }
 
+void MuScleFit::resolveTriggerPaths( const edm::Event & event, const edm::EventSetup & eventSetup,
+                                     const edm::TriggerNames & triggerNames )
+{
+  if( !triggerIndicesValid_ || event.id().run() != triggerIndicesRun_ ) {
+    bool changed;
+    hltConfig_.init(event.getRun(), eventSetup, triggerResultsProcess_, changed);
+  }
+  triggerIndices_.clear();
+  for (unsigned i=0; i<triggerNames.size(); i++) {
+    const std::string & hltName = triggerNames.triggerName(i);
+
+    // match the path in the pset with the true name of the trigger
+    for ( unsigned int ipath=0; ipath<triggerPath_.size(); ipath++ ) {
+      if ( hltName.find(triggerPath_[ipath]) != std::string::npos ) {
+        triggerIndices_.push_back(std::make_pair(hltConfig_.triggerIndex(hltName), ipath));
+      }
+    }
+  }
+  triggerIndicesValid_ = true;
+  triggerIndicesRun_ = event.id().run();
+  triggerNamesID_ = triggerNames.parameterSetID();
+  if( debug_>0 ) std::cout << "Resolved " << triggerIndices_.size() << " trigger paths for run " << triggerIndicesRun_ << std::endl;
+}
+
 // Stuff to do during loop
 // -----------------------
 edm::EDLooper::Status MuScleFit::duringLoop( const edm::Event & event, const edm::EventSetup& eventSetup )
@@ -760,31 +1078,21 @@ edm::EDLooper::Status MuScleFit::duringLoop( const edm::Event & event, const edm
       std::cout<<"Trigger "<<isFired<<std::endl;
   }
   else{
-    bool changed;
-    HLTConfigProvider hltConfig;
-    hltConfig.init(event.getRun(), eventSetup, triggerResultsProcess_, changed);
-
-
-    const edm::TriggerNames triggerNames = event.triggerNames(*triggerResults); 
-
-    for (unsigned i=0; i<triggerNames.size(); i++) { 
-      std::string hltName = triggerNames.triggerName(i);
-
-      // match the path in the pset with the true name of the trigger  
-      for ( unsigned int ipath=0; ipath<triggerPath_.size(); ipath++ ) {
-	if ( hltName.find(triggerPath_[ipath]) != std::string::npos ) {
-	    unsigned int triggerIndex( hltConfig.triggerIndex(hltName) );
-	  
-	  // triggerIndex must be less than the size of HLTR or you get a CMSException: _M_range_check
-	    if (triggerIndex < triggerResults->size()) {
-	      isFired = triggerResults->accept(triggerIndex);
-	      if(debug_>0) 
-		std::cout << triggerPath_[ipath] <<" "<< hltName << " " << isFired<<std::endl;
-	    }	    
-	} // end if (matching the path in the pset with the true trigger name      
-      }
+    const edm::TriggerNames & triggerNames = event.triggerNames(*triggerResults);
+    if( !triggerIndicesValid_ || event.id().run() != triggerIndicesRun_ || triggerNames.parameterSetID() != triggerNamesID_ ) {
+      resolveTriggerPaths(event, eventSetup, triggerNames);
     }
 
+    // The matching paths are in the order of the trigger names: as before, the last one decides
+    for( std::vector<std::pair<unsigned int, unsigned int> >::const_iterator path = triggerIndices_.begin();
+         path != triggerIndices_.end(); ++path ) {
+      // triggerIndex must be less than the size of HLTR or you get a CMSException: _M_range_check
+      if (path->first < triggerResults->size()) {
+        isFired = triggerResults->accept(path->first);
+        if(debug_>0)
+          std::cout << triggerPath_[path->second] <<" "<< triggerNames.triggerName(path->first) << " " << isFired<<std::endl;
+      }
+    }
   }
 
   if( negateTrigger_ && isFired ) return kContinue;
@@ -808,7 +1116,9 @@ edm::EDLooper::Status MuScleFit::duringLoop( const edm::Event & event, const edm
 
     if( !fastLoop || inputRootTreeFileName_.empty() ) {
       if( debug_ > 0 ) std::cout << "Reading from edm event" << std::endl;
+      selectionTimer_.Start(kFALSE);
       selectMuons(event);
+      selectionTimer_.Stop();
       duringFastLoop();
       ++totalEvents_;
     }
@@ -828,6 +1138,7 @@ void MuScleFit::selectMuons(const edm::Event & event)
   recMu2 = reco::Particle::LorentzVector(0,0,0,0);
 
   std::vector<reco::LeafCandidate> muons;
+  genMuonPairs_.clear();
   muonSelector_->selectMuons(event, muons, genMuonPairs_, MuScleFitUtils::simPair, plotter);
   //  plotter->fillRec(muons); // @EM method already invoked inside MuScleFitMuonSelector::selectMuons()
 
@@ -855,107 +1166,130 @@ void MuScleFit::selectMuons(const edm::Event & event)
   } else {
     MuScleFitUtils::SavedPair.push_back( std::make_pair( lorentzVector(0.,0.,0.,0.), lorentzVector(0.,0.,0.,0.) ) );
   }
-  // Save the events also in the external tree so that it can be saved late
+  // Save the run and event number so that the events can be saved later
 
   // std::cout << "SavedPair->size() " << MuScleFitUtils::SavedPair.size() << std::endl;
-  muonPairs_.push_back(MuonPair(MuScleFitUtils::SavedPair.back().first,
-				MuScleFitUtils::SavedPair.back().second,
-				event.run(), event.id().event()));
-  // Fill the internal genPair tree from the external one
+  evtRun_.push_back(std::make_pair(int(event.id().event()), int(event.run())));
+  // Fill the internal genPair tree from the one returned by the selector
   if( MuScleFitUtils::speedup == false ) {
     MuScleFitUtils::genPair.push_back(std::make_pair( genMuonPairs_.back().mu1, genMuonPairs_.back().mu2 ));
+    genMotherId_.push_back(genMuonPairs_.back().motherId);
+  }
+}
+
+void MuScleFit::readInputTree( const int maxEvents, const std::vector<std::string> fileNames, std::string * error )
+{
+  TStopwatch readTimer;
+  RootTreeHandler rootTreeHandler(treeCacheSize_, parallelUnzip_);
+  std::cout << "Reading " << fileNames.size() << " file(s) with up to " << inputRootTreeThreads_ << " threads" << std::endl;
+  MuScleFitPairCuts pairCuts;
+  const RootTreeHandler::PairSelector * selector = applyCutsWhileReading_ ? &pairCuts : 0;
+  MuonPairEvents * genPair = MuScleFitUtils::speedup ? 0 : &(MuScleFitUtils::genPair);
+
+  // The segment depends on everything that changes the pairs read: the cuts only matter if applied while reading
+  MuonPairSharedStore sharedStore(sharedStoreDirectory_);
+  std::string segment;
+  bool attached = false;
+  if( !sharedStoreDirectory_.empty() ) {
+    std::stringstream selection;
+    selection << maxEvents << ";" << theMuonType_ << ";" << applyCutsWhileReading_;
+    if( applyCutsWhileReading_ ) {
+      selection << ";" << MuScleFitUtils::separateRanges_ << ";" << MuScleFitUtils::minMuonPt_ << ";" << MuScleFitUtils::maxMuonPt_
+                << ";" << MuScleFitUtils::minMuonEtaFirstRange_ << ";" << MuScleFitUtils::maxMuonEtaFirstRange_
+                << ";" << MuScleFitUtils::minMuonEtaSecondRange_ << ";" << MuScleFitUtils::maxMuonEtaSecondRange_
+                << ";" << MuScleFitUtils::deltaPhiMinCut_ << ";" << MuScleFitUtils::deltaPhiMaxCut_;
+    }
+    segment = sharedStore.segmentName(fileNames, selection.str());
+    attached = sharedStore.attach(segment, &(MuScleFitUtils::SavedPair), &evtRun_, genPair);
+    if( attached ) std::cout << "Attached shared store " << segment << std::endl;
+  }
+  if( !attached ) {
+    MuonPairVector savedPairVector;
+    MuonPairVector genPairVector;
+    *error = rootTreeHandler.readFiles(maxEvents, fileNames, &savedPairVector, theMuonType_, &evtRun_,
+                                       genPair != 0 ? &genPairVector : 0, inputRootTreeThreads_, selector);
+    if( !error->empty() ) return;
+    MuScleFitUtils::SavedPair.swap(savedPairVector);
+    if( genPair != 0 ) genPair->swap(genPairVector);
+    if( !segment.empty() && sharedStore.publish(segment, MuScleFitUtils::SavedPair, evtRun_, genPair) ) {
+      std::cout << "Published shared store " << segment << std::endl;
+      if( maxSharedStoreSegments_ > 0 ) sharedStore.removeOldSegments(maxSharedStoreSegments_);
+    }
+  }
+  readTimer.Stop();
+  readRealTime_ = readTimer.RealTime();
+  std::cout << "Read " << MuScleFitUtils::SavedPair.size() << " muon pairs in real = " << readRealTime_
+            << " s, cpu = " << readTimer.CpuTime() << " s" << std::endl;
+}
+
+void MuScleFit::waitForInputTree()
+{
+  if( prefetchThread_.get() != 0 ) {
+    TStopwatch waitTimer;
+    prefetchThread_->join();
+    prefetchThread_.reset();
+    std::cout << "[MuScleFit]: startup breakdown: configuration = " << configurationTime_
+              << " s, probability tables and output files = " << tablesLoadingTime_
+              << " s, tree reading (background) = " << readRealTime_
+              << " s, wait for the tree = " << waitTimer.RealTime() << " s" << std::endl;
   }
 }
 
 void MuScleFit::selectMuons(const int maxEvents, const TString & treeFileName)
 {
-  std::cout << "Reading muon pairs from Root Tree in " << treeFileName << std::endl;
-  RootTreeHandler rootTreeHandler;
-  std::vector<std::pair<int, int> > evtRun;
-  if( MuScleFitUtils::speedup ) {
-    rootTreeHandler.readTree(maxEvents, inputRootTreeFileName_, &(MuScleFitUtils::SavedPair), theMuonType_, &evtRun);
+  // Sync point with the prefetch thread
+  std::string readError;
+  if( inputTreePrefetched_ ) {
+    waitForInputTree();
+    readError = prefetchError_;
   }
   else {
-    rootTreeHandler.readTree(maxEvents, inputRootTreeFileName_, &(MuScleFitUtils::SavedPair), theMuonType_, &evtRun, &(MuScleFitUtils::genPair));
+    std::cout << "Reading muon pairs from Root Tree in " << treeFileName << std::endl;
+    readInputTree(maxEvents, RootTreeHandler::expandFileNames(treeFileName.Data()), &readError);
+  }
+  if( !readError.empty() ) {
+    std::cout << "ERROR: " << readError << std::endl;
+    exit(1);
+  }
+
+  MuScleFitPairCuts pairCuts;
+  // Keep only the requested shard. The pairs are selected in memory, the tree is not split on disk.
+  if( !shardMode_.empty() ) {
+    MuonPairShards::View shard;
+    if( !MuonPairShards::build(shardMode_, evtRun_, shardFirstEvent_, shardMaxEvents_, numberOfShards_, shardIndex_,
+                               shardFirstRun_, shardLastRun_, shardSeed_, shard) ) {
+      exit(1);
+    }
+    MuonPairShards::select(MuScleFitUtils::SavedPair, shard);
+    MuonPairShards::select(evtRun_, shard);
+    if( !(MuScleFitUtils::speedup) ) MuonPairShards::select(MuScleFitUtils::genPair, shard);
+    std::cout << "Fitting the " << shardMode_ << " shard with " << MuScleFitUtils::SavedPair.size() << " muon pairs" << std::endl;
   }
-  // Now loop on all the pairs and apply any smearing and bias if needed
-  std::vector<std::pair<int, int> >::iterator evtRunIt = evtRun.begin();
-  std::vector<std::pair<lorentzVector,lorentzVector> >::iterator it = MuScleFitUtils::SavedPair.begin();
-  std::vector<std::pair<lorentzVector,lorentzVector> >::iterator genIt;
-  if(MuScleFitUtils::speedup == false) genIt = MuScleFitUtils::genPair.begin();
-  for( ; it != MuScleFitUtils::SavedPair.end(); ++it, ++evtRunIt ) {
+  // Now loop on all the pairs and apply any smearing and bias if needed.
+  // The pairs are only modified (and then copied if shared, see MuonPairEvents) if needed.
+  const bool smearOrBias = (MuScleFitUtils::SmearType != 0) || (MuScleFitUtils::BiasType != 0);
+  for( unsigned int i=0; i<MuScleFitUtils::SavedPair.size(); ++i ) {
+    std::pair<lorentzVector,lorentzVector> pair(MuScleFitUtils::SavedPair[i]);
 
     // Apply any cut if requested
     // Note that cuts here are only applied to already selected muons. They should not be used unless
     // you are sure that the difference is negligible (e.g. the number of events with > 2 muons is negligible).
-    double pt1 = it->first.pt();
-    // std::cout << "pt1 = " << pt1 << std::endl;
-    double pt2 = it->second.pt();
-    // std::cout << "pt2 = " << pt2 << std::endl;
-    double eta1 = it->first.eta();
-    // std::cout << "eta1 = " << eta1 << std::endl;
-    double eta2 = it->second.eta();
-    // std::cout << "eta2 = " << eta2 << std::endl;
     // If they don't pass the cuts set to null vectors
-    bool dontPass = false;
-    bool eta1InFirstRange; 
-    bool eta2InFirstRange; 
-    bool eta1InSecondRange; 
-    bool eta2InSecondRange; 
-
-    if( MuScleFitUtils::separateRanges_ ) {
-      eta1InFirstRange = eta1 >= MuScleFitUtils::minMuonEtaFirstRange_ && eta1 < MuScleFitUtils::maxMuonEtaFirstRange_;
-      eta2InFirstRange = eta2 >= MuScleFitUtils::minMuonEtaFirstRange_ && eta2 < MuScleFitUtils::maxMuonEtaFirstRange_;
-      eta1InSecondRange = eta1 >= MuScleFitUtils::minMuonEtaSecondRange_ && eta1 < MuScleFitUtils::maxMuonEtaSecondRange_;
-      eta2InSecondRange = eta2 >= MuScleFitUtils::minMuonEtaSecondRange_ && eta2 < MuScleFitUtils::maxMuonEtaSecondRange_;
-
-      // This is my logic, which should be erroneous, but certainly simpler...
-      if( !(pt1 >= MuScleFitUtils::minMuonPt_ && pt1 < MuScleFitUtils::maxMuonPt_ &&
-	    pt2 >= MuScleFitUtils::minMuonPt_ && pt2 < MuScleFitUtils::maxMuonPt_ &&
-	    eta1InFirstRange && eta2InSecondRange ) ) {
-	dontPass = true;
-      }
-    }
-    else {
-      eta1 = fabs(eta1);
-      eta2 = fabs(eta2);
-      eta1InFirstRange = eta1 >= MuScleFitUtils::minMuonEtaFirstRange_ && eta1 < MuScleFitUtils::maxMuonEtaFirstRange_;
-      eta2InFirstRange = eta2 >= MuScleFitUtils::minMuonEtaFirstRange_ && eta2 < MuScleFitUtils::maxMuonEtaFirstRange_;
-      eta1InSecondRange = eta1 >= MuScleFitUtils::minMuonEtaSecondRange_ && eta1 < MuScleFitUtils::maxMuonEtaSecondRange_;
-      eta2InSecondRange = eta2 >= MuScleFitUtils::minMuonEtaSecondRange_ && eta2 < MuScleFitUtils::maxMuonEtaSecondRange_;
-      if( !(pt1 >= MuScleFitUtils::minMuonPt_ && pt1 < MuScleFitUtils::maxMuonPt_ &&
-	    pt2 >= MuScleFitUtils::minMuonPt_ && pt2 < MuScleFitUtils::maxMuonPt_ &&
-	    ( ((eta1InFirstRange && !eta2InFirstRange) && (eta2InSecondRange && !eta1InSecondRange)) ||
-	      ((eta2InFirstRange && !eta1InFirstRange) && (eta1InSecondRange && !eta2InSecondRange)) )) ) {
-	dontPass = true;
-      }
-    }
-    
-    // Additional check on deltaPhi
-    double deltaPhi = MuScleFitUtils::deltaPhi(it->first.phi(), it->second.phi());
-    if( (deltaPhi <= MuScleFitUtils::deltaPhiMinCut_) || (deltaPhi >= MuScleFitUtils::deltaPhiMaxCut_) ) dontPass = true;
-    
-    if( dontPass ) {
+    bool failsCuts = !applyCutsWhileReading_ && !pairCuts(pair.first, pair.second);
+    if( failsCuts ) {
       // std::cout << "removing muons not passing cuts" << std::endl;
-      it->first = reco::Particle::LorentzVector(0,0,0,0);
-      it->second = reco::Particle::LorentzVector(0,0,0,0);
+      pair.first = reco::Particle::LorentzVector(0,0,0,0);
+      pair.second = reco::Particle::LorentzVector(0,0,0,0);
     }
 
     // First is always mu-, second mu+
-    if( (MuScleFitUtils::SmearType != 0) || (MuScleFitUtils::BiasType != 0) ) {
-      applySmearing(it->first);
-      applyBias(it->first, -1);
-      applySmearing(it->second);
-      applyBias(it->second, 1);
-    }
-    muonPairs_.push_back(MuonPair(it->first, it->second,
-		         evtRunIt->second, evtRunIt->first));
-
-    // Fill the internal genPair tree from the external one
-    if( MuScleFitUtils::speedup == false ) {
-      genMuonPairs_.push_back(GenMuonPair(genIt->first, genIt->second, 0));
-      ++genIt;
+    if( smearOrBias ) {
+      applySmearing(pair.first);
+      applyBias(pair.first, -1);
+      applySmearing(pair.second);
+      applyBias(pair.second, 1);
     }
+    if( failsCuts || smearOrBias ) MuScleFitUtils::SavedPair.set(i, pair);
   }
   plotter->fillTreeRec(MuScleFitUtils::SavedPair);
   if( !(MuScleFitUtils::speedup) ) {
@@ -1008,25 +1342,29 @@ void MuScleFit::duringFastLoop()
 
     //Fill histograms
     //------------------
-   
-    mapHisto_["hRecBestMu"]->Fill(recMu1, -1,weight);
-    mapHisto_["hRecBestMuVSEta"]->Fill(recMu1);
-    mapHisto_["hRecBestMu"]->Fill(recMu2, +1,weight);
-    mapHisto_["hRecBestMuVSEta"]->Fill(recMu2);
-    mapHisto_["hDeltaRecBestMu"]->Fill(recMu1, recMu2);
-    // Reconstructed resonance
-    mapHisto_["hRecBestRes"]->Fill(bestRecRes,+1, weight);
-    mapHisto_["hRecBestResAllEvents"]->Fill(bestRecRes,+1, 1.);
+    // Only the families booked for the HistogramsProfile are filled (and their inputs computed)
+    if( histoFamily(kinematics) ) {
+      histo_.hRecBestMu->Fill(recMu1, -1,weight);
+      histo_.hRecBestMuVSEta->Fill(recMu1);
+      histo_.hRecBestMu->Fill(recMu2, +1,weight);
+      histo_.hRecBestMuVSEta->Fill(recMu2);
+      histo_.hDeltaRecBestMu->Fill(recMu1, recMu2);
+      // Reconstructed resonance
+      histo_.hRecBestRes->Fill(bestRecRes,+1, weight);
+      histo_.hRecBestResAllEvents->Fill(bestRecRes,+1, 1.);
+    }
 //     // Fill histogram of Res mass vs muon variables
 //     mapHisto_["hRecBestResVSMu"]->Fill (recMu1, bestRecRes, -1);
 //     mapHisto_["hRecBestResVSMu"]->Fill (recMu2, bestRecRes, +1);
 //     // Fill also the mass mu+/mu- comparisons
 //     mapHisto_["hRecBestResVSMu"]->Fill(recMu1, recMu2, bestRecRes);
 
-    mapHisto_["hRecBestResVSMu"]->Fill (recMu1, bestRecRes, -1, weight);
-    mapHisto_["hRecBestResVSMu"]->Fill (recMu2, bestRecRes, +1, weight);
-    // Fill also the mass mu+/mu- comparisons
-    mapHisto_["hRecBestResVSMu"]->Fill(recMu1, recMu2, bestRecRes, weight);
+    if( histoFamily(massVSMuon) ) {
+      histo_.hRecBestResVSMu->Fill (recMu1, bestRecRes, -1, weight);
+      histo_.hRecBestResVSMu->Fill (recMu2, bestRecRes, +1, weight);
+      // Fill also the mass mu+/mu- comparisons
+      histo_.hRecBestResVSMu->Fill(recMu1, recMu2, bestRecRes, weight);
+    }
     
     //-- rc 2010 filling histograms for mu+ /mu- ------
     //  mapHisto_["hRecBestResVSMuMinus"]->Fill (recMu1, bestRecRes, -1);
@@ -1038,7 +1376,7 @@ void MuScleFit::duringFastLoop()
 
     // Fill histogram of Res mass vs Res variables
     // mapHisto_["hRecBestResVSRes"]->Fill (bestRecRes, bestRecRes, +1);
-    mapHisto_["hRecBestResVSRes"]->Fill (bestRecRes, bestRecRes, +1, weight);
+    if( histoFamily(massVSMuon) ) histo_.hRecBestResVSRes->Fill (bestRecRes, bestRecRes, +1, weight);
 
 
 
@@ -1061,22 +1399,22 @@ void MuScleFit::duringFastLoop()
 
     //Compute pt resolution w.r.t generated and simulated muons
     //--------------------------------------------------------
-    if( !MuScleFitUtils::speedup ) {
+    if( !MuScleFitUtils::speedup && histoFamily(resolution) ) {
 
       //first is always mu-, second is always mu+
       if(checkDeltaR(MuScleFitUtils::genPair[iev].first,recMu1)) {
-        fillComparisonHistograms( MuScleFitUtils::genPair[iev].first, recMu1, "Gen", -1 );
+        fillComparisonHistograms( MuScleFitUtils::genPair[iev].first, recMu1, 0, -1 );
       }
       if(checkDeltaR(MuScleFitUtils::genPair[iev].second,recMu2)){
-        fillComparisonHistograms( MuScleFitUtils::genPair[iev].second, recMu2, "Gen", +1 );
+        fillComparisonHistograms( MuScleFitUtils::genPair[iev].second, recMu2, 0, +1 );
       }
       if( compareToSimTracks_ ) {
         //first is always mu-, second is always mu+
         if(checkDeltaR(MuScleFitUtils::simPair[iev].first,recMu1)){
-          fillComparisonHistograms( MuScleFitUtils::simPair[iev].first, recMu1, "Sim", -1 );
+          fillComparisonHistograms( MuScleFitUtils::simPair[iev].first, recMu1, 1, -1 );
         }
         if(checkDeltaR(MuScleFitUtils::simPair[iev].second,recMu2)){
-          fillComparisonHistograms( MuScleFitUtils::simPair[iev].second, recMu2, "Sim", +1 );
+          fillComparisonHistograms( MuScleFitUtils::simPair[iev].second, recMu2, 1, +1 );
         }
       }
     }
@@ -1085,17 +1423,20 @@ void MuScleFit::duringFastLoop()
     // Fill also the resolution histogramsm using the resolution functions:
     // the parameters are those from the last iteration, as the muons up to this point have also the corrections from the same iteration.
     // Need to use a different array (ForVec), containing functors able to operate on std::vector<double>
-    mapHisto_["hFunctionResolPt"]->Fill( recMu1, MuScleFitUtils::resolutionFunctionForVec->sigmaPt(recMu1.Pt(), recMu1.Eta(), *parval ), -1 );
-    mapHisto_["hFunctionResolCotgTheta"]->Fill( recMu1, MuScleFitUtils::resolutionFunctionForVec->sigmaCotgTh(recMu1.Pt(), recMu1.Eta(), *parval ), -1 );
-    mapHisto_["hFunctionResolPhi"]->Fill( recMu1, MuScleFitUtils::resolutionFunctionForVec->sigmaPhi(recMu1.Pt(), recMu1.Eta(), *parval ), -1 );
-    mapHisto_["hFunctionResolPt"]->Fill( recMu2, MuScleFitUtils::resolutionFunctionForVec->sigmaPt(recMu2.Pt(), recMu2.Eta(), *parval ), +1 );
-    mapHisto_["hFunctionResolCotgTheta"]->Fill( recMu2, MuScleFitUtils::resolutionFunctionForVec->sigmaCotgTh(recMu2.Pt(), recMu2.Eta(), *parval ), +1 );
-    mapHisto_["hFunctionResolPhi"]->Fill( recMu2, MuScleFitUtils::resolutionFunctionForVec->sigmaPhi(recMu2.Pt(), recMu2.Eta(), *parval ), +1 );
+    if( histoFamily(functionResolution) ) {
+      histo_.hFunctionResolPt->Fill( recMu1, MuScleFitUtils::resolutionFunctionForVec->sigmaPt(recMu1.Pt(), recMu1.Eta(), *parval ), -1 );
+      histo_.hFunctionResolCotgTheta->Fill( recMu1, MuScleFitUtils::resolutionFunctionForVec->sigmaCotgTh(recMu1.Pt(), recMu1.Eta(), *parval ), -1 );
+      histo_.hFunctionResolPhi->Fill( recMu1, MuScleFitUtils::resolutionFunctionForVec->sigmaPhi(recMu1.Pt(), recMu1.Eta(), *parval ), -1 );
+      histo_.hFunctionResolPt->Fill( recMu2, MuScleFitUtils::resolutionFunctionForVec->sigmaPt(recMu2.Pt(), recMu2.Eta(), *parval ), +1 );
+      histo_.hFunctionResolCotgTheta->Fill( recMu2, MuScleFitUtils::resolutionFunctionForVec->sigmaCotgTh(recMu2.Pt(), recMu2.Eta(), *parval ), +1 );
+      histo_.hFunctionResolPhi->Fill( recMu2, MuScleFitUtils::resolutionFunctionForVec->sigmaPhi(recMu2.Pt(), recMu2.Eta(), *parval ), +1 );
+    }
 
     // Compute likelihood histograms
     // -----------------------------
     if( debug_ > 0 ) std::cout << "mass = " << bestRecRes.mass() << std::endl;
-    if (weight!=0.) {
+    // The mass resolution and probability are only computed for the histograms
+    if (weight!=0. && histoFamily(likelihood | functionResolution | resolution | massVSMuon | massProbability | massProbabilityVSMuon)) {
       double massResol;
       double prob;
       double deltalike;
@@ -1133,35 +1474,39 @@ void MuScleFit::duringFastLoop()
         if( debug_ > 0 ) std::cout << "inside prob: mass = " << bestRecRes.mass() << ", prob = " << prob << std::endl;
 
 	deltalike = log(prob)*weight; // NB maximum likelihood --> deltalike is maximized
-	mapHisto_["hLikeVSMu"]->Fill(recMu1, deltalike);
-	mapHisto_["hLikeVSMu"]->Fill(recMu2, deltalike);
-	mapHisto_["hLikeVSMuMinus"]->Fill(recMu1, deltalike);
-	mapHisto_["hLikeVSMuPlus"]->Fill(recMu2, deltalike);
+        if( histoFamily(likelihood) ) {
+          histo_.hLikeVSMu->Fill(recMu1, deltalike);
+          histo_.hLikeVSMu->Fill(recMu2, deltalike);
+          histo_.hLikeVSMuMinus->Fill(recMu1, deltalike);
+          histo_.hLikeVSMuPlus->Fill(recMu2, deltalike);
+        }
 
         double recoMass = (recMu1+recMu2).mass();
-        if( recoMass != 0 ) {
+        if( recoMass != 0 && histoFamily(functionResolution) ) {
           // IMPORTANT: massResol is not a relative resolution
-          mapHisto_["hResolMassVSMu"]->Fill(recMu1, massResol, -1);
-          mapHisto_["hResolMassVSMu"]->Fill(recMu2, massResol, +1);
-          mapHisto_["hFunctionResolMassVSMu"]->Fill(recMu1, massResol/recoMass, -1);
-          mapHisto_["hFunctionResolMassVSMu"]->Fill(recMu2, massResol/recoMass, +1);
+          histo_.hResolMassVSMu->Fill(recMu1, massResol, -1);
+          histo_.hResolMassVSMu->Fill(recMu2, massResol, +1);
+          histo_.hFunctionResolMassVSMu->Fill(recMu1, massResol/recoMass, -1);
+          histo_.hFunctionResolMassVSMu->Fill(recMu2, massResol/recoMass, +1);
         }
 
-        if( MuScleFitUtils::debugMassResol_ ) {
-          mapHisto_["hdMdPt1"]->Fill(recMu1, MuScleFitUtils::massResolComponents.dmdpt1, -1);
-          mapHisto_["hdMdPt2"]->Fill(recMu2, MuScleFitUtils::massResolComponents.dmdpt2, +1);
-          mapHisto_["hdMdPhi1"]->Fill(recMu1, MuScleFitUtils::massResolComponents.dmdphi1, -1);
-          mapHisto_["hdMdPhi2"]->Fill(recMu2, MuScleFitUtils::massResolComponents.dmdphi2, +1);
-          mapHisto_["hdMdCotgTh1"]->Fill(recMu1, MuScleFitUtils::massResolComponents.dmdcotgth1, -1);
-          mapHisto_["hdMdCotgTh2"]->Fill(recMu2, MuScleFitUtils::massResolComponents.dmdcotgth2, +1);
+        if( MuScleFitUtils::debugMassResol_ && histoFamily(functionResolution) ) {
+          histo_.hdMdPt1->Fill(recMu1, MuScleFitUtils::massResolComponents.dmdpt1, -1);
+          histo_.hdMdPt2->Fill(recMu2, MuScleFitUtils::massResolComponents.dmdpt2, +1);
+          histo_.hdMdPhi1->Fill(recMu1, MuScleFitUtils::massResolComponents.dmdphi1, -1);
+          histo_.hdMdPhi2->Fill(recMu2, MuScleFitUtils::massResolComponents.dmdphi2, +1);
+          histo_.hdMdCotgTh1->Fill(recMu1, MuScleFitUtils::massResolComponents.dmdcotgth1, -1);
+          histo_.hdMdCotgTh2->Fill(recMu2, MuScleFitUtils::massResolComponents.dmdcotgth2, +1);
         }
 
         if( !MuScleFitUtils::speedup ) {
           double genMass = (MuScleFitUtils::genPair[iev].first + MuScleFitUtils::genPair[iev].second).mass();
           // Fill the mass resolution (computed from MC), we use the covariance class to compute the variance
           if( genMass != 0 ) {
-	    mapHisto_["hGenResVSMu"]->Fill((MuScleFitUtils::genPair[iev].first), (MuScleFitUtils::genPair[iev].first + MuScleFitUtils::genPair[iev].second), -1);
-	    mapHisto_["hGenResVSMu"]->Fill((MuScleFitUtils::genPair[iev].second), (MuScleFitUtils::genPair[iev].first + MuScleFitUtils::genPair[iev].second), +1);
+            if( histoFamily(massVSMuon) ) {
+              histo_.hGenResVSMu->Fill((MuScleFitUtils::genPair[iev].first), (MuScleFitUtils::genPair[iev].first + MuScleFitUtils::genPair[iev].second), -1);
+              histo_.hGenResVSMu->Fill((MuScleFitUtils::genPair[iev].second), (MuScleFitUtils::genPair[iev].first + MuScleFitUtils::genPair[iev].second), +1);
+            }
             double diffMass = (recoMass - genMass)/genMass;
             // double diffMass = recoMass - genMass;
             // Fill if for both muons
@@ -1172,34 +1517,44 @@ void MuScleFit::duringFastLoop()
             // This is to avoid nan
             if( diffMass == diffMass ) {
               // Mass relative difference vs Pt and Eta. To be used to extract the true mass resolution
-              mapHisto_["hDeltaMassOverGenMassVsPt"]->Fill(pt1, diffMass);
-              mapHisto_["hDeltaMassOverGenMassVsPt"]->Fill(pt2, diffMass);
-              mapHisto_["hDeltaMassOverGenMassVsEta"]->Fill(eta1, diffMass);
-              mapHisto_["hDeltaMassOverGenMassVsEta"]->Fill(eta2, diffMass);
+              if( histoFamily(resolution) ) {
+                histo_.hDeltaMassOverGenMassVsPt->Fill(pt1, diffMass);
+                histo_.hDeltaMassOverGenMassVsPt->Fill(pt2, diffMass);
+                histo_.hDeltaMassOverGenMassVsEta->Fill(eta1, diffMass);
+                histo_.hDeltaMassOverGenMassVsEta->Fill(eta2, diffMass);
+              }
               // This is used for the covariance comparison
-              mapHisto_["hMassResolutionVsPtEta"]->Fill(pt1, eta1, diffMass, diffMass);
-              mapHisto_["hMassResolutionVsPtEta"]->Fill(pt2, eta2, diffMass, diffMass);
+              if( histo_.hMassResolutionVsPtEta != 0 ) {
+                histo_.hMassResolutionVsPtEta->Fill(pt1, eta1, diffMass, diffMass);
+                histo_.hMassResolutionVsPtEta->Fill(pt2, eta2, diffMass, diffMass);
+              }
             }
             else {
               std::cout << "Error, there is a nan: recoMass = " << recoMass << ", genMass = " << genMass << std::endl;
             }
           }
           // Fill with mass resolution from resolution function
-          double massRes = MuScleFitUtils::massResolution(recMu1, recMu2, MuScleFitUtils::parResol);
-          mapHisto_["hFunctionResolMass"]->Fill( recMu1, std::pow(massRes,2), -1 );
-          mapHisto_["hFunctionResolMass"]->Fill( recMu2, std::pow(massRes,2), +1 );
+          if( histoFamily(functionResolution) ) {
+            double massRes = MuScleFitUtils::massResolution(recMu1, recMu2, MuScleFitUtils::parResol);
+            histo_.hFunctionResolMass->Fill( recMu1, std::pow(massRes,2), -1 );
+            histo_.hFunctionResolMass->Fill( recMu2, std::pow(massRes,2), +1 );
+          }
         }
 
-        mapHisto_["hMass_P"]->Fill(bestRecRes.mass(), prob);
         if( debug_ > 0 ) std::cout << "mass = " << bestRecRes.mass() << ", prob = " << prob << std::endl;
-        mapHisto_["hMass_fine_P"]->Fill(bestRecRes.mass(), prob);
-
-        mapHisto_["hMassProbVsRes"]->Fill(bestRecRes, bestRecRes, +1, prob);
-        mapHisto_["hMassProbVsMu"]->Fill(recMu1, bestRecRes, -1, prob);
-        mapHisto_["hMassProbVsMu"]->Fill(recMu2, bestRecRes, +1, prob);
-        mapHisto_["hMassProbVsRes_fine"]->Fill(bestRecRes, bestRecRes, +1, prob);
-        mapHisto_["hMassProbVsMu_fine"]->Fill(recMu1, bestRecRes, -1, prob);
-        mapHisto_["hMassProbVsMu_fine"]->Fill(recMu2, bestRecRes, +1, prob);
+        if( histoFamily(massProbability) ) {
+          histo_.hMass_P->Fill(bestRecRes.mass(), prob);
+          histo_.hMass_fine_P->Fill(bestRecRes.mass(), prob);
+        }
+
+        if( histoFamily(massProbabilityVSMuon) ) {
+          histo_.hMassProbVsRes->Fill(bestRecRes, bestRecRes, +1, prob);
+          histo_.hMassProbVsMu->Fill(recMu1, bestRecRes, -1, prob);
+          histo_.hMassProbVsMu->Fill(recMu2, bestRecRes, +1, prob);
+          histo_.hMassProbVsRes_fine->Fill(bestRecRes, bestRecRes, +1, prob);
+          histo_.hMassProbVsMu_fine->Fill(recMu1, bestRecRes, -1, prob);
+          histo_.hMassProbVsMu_fine->Fill(recMu2, bestRecRes, +1, prob);
+        }
       }
     }
   } // end if ResFound
@@ -1208,7 +1563,7 @@ void MuScleFit::duringFastLoop()
   // -------------
   if (loopCounter>0) {
     if (debug_>0) std::cout << "[MuScleFit]: filling the pair" << std::endl;
-    MuScleFitUtils::SavedPair[iev] = std::make_pair( recMu1, recMu2 );
+    MuScleFitUtils::SavedPair.set(iev, std::make_pair( recMu1, recMu2 ));
   }
 
   iev++;
@@ -1217,7 +1572,7 @@ void MuScleFit::duringFastLoop()
   // return kContinue;
 }
 
-bool MuScleFit::checkDeltaR(reco::Particle::LorentzVector& genMu, reco::Particle::LorentzVector& recMu){
+bool MuScleFit::checkDeltaR(const reco::Particle::LorentzVector & genMu, const reco::Particle::LorentzVector & recMu){
   //first is always mu-, second is always mu+
   double deltaR = sqrt(MuScleFitUtils::deltaPhi(recMu.Phi(),genMu.Phi()) * MuScleFitUtils::deltaPhi(recMu.Phi(),genMu.Phi()) +
                        ((recMu.Eta()-genMu.Eta()) * (recMu.Eta()-genMu.Eta())));
@@ -1232,19 +1587,18 @@ bool MuScleFit::checkDeltaR(reco::Particle::LorentzVector& genMu, reco::Particle
 }
 
 void MuScleFit::fillComparisonHistograms( const reco::Particle::LorentzVector & genMu, const reco::Particle::LorentzVector & recMu,
-					  const std::string & inputName, const int charge )
+					  const int comparison, const int charge )
 {
-  std::string name(inputName + "VSMu");
-  mapHisto_["hResolPt"+name]->Fill(recMu, (-genMu.Pt()+recMu.Pt())/genMu.Pt(), charge);
-  mapHisto_["hResolTheta"+name]->Fill(recMu, (-genMu.Theta()+recMu.Theta()), charge);
-  mapHisto_["hResolCotgTheta"+name]->Fill(recMu,(-cos(genMu.Theta())/sin(genMu.Theta())
+  histo_.hResolPt[comparison]->Fill(recMu, (-genMu.Pt()+recMu.Pt())/genMu.Pt(), charge);
+  histo_.hResolTheta[comparison]->Fill(recMu, (-genMu.Theta()+recMu.Theta()), charge);
+  histo_.hResolCotgTheta[comparison]->Fill(recMu,(-cos(genMu.Theta())/sin(genMu.Theta())
                                                  +cos(recMu.Theta())/sin(recMu.Theta())), charge);
-  mapHisto_["hResolEta"+name]->Fill(recMu, (-genMu.Eta()+recMu.Eta()),charge);
-  mapHisto_["hResolPhi"+name]->Fill(recMu, MuScleFitUtils::deltaPhiNoFabs(recMu.Phi(), genMu.Phi()), charge);
+  histo_.hResolEta[comparison]->Fill(recMu, (-genMu.Eta()+recMu.Eta()),charge);
+  histo_.hResolPhi[comparison]->Fill(recMu, MuScleFitUtils::deltaPhiNoFabs(recMu.Phi(), genMu.Phi()), charge);
 
   // Fill only if it was matched to a genMu and this muon is valid
   if( (genMu.Pt() != 0) && (recMu.Pt() != 0) ) {
-    mapHisto_["hPtRecoVsPt"+inputName]->Fill(genMu.Pt(), recMu.Pt());
+    histo_.hPtRecoVsPt[comparison]->Fill(genMu.Pt(), recMu.Pt());
   }
 }
 
@@ -4,6 +4,17 @@
 #include "MuScleFitBase.h"
 #include "FWCore/ParameterSet/interface/FileInPath.h"
 
+unsigned int MuScleFitBase::histoFamilies( const std::string & profile )
+{
+  const unsigned int fitOnly = kinematics;
+  const unsigned int validation = fitOnly | massVSMuon | resolution | functionResolution | massProbability;
+  if( profile == "fit-only" ) return fitOnly;
+  if( profile == "validation" ) return validation;
+  if( profile == "full" ) return validation | likelihood | massProbabilityVSMuon;
+  std::cout << "Error: unknown HistogramsProfile " << profile << ". Valid profiles are fit-only, validation and full" << std::endl;
+  exit(1);
+}
+
 void MuScleFitBase::fillHistoMap(TFile* outputFile, unsigned int iLoop) {
   //Reconstructed muon kinematics
   //-----------------------------
@@ -27,84 +38,160 @@ void MuScleFitBase::fillHistoMap(TFile* outputFile, unsigned int iLoop) {
 
   LogDebug("MuScleFitBase") << "Creating new histograms" << std::endl;
 
-  mapHisto_["hRecBestMu"]      = new HParticle ("hRecBestMu", minMass, maxMass, maxPt);
-  mapHisto_["hRecBestMuVSEta"] = new HPartVSEta ("hRecBestMuVSEta", minMass, maxMass, maxPt);
-  //mapHisto_["hRecBestMuVSPhi"] = new HPartVSPhi ("hRecBestMuVSPhi"); 
-  //mapHisto_["hRecBestMu_Acc"]  = new HParticle ("hRecBestMu_Acc", minMass, maxMass);
-  mapHisto_["hDeltaRecBestMu"] = new HDelta ("hDeltaRecBestMu");
+  // Histograms of the families not in the profile are not booked and their handles are null
+  if( histoFamily(kinematics) ) {
+    mapHisto_["hRecBestMu"]      = new HParticle ("hRecBestMu", minMass, maxMass, maxPt);
+    mapHisto_["hRecBestMuVSEta"] = new HPartVSEta ("hRecBestMuVSEta", minMass, maxMass, maxPt);
+    //mapHisto_["hRecBestMuVSPhi"] = new HPartVSPhi ("hRecBestMuVSPhi"); 
+    //mapHisto_["hRecBestMu_Acc"]  = new HParticle ("hRecBestMu_Acc", minMass, maxMass);
+    mapHisto_["hDeltaRecBestMu"] = new HDelta ("hDeltaRecBestMu");
 
-  mapHisto_["hRecBestRes"]          = new HParticle   ("hRecBestRes", minMass, maxMass, maxPt);
-  mapHisto_["hRecBestResAllEvents"] = new HParticle   ("hRecBestResAllEvents", minMass, maxMass, maxPt);
-  //mapHisto_["hRecBestRes_Acc"] = new HParticle   ("hRecBestRes_Acc", minMass, maxMass);
-  // If not finding Z, use a smaller mass window
-  mapHisto_["hRecBestResVSMu"] = new HMassVSPart ("hRecBestResVSMu", minMass, maxMass, maxPt);
-  mapHisto_["hRecBestResVSRes"] = new HMassVSPart ("hRecBestResVSRes", minMass, maxMass, maxPt);
-  //Generated Mass versus pt
-  mapHisto_["hGenResVSMu"] = new HMassVSPart ("hGenResVSMu", minMass, maxMass, maxPt);
-  // Likelihood values VS muon variables
-  // -------------------------------------
-  mapHisto_["hLikeVSMu"]       = new HLikelihoodVSPart ("hLikeVSMu");
-  mapHisto_["hLikeVSMuMinus"]  = new HLikelihoodVSPart ("hLikeVSMuMinus");
-  mapHisto_["hLikeVSMuPlus"]   = new HLikelihoodVSPart ("hLikeVSMuPlus");
+    mapHisto_["hRecBestRes"]          = new HParticle   ("hRecBestRes", minMass, maxMass, maxPt);
+    mapHisto_["hRecBestResAllEvents"] = new HParticle   ("hRecBestResAllEvents", minMass, maxMass, maxPt);
+    //mapHisto_["hRecBestRes_Acc"] = new HParticle   ("hRecBestRes_Acc", minMass, maxMass);
+  }
+  if( histoFamily(massVSMuon) ) {
+    // If not finding Z, use a smaller mass window
+    mapHisto_["hRecBestResVSMu"] = new HMassVSPart ("hRecBestResVSMu", minMass, maxMass, maxPt);
+    mapHisto_["hRecBestResVSRes"] = new HMassVSPart ("hRecBestResVSRes", minMass, maxMass, maxPt);
+    //Generated Mass versus pt
+    mapHisto_["hGenResVSMu"] = new HMassVSPart ("hGenResVSMu", minMass, maxMass, maxPt);
+  }
+  if( histoFamily(likelihood) ) {
+    // Likelihood values VS muon variables
+    // -------------------------------------
+    mapHisto_["hLikeVSMu"]       = new HLikelihoodVSPart ("hLikeVSMu");
+    mapHisto_["hLikeVSMuMinus"]  = new HLikelihoodVSPart ("hLikeVSMuMinus");
+    mapHisto_["hLikeVSMuPlus"]   = new HLikelihoodVSPart ("hLikeVSMuPlus");
+  }
 
   //Resolution VS muon kinematic
   //----------------------------
-  mapHisto_["hResolMassVSMu"]         = new HResolutionVSPart( outputFile, "hResolMassVSMu", maxPt, 0., yMaxEta, 0., yMaxPt, true );
-  mapHisto_["hFunctionResolMassVSMu"] = new HResolutionVSPart( outputFile, "hFunctionResolMassVSMu", maxPt, 0, 0.1, 0, 0.1, true );
-  mapHisto_["hResolPtGenVSMu"]        = new HResolutionVSPart( outputFile, "hResolPtGenVSMu", maxPt, -0.1, 0.1, -0.1, 0.1 );
-  mapHisto_["hResolPtSimVSMu"]        = new HResolutionVSPart( outputFile, "hResolPtSimVSMu", maxPt, -0.1, 0.1, -0.1, 0.1 );
-  mapHisto_["hResolEtaGenVSMu"]       = new HResolutionVSPart( outputFile, "hResolEtaGenVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
-  mapHisto_["hResolEtaSimVSMu"]       = new HResolutionVSPart( outputFile, "hResolEtaSimVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
-  mapHisto_["hResolThetaGenVSMu"]     = new HResolutionVSPart( outputFile, "hResolThetaGenVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
-  mapHisto_["hResolThetaSimVSMu"]     = new HResolutionVSPart( outputFile, "hResolThetaSimVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
-  mapHisto_["hResolCotgThetaGenVSMu"] = new HResolutionVSPart( outputFile, "hResolCotgThetaGenVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
-  mapHisto_["hResolCotgThetaSimVSMu"] = new HResolutionVSPart( outputFile, "hResolCotgThetaSimVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
-  mapHisto_["hResolPhiGenVSMu"]       = new HResolutionVSPart( outputFile, "hResolPhiGenVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
-  mapHisto_["hResolPhiSimVSMu"]       = new HResolutionVSPart( outputFile, "hResolPhiSimVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
+  if( histoFamily(functionResolution) ) {
+    mapHisto_["hResolMassVSMu"]         = new HResolutionVSPart( outputFile, "hResolMassVSMu", maxPt, 0., yMaxEta, 0., yMaxPt, true );
+    mapHisto_["hFunctionResolMassVSMu"] = new HResolutionVSPart( outputFile, "hFunctionResolMassVSMu", maxPt, 0, 0.1, 0, 0.1, true );
+  }
+  if( histoFamily(resolution) ) {
+    mapHisto_["hResolPtGenVSMu"]        = new HResolutionVSPart( outputFile, "hResolPtGenVSMu", maxPt, -0.1, 0.1, -0.1, 0.1 );
+    mapHisto_["hResolPtSimVSMu"]        = new HResolutionVSPart( outputFile, "hResolPtSimVSMu", maxPt, -0.1, 0.1, -0.1, 0.1 );
+    mapHisto_["hResolEtaGenVSMu"]       = new HResolutionVSPart( outputFile, "hResolEtaGenVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
+    mapHisto_["hResolEtaSimVSMu"]       = new HResolutionVSPart( outputFile, "hResolEtaSimVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
+    mapHisto_["hResolThetaGenVSMu"]     = new HResolutionVSPart( outputFile, "hResolThetaGenVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
+    mapHisto_["hResolThetaSimVSMu"]     = new HResolutionVSPart( outputFile, "hResolThetaSimVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
+    mapHisto_["hResolCotgThetaGenVSMu"] = new HResolutionVSPart( outputFile, "hResolCotgThetaGenVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
+    mapHisto_["hResolCotgThetaSimVSMu"] = new HResolutionVSPart( outputFile, "hResolCotgThetaSimVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
+    mapHisto_["hResolPhiGenVSMu"]       = new HResolutionVSPart( outputFile, "hResolPhiGenVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
+    mapHisto_["hResolPhiSimVSMu"]       = new HResolutionVSPart( outputFile, "hResolPhiSimVSMu", maxPt, -0.02, 0.02, -0.02, 0.02 );
+
+    HTH2D * recoGenHisto = new HTH2D(outputFile, "hPtRecoVsPtGen", "Pt reco vs Pt gen", "hPtRecoVsPtGen", 120, 0., 120., 120, 0, 120.);
+    (*recoGenHisto)->SetXTitle("Pt gen (GeV)");
+    (*recoGenHisto)->SetYTitle("Pt reco (GeV)");
+    mapHisto_["hPtRecoVsPtGen"] = recoGenHisto;
+    HTH2D * recoSimHisto = new HTH2D(outputFile, "hPtRecoVsPtSim", "Pt reco vs Pt sim", "hPtRecoVsPtSim", 120, 0., 120., 120, 0, 120.);
+    (*recoSimHisto)->SetXTitle("Pt sim (GeV)");
+    (*recoSimHisto)->SetYTitle("Pt reco (GeV)");
+    mapHisto_["hPtRecoVsPtSim"] = recoSimHisto;
+
+    // (M_reco-M_gen)/M_gen vs (pt, eta) of the muons from MC
+    mapHisto_["hDeltaMassOverGenMassVsPt"] = new HTH2D( outputFile, "DeltaMassOverGenMassVsPt", "DeltaMassOverGenMassVsPt", "DeltaMassOverGenMass", 200, 0, maxPt, 200, -0.2, 0.2 );
+    mapHisto_["hDeltaMassOverGenMassVsEta"] = new HTH2D( outputFile, "DeltaMassOverGenMassVsEta", "DeltaMassOverGenMassVsEta", "DeltaMassOverGenMass", 200, -3., 3., 200, -0.2, 0.2 );
 
-  if( MuScleFitUtils::debugMassResol_ ) {
-    mapHisto_["hdMdPt1"] = new HResolutionVSPart( outputFile, "hdMdPt1", maxPt, 0, 100, -3.2, 3.2, true );
-    mapHisto_["hdMdPt2"] = new HResolutionVSPart( outputFile, "hdMdPt2", maxPt, 0, 100, -3.2, 3.2, true );
-    mapHisto_["hdMdPhi1"] = new HResolutionVSPart( outputFile, "hdMdPhi1", maxPt, 0, 100, -3.2, 3.2, true );
-    mapHisto_["hdMdPhi2"] = new HResolutionVSPart( outputFile, "hdMdPhi2", maxPt, 0, 100, -3.2, 3.2, true );
-    mapHisto_["hdMdCotgTh1"] = new HResolutionVSPart( outputFile, "hdMdCotgTh1", maxPt, 0, 100, -3.2, 3.2, true );
-    mapHisto_["hdMdCotgTh2"] = new HResolutionVSPart( outputFile, "hdMdCotgTh2", maxPt, 0, 100, -3.2, 3.2, true );
+    // Square of mass resolution vs (pt, eta) of the muons from MC
+    // EM 2012.12.19  mapHisto_["hMassResolutionVsPtEta"] = new HCovarianceVSxy( "Mass", "Mass", 100, 0., maxPt, 60, -3, 3, outputFile->mkdir("MassCovariance") );
   }
 
-  HTH2D * recoGenHisto = new HTH2D(outputFile, "hPtRecoVsPtGen", "Pt reco vs Pt gen", "hPtRecoVsPtGen", 120, 0., 120., 120, 0, 120.);
-  (*recoGenHisto)->SetXTitle("Pt gen (GeV)");
-  (*recoGenHisto)->SetYTitle("Pt reco (GeV)");
-  mapHisto_["hPtRecoVsPtGen"] = recoGenHisto;
-  HTH2D * recoSimHisto = new HTH2D(outputFile, "hPtRecoVsPtSim", "Pt reco vs Pt sim", "hPtRecoVsPtSim", 120, 0., 120., 120, 0, 120.);
-  (*recoSimHisto)->SetXTitle("Pt sim (GeV)");
-  (*recoSimHisto)->SetYTitle("Pt reco (GeV)");
-  mapHisto_["hPtRecoVsPtSim"] = recoSimHisto;
-  // Resolutions from resolution functions
-  // -------------------------------------
-  mapHisto_["hFunctionResolPt"]        = new HFunctionResolution( outputFile, "hFunctionResolPt", maxPt );
-  mapHisto_["hFunctionResolCotgTheta"] = new HFunctionResolution( outputFile, "hFunctionResolCotgTheta", maxPt );
-  mapHisto_["hFunctionResolPhi"]       = new HFunctionResolution( outputFile, "hFunctionResolPhi", maxPt );
+  if( histoFamily(functionResolution) ) {
+    if( MuScleFitUtils::debugMassResol_ ) {
+      mapHisto_["hdMdPt1"] = new HResolutionVSPart( outputFile, "hdMdPt1", maxPt, 0, 100, -3.2, 3.2, true );
+      mapHisto_["hdMdPt2"] = new HResolutionVSPart( outputFile, "hdMdPt2", maxPt, 0, 100, -3.2, 3.2, true );
+      mapHisto_["hdMdPhi1"] = new HResolutionVSPart( outputFile, "hdMdPhi1", maxPt, 0, 100, -3.2, 3.2, true );
+      mapHisto_["hdMdPhi2"] = new HResolutionVSPart( outputFile, "hdMdPhi2", maxPt, 0, 100, -3.2, 3.2, true );
+      mapHisto_["hdMdCotgTh1"] = new HResolutionVSPart( outputFile, "hdMdCotgTh1", maxPt, 0, 100, -3.2, 3.2, true );
+      mapHisto_["hdMdCotgTh2"] = new HResolutionVSPart( outputFile, "hdMdCotgTh2", maxPt, 0, 100, -3.2, 3.2, true );
+    }
+
+    // Resolutions from resolution functions
+    // -------------------------------------
+    mapHisto_["hFunctionResolPt"]        = new HFunctionResolution( outputFile, "hFunctionResolPt", maxPt );
+    mapHisto_["hFunctionResolCotgTheta"] = new HFunctionResolution( outputFile, "hFunctionResolCotgTheta", maxPt );
+    mapHisto_["hFunctionResolPhi"]       = new HFunctionResolution( outputFile, "hFunctionResolPhi", maxPt );
+    // Mass resolution vs (pt, eta) from resolution function
+    mapHisto_["hFunctionResolMass"] = new HFunctionResolution( outputFile, "hFunctionResolMass", maxPt );
+  }
 
   // Mass probability histograms
   // ---------------------------
-  // The word "profile" is added to the title automatically
-  mapHisto_["hMass_P"]      = new HTProfile( outputFile, "Mass_P", "Mass probability", 4000, 0., 200., 0., 50. );
-  mapHisto_["hMass_fine_P"] = new HTProfile( outputFile, "Mass_fine_P", "Mass probability", 4000, 0., 20., 0., 50. );
-  mapHisto_["hMass_Probability"]      = new HTH1D( outputFile, "Mass_Probability", "Mass probability", 4000, 0., 200.);
-  mapHisto_["hMass_fine_Probability"] = new HTH1D( outputFile, "Mass_fine_Probability", "Mass probability", 4000, 0., 20.);
-  mapHisto_["hMassProbVsMu"] = new HMassVSPartProfile( "hMassProbVsMu", minMass, maxMass, maxPt );
-  mapHisto_["hMassProbVsRes"] = new HMassVSPartProfile( "hMassProbVsRes", minMass, maxMass, maxPt );
-  mapHisto_["hMassProbVsMu_fine"] = new HMassVSPartProfile( "hMassProbVsMu_fine", minMass, maxMass, maxPt );
-  mapHisto_["hMassProbVsRes_fine"] = new HMassVSPartProfile( "hMassProbVsRes_fine", minMass, maxMass, maxPt );
+  if( histoFamily(massProbability) ) {
+    // The word "profile" is added to the title automatically
+    mapHisto_["hMass_P"]      = new HTProfile( outputFile, "Mass_P", "Mass probability", 4000, 0., 200., 0., 50. );
+    mapHisto_["hMass_fine_P"] = new HTProfile( outputFile, "Mass_fine_P", "Mass probability", 4000, 0., 20., 0., 50. );
+    mapHisto_["hMass_Probability"]      = new HTH1D( outputFile, "Mass_Probability", "Mass probability", 4000, 0., 200.);
+    mapHisto_["hMass_fine_Probability"] = new HTH1D( outputFile, "Mass_fine_Probability", "Mass probability", 4000, 0., 20.);
+  }
+  if( histoFamily(massProbabilityVSMuon) ) {
+    mapHisto_["hMassProbVsMu"] = new HMassVSPartProfile( "hMassProbVsMu", minMass, maxMass, maxPt );
+    mapHisto_["hMassProbVsRes"] = new HMassVSPartProfile( "hMassProbVsRes", minMass, maxMass, maxPt );
+    mapHisto_["hMassProbVsMu_fine"] = new HMassVSPartProfile( "hMassProbVsMu_fine", minMass, maxMass, maxPt );
+    mapHisto_["hMassProbVsRes_fine"] = new HMassVSPartProfile( "hMassProbVsRes_fine", minMass, maxMass, maxPt );
+  }
+
+  resolveHistoHandles();
+}
 
-  // (M_reco-M_gen)/M_gen vs (pt, eta) of the muons from MC
-  mapHisto_["hDeltaMassOverGenMassVsPt"] = new HTH2D( outputFile, "DeltaMassOverGenMassVsPt", "DeltaMassOverGenMassVsPt", "DeltaMassOverGenMass", 200, 0, maxPt, 200, -0.2, 0.2 );
-  mapHisto_["hDeltaMassOverGenMassVsEta"] = new HTH2D( outputFile, "DeltaMassOverGenMassVsEta", "DeltaMassOverGenMassVsEta", "DeltaMassOverGenMass", 200, -3., 3., 200, -0.2, 0.2 );
+void MuScleFitBase::resolveHistoHandles()
+{
+  histo_.hRecBestMu = findHistogram(mapHisto_, "hRecBestMu");
+  histo_.hRecBestMuVSEta = findHistogram(mapHisto_, "hRecBestMuVSEta");
+  histo_.hDeltaRecBestMu = findHistogram(mapHisto_, "hDeltaRecBestMu");
+  histo_.hRecBestRes = findHistogram(mapHisto_, "hRecBestRes");
+  histo_.hRecBestResAllEvents = findHistogram(mapHisto_, "hRecBestResAllEvents");
+  histo_.hRecBestResVSMu = findHistogram(mapHisto_, "hRecBestResVSMu");
+  histo_.hRecBestResVSRes = findHistogram(mapHisto_, "hRecBestResVSRes");
+  histo_.hGenResVSMu = findHistogram(mapHisto_, "hGenResVSMu");
+  histo_.hLikeVSMu = findHistogram(mapHisto_, "hLikeVSMu");
+  histo_.hLikeVSMuMinus = findHistogram(mapHisto_, "hLikeVSMuMinus");
+  histo_.hLikeVSMuPlus = findHistogram(mapHisto_, "hLikeVSMuPlus");
+  histo_.hResolMassVSMu = findHistogram(mapHisto_, "hResolMassVSMu");
+  histo_.hFunctionResolMassVSMu = findHistogram(mapHisto_, "hFunctionResolMassVSMu");
+  histo_.hdMdPt1 = findHistogram(mapHisto_, "hdMdPt1");
+  histo_.hdMdPt2 = findHistogram(mapHisto_, "hdMdPt2");
+  histo_.hdMdPhi1 = findHistogram(mapHisto_, "hdMdPhi1");
+  histo_.hdMdPhi2 = findHistogram(mapHisto_, "hdMdPhi2");
+  histo_.hdMdCotgTh1 = findHistogram(mapHisto_, "hdMdCotgTh1");
+  histo_.hdMdCotgTh2 = findHistogram(mapHisto_, "hdMdCotgTh2");
+  histo_.hFunctionResolPt = findHistogram(mapHisto_, "hFunctionResolPt");
+  histo_.hFunctionResolCotgTheta = findHistogram(mapHisto_, "hFunctionResolCotgTheta");
+  histo_.hFunctionResolPhi = findHistogram(mapHisto_, "hFunctionResolPhi");
+  histo_.hMass_P = findHistogram(mapHisto_, "hMass_P");
+  histo_.hMass_fine_P = findHistogram(mapHisto_, "hMass_fine_P");
+  histo_.hMassProbVsMu = findHistogram(mapHisto_, "hMassProbVsMu");
+  histo_.hMassProbVsRes = findHistogram(mapHisto_, "hMassProbVsRes");
+  histo_.hMassProbVsMu_fine = findHistogram(mapHisto_, "hMassProbVsMu_fine");
+  histo_.hMassProbVsRes_fine = findHistogram(mapHisto_, "hMassProbVsRes_fine");
+  histo_.hDeltaMassOverGenMassVsPt = findHistogram(mapHisto_, "hDeltaMassOverGenMassVsPt");
+  histo_.hDeltaMassOverGenMassVsEta = findHistogram(mapHisto_, "hDeltaMassOverGenMassVsEta");
+  histo_.hMassResolutionVsPtEta = findHistogram(mapHisto_, "hMassResolutionVsPtEta");
+  histo_.hFunctionResolMass = findHistogram(mapHisto_, "hFunctionResolMass");
+  histo_.hRecBestMu_Acc = findHistogram(mapHisto_, "hRecBestMu_Acc");
+  histo_.hRecBestRes_Acc = findHistogram(mapHisto_, "hRecBestRes_Acc");
 
-  // Square of mass resolution vs (pt, eta) of the muons from MC
-  // EM 2012.12.19  mapHisto_["hMassResolutionVsPtEta"] = new HCovarianceVSxy( "Mass", "Mass", 100, 0., maxPt, 60, -3, 3, outputFile->mkdir("MassCovariance") );
-  // Mass resolution vs (pt, eta) from resolution function
-  mapHisto_["hFunctionResolMass"] = new HFunctionResolution( outputFile, "hFunctionResolMass", maxPt );
+  const std::string comparison[2] = { "Gen", "Sim" };
+  for( int i=0; i<2; ++i ) {
+    histo_.hResolPt[i]        = findHistogram(mapHisto_, "hResolPt"+comparison[i]+"VSMu");
+    histo_.hResolTheta[i]     = findHistogram(mapHisto_, "hResolTheta"+comparison[i]+"VSMu");
+    histo_.hResolCotgTheta[i] = findHistogram(mapHisto_, "hResolCotgTheta"+comparison[i]+"VSMu");
+    histo_.hResolEta[i]       = findHistogram(mapHisto_, "hResolEta"+comparison[i]+"VSMu");
+    histo_.hResolPhi[i]       = findHistogram(mapHisto_, "hResolPhi"+comparison[i]+"VSMu");
+    histo_.hPtRecoVsPt[i]     = findHistogram(mapHisto_, "hPtRecoVsPt"+comparison[i]);
+  }
+}
+
+std::map<std::string, Histograms*> MuScleFitBase::releaseHistoMap()
+{
+  std::map<std::string, Histograms*> histoMap;
+  histoMap.swap(mapHisto_);
+  resolveHistoHandles();
+  return histoMap;
 }
 
 void MuScleFitBase::clearHistoMap() {
@@ -25,7 +25,8 @@ public:
     theMuonLabel_( iConfig.getParameter<edm::InputTag>( "MuonLabel" ) ),
     theRootFileName_( iConfig.getUntrackedParameter<std::string>("OutputFileName") ),
     theGenInfoRootFileName_( iConfig.getUntrackedParameter<std::string>("OutputGenInfoFileName", "genSimRecoPlots.root") ),
-    debug_( iConfig.getUntrackedParameter<int>("debug",0) )
+    debug_( iConfig.getUntrackedParameter<int>("debug",0) ),
+    histoFamilies_( histoFamilies(iConfig.getUntrackedParameter<std::string>("HistogramsProfile", "full")) )
   {}
   virtual ~MuScleFitBase() {}
 protected:
@@ -35,6 +36,28 @@ protected:
   void clearHistoMap();
   /// Save the histograms map to file
   void writeHistoMap( const unsigned int iLoop );
+  /// Resolve the histograms filled in the event loop from the map (called by fillHistoMap)
+  void resolveHistoHandles();
+  /// Pass the histograms to the caller, which takes their ownership. The map is left empty
+  std::map<std::string, Histograms*> releaseHistoMap();
+
+  /// Families of histograms booked by fillHistoMap
+  enum HistoFamily {
+    kinematics             = 1 << 0, // muons and resonance kinematics
+    massVSMuon             = 1 << 1, // resonance mass vs muon and resonance variables
+    likelihood             = 1 << 2, // likelihood vs muon variables
+    resolution             = 1 << 3, // resolutions with respect to gen and sim muons
+    functionResolution     = 1 << 4, // resolutions from the resolution functions
+    massProbability        = 1 << 5, // mass probability vs mass
+    massProbabilityVSMuon  = 1 << 6  // mass probability vs mass and muon variables (TProfile2D)
+  };
+  /**
+   * Families booked for a profile: "fit-only" (kinematics), "validation" (all but the likelihood
+   * and the mass probability vs muon variables) or "full". Exits for an unknown profile.
+   */
+  static unsigned int histoFamilies( const std::string & profile );
+  /// True if any of the families is booked. The histograms of the other families are not filled.
+  bool histoFamily( const unsigned int families ) const { return (histoFamilies_ & families) != 0; }
 
   /// Read probability distributions from a local root file.
   void readProbabilityDistributionsFromFile();
@@ -49,6 +72,8 @@ protected:
 
   int debug_;
 
+  unsigned int histoFamilies_;
+
   /// Functor used to compute the normalization integral of probability functions
   class ProbForIntegral
   {
@@ -75,10 +100,62 @@ protected:
 
   /// The map of histograms
   std::map<std::string, Histograms*> mapHisto_;
+
+  /**
+   * Pointers to the histograms of mapHisto_ filled in the event loop, named as in the map.
+   * They are null for the histograms that are not booked.
+   */
+  struct HistoHandles
+  {
+    Histograms * hRecBestMu;
+    Histograms * hRecBestMuVSEta;
+    Histograms * hDeltaRecBestMu;
+    Histograms * hRecBestRes;
+    Histograms * hRecBestResAllEvents;
+    Histograms * hRecBestResVSMu;
+    Histograms * hRecBestResVSRes;
+    Histograms * hGenResVSMu;
+    Histograms * hLikeVSMu;
+    Histograms * hLikeVSMuMinus;
+    Histograms * hLikeVSMuPlus;
+    Histograms * hResolMassVSMu;
+    Histograms * hFunctionResolMassVSMu;
+    Histograms * hdMdPt1;
+    Histograms * hdMdPt2;
+    Histograms * hdMdPhi1;
+    Histograms * hdMdPhi2;
+    Histograms * hdMdCotgTh1;
+    Histograms * hdMdCotgTh2;
+    Histograms * hFunctionResolPt;
+    Histograms * hFunctionResolCotgTheta;
+    Histograms * hFunctionResolPhi;
+    Histograms * hMass_P;
+    Histograms * hMass_fine_P;
+    Histograms * hMassProbVsMu;
+    Histograms * hMassProbVsRes;
+    Histograms * hMassProbVsMu_fine;
+    Histograms * hMassProbVsRes_fine;
+    Histograms * hDeltaMassOverGenMassVsPt;
+    Histograms * hDeltaMassOverGenMassVsEta;
+    Histograms * hMassResolutionVsPtEta;
+    Histograms * hFunctionResolMass;
+    Histograms * hRecBestMu_Acc;
+    Histograms * hRecBestRes_Acc;
+    // Comparison with gen (index 0) and sim (index 1) muons
+    Histograms * hResolPt[2];
+    Histograms * hResolTheta[2];
+    Histograms * hResolCotgTheta[2];
+    Histograms * hResolEta[2];
+    Histograms * hResolPhi[2];
+    Histograms * hPtRecoVsPt[2];
+  };
+  HistoHandles histo_;
   
-  /// Used to store the muon pairs plus run and event number prior to the creation of the internal tree
-  std::vector<MuonPair> muonPairs_;
-  /// Stores the genMuon pairs and the motherId prior to the creation of the internal tree
+  /// Event and run number of each pair in MuScleFitUtils::SavedPair (same order as in RootTreeHandler::readTree)
+  std::vector<std::pair<int, int> > evtRun_;
+  /// Mother id of each pair in MuScleFitUtils::genPair. Empty if not available (e.g. when reading from a tree).
+  std::vector<int> genMotherId_;
+  /// Gen pair of the current event as returned by the muon selector
   std::vector<GenMuonPair> genMuonPairs_;
 };
 
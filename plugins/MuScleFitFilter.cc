@@ -14,6 +14,9 @@
 #include "DataFormats/MuonReco/interface/Muon.h"
 #include "DataFormats/MuonReco/interface/MuonFwd.h"
 #include "DataFormats/Candidate/interface/Candidate.h"
+#include "DataFormats/Candidate/interface/LeafCandidate.h"
+#include "DataFormats/HepMCCandidate/interface/GenParticle.h"
+#include "DataFormats/Math/interface/deltaR.h"
 #include "RecoMuon/TrackingTools/interface/MuonPatternRecoDumper.h"
 #include "RecoMuon/TrackingTools/interface/MuonServiceProxy.h"
 
@@ -25,11 +28,18 @@
 #include <sstream>
 #include <cmath>
 #include <memory>
+#include <string>
+#include <algorithm>
 
 #include <vector>
 
 #include "TRandom.h"
 
+#include <boost/thread/mutex.hpp>
+
+#include "MuonAnalysis/MomentumScaleCalibration/interface/RootTreeHandler.h"
+#include "MuonAnalysis/MomentumScaleCalibration/interface/MuonPairTreeStream.h"
+
 // Class declaration
 // -----------------
 
@@ -40,7 +50,14 @@ class MuScleFitFilter : public edm::EDFilter {
 
  private:
   virtual bool filter(edm::Event&, const edm::EventSetup&);
-  virtual void endJob() {};
+  virtual void endJob();
+
+  /**
+   * Gen muons (status 1) closest in deltaR to the two selected muons, with the pdgId of their common mother. <br>
+   * The pair is left empty if any of the two muons has no gen muon within genMatchMaxDeltaR and the motherId
+   * is left to 0 if the two gen muons do not come from the same particle.
+   */
+  GenMuonPair findGenMuons(const edm::Event & event, const lorentzVector & mu1, const lorentzVector & mu2) const;
 
   // Member data
   // -----------
@@ -57,6 +74,18 @@ class MuScleFitFilter : public edm::EDFilter {
   // ------------------
   edm::InputTag theMuonLabel;
 
+  // Optional output of the best pair of each selected event in the MuScleFit muon pairs tree format
+  // -----------------------------------------------------------------------------------------------
+  std::string outputTreeFileName;
+  bool saveGenInfo;
+  edm::InputTag genParticlesLabel;
+  double genMatchMaxDeltaR;
+  std::auto_ptr<MuonPairTreeWriter> treeWriter;
+
+  // The counters and the tree are the only state changed by the events. They are updated under
+  // this lock, so that events can be filtered concurrently.
+  boost::mutex writeMutex;
+
 };
 
 // Static data member definitions
@@ -85,6 +114,19 @@ MuScleFitFilter::MuScleFitFilter(const edm::ParameterSet& iConfig)
 
   minimumMuonsNumber = iConfig.getUntrackedParameter<unsigned int>("minimumMuonsNumber", 2);
 
+  // If not empty, the best pair of the selected events is written to this file and can be fed directly to MuScleFit
+  outputTreeFileName = iConfig.getUntrackedParameter<std::string>("OutputTreeFileName", "");
+  saveGenInfo = iConfig.getUntrackedParameter<bool>("SaveGenInfo", false);
+  genParticlesLabel = iConfig.getUntrackedParameter<edm::InputTag>("GenParticlesLabel", edm::InputTag("genParticles"));
+  genMatchMaxDeltaR = iConfig.getUntrackedParameter<double>("GenMatchMaxDeltaR", 0.1);
+  if( !outputTreeFileName.empty() ) {
+    int compression = RootTreeHandler::compressionSettings(iConfig.getUntrackedParameter<std::string>("TreeCompression", ""),
+                                                           iConfig.getUntrackedParameter<int>("TreeCompressionLevel", 1));
+    if( compression == -2 ) abort();
+    treeWriter.reset(new MuonPairTreeWriter(outputTreeFileName.c_str(), saveGenInfo, compression,
+                                            iConfig.getUntrackedParameter<int>("TreeBasketSize", 32000)));
+  }
+
   // The must have the same size and they must not be empty, otherwise abort.
   if ( !(Mmin.size() == Mmax.size() && !Mmin.empty()) ) abort();
 
@@ -103,6 +145,13 @@ MuScleFitFilter::~MuScleFitFilter() {
   std::cout << "Total number of events written = " << eventsWritten << std::endl;
 }
 
+void MuScleFitFilter::endJob() {
+  if( treeWriter.get() != 0 ) {
+    treeWriter->close(theMuonType);
+    treeWriter.reset();
+  }
+}
+
 // Member functions
 // ----------------
 
@@ -112,11 +161,15 @@ bool MuScleFitFilter::filter(edm::Event& event, const edm::EventSetup& iSetup) {
 
   // Cut the crap if we have stored enough stuff
   // -------------------------------------------
-  if ( maxWrite != -1 && eventsWritten>=maxWrite ) return false;
+  {
+    boost::mutex::scoped_lock lock(writeMutex);
+    if ( maxWrite != -1 && eventsWritten>=maxWrite ) return false;
+  }
 
   // Get the RecTrack and the RecMuon collection from the event
   // ----------------------------------------------------------
-  std::auto_ptr<reco::MuonCollection> muons(new reco::MuonCollection());
+  // Only the momentum and the charge are used: store them, not the full muons
+  std::auto_ptr<std::vector<reco::LeafCandidate> > muons(new std::vector<reco::LeafCandidate>());
 
   if (debug) std::cout << "Looking for muons of the right kind" << std::endl;
 
@@ -133,8 +186,9 @@ bool MuScleFitFilter::filter(edm::Event& event, const edm::EventSetup& iSetup) {
     // Store the muon 
     // --------------
     reco::MuonCollection::const_iterator glbMuon;
+    muons->reserve(glbMuons->size());
     for (glbMuon=glbMuons->begin(); glbMuon!=glbMuons->end(); ++glbMuon) {   
-      muons->push_back(*glbMuon);
+      muons->push_back(reco::LeafCandidate(glbMuon->charge(), glbMuon->p4()));
       if (debug) {    
 	std::cout << "  Reconstructed muon: pT = " << glbMuon->p4().Pt()
 	     << "  Eta = " << glbMuon->p4().Eta() << std::endl;
@@ -152,13 +206,11 @@ bool MuScleFitFilter::filter(edm::Event& event, const edm::EventSetup& iSetup) {
     // Store the muon   
     // --------------
     reco::TrackCollection::const_iterator saMuon;
+    muons->reserve(saMuons->size());
     for (saMuon=saMuons->begin(); saMuon!=saMuons->end(); ++saMuon) {  
-      reco::Muon muon;
       double energy = sqrt(saMuon->p()*saMuon->p()+Mmu2);
       math::XYZTLorentzVector p4(saMuon->px(), saMuon->py(), saMuon->pz(), energy);
-      muon.setP4(p4);
-      muon.setCharge(saMuon->charge());
-      muons->push_back(muon);
+      muons->push_back(reco::LeafCandidate(saMuon->charge(), p4));
     }
   } else if (theMuonType==3) { // Tracker tracks
 
@@ -172,13 +224,11 @@ bool MuScleFitFilter::filter(edm::Event& event, const edm::EventSetup& iSetup) {
     // Store the muon
     // -------------
     reco::TrackCollection::const_iterator track;
+    muons->reserve(tracks->size());
     for (track=tracks->begin(); track!=tracks->end(); ++track) {  
-      reco::Muon muon;
       double energy = sqrt(track->p()*track->p()+Mmu2);
       math::XYZTLorentzVector p4(track->px(), track->py(), track->pz(), energy);
-      muon.setP4(p4);
-      muon.setCharge(track->charge());      
-      muons->push_back(muon);
+      muons->push_back(reco::LeafCandidate(track->charge(), p4));
     }
   } else {
     std::cout << "Wrong muon type! Aborting." << std::endl;
@@ -187,10 +237,17 @@ bool MuScleFitFilter::filter(edm::Event& event, const edm::EventSetup& iSetup) {
 
   // Loop on RecMuon and reconstruct the resonance
   // ---------------------------------------------
-  reco::MuonCollection::const_iterator muon1;
-  reco::MuonCollection::const_iterator muon2;
+  std::vector<reco::LeafCandidate>::const_iterator muon1;
+  std::vector<reco::LeafCandidate>::const_iterator muon2;
   
   bool resfound = false;
+  // Best pair for the tree output: the one closest to the center of a mass window, relative to its width.
+  // The windows without cuts count as a distance of 1, larger than that of any pair inside a window.
+  // This is not the criterion of MuScleFitUtils::findBestRecoRes (pt and eta cuts and highest mass probability),
+  // which needs the resolution and the probability tables of the fit.
+  double bestDistance = 2.;
+  std::vector<reco::LeafCandidate>::const_iterator bestMuon1 = muons->end();
+  std::vector<reco::LeafCandidate>::const_iterator bestMuon2 = muons->end();
 
   // Require at least N muons of the selected type.
   if( muons->size() >= minimumMuonsNumber ) {
@@ -216,18 +273,26 @@ bool MuScleFitFilter::filter(edm::Event& event, const edm::EventSetup& iSetup) {
             std::vector<double>::const_iterator mMaxCut = Mmax.begin();
             for( ; mMinCut != Mmin.end(); ++mMinCut, ++mMaxCut ) {
               // When the two borders are -1 do not cut.
+              double distance = 2.;
               if( *mMinCut == *mMaxCut && *mMaxCut == -1) {
                 resfound = true;
+                distance = 1.;
                 if (debug) {
                   std::cout << "Acceptiong event because mMinCut = " << *mMinCut << " = mMaxCut = " << *mMaxCut << std::endl;
                 }
               }
               else if (Z.mass()>*mMinCut && Z.mass()<*mMaxCut) {
                 resfound = true;
+                distance = fabs(Z.mass() - 0.5*(*mMinCut + *mMaxCut))/(*mMaxCut - *mMinCut);
                 if (debug) {
                   std::cout << "One particle found with mass = " << Z.mass() << std::endl;
                 }
               }
+              if( distance < bestDistance ) {
+                bestDistance = distance;
+                bestMuon1 = muon1;
+                bestMuon2 = muon2;
+              }
             }
           }
         }
@@ -242,15 +307,78 @@ bool MuScleFitFilter::filter(edm::Event& event, const edm::EventSetup& iSetup) {
   
   // Store the event if it has a dimuon pair with mass within defined boundaries
   // ---------------------------------------------------------------------------
+  // The pair for the tree is prepared before taking the lock
+  MuonPair pair;
+  GenMuonPair genPair;
+  if( resfound && treeWriter.get() != 0 ) {
+    // As in MuScleFit the negative muon is stored first
+    if( bestMuon1->charge() > 0 ) std::swap(bestMuon1, bestMuon2);
+    pair = MuonPair(bestMuon1->p4(), bestMuon2->p4(), event.id().run(), event.id().event());
+    if( saveGenInfo ) genPair = findGenMuons(event, pair.mu1, pair.mu2);
+  }
+
   bool write = false;
+  boost::mutex::scoped_lock lock(writeMutex);
   eventsRead++;
-  if ( resfound ) {
+  // Checked again: other events may have reached maxWrite in the meantime
+  if ( resfound && (maxWrite == -1 || eventsWritten<maxWrite) ) {
     write = true;
     eventsWritten++;
+    if( treeWriter.get() != 0 ) {
+      if( saveGenInfo ) treeWriter->fill(pair, &genPair);
+      else treeWriter->fill(pair);
+    }
   }
   return write;
 
 }
 
+GenMuonPair MuScleFitFilter::findGenMuons(const edm::Event & event, const lorentzVector & mu1, const lorentzVector & mu2) const
+{
+  GenMuonPair genPair;
+  edm::Handle<reco::GenParticleCollection> genParticles;
+  event.getByLabel(genParticlesLabel, genParticles);
+  if( !genParticles.isValid() ) {
+    if (debug) std::cout << "No genParticles found" << std::endl;
+    return genPair;
+  }
+  // mu1 is the negative muon (pdgId 13), mu2 the positive one
+  double minDeltaR1 = genMatchMaxDeltaR;
+  double minDeltaR2 = genMatchMaxDeltaR;
+  const reco::GenParticle * genMu1 = 0;
+  const reco::GenParticle * genMu2 = 0;
+  for( reco::GenParticleCollection::const_iterator part = genParticles->begin(); part != genParticles->end(); ++part ) {
+    if( part->status() != 1 ) continue;
+    if( part->pdgId() == 13 ) {
+      double dR = deltaR(part->eta(), part->phi(), mu1.eta(), mu1.phi());
+      if( dR < minDeltaR1 ) {
+        minDeltaR1 = dR;
+        genMu1 = &(*part);
+      }
+    }
+    else if( part->pdgId() == -13 ) {
+      double dR = deltaR(part->eta(), part->phi(), mu2.eta(), mu2.phi());
+      if( dR < minDeltaR2 ) {
+        minDeltaR2 = dR;
+        genMu2 = &(*part);
+      }
+    }
+  }
+  if( genMu1 == 0 || genMu2 == 0 ) {
+    if (debug) std::cout << "No gen muon matching the selected " << (genMu1 == 0 ? "mu-" : "mu+") << std::endl;
+    return genPair;
+  }
+  genPair.mu1 = genMu1->p4();
+  genPair.mu2 = genMu2->p4();
+  // Go up the muon lines (e.g. after FSR) to the mothers, which must be the same particle
+  const reco::Candidate * mother1 = genMu1->mother();
+  while( mother1 != 0 && mother1->pdgId() == 13 ) mother1 = mother1->mother();
+  const reco::Candidate * mother2 = genMu2->mother();
+  while( mother2 != 0 && mother2->pdgId() == -13 ) mother2 = mother2->mother();
+  if( mother1 != 0 && mother1 == mother2 ) genPair.motherId = mother1->pdgId();
+  else if (debug) std::cout << "The gen muons do not have the same mother" << std::endl;
+  return genPair;
+}
+
 #include "FWCore/Framework/interface/MakerMacros.h"
 DEFINE_FWK_MODULE(MuScleFitFilter);
@@ -27,6 +27,8 @@
 
 #include <CLHEP/Vector/LorentzVector.h>
 
+#include <boost/thread/mutex.hpp>
+
 // Class declaration
 // -----------------
 
@@ -39,9 +41,13 @@ class MuScleFitGenFilter : public edm::EDFilter {
   virtual bool filter(edm::Event&, const edm::EventSetup&);
   virtual void endJob() {};
 
+  /// Counts the event (under the lock, the only state changed by the events) and returns passed
+  bool count(const bool passed);
+
   std::string genParticlesName_;
   unsigned int totalEvents_;
   unsigned int eventsPassingTheFilter_;
+  boost::mutex countersMutex_;
 };
 
 // Constructor
@@ -64,10 +70,16 @@ MuScleFitGenFilter::~MuScleFitGenFilter()
 
 // Method called for each event 
 // ----------------------------
-bool MuScleFitGenFilter::filter(edm::Event& event, const edm::EventSetup& iSetup)
+bool MuScleFitGenFilter::count(const bool passed)
 {
+  boost::mutex::scoped_lock lock(countersMutex_);
   ++totalEvents_;
+  if( passed ) ++eventsPassingTheFilter_;
+  return passed;
+}
 
+bool MuScleFitGenFilter::filter(edm::Event& event, const edm::EventSetup& iSetup)
+{
   edm::Handle<edm::HepMCProduct> evtMC;
 
   std::pair<lorentzVector,lorentzVector> genPair;
@@ -86,17 +98,15 @@ bool MuScleFitGenFilter::filter(edm::Event& event, const edm::EventSetup& iSetup
     }
     else {
       std::cout << "ERROR: no generator info found" << std::endl;
-      return false;
+      return count(false);
     }
   }
   lorentzVector emptyVec(0.,0.,0.,0.);
   if( (genPair.first == emptyVec) || (genPair.second == emptyVec) ) {
-    return false;
+    return count(false);
   }
 
-  ++eventsPassingTheFilter_;
-
-  return true;
+  return count(true);
 }
 
 #include "FWCore/Framework/interface/MakerMacros.h"
@@ -0,0 +1,171 @@
+#ifndef MUSCLEFITHISTOGRAMSWRITER_H
+#define MUSCLEFITHISTOGRAMSWRITER_H
+
+#include <map>
+#include <deque>
+#include <string>
+#include <memory>
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "TROOT.h"
+#include "TFile.h"
+#include "TKey.h"
+#include "TClass.h"
+#include "TDirectory.h"
+
+#include "Histograms.h"
+
+/**
+ * Writes the histograms of each MuScleFit loop, optionally from a separate thread. <br>
+ * A set is the map of histograms of a loop together with the file where they were booked.
+ * The writer takes the ownership of both: it writes the histograms, closes and deletes the file and
+ * deletes the histograms. <br>
+ * If an output file is given, the content of each loop file (normally a TMemFile) is also copied in a directory
+ * of the output file named after the set, so that all the loops end up in a single file. <br>
+ * In asynchronous mode at most maxQueued sets wait to be written: write blocks while the queue is full,
+ * so that a slow disk cannot make the memory grow with the number of loops. <br>
+ * ROOT I/O is not thread safe (the current directory is global): the writer does all its ROOT operations holding
+ * rootMutex, which the caller must hold while doing ROOT I/O itself (creating or changing directories, booking
+ * or writing histograms, opening or closing files). The caller must not hold it when calling write or finish.
+ */
+
+class MuScleFitHistogramsWriter
+{
+public:
+  MuScleFitHistogramsWriter( const bool asynchronous, const unsigned int maxQueued, boost::mutex & rootMutex,
+                             TFile * outputFile = 0 ) :
+    maxQueued_(maxQueued > 0 ? maxQueued : 1),
+    rootMutex_(rootMutex),
+    outputFile_(outputFile),
+    done_(false)
+  {
+    if( asynchronous ) thread_.reset(new boost::thread(boost::bind(&MuScleFitHistogramsWriter::run, this)));
+  }
+
+  ~MuScleFitHistogramsWriter()
+  {
+    finish();
+  }
+
+  /// Queues the set (or writes it directly in synchronous mode). Blocks while maxQueued sets are waiting.
+  void write( const std::map<std::string, Histograms*> & histograms, TFile * file, const std::string & directory )
+  {
+    HistogramsSet set;
+    set.histograms = histograms;
+    set.file = file;
+    set.directory = directory;
+    if( thread_.get() == 0 ) {
+      writeSet(set);
+      return;
+    }
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while( queue_.size() >= maxQueued_ ) notFull_.wait(lock);
+    queue_.push_back(set);
+    notEmpty_.notify_one();
+  }
+
+  /// Waits for all the queued sets to be written, then closes the output file
+  void finish()
+  {
+    if( thread_.get() != 0 ) {
+      {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        done_ = true;
+        notEmpty_.notify_one();
+      }
+      thread_->join();
+      thread_.reset();
+    }
+    if( outputFile_ != 0 ) {
+      boost::mutex::scoped_lock rootLock(rootMutex_);
+      outputFile_->Close();
+      delete outputFile_;
+      outputFile_ = 0;
+    }
+  }
+
+protected:
+  struct HistogramsSet
+  {
+    std::map<std::string, Histograms*> histograms;
+    TFile * file;
+    std::string directory;
+  };
+
+  void run()
+  {
+    while( true ) {
+      HistogramsSet set;
+      {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while( queue_.empty() && !done_ ) notEmpty_.wait(lock);
+        if( queue_.empty() ) return;
+        set = queue_.front();
+        queue_.pop_front();
+        notFull_.notify_one();
+      }
+      writeSet(set);
+    }
+  }
+
+  /// Same operations and order as MuScleFitBase::writeHistoMap, the closing of the file and clearHistoMap
+  void writeSet( HistogramsSet & set )
+  {
+    boost::mutex::scoped_lock rootLock(rootMutex_);
+    for( std::map<std::string, Histograms*>::const_iterator histo = set.histograms.begin();
+         histo != set.histograms.end(); ++histo ) {
+      // This is to avoid writing into subdirs
+      set.file->cd();
+      histo->second->Write();
+    }
+    if( outputFile_ != 0 ) {
+      TDirectory * directory = outputFile_->mkdir(set.directory.c_str());
+      copyDirectory(set.file, directory);
+    }
+    set.file->Close();
+    delete set.file;
+    for( std::map<std::string, Histograms*>::const_iterator histo = set.histograms.begin();
+         histo != set.histograms.end(); ++histo ) {
+      delete histo->second;
+    }
+    // Do not leave the current directory in a file of the writer
+    gROOT->cd();
+  }
+
+  /// Copies all the objects written in the source directory (and in its subdirectories) to the target directory
+  static void copyDirectory( TDirectory * source, TDirectory * target )
+  {
+    TIter next(source->GetListOfKeys());
+    TKey * key = 0;
+    while( (key = (TKey*)next()) != 0 ) {
+      TClass * objectClass = TClass::GetClass(key->GetClassName());
+      if( objectClass != 0 && objectClass->InheritsFrom(TDirectory::Class()) ) {
+        TDirectory * subDirectory = target->GetDirectory(key->GetName());
+        if( subDirectory == 0 ) subDirectory = target->mkdir(key->GetName());
+        copyDirectory(source->GetDirectory(key->GetName()), subDirectory);
+      }
+      else {
+        TObject * object = key->ReadObj();
+        target->WriteTObject(object, key->GetName());
+        delete object;
+      }
+    }
+  }
+
+  unsigned int maxQueued_;
+  boost::mutex & rootMutex_;
+  TFile * outputFile_;
+  bool done_;
+  std::deque<HistogramsSet> queue_;
+  boost::mutex mutex_;
+  boost::condition_variable notEmpty_;
+  boost::condition_variable notFull_;
+  std::auto_ptr<boost::thread> thread_;
+};
+
+#endif
@@ -5,7 +5,13 @@
 //
 /**
  * Produce a new muon collection with corrected Pt. <br>
- * It is also possible to apply a smearing to the muons Pt.
+ * It is also possible to apply a smearing to the muons Pt. <br>
+ * With OutputMode = "valueMap" the muons are not copied: the corrected Pt is stored in a ValueMap<float> ("pt")
+ * keyed to the input collection and, if SaveResolution is true, the relative Pt resolution of the
+ * ResolutionFunction at the corrected Pt in a second ValueMap<float> ("resolution"). <br>
+ * The module does not modify its state while processing the events: the corrector of the current IOV is
+ * kept in a cache shared by all the events and replaced under a lock when the IOV changes, so that
+ * events can be processed concurrently.
  */
 //
 // Original Author:  Marco De Mattia,40 3-B32,+41227671551,
@@ -17,6 +23,8 @@
 // system include files
 #include <memory>
 #include <string>
+#include <vector>
+#include <iostream>
 
 // user include files
 #include "FWCore/Framework/interface/Frameworkfwd.h"
@@ -26,11 +34,13 @@
 #include "FWCore/Framework/interface/MakerMacros.h"
 
 #include "FWCore/Utilities/interface/InputTag.h"
+#include "FWCore/Utilities/interface/Exception.h"
 #include "FWCore/ParameterSet/interface/ParameterSet.h"
 
 #include "DataFormats/MuonReco/interface/Muon.h"
 #include "DataFormats/MuonReco/interface/MuonFwd.h"
 #include "DataFormats/Candidate/interface/LeafCandidate.h"
+#include "DataFormats/Common/interface/ValueMap.h"
 
 #include "DataFormats/TrackReco/interface/Track.h"
 #include "DataFormats/PatCandidates/interface/Muon.h"
@@ -44,6 +54,10 @@
 #include "FWCore/Framework/interface/EventSetup.h"
 #include "FWCore/Framework/interface/ESHandle.h"
 #include "MuonAnalysis/MomentumScaleCalibration/interface/MomentumScaleCorrector.h"
+#include "MuonAnalysis/MomentumScaleCalibration/interface/ResolutionFunction.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 class MuScleFitMuonProducer : public edm::EDProducer {
    public:
@@ -54,23 +68,63 @@ class MuScleFitMuonProducer : public edm::EDProducer {
       virtual void beginJob() ;
       virtual void produce(edm::Event&, const edm::EventSetup&);
       virtual void endJob() ;
-      template<class T> std::auto_ptr<T> applyCorrection(const edm::Handle<T> & allMuons);
+      /// Corrector (and resolution) built from the parameters of an IOV, shared by all the events of the IOV
+      struct Corrections
+      {
+        boost::shared_ptr<MomentumScaleCorrector> corrector;
+        boost::shared_ptr<ResolutionFunction> resolution;
+      };
+      /// Returns the corrections of the current IOV, building them if the IOV changed
+      Corrections corrections(const edm::EventSetup & iSetup) const;
+      template<class T> std::auto_ptr<T> applyCorrection(const edm::Handle<T> & allMuons, const Corrections & corrections) const;
+      /// Puts in the event the ValueMaps of the corrected Pt (and resolution) of the muons in the input collection
+      template<class T> void fillValueMaps(edm::Event & iEvent, const edm::Handle<T> & allMuons, const Corrections & corrections) const;
 
   edm::InputTag theMuonLabel_;
   bool patMuons_;
-  edm::ESHandle<MuScleFitDBobject> dbObject_;
   std::string dbObjectLabel_;
-  unsigned long long dbObjectCacheId_;
-  boost::shared_ptr<MomentumScaleCorrector> corrector_;
+  bool valueMapOutput_;
+  bool saveResolution_;
+  std::string resolutionDbObjectLabel_;
+  // Optional grid on which the correction is sampled (see MomentumScaleCorrector::setGrid)
+  bool useCorrectionGrid_;
+  edm::ParameterSet correctionGrid_;
+
+  // Cache of the corrections, with the identifier of the record they were built from
+  mutable boost::mutex cacheMutex_;
+  mutable unsigned long long dbObjectCacheId_;
+  mutable Corrections cache_;
 };
 
 MuScleFitMuonProducer::MuScleFitMuonProducer(const edm::ParameterSet& iConfig) :
   theMuonLabel_( iConfig.getParameter<edm::InputTag>( "MuonLabel" ) ),
   patMuons_( iConfig.getParameter<bool>( "PatMuons" ) ),
   dbObjectLabel_( iConfig.getUntrackedParameter<std::string>("DbObjectLabel", "") ),
-  dbObjectCacheId_(0)
+  dbObjectCacheId_(0),
+  saveResolution_( iConfig.getUntrackedParameter<bool>("SaveResolution", false) ),
+  resolutionDbObjectLabel_( iConfig.getUntrackedParameter<std::string>("ResolutionDbObjectLabel", "") ),
+  useCorrectionGrid_( iConfig.getUntrackedParameter<bool>("UseCorrectionGrid", false) )
 {
-  if ( patMuons_ == true ) {
+  if( useCorrectionGrid_ ) correctionGrid_ = iConfig.getUntrackedParameter<edm::ParameterSet>("CorrectionGrid");
+  std::string outputMode( iConfig.getUntrackedParameter<std::string>("OutputMode", "collection") );
+  if( outputMode != "collection" && outputMode != "valueMap" ) {
+    std::cout << "Unknown OutputMode " << outputMode << ". Valid values are collection and valueMap" << std::endl;
+    exit(1);
+  }
+  valueMapOutput_ = (outputMode == "valueMap");
+  // The resolution is only stored in the ValueMap output
+  saveResolution_ = saveResolution_ && valueMapOutput_;
+  // The resolution parameters are in a different payload than the scale ones: reading them with the
+  // scale label would silently store a resolution computed from the scale parameters
+  if( saveResolution_ && (resolutionDbObjectLabel_.empty() || resolutionDbObjectLabel_ == dbObjectLabel_) ) {
+    throw cms::Exception("Configuration") << "MuScleFitMuonProducer: SaveResolution requires a ResolutionDbObjectLabel"
+                                          << " different from the DbObjectLabel (\"" << dbObjectLabel_ << "\"), got \""
+                                          << resolutionDbObjectLabel_ << "\"" << std::endl;
+  }
+  if ( valueMapOutput_ ) {
+    produces<edm::ValueMap<float> >("pt");
+    if( saveResolution_ ) produces<edm::ValueMap<float> >("resolution");
+  } else if ( patMuons_ == true ) {
     produces<pat::MuonCollection>();
   } else {
     produces<reco::MuonCollection>();
@@ -84,54 +138,122 @@ MuScleFitMuonProducer::~MuScleFitMuonProducer()
 
 
 template<class T>
-std::auto_ptr<T> MuScleFitMuonProducer::applyCorrection(const edm::Handle<T> & allMuons)
+std::auto_ptr<T> MuScleFitMuonProducer::applyCorrection(const edm::Handle<T> & allMuons, const Corrections & corrections) const
 {
   std::auto_ptr<T> pOut(new T);
+  pOut->reserve(allMuons->size());
+
+  std::vector<double> pts;
+  corrections.corrector->correct(*allMuons, pts);
 
   // Apply the correction and produce the new muons
-  for( typename T::const_iterator muon = allMuons->begin(); muon != allMuons->end(); ++muon ) {
+  std::vector<double>::const_iterator correctedPt = pts.begin();
+  for( typename T::const_iterator muon = allMuons->begin(); muon != allMuons->end(); ++muon, ++correctedPt ) {
 
     //std::cout << "Pt before correction = " << muon->pt() << std::endl;
-    double pt = (*corrector_)(*muon);
+    double pt = *correctedPt;
     //std::cout << "Pt after correction = " << pt << std::endl;
     double eta = muon->eta();
     double phi = muon->phi();
 
-    typename T::value_type * newMuon = muon->clone();
-    newMuon->setP4( reco::Particle::PolarLorentzVector( pt, eta, phi, muon->mass() ) );
-
-    pOut->push_back(*newMuon);
+    // Copy the muon directly in the output collection and correct it there
+    pOut->push_back(*muon);
+    pOut->back().setP4( reco::Particle::PolarLorentzVector( pt, eta, phi, muon->mass() ) );
   }
   return pOut;
 }
 
-// ------------ method called to produce the data  ------------
-void MuScleFitMuonProducer::produce(edm::Event& iEvent, const edm::EventSetup& iSetup)
+template<class T>
+void MuScleFitMuonProducer::fillValueMaps(edm::Event & iEvent, const edm::Handle<T> & allMuons, const Corrections & corrections) const
+{
+  std::vector<double> correctedPts;
+  corrections.corrector->correct(*allMuons, correctedPts);
+  std::vector<float> pts(correctedPts.begin(), correctedPts.end());
+  std::vector<float> resolutions;
+  if( saveResolution_ ) {
+    resolutions.reserve(allMuons->size());
+    std::vector<double>::const_iterator correctedPt = correctedPts.begin();
+    for( typename T::const_iterator muon = allMuons->begin(); muon != allMuons->end(); ++muon, ++correctedPt ) {
+      reco::Particle::PolarLorentzVector correctedMuon( *correctedPt, muon->eta(), muon->phi(), muon->mass() );
+      resolutions.push_back(corrections.resolution->sigmaPt(correctedMuon));
+    }
+  }
+
+  std::auto_ptr<edm::ValueMap<float> > ptMap(new edm::ValueMap<float>());
+  edm::ValueMap<float>::Filler ptFiller(*ptMap);
+  ptFiller.insert(allMuons, pts.begin(), pts.end());
+  ptFiller.fill();
+  iEvent.put(ptMap, "pt");
+
+  if( saveResolution_ ) {
+    std::auto_ptr<edm::ValueMap<float> > resolutionMap(new edm::ValueMap<float>());
+    edm::ValueMap<float>::Filler resolutionFiller(*resolutionMap);
+    resolutionFiller.insert(allMuons, resolutions.begin(), resolutions.end());
+    resolutionFiller.fill();
+    iEvent.put(resolutionMap, "resolution");
+  }
+}
+
+MuScleFitMuonProducer::Corrections MuScleFitMuonProducer::corrections(const edm::EventSetup & iSetup) const
 {
   unsigned long long dbObjectCacheId = iSetup.get<MuScleFitDBobjectRcd>().cacheIdentifier();
-  if ( dbObjectCacheId != dbObjectCacheId_ ) {
+  boost::mutex::scoped_lock lock(cacheMutex_);
+  // The corrector is rebuilt only when the parameters change (new IOV). The events still using
+  // the previous one keep it alive through their copy of the shared pointer.
+  if ( dbObjectCacheId != dbObjectCacheId_ || cache_.corrector.get() == 0 ) {
+    edm::ESHandle<MuScleFitDBobject> dbObject;
     if ( dbObjectLabel_ != "" ) {
-      iSetup.get<MuScleFitDBobjectRcd>().get(dbObjectLabel_, dbObject_);
+      iSetup.get<MuScleFitDBobjectRcd>().get(dbObjectLabel_, dbObject);
     } else {
-      iSetup.get<MuScleFitDBobjectRcd>().get(dbObject_);
+      iSetup.get<MuScleFitDBobjectRcd>().get(dbObject);
     }
-  }
 
-  //std::cout << "identifiers size from dbObject = " << dbObject_->identifiers.size() << std::endl;
-  //std::cout << "parameters size from dbObject = " << dbObject_->parameters.size() << std::endl;;
+    //std::cout << "identifiers size from dbObject = " << dbObject->identifiers.size() << std::endl;
+    //std::cout << "parameters size from dbObject = " << dbObject->parameters.size() << std::endl;;
+
+    // Create the corrector and set the parameters
+    Corrections newCorrections;
+    newCorrections.corrector.reset(new MomentumScaleCorrector( dbObject.product() ) );
+    if( useCorrectionGrid_ ) {
+      newCorrections.corrector->setGrid( correctionGrid_.getUntrackedParameter<unsigned int>("PtBins"),
+                                         correctionGrid_.getUntrackedParameter<double>("PtMin"),
+                                         correctionGrid_.getUntrackedParameter<double>("PtMax"),
+                                         correctionGrid_.getUntrackedParameter<unsigned int>("EtaBins"),
+                                         correctionGrid_.getUntrackedParameter<double>("EtaMin"),
+                                         correctionGrid_.getUntrackedParameter<double>("EtaMax"),
+                                         correctionGrid_.getUntrackedParameter<unsigned int>("PhiBins"),
+                                         correctionGrid_.getUntrackedParameter<double>("MaxRelativeError"),
+                                         correctionGrid_.getUntrackedParameter<unsigned int>("RandomSamplesPerCell", 4) );
+    }
 
-  // Create the corrector and set the parameters
-  corrector_.reset(new MomentumScaleCorrector( dbObject_.product() ) );
+    // The resolution parameters are in the same record, with a different label
+    if( saveResolution_ ) {
+      edm::ESHandle<MuScleFitDBobject> resolutionDbObject;
+      iSetup.get<MuScleFitDBobjectRcd>().get(resolutionDbObjectLabel_, resolutionDbObject);
+      newCorrections.resolution.reset(new ResolutionFunction( resolutionDbObject.product() ) );
+    }
+    cache_ = newCorrections;
+    dbObjectCacheId_ = dbObjectCacheId;
+  }
+  return cache_;
+}
+
+// ------------ method called to produce the data  ------------
+void MuScleFitMuonProducer::produce(edm::Event& iEvent, const edm::EventSetup& iSetup)
+{
+  const Corrections currentCorrections(corrections(iSetup));
 
   if( patMuons_ == true ) {
     edm::Handle<pat::MuonCollection> allMuons;
     iEvent.getByLabel (theMuonLabel_, allMuons);
-    iEvent.put(applyCorrection(allMuons));
+    if( valueMapOutput_ ) fillValueMaps(iEvent, allMuons, currentCorrections);
+    else iEvent.put(applyCorrection(allMuons, currentCorrections));
   }
   else {
     edm::Handle<reco::MuonCollection> allMuons;
     iEvent.getByLabel (theMuonLabel_, allMuons);
-    iEvent.put(applyCorrection(allMuons));
+    if( valueMapOutput_ ) fillValueMaps(iEvent, allMuons, currentCorrections);
+    else iEvent.put(applyCorrection(allMuons, currentCorrections));
   }
 
   // put into the Event
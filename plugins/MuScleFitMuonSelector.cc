@@ -77,9 +77,11 @@ void MuScleFitMuonSelector::selectMuons(const edm::Event & event, std::vector<re
   //================onia cuts===========================/
 
   if( muonType_ <= -1 && PATmuons_) {
-    std::vector<const pat::CompositeCandidate*> collSelGG;
-    std::vector<const pat::CompositeCandidate*> collSelGT;
-    std::vector<const pat::CompositeCandidate*> collSelTT;
+    // The pairs of muons of the selected candidates, the daughters are looked up only once per candidate
+    typedef std::pair<const pat::Muon*, const pat::Muon*> MuonPtrPair;
+    std::vector<MuonPtrPair> collSelGG;
+    std::vector<MuonPtrPair> collSelGT;
+    std::vector<MuonPtrPair> collSelTT;
     if (collAll.failedToGet()) {
       std::cout << "J/psi not present in event!" << std::endl;
     } else if (collAll.isValid()) {
@@ -89,6 +91,9 @@ void MuScleFitMuonSelector::selectMuons(const edm::Event & event, std::vector<re
 
 	const pat::CompositeCandidate* cand = &(*it);
 	// cout << "Now checking candidate of type " << theJpsiCat << " with pt = " << cand->pt() << endl;
+	// The vertex probability cut is common to all the categories: check it first and only once
+	if( !(cand->userFloat("vProb") > 0.001) )
+	  continue;
 	const pat::Muon* muon1 = dynamic_cast<const pat::Muon*>(cand->daughter("muon1"));
 	const pat::Muon* muon2 = dynamic_cast<const pat::Muon*>(cand->daughter("muon2"));
 
@@ -96,76 +101,56 @@ void MuScleFitMuonSelector::selectMuons(const edm::Event & event, std::vector<re
 	  continue;
 	// global + global?
 	if (muon1->isGlobalMuon() && muon2->isGlobalMuon() ) {
-	  if (selGlobalMuon(muon1) && selGlobalMuon(muon2) && cand->userFloat("vProb") > 0.001 ) {
-	    collSelGG.push_back(cand);
+	  if (selGlobalMuon(muon1) && selGlobalMuon(muon2) ) {
+	    collSelGG.push_back(MuonPtrPair(muon1, muon2));
 	    continue;
 	  }
 	}
 	// global + tracker? (x2)
 	if (muon1->isGlobalMuon() && muon2->isTrackerMuon() ) {
-	  if (selGlobalMuon(muon1) &&  selTrackerMuon(muon2) && cand->userFloat("vProb") > 0.001 ) {
-	    collSelGT.push_back(cand);
+	  if (selGlobalMuon(muon1) &&  selTrackerMuon(muon2) ) {
+	    collSelGT.push_back(MuonPtrPair(muon1, muon2));
 	    continue;
 	  }
 	}
 	if (muon2->isGlobalMuon() && muon1->isTrackerMuon() ) {
-	  if (selGlobalMuon(muon2) && selTrackerMuon(muon1) && cand->userFloat("vProb") > 0.001) {
-	    collSelGT.push_back(cand);
+	  if (selGlobalMuon(muon2) && selTrackerMuon(muon1) ) {
+	    collSelGT.push_back(MuonPtrPair(muon1, muon2));
 	    continue;
 	  }
 	}
 	// tracker + tracker?
 	if (muon1->isTrackerMuon() && muon2->isTrackerMuon() ) {
-	  if (selTrackerMuon(muon1) && selTrackerMuon(muon2) && cand->userFloat("vProb") > 0.001) {
-	    collSelTT.push_back(cand);
+	  if (selTrackerMuon(muon1) && selTrackerMuon(muon2) ) {
+	    collSelTT.push_back(MuonPtrPair(muon1, muon2));
 	    continue;
 	  }
 	}
       }
     }
     // Split them in independent collections if using muonType_ == -2, -3 or -4. Take them all if muonType_ == -1.
-    std::vector<reco::Track> tracks;
+    std::vector<reco::TrackRef> tracks;
+    const MuonPtrPair * selected = 0;
+    //CHECK THAT THEY ARE ORDERED BY PT !!!!!!!!!!!!!!!!!!!!!!!
     if(collSelGG.size()){
-      //CHECK THAT THEY ARE ORDERED BY PT !!!!!!!!!!!!!!!!!!!!!!!
-      const pat::Muon* muon1 = dynamic_cast<const pat::Muon*>(collSelGG[0]->daughter("muon1"));
-      const pat::Muon* muon2 = dynamic_cast<const pat::Muon*>(collSelGG[0]->daughter("muon2"));
-      if( muonType_ == -1 || muonType_ == -2 ) {
-	tracks.push_back(*(muon1->innerTrack()));
-	tracks.push_back(*(muon2->innerTrack()));
-	collMuSel.push_back(muon1);
-	collMuSel.push_back(muon2);
-      }
+      if( muonType_ == -1 || muonType_ == -2 ) selected = &(collSelGG[0]);
     }
-    else if(!collSelGG.size() && collSelGT.size()){
-      //CHECK THAT THEY ARE ORDERED BY PT !!!!!!!!!!!!!!!!!!!!!!!
-      const pat::Muon* muon1 = dynamic_cast<const pat::Muon*>(collSelGT[0]->daughter("muon1"));
-      const pat::Muon* muon2 = dynamic_cast<const pat::Muon*>(collSelGT[0]->daughter("muon2"));
-      if( muonType_ == -1 || muonType_ == -3 ) {
-	tracks.push_back(*(muon1->innerTrack()));
-	tracks.push_back(*(muon2->innerTrack()));
- 	collMuSel.push_back(muon1);
-	collMuSel.push_back(muon2);
-     }
+    else if(collSelGT.size()){
+      if( muonType_ == -1 || muonType_ == -3 ) selected = &(collSelGT[0]);
     }
-    else if(!collSelGG.size() && !collSelGT.size() && collSelTT.size()){
-      //CHECK THAT THEY ARE ORDERED BY PT !!!!!!!!!!!!!!!!!!!!!!!
-      const pat::Muon* muon1 = dynamic_cast<const pat::Muon*>(collSelTT[0]->daughter("muon1"));
-      const pat::Muon* muon2 = dynamic_cast<const pat::Muon*>(collSelTT[0]->daughter("muon2"));
-      if( muonType_ == -1 || muonType_ == -4 ) {
-	tracks.push_back(*(muon1->innerTrack()));
-	tracks.push_back(*(muon2->innerTrack()));
-	collMuSel.push_back(muon1);
-	collMuSel.push_back(muon2);
-      }
+    else if(collSelTT.size()){
+      if( muonType_ == -1 || muonType_ == -4 ) selected = &(collSelTT[0]);
     }
-    if (tracks.size() != 2 && tracks.size() != 0){
-      std::cout<<"ERROR strange number of muons selected by onia cuts!"<<std::endl;
-      abort();
+    if( selected != 0 ) {
+      tracks.push_back(selected->first->innerTrack());
+      tracks.push_back(selected->second->innerTrack());
+      collMuSel.push_back(selected->first);
+      collMuSel.push_back(selected->second);
     }
     muons = fillMuonCollection(tracks);
   }
   else if( (muonType_<4 && muonType_>=0) || muonType_>=10 ) { // Muons (glb,sta,trk)
-    std::vector<reco::Track> tracks;
+    std::vector<reco::TrackRef> tracks;
     if( PATmuons_ == true ) {
       edm::Handle<pat::MuonCollection> allMuons;
       event.getByLabel( muonLabel_, allMuons );
@@ -199,9 +184,10 @@ void MuScleFitMuonSelector::selectMuons(const edm::Event & event, std::vector<re
   else if(muonType_==4){  //CaloMuons
     edm::Handle<reco::CaloMuonCollection> caloMuons;
     event.getByLabel (muonLabel_, caloMuons);
-    std::vector<reco::Track> tracks;
+    std::vector<reco::TrackRef> tracks;
+    tracks.reserve(caloMuons->size());
     for (std::vector<reco::CaloMuon>::const_iterator muon = caloMuons->begin(); muon != caloMuons->end(); ++muon){
-      tracks.push_back(*(muon->track()));
+      tracks.push_back(muon->track());
     }
     muons = fillMuonCollection(tracks);
   }
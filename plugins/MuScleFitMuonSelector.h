@@ -7,6 +7,7 @@
 #include "DataFormats/PatCandidates/interface/CompositeCandidate.h"
 #include "DataFormats/PatCandidates/interface/CompositeCandidate.h"
 #include "DataFormats/PatCandidates/interface/Muon.h"
+#include "DataFormats/TrackReco/interface/TrackFwd.h"
 #include "SimDataFormats/GeneratorProducts/interface/HepMCProduct.h"
 #include "SimDataFormats/Track/interface/SimTrackContainer.h"
 #include "FWCore/Utilities/interface/InputTag.h"
@@ -80,42 +81,60 @@ class MuScleFitMuonSelector
 			    std::vector<std::pair<lorentzVector,lorentzVector> > & simPair,
 			    MuScleFitPlotter * plotter);
 
+  /// Template function used to add a muon with the momentum and charge of the track (or muon) to the collection
+  template<typename T>
+  static void addMuon( const T & track, std::vector<reco::LeafCandidate> & muons )
+  {
+    const double p = track.p();
+    muons.push_back(reco::LeafCandidate(track.charge(),
+					reco::Particle::LorentzVector(track.px(), track.py(), track.pz(), sqrt(p*p + mMu2))));
+  }
+
   /// Template function used to convert the muon collection to a vector of reco::LeafCandidate
   template<typename T>
   std::vector<reco::LeafCandidate> fillMuonCollection( const std::vector<T>& tracks )
   {
     std::vector<reco::LeafCandidate> muons;
+    muons.reserve(tracks.size());
     typename std::vector<T>::const_iterator track;
     for( track = tracks.begin(); track != tracks.end(); ++track ) {
-      reco::Particle::LorentzVector mu;
-      mu = reco::Particle::LorentzVector(track->px(),track->py(),track->pz(),
-					 sqrt(track->p()*track->p() + mMu2));
-      reco::LeafCandidate muon(track->charge(),mu);
-      muons.push_back(muon);
+      addMuon(*track, muons);
+    }
+    return muons;
+  }
+
+  /// Same as above for references to the selected tracks: only the momentum and charge are read, the tracks are not copied
+  std::vector<reco::LeafCandidate> fillMuonCollection( const std::vector<reco::TrackRef>& tracks )
+  {
+    std::vector<reco::LeafCandidate> muons;
+    muons.reserve(tracks.size());
+    std::vector<reco::TrackRef>::const_iterator track;
+    for( track = tracks.begin(); track != tracks.end(); ++track ) {
+      addMuon(**track, muons);
     }
     return muons;
   }
 
   /// Template function used to extract the selected muon type from the muon collection
   template<typename T>
-  void takeSelectedMuonType(const T & muon, std::vector<reco::Track> & tracks)
+  void takeSelectedMuonType(const T & muon, std::vector<reco::TrackRef> & tracks)
   {
     // std::cout<<"muon "<<muon->isGlobalMuon()<<muon->isStandAloneMuon()<<muon->isTrackerMuon()<<std::endl;
     //NNBB: one muon can be of many kinds at once but with the muonType_ we are sure
     // to avoid double counting of the same muon
     if(muon->isGlobalMuon() && muonType_==1)
-      tracks.push_back(*(muon->globalTrack()));
+      tracks.push_back(muon->globalTrack());
     else if(muon->isStandAloneMuon() && muonType_==2)
-      tracks.push_back(*(muon->outerTrack()));
+      tracks.push_back(muon->outerTrack());
     else if(muon->isTrackerMuon() && muonType_==3)
-      tracks.push_back(*(muon->innerTrack()));
+      tracks.push_back(muon->innerTrack());
 
     else if( muonType_ == 10 && !(muon->isStandAloneMuon()) ) //particular case!!
-      tracks.push_back(*(muon->innerTrack()));
+      tracks.push_back(muon->innerTrack());
     else if( muonType_ == 11 && muon->isGlobalMuon() )
-      tracks.push_back(*(muon->innerTrack()));
+      tracks.push_back(muon->innerTrack());
     else if( muonType_ == 13 && muon->isTrackerMuon() )
-      tracks.push_back(*(muon->innerTrack()));
+      tracks.push_back(muon->innerTrack());
   }
 
   const edm::InputTag muonLabel_;
@@ -64,9 +64,9 @@ void MuScleFitPlotter::fillGen(const reco::GenParticleCollection* genParticles,
           pdgId==553 || pdgId==100553 || pdgId==200553 ) ) {
       genRes = mcIter->p4();
       // std::cout << "mother's mother = " << mcIter->mother()->pdgId() << std::endl;
-      if( pdgId == 23 ) mapHisto["hGenResZ"]->Fill(genRes);
-      else if( pdgId == 443 || pdgId == 100443 ) mapHisto["hGenResJPsi"]->Fill(genRes);
-      else if( pdgId == 553 || pdgId == 100553 || pdgId == 200553 ) mapHisto["hGenResUpsilon1S"]->Fill(genRes);
+      if( pdgId == 23 ) histo_.hGenResZ->Fill(genRes);
+      else if( pdgId == 443 || pdgId == 100443 ) histo_.hGenResJPsi->Fill(genRes);
+      else if( pdgId == 553 || pdgId == 100553 || pdgId == 200553 ) histo_.hGenResUpsilon1S->Fill(genRes);
     }
     //Check if it's a muon from a resonance
     if( status==1 && pdgId==13 && !PATmuons) {
@@ -76,7 +76,7 @@ void MuScleFitPlotter::fillGen(const reco::GenParticleCollection* genParticles,
         if( momPdgId == 23 ) mothersFound[0] = 1;
         if( momPdgId == 443 || momPdgId == 100443 ) mothersFound[5] = 1;
         if( momPdgId == 553 || momPdgId == 100553 || momPdgId == 200553 ) mothersFound[3] = 1;
-	mapHisto["hGenMu"]->Fill(mcIter->p4());
+	histo_.hGenMu->Fill(mcIter->p4());
 	std::cout<<"genmu "<<mcIter->p4()<<std::endl;
 	if(mcIter->charge()>0){
 	  muFromRes.first = mcIter->p4();
@@ -87,7 +87,7 @@ void MuScleFitPlotter::fillGen(const reco::GenParticleCollection* genParticles,
     }//if PATmuons you don't have the info of the mother !!! Here I assume is a JPsi
     if( status==1 && pdgId==13 && PATmuons) {
       mothersFound[5] = 1;
-      mapHisto["hGenMu"]->Fill(mcIter->p4());
+      histo_.hGenMu->Fill(mcIter->p4());
       std::cout<<"genmu "<<mcIter->p4()<<std::endl;
       if(mcIter->charge()>0){
 	muFromRes.first = mcIter->p4();
@@ -100,22 +100,22 @@ void MuScleFitPlotter::fillGen(const reco::GenParticleCollection* genParticles,
   //     std::cout<<"hgenmumu not found"<<std::endl;
 
   if( mothersFound[0] == 1 ) {
-    mapHisto["hGenMuMuZ"]->Fill(muFromRes.first+muFromRes.second);
-    mapHisto["hGenResVSMuZ"]->Fill( muFromRes.first, genRes, 1 );
-    mapHisto["hGenResVSMuZ"]->Fill( muFromRes.second,genRes, -1 );
+    histo_.hGenMuMuZ->Fill(muFromRes.first+muFromRes.second);
+    histo_.hGenResVSMuZ->Fill( muFromRes.first, genRes, 1 );
+    histo_.hGenResVSMuZ->Fill( muFromRes.second,genRes, -1 );
   }
   if( mothersFound[3] == 1 ) {
-    mapHisto["hGenMuMuUpsilon1S"]->Fill(muFromRes.first+muFromRes.second);
-    mapHisto["hGenResVSMuUpsilon1S"]->Fill( muFromRes.first, genRes, 1 );
-    mapHisto["hGenResVSMuUpsilon1S"]->Fill( muFromRes.second,genRes, -1 );
+    histo_.hGenMuMuUpsilon1S->Fill(muFromRes.first+muFromRes.second);
+    histo_.hGenResVSMuUpsilon1S->Fill( muFromRes.first, genRes, 1 );
+    histo_.hGenResVSMuUpsilon1S->Fill( muFromRes.second,genRes, -1 );
   }
   if( mothersFound[5] == 1 ) {
-    mapHisto["hGenMuMuJPsi"]->Fill(muFromRes.first+muFromRes.second);
-    mapHisto["hGenResVSMuJPsi"]->Fill( muFromRes.first, genRes, 1 );
-    mapHisto["hGenResVSMuJPsi"]->Fill( muFromRes.second,genRes, -1 );
+    histo_.hGenMuMuJPsi->Fill(muFromRes.first+muFromRes.second);
+    histo_.hGenResVSMuJPsi->Fill( muFromRes.first, genRes, 1 );
+    histo_.hGenResVSMuJPsi->Fill( muFromRes.second,genRes, -1 );
   }
 
-  mapHisto["hGenResVsSelf"]->Fill( genRes, genRes, 1 );
+  histo_.hGenResVsSelf->Fill( genRes, genRes, 1 );
 }
 
 // Find and store in histograms the generated resonance and muons
@@ -153,7 +153,7 @@ void MuScleFitPlotter::fillGen(const edm::HepMCProduct* evtMC, bool sherpaFlag_)
       }
       
     }
-    mapHisto["hGenResZ"]->Fill(muFromRes.first+muFromRes.second);   
+    histo_.hGenResZ->Fill(muFromRes.first+muFromRes.second);   
   }
   else{
     for (HepMC::GenEvent::particle_const_iterator part=Evt->particles_begin(); 
@@ -173,11 +173,11 @@ void MuScleFitPlotter::fillGen(const edm::HepMCProduct* evtMC, bool sherpaFlag_)
 	  genRes = reco::Particle::LorentzVector((*part)->momentum().px(),(*part)->momentum().py(),
 						 (*part)->momentum().pz(),(*part)->momentum().e());
 	  
-	  if( pdgId == 23 ) mapHisto["hGenResZ"]->Fill(genRes);
-	  if( pdgId == 443 ) mapHisto["hGenResJPsi"]->Fill(genRes);
+	  if( pdgId == 23 ) histo_.hGenResZ->Fill(genRes);
+	  if( pdgId == 443 ) histo_.hGenResJPsi->Fill(genRes);
 	  if( pdgId == 553 ) {
 	    // std::cout << "genRes mass = " << CLHEP::HepLorentzVector(genRes.x(),genRes.y(),genRes.z(),genRes.t()).m() << std::endl;
-	    mapHisto["hGenResUpsilon1S"]->Fill(genRes);
+	    histo_.hGenResUpsilon1S->Fill(genRes);
 	  }
 	}
       
@@ -198,9 +198,9 @@ void MuScleFitPlotter::fillGen(const edm::HepMCProduct* evtMC, bool sherpaFlag_)
 	  }
 	  
 	  if(fromRes) {	
-	    mapHisto["hGenMu"]->Fill(reco::Particle::LorentzVector((*part)->momentum().px(),(*part)->momentum().py(),
+	    histo_.hGenMu->Fill(reco::Particle::LorentzVector((*part)->momentum().px(),(*part)->momentum().py(),
 								   (*part)->momentum().pz(),(*part)->momentum().e()));
-	    mapHisto["hGenMuVSEta"]->Fill(reco::Particle::LorentzVector((*part)->momentum().px(),(*part)->momentum().py(),
+	    histo_.hGenMuVSEta->Fill(reco::Particle::LorentzVector((*part)->momentum().px(),(*part)->momentum().py(),
 									(*part)->momentum().pz(),(*part)->momentum().e()));
 	    if((*part)->pdg_id()==-13)
 	      muFromRes.first = (reco::Particle::LorentzVector((*part)->momentum().px(),(*part)->momentum().py(),
@@ -214,21 +214,21 @@ void MuScleFitPlotter::fillGen(const edm::HepMCProduct* evtMC, bool sherpaFlag_)
     }
   }
   if( mothersFound[0] == 1 ) {
-    mapHisto["hGenMuMuZ"]->Fill(muFromRes.first+muFromRes.second);
-    mapHisto["hGenResVSMuZ"]->Fill( muFromRes.first, genRes, 1 );
-    mapHisto["hGenResVSMuZ"]->Fill( muFromRes.second,genRes, -1 );
+    histo_.hGenMuMuZ->Fill(muFromRes.first+muFromRes.second);
+    histo_.hGenResVSMuZ->Fill( muFromRes.first, genRes, 1 );
+    histo_.hGenResVSMuZ->Fill( muFromRes.second,genRes, -1 );
   }
   if( mothersFound[3] == 1 ) {
-    mapHisto["hGenMuMuUpsilon1S"]->Fill(muFromRes.first+muFromRes.second);
-    mapHisto["hGenResVSMuUpsilon1S"]->Fill( muFromRes.first, genRes, 1 );
-    mapHisto["hGenResVSMuUpsilon1S"]->Fill( muFromRes.second,genRes, -1 );
+    histo_.hGenMuMuUpsilon1S->Fill(muFromRes.first+muFromRes.second);
+    histo_.hGenResVSMuUpsilon1S->Fill( muFromRes.first, genRes, 1 );
+    histo_.hGenResVSMuUpsilon1S->Fill( muFromRes.second,genRes, -1 );
   }
   if( mothersFound[5] == 1 ) {
-    mapHisto["hGenMuMuJPsi"]->Fill(muFromRes.first+muFromRes.second);
-    mapHisto["hGenResVSMuJPsi"]->Fill( muFromRes.first, genRes, 1 );
-    mapHisto["hGenResVSMuJPsi"]->Fill( muFromRes.second,genRes, -1 );
+    histo_.hGenMuMuJPsi->Fill(muFromRes.first+muFromRes.second);
+    histo_.hGenResVSMuJPsi->Fill( muFromRes.first, genRes, 1 );
+    histo_.hGenResVSMuJPsi->Fill( muFromRes.second,genRes, -1 );
   }
-  mapHisto["hGenResVsSelf"]->Fill( genRes, genRes, 1 );
+  histo_.hGenResVsSelf->Fill( genRes, genRes, 1 );
 }
 
 // Find and store in histograms the simulated resonance and muons
@@ -242,10 +242,10 @@ void MuScleFitPlotter::fillSim(edm::Handle<edm::SimTrackContainer> simTracks)
     // Select the muons from all the simulated tracks
     if (fabs((*simTrack).type())==13) {
       simMuons.push_back(*simTrack);	  
-      mapHisto["hSimMu"]->Fill((*simTrack).momentum());
+      histo_.hSimMu->Fill((*simTrack).momentum());
     }
   }
-  mapHisto["hSimMu"]->Fill(simMuons.size());
+  histo_.hSimMu->Fill(simMuons.size());
 
   // Recombine all the possible Z from simulated muons
   if( simMuons.size() >= 2 ) {
@@ -256,7 +256,7 @@ void MuScleFitPlotter::fillSim(edm::Handle<edm::SimTrackContainer> simTracks)
 	// Try all the pairs with opposite charge
 	if (((*imu).charge()*(*imu2).charge())<0) {
 	  reco::Particle::LorentzVector Z = (*imu).momentum()+(*imu2).momentum();
-	  mapHisto["hSimMuPMuM"]->Fill(Z); 
+	  histo_.hSimMuPMuM->Fill(Z); 
 	}
       }
     }
@@ -264,11 +264,11 @@ void MuScleFitPlotter::fillSim(edm::Handle<edm::SimTrackContainer> simTracks)
     // Plots for the best possible simulated resonance
     std::pair<SimTrack,SimTrack> simMuFromBestRes = MuScleFitUtils::findBestSimuRes(simMuons);
     reco::Particle::LorentzVector bestSimZ = (simMuFromBestRes.first).momentum()+(simMuFromBestRes.second).momentum();
-    mapHisto["hSimBestRes"]->Fill(bestSimZ);
+    histo_.hSimBestRes->Fill(bestSimZ);
     if (fabs(simMuFromBestRes.first.momentum().eta())<2.5 && fabs(simMuFromBestRes.second.momentum().eta())<2.5 &&
 	simMuFromBestRes.first.momentum().pt()>2.5 && simMuFromBestRes.second.momentum().pt()>2.5) {
-      mapHisto["hSimBestResVSMu"]->Fill (simMuFromBestRes.first.momentum(), bestSimZ, int(simMuFromBestRes.first.charge()));
-      mapHisto["hSimBestResVSMu"]->Fill (simMuFromBestRes.second.momentum(),bestSimZ, int(simMuFromBestRes.second.charge()));
+      histo_.hSimBestResVSMu->Fill (simMuFromBestRes.first.momentum(), bestSimZ, int(simMuFromBestRes.first.charge()));
+      histo_.hSimBestResVSMu->Fill (simMuFromBestRes.second.momentum(),bestSimZ, int(simMuFromBestRes.second.charge()));
     }
   }
 }
@@ -281,7 +281,7 @@ void MuScleFitPlotter::fillGenSim(edm::Handle<edm::HepMCProduct> evtMC, edm::Han
     MuScleFitUtils::findSimMuFromRes(evtMC,simTracks);
   //Fill resonance info
   reco::Particle::LorentzVector rightSimRes = (simMuFromRes.first)+(simMuFromRes.second);
-  mapHisto["hSimRightRes"]->Fill(rightSimRes);
+  histo_.hSimRightRes->Fill(rightSimRes);
   /*if ((fabs(simMuFromRes.first.Eta())<2.5 && fabs(simMuFromRes.second.Eta())<2.5) 
     && simMuFromRes.first.Pt()>2.5 && simMuFromRes.second.Pt()>2.5) {
   }*/
@@ -292,30 +292,30 @@ void MuScleFitPlotter::fillGenSim(edm::Handle<edm::HepMCProduct> evtMC, edm::Han
 void MuScleFitPlotter::fillRec(std::vector<reco::LeafCandidate>& muons)
 {
   for(std::vector<reco::LeafCandidate>::const_iterator mu1 = muons.begin(); mu1!=muons.end(); mu1++){
-    mapHisto["hRecMu"]->Fill(mu1->p4());
-    mapHisto["hRecMuVSEta"]->Fill(mu1->p4());
+    histo_.hRecMu->Fill(mu1->p4());
+    histo_.hRecMuVSEta->Fill(mu1->p4());
     for(std::vector<reco::LeafCandidate>::const_iterator mu2 = muons.begin(); mu2!=muons.end(); mu2++){  
       if (mu1->charge()<0 || mu2->charge()>0)
 	continue;
       reco::Particle::LorentzVector Res (mu1->p4()+mu2->p4());
-      mapHisto["hRecMuPMuM"]->Fill(Res);	  
+      histo_.hRecMuPMuM->Fill(Res);	  
     } 
   }
-  mapHisto["hRecMu"]->Fill(muons.size());
+  histo_.hRecMu->Fill(muons.size());
 }
 
 /// Used when running on the root tree containing preselected muon pairs
-void MuScleFitPlotter::fillTreeRec( const std::vector<std::pair<reco::Particle::LorentzVector, reco::Particle::LorentzVector> > & savedPairs )
+void MuScleFitPlotter::fillTreeRec( const MuonPairEvents & savedPairs )
 {
-  std::vector<std::pair<reco::Particle::LorentzVector, reco::Particle::LorentzVector> >::const_iterator muonPair = savedPairs.begin();
+  MuonPairEvents::const_iterator muonPair = savedPairs.begin();
   for( ; muonPair != savedPairs.end(); ++muonPair ) {
-    mapHisto["hRecMu"]->Fill(muonPair->first);
-    mapHisto["hRecMuVSEta"]->Fill(muonPair->first);
-    mapHisto["hRecMu"]->Fill(muonPair->second);
-    mapHisto["hRecMuVSEta"]->Fill(muonPair->second);
+    histo_.hRecMu->Fill(muonPair->first);
+    histo_.hRecMuVSEta->Fill(muonPair->first);
+    histo_.hRecMu->Fill(muonPair->second);
+    histo_.hRecMuVSEta->Fill(muonPair->second);
     reco::Particle::LorentzVector Res( muonPair->first+muonPair->second );
-    mapHisto["hRecMuPMuM"]->Fill(Res);
-    mapHisto["hRecMu"]->Fill(savedPairs.size());
+    histo_.hRecMuPMuM->Fill(Res);
+    histo_.hRecMu->Fill(savedPairs.size());
   }
 }
 
@@ -324,24 +324,24 @@ void MuScleFitPlotter::fillTreeRec( const std::vector<std::pair<reco::Particle::
  * ATTENTION: since we do not have any id information when reading from the root tree, we always
  * fill the Z histograms by default.
  */
-void MuScleFitPlotter::fillTreeGen( const std::vector<std::pair<reco::Particle::LorentzVector, reco::Particle::LorentzVector> > & genPairs )
+void MuScleFitPlotter::fillTreeGen( const MuonPairEvents & genPairs )
 {
-  std::vector<std::pair<reco::Particle::LorentzVector, reco::Particle::LorentzVector> >::const_iterator genPair = genPairs.begin();
+  MuonPairEvents::const_iterator genPair = genPairs.begin();
   for( ; genPair != genPairs.end(); ++genPair ) {
     reco::Particle::LorentzVector genRes(genPair->first+genPair->second);
-    mapHisto["hGenResZ"]->Fill(genRes);
-    mapHisto["hGenMu"]->Fill(genPair->first);
-    mapHisto["hGenMuVSEta"]->Fill(genPair->first);
-    mapHisto["hGenMuMuZ"]->Fill(genRes);
-    mapHisto["hGenResVSMuZ"]->Fill( genPair->first, genRes, 1 );
-    mapHisto["hGenResVSMuZ"]->Fill( genPair->second, genRes, -1 );
-    mapHisto["hGenMuMuUpsilon1S"]->Fill(genRes);
-    mapHisto["hGenResVSMuUpsilon1S"]->Fill( genPair->first, genRes, 1 );
-    mapHisto["hGenResVSMuUpsilon1S"]->Fill( genPair->second, genRes, -1 );
-    mapHisto["hGenMuMuJPsi"]->Fill(genRes);
-    mapHisto["hGenResVSMuJPsi"]->Fill( genPair->first, genRes, 1 );
-    mapHisto["hGenResVSMuJPsi"]->Fill( genPair->second, genRes, -1 );
-    mapHisto["hGenResVsSelf"]->Fill( genRes, genRes, 1 );
+    histo_.hGenResZ->Fill(genRes);
+    histo_.hGenMu->Fill(genPair->first);
+    histo_.hGenMuVSEta->Fill(genPair->first);
+    histo_.hGenMuMuZ->Fill(genRes);
+    histo_.hGenResVSMuZ->Fill( genPair->first, genRes, 1 );
+    histo_.hGenResVSMuZ->Fill( genPair->second, genRes, -1 );
+    histo_.hGenMuMuUpsilon1S->Fill(genRes);
+    histo_.hGenResVSMuUpsilon1S->Fill( genPair->first, genRes, 1 );
+    histo_.hGenResVSMuUpsilon1S->Fill( genPair->second, genRes, -1 );
+    histo_.hGenMuMuJPsi->Fill(genRes);
+    histo_.hGenResVSMuJPsi->Fill( genPair->first, genRes, 1 );
+    histo_.hGenResVSMuJPsi->Fill( genPair->second, genRes, -1 );
+    histo_.hGenResVsSelf->Fill( genRes, genRes, 1 );
   }
 }
 
@@ -383,6 +383,28 @@ void MuScleFitPlotter::fillHistoMap() {
   mapHisto["hRecMu"]      = new HParticle ("hRecMu");
   mapHisto["hRecMuVSEta"]      = new HPartVSEta ("hRecMuVSEta");
   mapHisto["hRecMuPMuM"]         = new HParticle  ("hRecMuPMuM");
+
+  // Resolve the histograms once, the fill methods do not look up the map
+  histo_.hGenResJPsi = findHistogram(mapHisto, "hGenResJPsi");
+  histo_.hGenResUpsilon1S = findHistogram(mapHisto, "hGenResUpsilon1S");
+  histo_.hGenResZ = findHistogram(mapHisto, "hGenResZ");
+  histo_.hGenMu = findHistogram(mapHisto, "hGenMu");
+  histo_.hGenMuVSEta = findHistogram(mapHisto, "hGenMuVSEta");
+  histo_.hGenMuMuJPsi = findHistogram(mapHisto, "hGenMuMuJPsi");
+  histo_.hGenResVSMuJPsi = findHistogram(mapHisto, "hGenResVSMuJPsi");
+  histo_.hGenMuMuUpsilon1S = findHistogram(mapHisto, "hGenMuMuUpsilon1S");
+  histo_.hGenResVSMuUpsilon1S = findHistogram(mapHisto, "hGenResVSMuUpsilon1S");
+  histo_.hGenMuMuZ = findHistogram(mapHisto, "hGenMuMuZ");
+  histo_.hGenResVSMuZ = findHistogram(mapHisto, "hGenResVSMuZ");
+  histo_.hGenResVsSelf = findHistogram(mapHisto, "hGenResVsSelf");
+  histo_.hSimMu = findHistogram(mapHisto, "hSimMu");
+  histo_.hSimMuPMuM = findHistogram(mapHisto, "hSimMuPMuM");
+  histo_.hSimBestRes = findHistogram(mapHisto, "hSimBestRes");
+  histo_.hSimBestResVSMu = findHistogram(mapHisto, "hSimBestResVSMu");
+  histo_.hSimRightRes = findHistogram(mapHisto, "hSimRightRes");
+  histo_.hRecMu = findHistogram(mapHisto, "hRecMu");
+  histo_.hRecMuVSEta = findHistogram(mapHisto, "hRecMuVSEta");
+  histo_.hRecMuPMuM = findHistogram(mapHisto, "hRecMuPMuM");
 }  
 
 
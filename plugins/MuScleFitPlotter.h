@@ -14,6 +14,7 @@
 #include "DataFormats/HepMCCandidate/interface/GenParticleFwd.h"
 #include "SimDataFormats/Track/interface/SimTrackContainer.h"
 #include "Histograms.h"
+#include "MuonAnalysis/MomentumScaleCalibration/interface/MuonPairEvents.h"
 
 namespace edm {
   class ParameterSet;
@@ -44,8 +45,8 @@ class MuScleFitPlotter{
   void fillRec(std::vector<reco::LeafCandidate>& muons);
 
   // Root tree specific
-  void fillTreeRec( const std::vector<std::pair<reco::Particle::LorentzVector, reco::Particle::LorentzVector> > & savedPairs );
-  void fillTreeGen( const std::vector<std::pair<reco::Particle::LorentzVector, reco::Particle::LorentzVector> > & genPairs );
+  void fillTreeRec( const MuonPairEvents & savedPairs );
+  void fillTreeGen( const MuonPairEvents & genPairs );
 
   void fillHistoMap();
   void writeHistoMap();
@@ -58,6 +59,31 @@ class MuScleFitPlotter{
   // The map of histograms
   // ---------------------
   std::map<std::string, Histograms*> mapHisto;
+  // Pointers to the histograms of the map used by the fill methods, named as in the map
+  struct HistoHandles
+  {
+    Histograms * hGenResJPsi;
+    Histograms * hGenResUpsilon1S;
+    Histograms * hGenResZ;
+    Histograms * hGenMu;
+    Histograms * hGenMuVSEta;
+    Histograms * hGenMuMuJPsi;
+    Histograms * hGenResVSMuJPsi;
+    Histograms * hGenMuMuUpsilon1S;
+    Histograms * hGenResVSMuUpsilon1S;
+    Histograms * hGenMuMuZ;
+    Histograms * hGenResVSMuZ;
+    Histograms * hGenResVsSelf;
+    Histograms * hSimMu;
+    Histograms * hSimMuPMuM;
+    Histograms * hSimBestRes;
+    Histograms * hSimBestResVSMu;
+    Histograms * hSimRightRes;
+    Histograms * hRecMu;
+    Histograms * hRecMuVSEta;
+    Histograms * hRecMuPMuM;
+  };
+  HistoHandles histo_;
   TFile * outputFile;
 
 };
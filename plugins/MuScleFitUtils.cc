@@ -40,6 +40,11 @@
 #include <iostream>
 #include <fstream>
 #include <memory> // to use the auto_ptr
+#include <algorithm>
+#include <limits>
+
+#include <boost/thread/tss.hpp>
+#include <boost/thread/mutex.hpp>
 
 // Includes the definitions of all the bias and scale functions
 // These functions are selected in the constructor according
@@ -81,9 +86,33 @@ double g[11][100];
 
 // Lorentzian convoluted with a gaussian:
 // --------------------------------------
-TF1 * GL = new TF1 ("GL",
-		    "0.5/3.1415926*[0]/(pow(x-[1],2)+pow(0.5*[0],2))*exp(-0.5*pow((x-[2])/[3],2))/([3]*sqrt(6.283185))",
-		    0, 1000);
+// massProb sets the parameters of the function, so each thread uses its own copy.
+// The copy is deleted when the thread exits: creations and deletions are serialized since the
+// functions register in the list of functions of gROOT.
+static boost::mutex GLMutex;
+static unsigned int GLCounter = 0;
+
+static void deleteFunction( TF1 * function )
+{
+  boost::mutex::scoped_lock lock(GLMutex);
+  delete function;
+}
+static boost::thread_specific_ptr<TF1> threadGL(&deleteFunction);
+
+static TF1 * lorentzGaussian()
+{
+  if( threadGL.get() == 0 ) {
+    // A new TF1 deletes the function with the same name, so each copy has its own name
+    boost::mutex::scoped_lock lock(GLMutex);
+    TString name("GL");
+    if( GLCounter > 0 ) name += GLCounter;
+    ++GLCounter;
+    threadGL.reset(new TF1 (name,
+                            "0.5/3.1415926*[0]/(pow(x-[1],2)+pow(0.5*[0],2))*exp(-0.5*pow((x-[2])/[3],2))/([3]*sqrt(6.283185))",
+                            0, 1000));
+  }
+  return threadGL.get();
+}
 
 TF2 * GL2= new TF2 ("GL2",
   "0.5/3.1415926*[0]/(pow(x-[1],2)+pow(0.5*[0],2))*exp(-0.5*pow((x-y)/[2],2))/([2]*sqrt(6.283185))",
@@ -101,75 +130,11 @@ TF2 * GL2= new TF2 ("GL2",
 //   "0.5/3.1415926*[0]/(pow(x-[1],2)+pow(0.5*[0],2))*exp(-0.5*pow((x-[2])/[3],2))/([3]*sqrt(6.283185))+exp([4]+[5]*x)",
 //   0, 1000);
 
-std::vector<int> MuScleFitUtils::doResolFit;
-std::vector<int> MuScleFitUtils::doScaleFit;
-std::vector<int> MuScleFitUtils::doCrossSectionFit;
-std::vector<int> MuScleFitUtils::doBackgroundFit;
-
-int MuScleFitUtils::minuitLoop_ = 0;
-TH1D* MuScleFitUtils::likelihoodInLoop_ = 0;
-TH1D* MuScleFitUtils::signalProb_ = 0;
-TH1D* MuScleFitUtils::backgroundProb_ = 0;
-
-bool MuScleFitUtils::duringMinos_ = false;
-
 const int MuScleFitUtils::totalResNum = 6;
 
-int MuScleFitUtils::SmearType = 0;
-smearFunctionBase * MuScleFitUtils::smearFunction = 0;
-int MuScleFitUtils::BiasType  = 0;
-// No error, we take functions from the same group for bias and scale.
-scaleFunctionBase<std::vector<double> > * MuScleFitUtils::biasFunction = 0;
-int MuScleFitUtils::ResolFitType = 0;
-resolutionFunctionBase<double *> * MuScleFitUtils::resolutionFunction = 0;
-resolutionFunctionBase<std::vector<double> > * MuScleFitUtils::resolutionFunctionForVec = 0;
-int MuScleFitUtils::ScaleFitType = 0;
-scaleFunctionBase<double*> * MuScleFitUtils::scaleFunction = 0;
-scaleFunctionBase<std::vector<double> > * MuScleFitUtils::scaleFunctionForVec = 0;
-int MuScleFitUtils::BgrFitType   = 0;
-
-CrossSectionHandler * MuScleFitUtils::crossSectionHandler;
 // const int MuScleFitUtils::backgroundFunctionsRegions = 3;
 // backgroundFunctionBase * MuScleFitUtils::backgroundFunctionForRegion[MuScleFitUtils::backgroundFunctionsRegions];
 // backgroundFunctionBase * MuScleFitUtils::backgroundFunction[MuScleFitUtils::totalResNum];
-BackgroundHandler * MuScleFitUtils::backgroundHandler;
-std::vector<double> MuScleFitUtils::parBias;
-std::vector<double> MuScleFitUtils::parSmear;
-std::vector<double> MuScleFitUtils::parResol;
-std::vector<double> MuScleFitUtils::parResolStep;
-std::vector<double> MuScleFitUtils::parResolMin;
-std::vector<double> MuScleFitUtils::parResolMax;
-std::vector<double> MuScleFitUtils::parScale;
-std::vector<double> MuScleFitUtils::parScaleStep;
-std::vector<double> MuScleFitUtils::parScaleMin;
-std::vector<double> MuScleFitUtils::parScaleMax;
-std::vector<double> MuScleFitUtils::parCrossSection;
-std::vector<double> MuScleFitUtils::parBgr;
-std::vector<int> MuScleFitUtils::parResolFix;
-std::vector<int> MuScleFitUtils::parScaleFix;
-std::vector<int> MuScleFitUtils::parCrossSectionFix;
-std::vector<int> MuScleFitUtils::parBgrFix;
-std::vector<int> MuScleFitUtils::parResolOrder;
-std::vector<int> MuScleFitUtils::parScaleOrder;
-std::vector<int> MuScleFitUtils::parCrossSectionOrder;
-std::vector<int> MuScleFitUtils::parBgrOrder;
-
-std::vector<int> MuScleFitUtils::resfind;
-int MuScleFitUtils::debug = 0;
-
-bool MuScleFitUtils::ResFound = false;
-int MuScleFitUtils::goodmuon = 0;
-int MuScleFitUtils::counter_resprob = 0;
-
-std::vector<std::vector<double> > MuScleFitUtils::parvalue;
-
-int MuScleFitUtils::FitStrategy = 1; // Strategy in likelihood fit (1 or 2)
-bool MuScleFitUtils::speedup = false; // Whether to cut corners (no sim study, fewer histos)
-
-std::vector<std::pair<lorentzVector,lorentzVector> > MuScleFitUtils::SavedPair; // Pairs of reconstructed muons making resonances
-std::vector<std::pair<lorentzVector,lorentzVector> > MuScleFitUtils::ReducedSavedPair; // Pairs of reconstructed muons making resonances inside smaller windows
-std::vector<std::pair<lorentzVector,lorentzVector> > MuScleFitUtils::genPair; // Pairs of generated muons making resonances
-std::vector<std::pair<lorentzVector,lorentzVector> > MuScleFitUtils::simPair; // Pairs of simulated muons making resonances
 
 // Smearing parameters
 // -------------------
@@ -190,9 +155,6 @@ double MuScleFitUtils::ResMaxSigma[];
 const double MuScleFitUtils::mMu2 = 0.011163612;
 const double MuScleFitUtils::muMass = 0.105658;
 double MuScleFitUtils::ResHalfWidth[];
-double MuScleFitUtils::massWindowHalfWidth[][6];
-int MuScleFitUtils::MuonType;
-int MuScleFitUtils::MuonTypeForCheckMassWindow;
 
 double MuScleFitUtils::ResGamma[] = {2.4952, 0.000020, 0.000032, 0.000054, 0.000317, 0.0000932 };
 // ATTENTION:
@@ -201,7 +163,6 @@ double MuScleFitUtils::ResGamma[] = {2.4952, 0.000020, 0.000032, 0.000054, 0.000
 // The histograms are read after the initialization of the BackgroundHandler (this can be improved so that
 // the background handler too could use the new values).
 // At this time the values are consistent.
-double MuScleFitUtils::ResMinMass[] = {-99, -99, -99, -99, -99, -99};
 double MuScleFitUtils::ResMass[] = {91.1876, 10.3552, 10.0233, 9.4603, 3.68609, 3.0969};
 // From Summer08 generator production TWiki: https://twiki.cern.ch/twiki/bin/view/CMS/ProductionSummer2008
 // - Z->mumu              1.233 nb
@@ -213,8 +174,6 @@ double MuScleFitUtils::ResMass[] = {91.1876, 10.3552, 10.0233, 9.4603, 3.68609,
 // double MuScleFitUtils::crossSection[] = {1.233, 0.82, 6.33, 13.9, 2.169, 127.2};
 // double MuScleFitUtils::crossSection[] = {1.233, 2.07, 6.33, 13.9, 2.169, 127.2};
 
-unsigned int MuScleFitUtils::loopCounter = 5;
-
 // According to the pythia manual, there is only a code for the Upsilon and Upsilon'. It does not distinguish
 // between Upsilon(2S) and Upsilon(3S)
 const unsigned int MuScleFitUtils::motherPdgIdArray[] = {23, 100553, 100553, 553, 100443, 443};
@@ -230,43 +189,173 @@ const unsigned int MuScleFitUtils::motherPdgIdArray[] = {23, 100553, 100553, 553
 
 // double MuScleFitUtils::oldEventsOutInRatio_ = 0.;
 
-bool MuScleFitUtils::scaleFitNotDone_ = true;
-
-bool MuScleFitUtils::sherpa_ = false;
-
-bool MuScleFitUtils::useProbsFile_ = true;
-
-bool MuScleFitUtils::rapidityBinsForZ_ = true;
-
-bool MuScleFitUtils::separateRanges_ = true;
-double MuScleFitUtils::minMuonPt_ = 0.;
-double MuScleFitUtils::maxMuonPt_ = 100000000.;
-double MuScleFitUtils::minMuonEtaFirstRange_ = -6.;
-double MuScleFitUtils::maxMuonEtaFirstRange_ = 6.;
-double MuScleFitUtils::minMuonEtaSecondRange_ = -100.;
-double MuScleFitUtils::maxMuonEtaSecondRange_ = 100.;
-double MuScleFitUtils::deltaPhiMinCut_ = -100.;
-double MuScleFitUtils::deltaPhiMaxCut_ = 100.;
-
-bool MuScleFitUtils::debugMassResol_;
-MuScleFitUtils::massResolComponentsStruct MuScleFitUtils::massResolComponents;
+MuScleFitContext::MuScleFitContext() :
+  debug(0),
+  ResFound(false),
+  massWindowHalfWidth(),
+  loopCounter(5),
+  SmearType(0),
+  smearFunction(0),
+  BiasType(0),
+  // No error, we take functions from the same group for bias and scale.
+  biasFunction(0),
+  ResolFitType(0),
+  resolutionFunction(0),
+  resolutionFunctionForVec(0),
+  ScaleFitType(0),
+  scaleFunction(0),
+  scaleFunctionForVec(0),
+  BgrFitType(0),
+  crossSectionHandler(0),
+  backgroundHandler(0),
+  minuitLoop_(0),
+  likelihoodInLoop_(0),
+  signalProb_(0),
+  backgroundProb_(0),
+  duringMinos_(false),
+  FitStrategy(1), // Strategy in likelihood fit (1 or 2)
+  speedup(false), // Whether to cut corners (no sim study, fewer histos)
+  goodmuon(0),
+  counter_resprob(0),
+  MuonType(0),
+  MuonTypeForCheckMassWindow(0),
+  scaleFitNotDone_(true),
+  normalizeLikelihoodByEventNumber_(true),
+  rminPtr_(0),
+  oldNormalization_(0.),
+  normalizationChanged_(0),
+  sherpa_(false),
+  rapidityBinsForZ_(true),
+  iev_(0),
+  useProbsFile_(true),
+  separateRanges_(true),
+  minMuonPt_(0.),
+  maxMuonPt_(100000000.),
+  minMuonEtaFirstRange_(-6.),
+  maxMuonEtaFirstRange_(6.),
+  minMuonEtaSecondRange_(-100.),
+  maxMuonEtaSecondRange_(100.),
+  deltaPhiMinCut_(-100.),
+  deltaPhiMaxCut_(100.),
+  debugMassResol_(false),
+  massResolComponents(),
+  startWithSimplex_(false),
+  computeMinosErrors_(false),
+  minimumShapePlots_(false),
+  fitParametersFileName_("FitParameters.txt"),
+  outputDirectory_(0)
+{
+  for( int ires=0; ires<6; ++ires ) ResMinMass[ires] = -99;
+}
 
-bool MuScleFitUtils::normalizeLikelihoodByEventNumber_ = true;
-TMinuit * MuScleFitUtils::rminPtr_ = 0;
-double MuScleFitUtils::oldNormalization_ = 0.;
-unsigned int MuScleFitUtils::normalizationChanged_ = 0;
+MuScleFitContext & MuScleFitContext::defaultContext()
+{
+  static MuScleFitContext context;
+  return context;
+}
 
-bool MuScleFitUtils::startWithSimplex_;
-bool MuScleFitUtils::computeMinosErrors_;
-bool MuScleFitUtils::minimumShapePlots_;
+void MuScleFitContext::shareEvents( const MuonPairEvents & savedPair, const MuonPairEvents & genPairs )
+{
+  // The copies share the pairs: the first modification of the pairs of this context copies them
+  SavedPair = savedPair;
+  genPair = genPairs;
+  ReducedSavedPairIndex.clear();
+  massSortedIndex_.clear();
+  resonanceWindowMask_.clear();
+}
 
-int MuScleFitUtils::iev_ = 0;
+// The state of the fit used by the static interface is the state of the default context
+// ---------------------------------------------------------------------------------------
+int & MuScleFitUtils::debug = MuScleFitContext::defaultContext().debug;
+bool & MuScleFitUtils::ResFound = MuScleFitContext::defaultContext().ResFound;
+double (&MuScleFitUtils::massWindowHalfWidth)[3][6] = MuScleFitContext::defaultContext().massWindowHalfWidth;
+double (&MuScleFitUtils::ResMinMass)[6] = MuScleFitContext::defaultContext().ResMinMass;
+unsigned int & MuScleFitUtils::loopCounter = MuScleFitContext::defaultContext().loopCounter;
+int & MuScleFitUtils::SmearType = MuScleFitContext::defaultContext().SmearType;
+smearFunctionBase * & MuScleFitUtils::smearFunction = MuScleFitContext::defaultContext().smearFunction;
+int & MuScleFitUtils::BiasType = MuScleFitContext::defaultContext().BiasType;
+scaleFunctionBase<std::vector<double> > * & MuScleFitUtils::biasFunction = MuScleFitContext::defaultContext().biasFunction;
+int & MuScleFitUtils::ResolFitType = MuScleFitContext::defaultContext().ResolFitType;
+resolutionFunctionBase<double *> * & MuScleFitUtils::resolutionFunction = MuScleFitContext::defaultContext().resolutionFunction;
+resolutionFunctionBase<std::vector<double> > * & MuScleFitUtils::resolutionFunctionForVec = MuScleFitContext::defaultContext().resolutionFunctionForVec;
+int & MuScleFitUtils::ScaleFitType = MuScleFitContext::defaultContext().ScaleFitType;
+scaleFunctionBase<double*> * & MuScleFitUtils::scaleFunction = MuScleFitContext::defaultContext().scaleFunction;
+scaleFunctionBase<std::vector<double> > * & MuScleFitUtils::scaleFunctionForVec = MuScleFitContext::defaultContext().scaleFunctionForVec;
+int & MuScleFitUtils::BgrFitType = MuScleFitContext::defaultContext().BgrFitType;
+CrossSectionHandler * & MuScleFitUtils::crossSectionHandler = MuScleFitContext::defaultContext().crossSectionHandler;
+BackgroundHandler * & MuScleFitUtils::backgroundHandler = MuScleFitContext::defaultContext().backgroundHandler;
+std::vector<int> & MuScleFitUtils::doResolFit = MuScleFitContext::defaultContext().doResolFit;
+std::vector<int> & MuScleFitUtils::doScaleFit = MuScleFitContext::defaultContext().doScaleFit;
+std::vector<int> & MuScleFitUtils::doCrossSectionFit = MuScleFitContext::defaultContext().doCrossSectionFit;
+std::vector<int> & MuScleFitUtils::doBackgroundFit = MuScleFitContext::defaultContext().doBackgroundFit;
+int & MuScleFitUtils::minuitLoop_ = MuScleFitContext::defaultContext().minuitLoop_;
+TH1D* & MuScleFitUtils::likelihoodInLoop_ = MuScleFitContext::defaultContext().likelihoodInLoop_;
+TH1D* & MuScleFitUtils::signalProb_ = MuScleFitContext::defaultContext().signalProb_;
+TH1D* & MuScleFitUtils::backgroundProb_ = MuScleFitContext::defaultContext().backgroundProb_;
+bool & MuScleFitUtils::duringMinos_ = MuScleFitContext::defaultContext().duringMinos_;
+std::vector<double> & MuScleFitUtils::parSmear = MuScleFitContext::defaultContext().parSmear;
+std::vector<double> & MuScleFitUtils::parBias = MuScleFitContext::defaultContext().parBias;
+std::vector<double> & MuScleFitUtils::parResol = MuScleFitContext::defaultContext().parResol;
+std::vector<double> & MuScleFitUtils::parResolStep = MuScleFitContext::defaultContext().parResolStep;
+std::vector<double> & MuScleFitUtils::parResolMin = MuScleFitContext::defaultContext().parResolMin;
+std::vector<double> & MuScleFitUtils::parResolMax = MuScleFitContext::defaultContext().parResolMax;
+std::vector<double> & MuScleFitUtils::parScale = MuScleFitContext::defaultContext().parScale;
+std::vector<double> & MuScleFitUtils::parScaleStep = MuScleFitContext::defaultContext().parScaleStep;
+std::vector<double> & MuScleFitUtils::parScaleMin = MuScleFitContext::defaultContext().parScaleMin;
+std::vector<double> & MuScleFitUtils::parScaleMax = MuScleFitContext::defaultContext().parScaleMax;
+std::vector<double> & MuScleFitUtils::parCrossSection = MuScleFitContext::defaultContext().parCrossSection;
+std::vector<double> & MuScleFitUtils::parBgr = MuScleFitContext::defaultContext().parBgr;
+std::vector<int> & MuScleFitUtils::parResolFix = MuScleFitContext::defaultContext().parResolFix;
+std::vector<int> & MuScleFitUtils::parScaleFix = MuScleFitContext::defaultContext().parScaleFix;
+std::vector<int> & MuScleFitUtils::parCrossSectionFix = MuScleFitContext::defaultContext().parCrossSectionFix;
+std::vector<int> & MuScleFitUtils::parBgrFix = MuScleFitContext::defaultContext().parBgrFix;
+std::vector<int> & MuScleFitUtils::parResolOrder = MuScleFitContext::defaultContext().parResolOrder;
+std::vector<int> & MuScleFitUtils::parScaleOrder = MuScleFitContext::defaultContext().parScaleOrder;
+std::vector<int> & MuScleFitUtils::parCrossSectionOrder = MuScleFitContext::defaultContext().parCrossSectionOrder;
+std::vector<int> & MuScleFitUtils::parBgrOrder = MuScleFitContext::defaultContext().parBgrOrder;
+std::vector<int> & MuScleFitUtils::resfind = MuScleFitContext::defaultContext().resfind;
+int & MuScleFitUtils::FitStrategy = MuScleFitContext::defaultContext().FitStrategy;
+bool & MuScleFitUtils::speedup = MuScleFitContext::defaultContext().speedup;
+int & MuScleFitUtils::goodmuon = MuScleFitContext::defaultContext().goodmuon;
+int & MuScleFitUtils::counter_resprob = MuScleFitContext::defaultContext().counter_resprob;
+int & MuScleFitUtils::MuonType = MuScleFitContext::defaultContext().MuonType;
+int & MuScleFitUtils::MuonTypeForCheckMassWindow = MuScleFitContext::defaultContext().MuonTypeForCheckMassWindow;
+std::vector<std::vector<double> > & MuScleFitUtils::parvalue = MuScleFitContext::defaultContext().parvalue;
+MuonPairEvents & MuScleFitUtils::SavedPair = MuScleFitContext::defaultContext().SavedPair;
+std::vector<unsigned int> & MuScleFitUtils::ReducedSavedPairIndex = MuScleFitContext::defaultContext().ReducedSavedPairIndex;
+std::vector<std::pair<double, unsigned int> > & MuScleFitUtils::massSortedIndex_ = MuScleFitContext::defaultContext().massSortedIndex_;
+std::vector<unsigned char> & MuScleFitUtils::resonanceWindowMask_ = MuScleFitContext::defaultContext().resonanceWindowMask_;
+MuonPairEvents & MuScleFitUtils::genPair = MuScleFitContext::defaultContext().genPair;
+std::vector<std::pair<lorentzVector,lorentzVector> > & MuScleFitUtils::simPair = MuScleFitContext::defaultContext().simPair;
+bool & MuScleFitUtils::scaleFitNotDone_ = MuScleFitContext::defaultContext().scaleFitNotDone_;
+bool & MuScleFitUtils::normalizeLikelihoodByEventNumber_ = MuScleFitContext::defaultContext().normalizeLikelihoodByEventNumber_;
+TMinuit * & MuScleFitUtils::rminPtr_ = MuScleFitContext::defaultContext().rminPtr_;
+double & MuScleFitUtils::oldNormalization_ = MuScleFitContext::defaultContext().oldNormalization_;
+unsigned int & MuScleFitUtils::normalizationChanged_ = MuScleFitContext::defaultContext().normalizationChanged_;
+bool & MuScleFitUtils::sherpa_ = MuScleFitContext::defaultContext().sherpa_;
+bool & MuScleFitUtils::rapidityBinsForZ_ = MuScleFitContext::defaultContext().rapidityBinsForZ_;
+int & MuScleFitUtils::iev_ = MuScleFitContext::defaultContext().iev_;
+bool & MuScleFitUtils::useProbsFile_ = MuScleFitContext::defaultContext().useProbsFile_;
+bool & MuScleFitUtils::separateRanges_ = MuScleFitContext::defaultContext().separateRanges_;
+double & MuScleFitUtils::minMuonPt_ = MuScleFitContext::defaultContext().minMuonPt_;
+double & MuScleFitUtils::maxMuonPt_ = MuScleFitContext::defaultContext().maxMuonPt_;
+double & MuScleFitUtils::minMuonEtaFirstRange_ = MuScleFitContext::defaultContext().minMuonEtaFirstRange_;
+double & MuScleFitUtils::maxMuonEtaFirstRange_ = MuScleFitContext::defaultContext().maxMuonEtaFirstRange_;
+double & MuScleFitUtils::minMuonEtaSecondRange_ = MuScleFitContext::defaultContext().minMuonEtaSecondRange_;
+double & MuScleFitUtils::maxMuonEtaSecondRange_ = MuScleFitContext::defaultContext().maxMuonEtaSecondRange_;
+double & MuScleFitUtils::deltaPhiMinCut_ = MuScleFitContext::defaultContext().deltaPhiMinCut_;
+double & MuScleFitUtils::deltaPhiMaxCut_ = MuScleFitContext::defaultContext().deltaPhiMaxCut_;
+bool & MuScleFitUtils::debugMassResol_ = MuScleFitContext::defaultContext().debugMassResol_;
+MuScleFitUtils::massResolComponentsStruct & MuScleFitUtils::massResolComponents = MuScleFitContext::defaultContext().massResolComponents;
+bool & MuScleFitUtils::startWithSimplex_ = MuScleFitContext::defaultContext().startWithSimplex_;
+bool & MuScleFitUtils::computeMinosErrors_ = MuScleFitContext::defaultContext().computeMinosErrors_;
+bool & MuScleFitUtils::minimumShapePlots_ = MuScleFitContext::defaultContext().minimumShapePlots_;
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 // Find the best simulated resonance from a vector of simulated muons (SimTracks)
 // and return its decay muons
 // ------------------------------------------------------------------------------
-std::pair<SimTrack,SimTrack> MuScleFitUtils::findBestSimuRes (const std::vector<SimTrack>& simMuons) {
+std::pair<SimTrack,SimTrack> MuScleFitContext::findBestSimuRes (const std::vector<SimTrack>& simMuons) {
 
   std::pair<SimTrack, SimTrack> simMuFromBestRes;
   double maxprob = -0.1;
@@ -303,7 +392,7 @@ std::pair<SimTrack,SimTrack> MuScleFitUtils::findBestSimuRes (const std::vector<
 // Find the best reconstructed resonance from a collection of reconstructed muons
 // (MuonCollection) and return its decay muons
 // ------------------------------------------------------------------------------
-std::pair<lorentzVector,lorentzVector> MuScleFitUtils::findBestRecoRes( const std::vector<reco::LeafCandidate>& muons ){
+std::pair<lorentzVector,lorentzVector> MuScleFitContext::findBestRecoRes( const std::vector<reco::LeafCandidate>& muons ){
   // NB this routine returns the resonance, but it also sets the ResFound flag, which
   // is used in MuScleFit to decide whether to use the event or not.
   // --------------------------------------------------------------------------------
@@ -313,70 +402,88 @@ std::pair<lorentzVector,lorentzVector> MuScleFitUtils::findBestRecoRes( const st
 
   // Choose the best resonance using its mass probability
   // ----------------------------------------------------
+  // The pairs are visited in the same order as a double loop on the muons, so that ties are resolved in the same way,
+  // but the muons of the same charge are skipped without being visited and the kinematic cuts are evaluated once per muon.
+  // To allow the selection of ranges at negative and positive eta independently we define two
+  // ranges of eta: (minMuonEtaFirstRange_, maxMuonEtaFirstRange_) and (minMuonEtaSecondRange_, maxMuonEtaSecondRange_).
+  // If the interval selected is simmetric, one only needs to specify the first range. The second has
+  // default values that accept all muons (minMuonEtaSecondRange_ = -100., maxMuonEtaSecondRange_ = 100.).
+  const unsigned int nMuons = muons.size();
+  std::vector<int> muonRanges(nMuons, 0);
+  std::vector<unsigned int> notPositive;
+  std::vector<unsigned int> notNegative;
+  for( unsigned int i=0; i<nMuons; ++i ) {
+    const double pt = muons[i].p4().Pt();
+    const double eta = muons[i].p4().Eta();
+    if( pt >= minMuonPt_ && pt < maxMuonPt_ ) {
+      if( eta >= minMuonEtaFirstRange_ && eta < maxMuonEtaFirstRange_ ) muonRanges[i] |= 1;
+      if( eta >= minMuonEtaSecondRange_ && eta < maxMuonEtaSecondRange_ ) muonRanges[i] |= 2;
+    }
+    if( muons[i].charge() <= 0 ) notPositive.push_back(i);
+    if( muons[i].charge() >= 0 ) notNegative.push_back(i);
+  }
+  std::vector<unsigned int> all(nMuons);
+  for( unsigned int i=0; i<nMuons; ++i ) all[i] = i;
+
   double maxprob = -0.1;
   double minDeltaMass = 999999;
   std::pair<reco::LeafCandidate,reco::LeafCandidate> bestMassMuons;
-  for (std::vector<reco::LeafCandidate>::const_iterator Muon1=muons.begin(); Muon1!=muons.end(); ++Muon1) {
+  for( unsigned int i1=0; i1<nMuons; ++i1 ) {
+    const reco::LeafCandidate & muon1 = muons[i1];
     //rc2010
-    if (debug>0) std::cout << "muon_1_charge:"<<(*Muon1).charge() << std::endl;
-    for (std::vector<reco::LeafCandidate>::const_iterator Muon2=Muon1+1; Muon2!=muons.end(); ++Muon2) {
-   //rc2010
+    if (debug>0) std::cout << "muon_1_charge:"<<muon1.charge() << std::endl;
+    // The partners of opposite charge (or neutral) following muon1 in the collection
+    const std::vector<unsigned int> & partners = muon1.charge() > 0 ? notPositive : (muon1.charge() < 0 ? notNegative : all);
+    for( std::vector<unsigned int>::const_iterator i2 = std::upper_bound(partners.begin(), partners.end(), i1);
+         i2 != partners.end(); ++i2 ) {
+      const reco::LeafCandidate & muon2 = muons[*i2];
+      //rc2010
       if (debug>0) std::cout << "after_2" << std::endl;
-      if (((*Muon1).charge()*(*Muon2).charge())>0) {
-	continue; // This also gets rid of Muon1==Muon2...
+      if( (muonRanges[i1] & muonRanges[*i2]) == 0 ) continue;
+
+      const lorentzVector pair(muon1.p4()+muon2.p4());
+      const double mcomb = pair.mass();
+      const double Y = pair.Rapidity();
+      if (debug>1) {
+        std::cout<<"muon1 "<<muon1.p4().Px()<<", "<<muon1.p4().Py()<<", "<<muon1.p4().Pz()<<", "<<muon1.p4().E()<<std::endl;
+        std::cout<<"muon2 "<<muon2.p4().Px()<<", "<<muon2.p4().Py()<<", "<<muon2.p4().Pz()<<", "<<muon2.p4().E()<<std::endl;
+        std::cout<<"mcomb "<<mcomb<<std::endl;}
+      double massResol = 0.;
+      if( useProbsFile_ ) {
+        // Same as the version taking the vector, without copying it
+        if( parResol.empty() ) massResol = massResolution(muon1.p4(), muon2.p4(), parResol);
+        else massResol = massResolution(muon1.p4(), muon2.p4(), &(parResol[0]));
       }
-      // To allow the selection of ranges at negative and positive eta independently we define two
-      // ranges of eta: (minMuonEtaFirstRange_, maxMuonEtaFirstRange_) and (minMuonEtaSecondRange_, maxMuonEtaSecondRange_).
-      // If the interval selected is simmetric, one only needs to specify the first range. The second has
-      // default values that accept all muons (minMuonEtaSecondRange_ = -100., maxMuonEtaSecondRange_ = 100.).
-      double pt1 = (*Muon1).p4().Pt();
-      double pt2 = (*Muon2).p4().Pt();
-      double eta1 = (*Muon1).p4().Eta();
-      double eta2 = (*Muon2).p4().Eta();
-      if( pt1 >= minMuonPt_ && pt1 < maxMuonPt_ &&
-	  pt2 >= minMuonPt_ && pt2 < maxMuonPt_ &&
-	  ( (eta1 >= minMuonEtaFirstRange_ && eta1 < maxMuonEtaFirstRange_ &&
-	     eta2 >= minMuonEtaFirstRange_ && eta2 < maxMuonEtaFirstRange_) ||
-	    (eta1 >= minMuonEtaSecondRange_ && eta1 < maxMuonEtaSecondRange_ &&
-	     eta2 >= minMuonEtaSecondRange_ && eta2 < maxMuonEtaSecondRange_) ) ) {
-        double mcomb = ((*Muon1).p4()+(*Muon2).p4()).mass();
-	double Y = ((*Muon1).p4()+(*Muon2).p4()).Rapidity();
-	if (debug>1) {
-	  std::cout<<"muon1 "<<(*Muon1).p4().Px()<<", "<<(*Muon1).p4().Py()<<", "<<(*Muon1).p4().Pz()<<", "<<(*Muon1).p4().E()<<std::endl;
-	  std::cout<<"muon2 "<<(*Muon2).p4().Px()<<", "<<(*Muon2).p4().Py()<<", "<<(*Muon2).p4().Pz()<<", "<<(*Muon2).p4().E()<<std::endl;
-	  std::cout<<"mcomb "<<mcomb<<std::endl;}
-	double massResol = 0.;
-	if( useProbsFile_ ) {
-	  massResol = massResolution ((*Muon1).p4(), (*Muon2).p4(), parResol);
-	}
-	double prob = 0;
-	for( int ires=0; ires<6; ires++ ) {
-	  if( resfind[ires]>0 ) {
-	    if( useProbsFile_ ) {
-	      prob = massProb( mcomb, Y, ires, massResol );
-	    }
-	    if( prob>maxprob ) {
-	      if( (*Muon1).charge()<0 ) { // store first the mu minus and then the mu plus
-		recMuFromBestRes.first = (*Muon1).p4();
-		recMuFromBestRes.second = (*Muon2).p4();
-	      } else {
-		recMuFromBestRes.first = (*Muon2).p4();
-		recMuFromBestRes.second = (*Muon1).p4();
-	      }
-	      ResFound = true; // NNBB we accept "resonances" even outside mass bounds
-	      maxprob = prob;
-	    }
-	    // if( ResMass[ires] == 0 ) {
-	    //   std::cout << "Error: ResMass["<<ires<<"] = " << ResMass[ires] << std::endl;
-	    //   exit(1);
-	    // }
-	    double deltaMass = fabs(mcomb-ResMass[ires])/ResMass[ires];
-	    if( deltaMass<minDeltaMass ){
-	      bestMassMuons = std::make_pair((*Muon1),(*Muon2));
-	      minDeltaMass = deltaMass;
-	    }
-	  }
-	}
+      double prob = 0;
+      for( int ires=0; ires<6; ires++ ) {
+        if( resfind[ires]>0 ) {
+          if( useProbsFile_ ) {
+            // The probability cannot exceed the bound: if the bound does not exceed maxprob this pair cannot
+            // become the best for this resonance and the evaluation is skipped
+            if( massResol > 0. && massProbUpperBound(mcomb, ires, massResol) <= maxprob ) prob = maxprob;
+            else prob = massProb( mcomb, Y, ires, massResol );
+          }
+          if( prob>maxprob ) {
+            if( muon1.charge()<0 ) { // store first the mu minus and then the mu plus
+              recMuFromBestRes.first = muon1.p4();
+              recMuFromBestRes.second = muon2.p4();
+            } else {
+              recMuFromBestRes.first = muon2.p4();
+              recMuFromBestRes.second = muon1.p4();
+            }
+            ResFound = true; // NNBB we accept "resonances" even outside mass bounds
+            maxprob = prob;
+          }
+          // if( ResMass[ires] == 0 ) {
+          //   std::cout << "Error: ResMass["<<ires<<"] = " << ResMass[ires] << std::endl;
+          //   exit(1);
+          // }
+          double deltaMass = fabs(mcomb-ResMass[ires])/ResMass[ires];
+          if( deltaMass<minDeltaMass ){
+            bestMassMuons = std::make_pair(muon1, muon2);
+            minDeltaMass = deltaMass;
+          }
+        }
       }
     }
   }
@@ -395,9 +502,24 @@ std::pair<lorentzVector,lorentzVector> MuScleFitUtils::findBestRecoRes( const st
   return recMuFromBestRes;
 }
 
+/**
+ * The integrand of massProb is a Lorentzian, at most 2/(pi*gamma), times a gaussian of width massResol, at most
+ * exp(-d^2/(2*massResol^2))/(sqrt(2*pi)*massResol) where d is the distance of the mass from the integration range
+ * (ResMass-10*gamma, ResMass+10*gamma). The quadrature has positive weights summing to 20*gamma, so the result
+ * cannot exceed 40/pi times the maximum of the gaussian (a factor 2 covers the rounding), or the 1.e-12 floor.
+ */
+double MuScleFitUtils::massProbUpperBound( const double & mass, const int ires, const double & massResol )
+{
+  const double low = ResMass[ires] - 10*ResGamma[ires];
+  const double high = ResMass[ires] + 10*ResGamma[ires];
+  const double distance = mass < low ? low - mass : (mass > high ? mass - high : 0.);
+  const double bound = 2*40/TMath::Pi()*exp(-0.5*distance*distance/(massResol*massResol))/(sqrt(2*TMath::Pi())*massResol);
+  return bound > 1.0e-12 ? bound : 1.0e-12;
+}
+
 // Resolution smearing function called to worsen muon Pt resolution at start
 // -------------------------------------------------------------------------
-lorentzVector MuScleFitUtils::applySmearing (const lorentzVector& muon)
+lorentzVector MuScleFitContext::applySmearing (const lorentzVector& muon)
 {
   double pt = muon.Pt();
   double eta = muon.Eta();
@@ -427,28 +549,28 @@ lorentzVector MuScleFitUtils::applySmearing (const lorentzVector& muon)
 
 // Biasing function called to modify muon Pt scale at the start.
 // -------------------------------------------------------------
-lorentzVector MuScleFitUtils::applyBias( const lorentzVector& muon, const int chg )
+lorentzVector MuScleFitContext::applyBias( const lorentzVector& muon, const int chg )
 {
   double ptEtaPhiE[4] = {muon.Pt(),muon.Eta(),muon.Phi(),muon.E()};
 
-  if (MuScleFitUtils::debug>1) std::cout << "pt before bias = " << ptEtaPhiE[0] << std::endl;
+  if (debug>1) std::cout << "pt before bias = " << ptEtaPhiE[0] << std::endl;
 
   // Use functors (although not with the () operator)
   // Note that we always pass pt, eta and phi, but internally only the needed
   // values are used.
   // The functors used are takend from the same group used for the scaling
   // thus the name of the method used is "scale".
-  ptEtaPhiE[0] = biasFunction->scale(ptEtaPhiE[0], ptEtaPhiE[1], ptEtaPhiE[2], chg, MuScleFitUtils::parBias);
+  ptEtaPhiE[0] = biasFunction->scale(ptEtaPhiE[0], ptEtaPhiE[1], ptEtaPhiE[2], chg, parBias);
 
-  if (MuScleFitUtils::debug>1) std::cout << "pt after bias = " << ptEtaPhiE[0] << std::endl;
+  if (debug>1) std::cout << "pt after bias = " << ptEtaPhiE[0] << std::endl;
 
   return( fromPtEtaPhiToPxPyPz(ptEtaPhiE) );
 }
 
 // Version of applyScale accepting a std::vector<double> of parameters
 // --------------------------------------------------------------
-lorentzVector MuScleFitUtils::applyScale (const lorentzVector& muon,
-                                          const std::vector<double> & parval, const int chg)
+lorentzVector MuScleFitContext::applyScale (const lorentzVector& muon,
+                                            const std::vector<double> & parval, const int chg)
 {
   double * p = new double[(int)(parval.size())];
   // Replaced by auto_ptr, which handles delete at the end
@@ -467,19 +589,19 @@ lorentzVector MuScleFitUtils::applyScale (const lorentzVector& muon,
 
 // This is called by the likelihood to "taste" different values for additional corrections
 // ---------------------------------------------------------------------------------------
-lorentzVector MuScleFitUtils::applyScale (const lorentzVector& muon,
-                                          double* parval, const int chg)
+lorentzVector MuScleFitContext::applyScale (const lorentzVector& muon,
+                                            double* parval, const int chg)
 {
   double ptEtaPhiE[4] = {muon.Pt(),muon.Eta(),muon.Phi(),muon.E()};
   int shift = parResol.size();
 
-  if (MuScleFitUtils::debug>1) std::cout << "pt before scale = " << ptEtaPhiE[0] << std::endl;
+  if (debug>1) std::cout << "pt before scale = " << ptEtaPhiE[0] << std::endl;
 
   // the address of parval[shift] is passed as pointer to double. Internally it is used as a normal array, thus:
   // array[0] = parval[shift], array[1] = parval[shift+1], ...
   ptEtaPhiE[0] = scaleFunction->scale(ptEtaPhiE[0], ptEtaPhiE[1], ptEtaPhiE[2], chg, &(parval[shift]));
 
-  if (MuScleFitUtils::debug>1) std::cout << "pt after scale = " << ptEtaPhiE[0] << std::endl;
+  if (debug>1) std::cout << "pt after scale = " << ptEtaPhiE[0] << std::endl;
 
   return( fromPtEtaPhiToPxPyPz(ptEtaPhiE) );
 }
@@ -511,9 +633,9 @@ inline double MuScleFitUtils::invDimuonMass( const lorentzVector& mu1,
 
 // Mass resolution - version accepting a std::vector<double> parval
 // -----------------------------------------------------------
-double MuScleFitUtils::massResolution( const lorentzVector& mu1,
-                                       const lorentzVector& mu2,
-                                       const std::vector<double> & parval )
+double MuScleFitContext::massResolution( const lorentzVector& mu1,
+                                         const lorentzVector& mu2,
+                                         const std::vector<double> & parval )
 {
   // double * p = new double[(int)(parval.size())];
   // Replaced by auto_ptr, which handles delete at the end
@@ -555,9 +677,9 @@ double MuScleFitUtils::massResolution( const lorentzVector& mu1,
  *
  * and derive WRT Pt1, Pt2, phi1, phi2, theta1, theta2 to get the resolution.
  */
-double MuScleFitUtils::massResolution( const lorentzVector& mu1,
-                                       const lorentzVector& mu2,
-                                       double* parval )
+double MuScleFitContext::massResolution( const lorentzVector& mu1,
+                                         const lorentzVector& mu2,
+                                         double* parval )
 {
   double mass   = (mu1+mu2).mass();
   double pt1    = mu1.Pt();
@@ -644,9 +766,9 @@ double MuScleFitUtils::massResolution( const lorentzVector& mu1,
  * This method can be used outside MuScleFit. It gets the ResolutionFunction that must have been built with the parameters. <br>
  * TO-DO: this method duplicates the code in the previous method. It should be changed to avoid the duplication.
  */
-double MuScleFitUtils::massResolution( const lorentzVector& mu1,
-                                       const lorentzVector& mu2,
-				       const ResolutionFunction & resolFunc )
+double MuScleFitContext::massResolution( const lorentzVector& mu1,
+                                         const lorentzVector& mu2,
+				         const ResolutionFunction & resolFunc )
 {
   double mass   = (mu1+mu2).mass();
   double pt1    = mu1.Pt();
@@ -692,7 +814,7 @@ double MuScleFitUtils::massResolution( const lorentzVector& mu1,
 
 // Mass probability - version with linear background included, accepts std::vector<double> parval
 // -----------------------------------------------------------------------------------------
-double MuScleFitUtils::massProb( const double & mass, const double & resEta, const double & rapidity, const double & massResol, const std::vector<double> & parval, const bool doUseBkgrWindow, const double & eta1, const double & eta2 )
+double MuScleFitContext::massProb( const double & mass, const double & resEta, const double & rapidity, const double & massResol, const std::vector<double> & parval, const bool doUseBkgrWindow, const double & eta1, const double & eta2 )
 {
 #ifdef USE_CALLGRIND
   CALLGRIND_START_INSTRUMENTATION;
@@ -726,9 +848,9 @@ double MuScleFitUtils::massProb( const double & mass, const double & resEta, con
  * - if passing iRes == 0, iY is used to select the rapidity bin
  * - if passing iRes != 0, iY is used to select the resonance
  */
-double MuScleFitUtils::probability( const double & mass, const double & massResol,
-                                    const double GLvalue[][1001][1001], const double GLnorm[][1001],
-                                    const int iRes, const int iY )
+double MuScleFitContext::probability( const double & mass, const double & massResol,
+                                      const double GLvalue[][1001][1001], const double GLnorm[][1001],
+                                      const int iRes, const int iY )
 {
   if( iRes == 0 && iY > 23 ) {
     std::cout << "WARNING: rapidity bin selected = " << iY << " but there are only histograms for the first 24 bins" << std::endl;
@@ -857,7 +979,7 @@ double MuScleFitUtils::probability( const double & mass, const double & massReso
 
 // Mass probability - version with linear background included
 // ----------------------------------------------------------
-double MuScleFitUtils::massProb( const double & mass, const double & resEta, const double & rapidity, const double & massResol, double * parval, const bool doUseBkgrWindow, const double & eta1, const double & eta2 ) {
+double MuScleFitContext::massProb( const double & mass, const double & resEta, const double & rapidity, const double & massResol, double * parval, const bool doUseBkgrWindow, const double & eta1, const double & eta2 ) {
 
   // This routine computes the likelihood that a given measured mass "measMass" is
   // the result of a reference mass ResMass[] if the resolution
@@ -961,7 +1083,7 @@ double MuScleFitUtils::massProb( const double & mass, const double & resEta, con
   // -------------------------------------------------------
 
   // Do this only if we want to use the rapidity bins for the Z
-  if( MuScleFitUtils::rapidityBinsForZ_ ) {
+  if( rapidityBinsForZ_ ) {
     // ATTENTION: cut on Z rapidity at 2.4 since we only have histograms up to that value
     // std::pair<double, double> windowFactors = backgroundHandler->windowFactors( useBackgroundWindow, 0 );
     std::pair<double, double> windowBorders = backgroundHandler->windowBorders( useBackgroundWindow, 0 );
@@ -976,7 +1098,7 @@ double MuScleFitUtils::massProb( const double & mass, const double & resEta, con
       int iY = (int)(fabs(rapidity)*10.);
       if( iY > 23 ) iY = 23;
 
-      if (MuScleFitUtils::debug>1) std::cout << "massProb:resFound = 0, rapidity bin =" << iY << std::endl;
+      if (debug>1) std::cout << "massProb:resFound = 0, rapidity bin =" << iY << std::endl;
 
       // In this case the last value is the rapidity bin
       PS[0] = probability(mass, massResol, GLZValue, GLZNorm, 0, iY);
@@ -987,11 +1109,11 @@ double MuScleFitUtils::massProb( const double & mass, const double & resEta, con
       }
 
       // std::pair<double, double> bgrResult = backgroundHandler->backgroundFunction( doBackgroundFit[loopCounter],
-      // 										   &(parval[bgrParShift]), MuScleFitUtils::totalResNum, 0,
+      // 										   &(parval[bgrParShift]), totalResNum, 0,
       // 										   resConsidered, ResMass, ResHalfWidth, MuonType, mass, resEta );
 
       std::pair<double, double> bgrResult = backgroundHandler->backgroundFunction( doBackgroundFit[loopCounter],
-										   &(parval[bgrParShift]), MuScleFitUtils::totalResNum, 0,
+										   &(parval[bgrParShift]), totalResNum, 0,
 										   resConsidered, ResMass, ResHalfWidth, MuonType, mass, eta1, eta2 );
 
       Bgrp1 = bgrResult.first;
@@ -1017,20 +1139,20 @@ double MuScleFitUtils::massProb( const double & mass, const double & resEta, con
   // Next check the other resonances
   // -------------------------------
   int firstRes = 1;
-  if( !MuScleFitUtils::rapidityBinsForZ_ ) firstRes = 0;
+  if( !rapidityBinsForZ_ ) firstRes = 0;
   for( int ires=firstRes; ires<6; ++ires ) {
     if( resfind[ires] > 0 ) {
       // First is left, second is right (returns (1,1) in the case of resonances, it could be improved avoiding the call in this case)
       // std::pair<double, double> windowFactor = backgroundHandler->windowFactors( useBackgroundWindow, ires );
       std::pair<double, double> windowBorder = backgroundHandler->windowBorders( useBackgroundWindow, ires );
       if( checkMassWindow(mass, windowBorder.first, windowBorder.second) ) {
-        if (MuScleFitUtils::debug>1) std::cout << "massProb:resFound = " << ires << std::endl;
+        if (debug>1) std::cout << "massProb:resFound = " << ires << std::endl;
 
         // In this case the rapidity value is instead the resonance index again.
         PS[ires] = probability(mass, massResol, GLValue, GLNorm, ires, ires);
 
         std::pair<double, double> bgrResult = backgroundHandler->backgroundFunction( doBackgroundFit[loopCounter],
-										     &(parval[bgrParShift]), MuScleFitUtils::totalResNum, ires,
+										     &(parval[bgrParShift]), totalResNum, ires,
 										     // resConsidered, ResMass, ResHalfWidth, MuonType, mass, resEta );
 										     resConsidered, ResMass, ResHalfWidth, MuonType, mass, eta1, eta2 );
         Bgrp1 = bgrResult.first;
@@ -1038,7 +1160,7 @@ double MuScleFitUtils::massProb( const double & mass, const double & resEta, con
 
         if( PB != PB ) PB = 0;
         PStot[ires] = (1-Bgrp1)*PS[ires] + Bgrp1*PB;
-        if( MuScleFitUtils::debug>0 ) std::cout << "PStot["<<ires<<"] = " << "(1-"<<Bgrp1<<")*"<<PS[ires]<<" + "<<Bgrp1<<"*"<<PB<<" = " << PStot[ires] << std::endl;
+        if( debug>0 ) std::cout << "PStot["<<ires<<"] = " << "(1-"<<Bgrp1<<")*"<<PS[ires]<<" + "<<Bgrp1<<"*"<<PB<<" = " << PStot[ires] << std::endl;
 
         PStot[ires] *= relativeCrossSections[ires];
       }
@@ -1049,7 +1171,7 @@ double MuScleFitUtils::massProb( const double & mass, const double & resEta, con
     P += PStot[i];
   }
 
-  if( MuScleFitUtils::signalProb_ != 0 && MuScleFitUtils::backgroundProb_ != 0 ) {
+  if( signalProb_ != 0 && backgroundProb_ != 0 ) {
     double PStotTemp = 0.;
     for( int i=0; i<6; ++i ) {
       PStotTemp += PS[i]*relativeCrossSections[i];
@@ -1069,11 +1191,11 @@ double MuScleFitUtils::massProb( const double & mass, const double & resEta, con
       }
     }
     if( PStotTemp == PStotTemp ) {
-      MuScleFitUtils::signalProb_->SetBinContent(MuScleFitUtils::minuitLoop_, MuScleFitUtils::signalProb_->GetBinContent(MuScleFitUtils::minuitLoop_) + PStotTemp);
+      signalProb_->SetBinContent(minuitLoop_, signalProb_->GetBinContent(minuitLoop_) + PStotTemp);
     }
     if (debug>0) std::cout << "mass = " << mass << ", P = " << P << ", PStot = " << PStotTemp << ", PB = " << PB << ", bgrp1 = " << Bgrp1 << std::endl;
 
-    MuScleFitUtils::backgroundProb_->SetBinContent(MuScleFitUtils::minuitLoop_, MuScleFitUtils::backgroundProb_->GetBinContent(MuScleFitUtils::minuitLoop_) + PB);
+    backgroundProb_->SetBinContent(minuitLoop_, backgroundProb_->GetBinContent(minuitLoop_) + PB);
   }
   return P;
 }
@@ -1089,9 +1211,66 @@ inline bool MuScleFitUtils::checkMassWindow( const double & mass, const double &
   return( (mass > leftBorder) && (mass < rightBorder) );
 }
 
+void MuScleFitContext::buildMassSortedIndex()
+{
+  bool useBackgroundWindow = (doBackgroundFit[loopCounter]);
+  std::pair<double, double> windowBorder[6];
+  for( int ires=0; ires<6; ++ires ) {
+    windowBorder[ires] = backgroundHandler->windowBorders( useBackgroundWindow, ires );
+  }
+
+  unsigned int pairsNum = SavedPair.size();
+  massSortedIndex_.clear();
+  massSortedIndex_.reserve(pairsNum);
+  resonanceWindowMask_.assign(pairsNum, 0);
+  for( unsigned int nev=0; nev<pairsNum; ++nev ) {
+    double mass = invDimuonMass( SavedPair[nev].first, SavedPair[nev].second );
+    massSortedIndex_.push_back(std::make_pair(mass, nev));
+    for( int ires=0; ires<6; ++ires ) {
+      if( resfind[ires]>0 && checkMassWindow(mass, windowBorder[ires].first, windowBorder[ires].second) ) {
+        resonanceWindowMask_[nev] |= (1 << ires);
+      }
+    }
+  }
+  std::sort(massSortedIndex_.begin(), massSortedIndex_.end());
+}
+
+void MuScleFitContext::selectPairsInWindows( std::vector<std::pair<double, double> > windows )
+{
+  ReducedSavedPairIndex.clear();
+  if( windows.empty() ) return;
+
+  // Merge the overlapping windows so that no pair is taken twice
+  std::sort(windows.begin(), windows.end());
+  std::vector<std::pair<double, double> > mergedWindows(1, windows[0]);
+  for( unsigned int i=1; i<windows.size(); ++i ) {
+    if( windows[i].first < mergedWindows.back().second ) {
+      mergedWindows.back().second = std::max(mergedWindows.back().second, windows[i].second);
+    }
+    else {
+      mergedWindows.push_back(windows[i]);
+    }
+  }
+
+  // The borders are excluded, as in checkMassWindow
+  std::vector<std::pair<double, double> >::const_iterator window = mergedWindows.begin();
+  for( ; window != mergedWindows.end(); ++window ) {
+    std::vector<std::pair<double, unsigned int> >::const_iterator first =
+      std::lower_bound(massSortedIndex_.begin(), massSortedIndex_.end(),
+                       std::make_pair(window->first, std::numeric_limits<unsigned int>::max()));
+    std::vector<std::pair<double, unsigned int> >::const_iterator last =
+      std::lower_bound(first, massSortedIndex_.end(), std::make_pair(window->second, 0u));
+    for( ; first != last; ++first ) {
+      ReducedSavedPairIndex.push_back(first->second);
+    }
+  }
+  // Keep the event order, so that the likelihood sum does not depend on the windows
+  std::sort(ReducedSavedPairIndex.begin(), ReducedSavedPairIndex.end());
+}
+
 // Function that returns the weight for a muon pair
 // ------------------------------------------------
-double MuScleFitUtils::computeWeight( const double & mass, const int iev, const bool doUseBkgrWindow )
+double MuScleFitContext::computeWeight( const double & mass, const int iev, const bool doUseBkgrWindow )
 {
   // Compute weight for this event
   // -----------------------------
@@ -1124,15 +1303,66 @@ double MuScleFitUtils::computeWeight( const double & mass, const int iev, const
 
 // Likelihood minimization routine
 // -------------------------------
-void MuScleFitUtils::minimizeLikelihood()
+// The likelihood is given to Minuit as a function: it uses the context being minimized in the current thread
+// ------------------------------------------------------------------------------------------------------------
+static void keepContext( MuScleFitContext * ) {}
+static boost::thread_specific_ptr<MuScleFitContext> currentContext(&keepContext);
+
+static MuScleFitContext & minimizingContext()
+{
+  return currentContext.get() != 0 ? *currentContext : MuScleFitContext::defaultContext();
+}
+
+/// Sets the context used by the likelihood in this thread until the end of the scope
+class MinimizingContextGuard
+{
+public:
+  MinimizingContextGuard( MuScleFitContext * context ) : previous_(currentContext.get())
+  {
+    currentContext.reset(context);
+  }
+  ~MinimizingContextGuard()
+  {
+    currentContext.reset(previous_);
+  }
+private:
+  MuScleFitContext * previous_;
+};
+
+// TMinuit sets the global gMinuit and registers in the list of specials of gROOT. The histograms and the canvases
+// of the fit register in the current directory and in gROOT. These operations are serialized between the fits.
+static boost::mutex minuitMutex;
+
+/// Owns the TMinuit of a fit, created and deleted under minuitMutex
+class MinuitGuard
+{
+public:
+  MinuitGuard( const int parnumber )
+  {
+    boost::mutex::scoped_lock lock(minuitMutex);
+    minuit_ = new TMinuit(parnumber);
+  }
+  ~MinuitGuard()
+  {
+    boost::mutex::scoped_lock lock(minuitMutex);
+    delete minuit_;
+  }
+  TMinuit & minuit() { return *minuit_; }
+private:
+  TMinuit * minuit_;
+};
+
+void MuScleFitContext::minimizeLikelihood()
 {
   // Output file with fit parameters resulting from minimization
   // -----------------------------------------------------------
   ofstream FitParametersFile;
-  FitParametersFile.open ("FitParameters.txt", std::ios::app);
+  FitParametersFile.open (fitParametersFileName_.c_str(), std::ios::app);
   FitParametersFile << "Fitting with resolution, scale, bgr function # "
 		    << ResolFitType << " " << ScaleFitType << " " << BgrFitType
 		    << " - Iteration " << loopCounter << std::endl;
+  // The histograms of the fit are written to the output directory of the context or to the current one
+  TDirectory * outputDirectory = outputDirectory_ != 0 ? outputDirectory_ : gDirectory;
 
   // Fill parvalue and other vectors needed for the fitting
   // ------------------------------------------------------
@@ -1184,7 +1414,7 @@ void MuScleFitUtils::minimizeLikelihood()
   // Empty vector of size = number of cross section fitted parameters. Note that the cross section
   // fit works in a different way than the others and it uses ratios of the paramters passed via cfg.
   // We use this empty vector for compatibility with the rest of the structure.
-  std::vector<int> crossSectionParNumSizeVec( MuScleFitUtils::crossSectionHandler->parNum(), 0 );
+  std::vector<int> crossSectionParNumSizeVec( crossSectionHandler->parNum(), 0 );
 
   std::vector<int> parfix(parResolFix);
   parfix.insert( parfix.end(), parScaleFix.begin(), parScaleFix.end() );
@@ -1215,14 +1445,20 @@ void MuScleFitUtils::minimizeLikelihood()
 //     int localMuonType = MuonType;
 //     if( MuonType > 2 ) localMuonType = 2;
 //     backgroundHandler->rescale( parBgr, ResMass, massWindowHalfWidth[localMuonType],
-//                                 MuScleFitUtils::SavedPair);
+//                                 SavedPair);
 //   }
 
+  // Sort the events by mass, used to select the events in the windows for all the fit stages of this loop
+  // -----------------------------------------------------------------------------------------------------
+  buildMassSortedIndex();
+
   // Init Minuit
   // -----------
-  TMinuit rmin (parnumber);
+  MinuitGuard minuitGuard(parnumber);
+  TMinuit & rmin = minuitGuard.minuit();
   rminPtr_ = &rmin;
   rmin.SetFCN (likelihood);     // Unbinned likelihood
+  MinimizingContextGuard contextGuard(this);
   // Standard initialization of minuit parameters:
   // sets input to be $stdin, output to be $stdout
   // and saving to a file.
@@ -1249,38 +1485,38 @@ void MuScleFitUtils::minimizeLikelihood()
   TString * parname = new TString[parnumberAll];
 
   if( !parResolStep.empty() && !parResolMin.empty() && !parResolMax.empty() ) {
-    MuScleFitUtils::resolutionFunctionForVec->setParameters( Start, Step, Mini, Maxi, ind, parname, parResol, parResolOrder, parResolStep, parResolMin, parResolMax, MuonType );
+    resolutionFunctionForVec->setParameters( Start, Step, Mini, Maxi, ind, parname, parResol, parResolOrder, parResolStep, parResolMin, parResolMax, MuonType );
   }
   else {
-    MuScleFitUtils::resolutionFunctionForVec->setParameters( Start, Step, Mini, Maxi, ind, parname, parResol, parResolOrder, MuonType );
+    resolutionFunctionForVec->setParameters( Start, Step, Mini, Maxi, ind, parname, parResol, parResolOrder, MuonType );
   }
 
   // Take the number of parameters in the resolutionFunction and displace the arrays passed to the scaleFunction
-  int resParNum = MuScleFitUtils::resolutionFunctionForVec->parNum();
+  int resParNum = resolutionFunctionForVec->parNum();
 
   if( !parScaleStep.empty() && !parScaleMin.empty() && !parScaleMax.empty() ) {
-    MuScleFitUtils::scaleFunctionForVec->setParameters( &(Start[resParNum]), &(Step[resParNum]),
+    scaleFunctionForVec->setParameters( &(Start[resParNum]), &(Step[resParNum]),
 							&(Mini[resParNum]), &(Maxi[resParNum]),
 							&(ind[resParNum]), &(parname[resParNum]),
 							parScale, parScaleOrder, parScaleStep,
 							parScaleMin, parScaleMax, MuonType );
   }
   else {
-    MuScleFitUtils::scaleFunctionForVec->setParameters( &(Start[resParNum]), &(Step[resParNum]),
+    scaleFunctionForVec->setParameters( &(Start[resParNum]), &(Step[resParNum]),
 							&(Mini[resParNum]), &(Maxi[resParNum]),
 							&(ind[resParNum]), &(parname[resParNum]),
 							parScale, parScaleOrder, MuonType );
   }
 
   // Initialize cross section parameters
-  int crossSectionParShift = resParNum + MuScleFitUtils::scaleFunctionForVec->parNum();
-  MuScleFitUtils::crossSectionHandler->setParameters( &(Start[crossSectionParShift]), &(Step[crossSectionParShift]), &(Mini[crossSectionParShift]),
+  int crossSectionParShift = resParNum + scaleFunctionForVec->parNum();
+  crossSectionHandler->setParameters( &(Start[crossSectionParShift]), &(Step[crossSectionParShift]), &(Mini[crossSectionParShift]),
                                                       &(Maxi[crossSectionParShift]), &(ind[crossSectionParShift]), &(parname[crossSectionParShift]),
                                                       parCrossSection, parCrossSectionOrder, resfind );
 
   // Initialize background parameters
   int bgrParShift = crossSectionParShift + crossSectionHandler->parNum();
-  MuScleFitUtils::backgroundHandler->setParameters( &(Start[bgrParShift]), &(Step[bgrParShift]), &(Mini[bgrParShift]), &(Maxi[bgrParShift]),
+  backgroundHandler->setParameters( &(Start[bgrParShift]), &(Step[bgrParShift]), &(Mini[bgrParShift]), &(Maxi[bgrParShift]),
                                                     &(ind[bgrParShift]), &(parname[bgrParShift]), parBgr, parBgrOrder, MuonType );
 
   for( int ipar=0; ipar<parnumber; ++ipar ) {
@@ -1425,15 +1661,25 @@ void MuScleFitUtils::minimizeLikelihood()
       minuitLoop_ = 0;
       char name[50];
       sprintf(name, "likelihoodInLoop_%d_%d", loopCounter, iorder);
-      TH1D * tempLikelihoodInLoop = new TH1D(name, "likelihood value in minuit loop", 10000, 0, 10000);
-      likelihoodInLoop_ = tempLikelihoodInLoop;
       char signalProbName[50];
       sprintf(signalProbName, "signalProb_%d_%d", loopCounter, iorder);
-      TH1D * tempSignalProb = new TH1D(signalProbName, "signal probability", 10000, 0, 10000);
-      signalProb_ = tempSignalProb;
       char backgroundProbName[50];
       sprintf(backgroundProbName, "backgroundProb_%d_%d", loopCounter, iorder);
-      TH1D * tempBackgroundProb = new TH1D(backgroundProbName, "background probability", 10000, 0, 10000);
+      TH1D * tempLikelihoodInLoop = 0;
+      TH1D * tempSignalProb = 0;
+      TH1D * tempBackgroundProb = 0;
+      {
+        // Detached from the current directory, they are only written to the output directory at the end of the fit
+        boost::mutex::scoped_lock lock(minuitMutex);
+        tempLikelihoodInLoop = new TH1D(name, "likelihood value in minuit loop", 10000, 0, 10000);
+        tempLikelihoodInLoop->SetDirectory(0);
+        tempSignalProb = new TH1D(signalProbName, "signal probability", 10000, 0, 10000);
+        tempSignalProb->SetDirectory(0);
+        tempBackgroundProb = new TH1D(backgroundProbName, "background probability", 10000, 0, 10000);
+        tempBackgroundProb->SetDirectory(0);
+      }
+      likelihoodInLoop_ = tempLikelihoodInLoop;
+      signalProb_ = tempSignalProb;
       backgroundProb_ = tempBackgroundProb;
 // #endif
 
@@ -1446,14 +1692,10 @@ void MuScleFitUtils::minimizeLikelihood()
       // an 90% of the normalization window.
       double protectionFactor = 0.9;
 
-      MuScleFitUtils::ReducedSavedPair.clear();
-      for( unsigned int nev=0; nev<MuScleFitUtils::SavedPair.size(); ++nev ) {
-        const lorentzVector * recMu1 = &(MuScleFitUtils::SavedPair[nev].first);
-        const lorentzVector * recMu2 = &(MuScleFitUtils::SavedPair[nev].second);
-        double mass = MuScleFitUtils::invDimuonMass( *recMu1, *recMu2 );
-        // Test all resonances to see if the mass is inside at least one of the windows
-        bool check = false;
-        for( int ires = 0; ires < 6; ++ires ) {
+      // The events are taken from the mass-sorted index with a binary search on each window
+      std::vector<std::pair<double, double> > reducedWindows;
+      for( int ires = 0; ires < 6; ++ires ) {
+        if( resfind[ires] ) {
 	  // std::pair<double, double> windowFactor = backgroundHandler->windowFactors( doBackgroundFit[loopCounter], ires );
 	  std::pair<double, double> windowBorder = backgroundHandler->windowBorders( doBackgroundFit[loopCounter], ires );
           // if( resfind[ires] && checkMassWindow( mass, ires, backgroundHandler->resMass( doBackgroundFit[loopCounter], ires ),
@@ -1464,15 +1706,11 @@ void MuScleFitUtils::minimizeLikelihood()
 	  double windowBorderShift = (windowBorder.second - windowBorder.first)*(1-protectionFactor)/2.;
 	  double windowBorderLeft = windowBorder.first + windowBorderShift;
 	  double windowBorderRight = windowBorder.second - windowBorderShift;
-          if( resfind[ires] && checkMassWindow( mass, windowBorderLeft, windowBorderRight ) ) {
-            check = true;
-          }
-        }
-        if( check ) {
-          MuScleFitUtils::ReducedSavedPair.push_back(std::make_pair(*recMu1, *recMu2));
+          reducedWindows.push_back(std::make_pair(windowBorderLeft, windowBorderRight));
         }
       }
-      std::cout << "Fitting with " << MuScleFitUtils::ReducedSavedPair.size() << " events" << std::endl;
+      selectPairsInWindows(reducedWindows);
+      std::cout << "Fitting with " << ReducedSavedPairIndex.size() << " events" << std::endl;
 
 
       // rmin.SetMaxIterations(500*parnumber);
@@ -1485,7 +1723,7 @@ void MuScleFitUtils::minimizeLikelihood()
 
       std::cout<<"maxNumberOfIterations (just set) = "<<rmin.GetMaxIterations()<<std::endl;
 
-      MuScleFitUtils::normalizationChanged_ = 0;
+      normalizationChanged_ = 0;
 
       // Maximum number of iterations
       arglis[0] = 100000;
@@ -1503,12 +1741,15 @@ void MuScleFitUtils::minimizeLikelihood()
 
 
 // #ifdef DEBUG
-      likelihoodInLoop_->Write();
-      signalProb_->Write();
-      backgroundProb_->Write();
-      delete tempLikelihoodInLoop;
-      delete tempSignalProb;
-      delete tempBackgroundProb;
+      {
+        boost::mutex::scoped_lock lock(minuitMutex);
+        outputDirectory->WriteTObject(likelihoodInLoop_);
+        outputDirectory->WriteTObject(signalProb_);
+        outputDirectory->WriteTObject(backgroundProb_);
+        delete tempLikelihoodInLoop;
+        delete tempSignalProb;
+        delete tempBackgroundProb;
+      }
       likelihoodInLoop_ = 0;
       signalProb_ = 0;
       backgroundProb_ = 0;
@@ -1616,6 +1857,8 @@ void MuScleFitUtils::minimizeLikelihood()
 	  iparString << ipar+1;
 	  std::stringstream iparStringName;
 	  iparStringName << ipar;
+	  // The scan draws the graph with the plugins of gROOT
+	  boost::mutex::scoped_lock lock(minuitMutex);
 	  rmin.mncomd( ("scan "+iparString.str()).c_str(), ierror );
 	  if( ierror == 0 ) {
 	    TCanvas * canvas = new TCanvas(("likelihoodCanvas_loop_"+iLoopString.str()+"_oder_"+iorderString.str()+"_par_"+iparStringName.str()).c_str(), ("likelihood_"+iparStringName.str()).c_str(), 1000, 800);
@@ -1628,7 +1871,7 @@ void MuScleFitUtils::minimizeLikelihood()
 	    graph->SetTitle(parname[ipar]);
 	    // graph->Write();
 
-	    canvas->Write();
+	    outputDirectory->WriteTObject(canvas);
 	  }
 	}
 
@@ -1681,7 +1924,7 @@ void MuScleFitUtils::minimizeLikelihood()
     int localMuonType = MuonType;
     if( MuonType > 2 ) localMuonType = 2;
     backgroundHandler->rescale( parBgr, ResMass, massWindowHalfWidth[localMuonType],
-                                MuScleFitUtils::ReducedSavedPair );
+                                SavedPair, 1., &(ReducedSavedPairIndex) );
   }
 
   // Delete the arrays used to set some parameters
@@ -1697,16 +1940,18 @@ void MuScleFitUtils::minimizeLikelihood()
 // -------------------
 extern "C" void likelihood( int& npar, double* grad, double& fval, double* xval, int flag ) {
 
-  if (MuScleFitUtils::debug>19) std::cout << "[MuScleFitUtils-likelihood]: In likelihood function" << std::endl;
+  MuScleFitContext & context = minimizingContext();
+
+  if (context.debug>19) std::cout << "[MuScleFitUtils-likelihood]: In likelihood function" << std::endl;
 
   const lorentzVector * recMu1;
   const lorentzVector * recMu2;
   lorentzVector corrMu1;
   lorentzVector corrMu2;
 
-  //   if (MuScleFitUtils::debug>19) {
-  //     int parnumber = (int)(MuScleFitUtils::parResol.size()+MuScleFitUtils::parScale.size()+
-  //                           MuScleFitUtils::parCrossSection.size()+MuScleFitUtils::parBgr.size());
+  //   if (context.debug>19) {
+  //     int parnumber = (int)(context.parResol.size()+context.parScale.size()+
+  //                           context.parCrossSection.size()+context.parBgr.size());
   //     std::cout << "[MuScleFitUtils-likelihood]: Looping on tree with ";
   //     for (int ipar=0; ipar<parnumber; ipar++) {
   //       std::cout << "Parameter #" << ipar << " with value " << xval[ipar] << " ";
@@ -1719,34 +1964,36 @@ extern "C" void likelihood( int& npar, double* grad, double& fval, double* xval,
   double flike = 0;
   int evtsinlik = 0;
   int evtsoutlik = 0;
-  // std::cout << "SavedPair.size() = " << MuScleFitUtils::SavedPair.size() << std::endl;
-  if( MuScleFitUtils::debug>0 ) {
-    std::cout << "SavedPair.size() = " << MuScleFitUtils::SavedPair.size() << std::endl;
-    std::cout << "ReducedSavedPair.size() = " << MuScleFitUtils::ReducedSavedPair.size() << std::endl;
+  // std::cout << "SavedPair.size() = " << context.SavedPair.size() << std::endl;
+  if( context.debug>0 ) {
+    std::cout << "SavedPair.size() = " << context.SavedPair.size() << std::endl;
+    std::cout << "ReducedSavedPairIndex.size() = " << context.ReducedSavedPairIndex.size() << std::endl;
   }
-  // for( unsigned int nev=0; nev<MuScleFitUtils::SavedPair.size(); ++nev ) {
-  for( unsigned int nev=0; nev<MuScleFitUtils::ReducedSavedPair.size(); ++nev ) {
+  // for( unsigned int nev=0; nev<context.SavedPair.size(); ++nev ) {
+  for( unsigned int nev=0; nev<context.ReducedSavedPairIndex.size(); ++nev ) {
 
-    //     recMu1 = &(MuScleFitUtils::SavedPair[nev].first);
-    //     recMu2 = &(MuScleFitUtils::SavedPair[nev].second);
-    recMu1 = &(MuScleFitUtils::ReducedSavedPair[nev].first);
-    recMu2 = &(MuScleFitUtils::ReducedSavedPair[nev].second);
+    //     recMu1 = &(context.SavedPair[nev].first);
+    //     recMu2 = &(context.SavedPair[nev].second);
+    const std::pair<lorentzVector,lorentzVector> & savedPair = context.SavedPair[context.ReducedSavedPairIndex[nev]];
+    recMu1 = &(savedPair.first);
+    recMu2 = &(savedPair.second);
 
     // Compute original mass
     // ---------------------
-    double mass = MuScleFitUtils::invDimuonMass( *recMu1, *recMu2 );
+    double mass = context.invDimuonMass( *recMu1, *recMu2 );
 
     // Compute weight and reference mass (from original mass)
     // ------------------------------------------------------
-    double weight = MuScleFitUtils::computeWeight(mass, MuScleFitUtils::iev_);
+    // Same as computeWeight(mass, iev_), precomputed for this loop by buildMassSortedIndex
+    double weight = (context.resonanceWindowMask_[context.ReducedSavedPairIndex[nev]] != 0) ? 1. : 0.;
     if( weight!=0. ) {
       // Compute corrected mass (from previous biases) only if we are currently fitting the scale
       // ----------------------------------------------------------------------------------------
-      if( MuScleFitUtils::doScaleFit[MuScleFitUtils::loopCounter] ) {
+      if( context.doScaleFit[context.loopCounter] ) {
 // 	std::cout << "Original pt1 = " << corrMu1.Pt() << std::endl;
 // 	std::cout << "Original pt2 = " << corrMu2.Pt() << std::endl;
-        corrMu1 = MuScleFitUtils::applyScale(*recMu1, xval, -1);
-        corrMu2 = MuScleFitUtils::applyScale(*recMu2, xval,  1);
+        corrMu1 = context.applyScale(*recMu1, xval, -1);
+        corrMu2 = context.applyScale(*recMu2, xval,  1);
         
 //         if( (corrMu1.Pt() != corrMu1.Pt()) || (corrMu2.Pt() != corrMu2.Pt()) ) {
 //           std::cout << "Rescaled pt1 = " << corrMu1.Pt() << std::endl;
@@ -1764,27 +2011,27 @@ extern "C" void likelihood( int& npar, double* grad, double& fval, double* xval,
 //           std::cout << "Not rescaled pt2 = " << corrMu2.Pt() << std::endl;
 //         }
       }
-      double corrMass = MuScleFitUtils::invDimuonMass(corrMu1, corrMu2);
+      double corrMass = context.invDimuonMass(corrMu1, corrMu2);
       double Y = (corrMu1+corrMu2).Rapidity();
       double resEta = (corrMu1+corrMu2).Eta();
-      if( MuScleFitUtils::debug>19 ) {
+      if( context.debug>19 ) {
 	std::cout << "[MuScleFitUtils-likelihood]: Original/Corrected resonance mass = " << mass
 	     << " / " << corrMass << std::endl;
       }
 
       // Compute mass resolution
       // -----------------------
-      double massResol = MuScleFitUtils::massResolution(corrMu1, corrMu2, xval);
-      if (MuScleFitUtils::debug>19)
+      double massResol = context.massResolution(corrMu1, corrMu2, xval);
+      if (context.debug>19)
 	std::cout << "[MuScleFitUtils-likelihood]: Resolution is " << massResol << std::endl;
 
       // Compute probability of this mass value including background modeling
       // --------------------------------------------------------------------
-      if (MuScleFitUtils::debug>1) std::cout << "calling massProb inside likelihood function" << std::endl;
+      if (context.debug>1) std::cout << "calling massProb inside likelihood function" << std::endl;
 
-      // double prob = MuScleFitUtils::massProb( corrMass, resEta, Y, massResol, xval );
-      double prob = MuScleFitUtils::massProb( corrMass, resEta, Y, massResol, xval, false, corrMu1.eta(), corrMu2.eta() );
-      if (MuScleFitUtils::debug>1) std::cout << "likelihood:massProb = " << prob << std::endl;
+      // double prob = context.massProb( corrMass, resEta, Y, massResol, xval );
+      double prob = context.massProb( corrMass, resEta, Y, massResol, xval, false, corrMu1.eta(), corrMu2.eta() );
+      if (context.debug>1) std::cout << "likelihood:massProb = " << prob << std::endl;
 
       // Compute likelihood
       // ------------------
@@ -1793,14 +2040,14 @@ extern "C" void likelihood( int& npar, double* grad, double& fval, double* xval,
 	flike += log(prob)*weight;
 	evtsinlik += 1;  // NNBB test: see if likelihood per event is smarter (boundary problem)
       } else {
-        if( MuScleFitUtils::debug > 0 ) {
+        if( context.debug > 0 ) {
           std::cout << "WARNING: corrMass = " << corrMass << " outside window, this will cause a discontinuity in the likelihood. Consider increasing the safety bands which are now set to 90% of the normalization window to avoid this problem" << std::endl;
           std::cout << "Original mass was = " << mass << std::endl;
 	  std::cout << "WARNING: massResol = " << massResol << " outside window" << std::endl;
         }
 	evtsoutlik += 1;
       }
-      if (MuScleFitUtils::debug>19)
+      if (context.debug>19)
 	std::cout << "[MuScleFitUtils-likelihood]: Mass probability = " << prob << std::endl;
     } // weight!=0
 
@@ -1811,14 +2058,14 @@ extern "C" void likelihood( int& npar, double* grad, double& fval, double* xval,
 //   // because of ~ uniformly distributed events (a random combination could be good and spoil the fit).
 //   // We require that the number of events included in the fit does not change more than 5% in each minuit loop.
 //   bool lowStatPenalty = false;
-//   if( MuScleFitUtils::minuitLoop_ > 0 ) {
+//   if( context.minuitLoop_ > 0 ) {
 //     double newEventsOutInRatio = double(evtsinlik);
 //     // double newEventsOutInRatio = double(evtsoutlik)/double(evtsinlik);
-//     double ratio = newEventsOutInRatio/MuScleFitUtils::oldEventsOutInRatio_;
-//     MuScleFitUtils::oldEventsOutInRatio_ = newEventsOutInRatio;
+//     double ratio = newEventsOutInRatio/context.oldEventsOutInRatio_;
+//     context.oldEventsOutInRatio_ = newEventsOutInRatio;
 //     if( ratio < 0.8 || ratio > 1.2 ) {
 //       std::cout << "Warning: too much change from oldEventsInLikelihood to newEventsInLikelihood, ratio is = " << ratio << std::endl;
-//       std::cout << "oldEventsInLikelihood = " << MuScleFitUtils::oldEventsOutInRatio_ << ", newEventsInLikelihood = " << newEventsOutInRatio << std::endl;
+//       std::cout << "oldEventsInLikelihood = " << context.oldEventsOutInRatio_ << ", newEventsInLikelihood = " << newEventsOutInRatio << std::endl;
 //       lowStatPenalty = true;
 //     }
 //   }
@@ -1826,24 +2073,24 @@ extern "C" void likelihood( int& npar, double* grad, double& fval, double* xval,
   // It is a product of probabilities, we compare the sqrt_N of them. Thus N becomes a denominator of the logarithm.
   if( evtsinlik != 0 ) {
 
-    if( MuScleFitUtils::normalizeLikelihoodByEventNumber_ ) {
-      // && !(MuScleFitUtils::duringMinos_) ) {
-      if( MuScleFitUtils::rminPtr_ == 0 ) {
-        std::cout << "ERROR: rminPtr_ = " << MuScleFitUtils::rminPtr_ << ", code will crash" << std::endl;
+    if( context.normalizeLikelihoodByEventNumber_ ) {
+      // && !(context.duringMinos_) ) {
+      if( context.rminPtr_ == 0 ) {
+        std::cout << "ERROR: rminPtr_ = " << context.rminPtr_ << ", code will crash" << std::endl;
       }
       double normalizationArg[] = {1/double(evtsinlik)};
       // Reset the normalizationArg only if it changed
-      if( MuScleFitUtils::oldNormalization_ != normalizationArg[0] ) {
+      if( context.oldNormalization_ != normalizationArg[0] ) {
         int ierror = 0;
-//         if( MuScleFitUtils::likelihoodInLoop_ != 0 ) {
+//         if( context.likelihoodInLoop_ != 0 ) {
 //           // This condition is set only when minimizing. Later calls of hesse and minos will not change the value
 //           // This is done to avoid minos being confused by changing the UP parameter during its computation.
-//           MuScleFitUtils::rminPtr_->mnexcm("SET ERR", normalizationArg, 1, ierror);
+//           context.rminPtr_->mnexcm("SET ERR", normalizationArg, 1, ierror);
 //         }
-        MuScleFitUtils::rminPtr_->mnexcm("SET ERR", normalizationArg, 1, ierror);
-	std::cout << "oldNormalization = " << MuScleFitUtils::oldNormalization_ << " new = " << normalizationArg[0] << std::endl;
-        MuScleFitUtils::oldNormalization_ = normalizationArg[0];
-        MuScleFitUtils::normalizationChanged_ += 1;
+        context.rminPtr_->mnexcm("SET ERR", normalizationArg, 1, ierror);
+	std::cout << "oldNormalization = " << context.oldNormalization_ << " new = " << normalizationArg[0] << std::endl;
+        context.oldNormalization_ = normalizationArg[0];
+        context.normalizationChanged_ += 1;
       }
       fval = -2.*flike/double(evtsinlik);
       // fval = -2.*flike;
@@ -1860,25 +2107,25 @@ extern "C" void likelihood( int& npar, double* grad, double& fval, double* xval,
     fval = 999999999.;
   }
   // fval = -2.*flike;
-  if (MuScleFitUtils::debug>19)
+  if (context.debug>19)
     std::cout << "[MuScleFitUtils-likelihood]: End tree loop with likelihood value = " << fval << std::endl;
 
 //  #ifdef DEBUG
 
-//  if( MuScleFitUtils::minuitLoop_ < 10000 ) {
-  if( MuScleFitUtils::likelihoodInLoop_ != 0 ) {
-    ++MuScleFitUtils::minuitLoop_;
-    MuScleFitUtils::likelihoodInLoop_->SetBinContent(MuScleFitUtils::minuitLoop_, fval);
+//  if( context.minuitLoop_ < 10000 ) {
+  if( context.likelihoodInLoop_ != 0 ) {
+    ++context.minuitLoop_;
+    context.likelihoodInLoop_->SetBinContent(context.minuitLoop_, fval);
   }
   //  }
   // else std::cout << "minuitLoop over 10000. Not filling histogram" << std::endl;
 
-  std::cout<<"MINUIT loop number "<<MuScleFitUtils::minuitLoop_<<", likelihood = "<<fval<<std::endl;
+  std::cout<<"MINUIT loop number "<<context.minuitLoop_<<", likelihood = "<<fval<<std::endl;
 
-  if( MuScleFitUtils::debug > 0 ) {
-    //     if( MuScleFitUtils::duringMinos_ ) {
-    //       int parnumber = (int)(MuScleFitUtils::parResol.size()+MuScleFitUtils::parScale.size()+
-    //                             MuScleFitUtils::parCrossSection.size()+MuScleFitUtils::parBgr.size());
+  if( context.debug > 0 ) {
+    //     if( context.duringMinos_ ) {
+    //       int parnumber = (int)(context.parResol.size()+context.parScale.size()+
+    //                             context.parCrossSection.size()+context.parBgr.size());
     //       std::cout << "[MuScleFitUtils-likelihood]: Looping on tree with ";
     //       for (int ipar=0; ipar<parnumber; ipar++) {
     //         std::cout << "Parameter #" << ipar << " with value " << xval[ipar] << " ";
@@ -1895,9 +2142,9 @@ extern "C" void likelihood( int& npar, double* grad, double& fval, double* xval,
 
 // Mass fitting routine
 // --------------------
-std::vector<TGraphErrors*> MuScleFitUtils::fitMass (TH2F* histo) {
+std::vector<TGraphErrors*> MuScleFitContext::fitMass (TH2F* histo) {
 
-  if (MuScleFitUtils::debug>0) std::cout << "Fitting " << histo->GetName() << std::endl;
+  if (debug>0) std::cout << "Fitting " << histo->GetName() << std::endl;
 
   std::vector<TGraphErrors *> results;
 
@@ -2118,7 +2365,7 @@ std::vector<TGraphErrors*> MuScleFitUtils::fitReso (TH2F* histo) {
 
 // Mass probability for likelihood computation - no-background version (not used anymore)
 // --------------------------------------------------------------------------------------
-double MuScleFitUtils::massProb( const double & mass, const double & rapidity, const int ires, const double & massResol )
+double MuScleFitContext::massProb( const double & mass, const double & rapidity, const int ires, const double & massResol )
 {
   // This routine computes the likelihood that a given measured mass "measMass" is
   // the result of resonance #ires if the resolution expected for the two muons is massResol
@@ -2154,6 +2401,7 @@ double MuScleFitUtils::massProb( const double & mass, const double & rapidity, c
   Int_t np = 100;
   double * x = new double[np];
   double * w = new double[np];
+  TF1 * GL = lorentzGaussian();
   GL->SetParameters (ResGamma[ires], ResMass[ires], mass, massResol);
   GL->CalcGaussLegendreSamplingPoints (np, x, w, 0.1e-15);
   P = GL->IntegralFast (np, x, w, ResMass[ires]-10*ResGamma[ires], ResMass[ires]+10*ResGamma[ires]);
@@ -2176,8 +2424,8 @@ double MuScleFitUtils::massProb( const double & mass, const double & rapidity, c
   return P;
 }
 
-std::pair<lorentzVector, lorentzVector> MuScleFitUtils::findSimMuFromRes( const edm::Handle<edm::HepMCProduct> & evtMC,
-									  const edm::Handle<edm::SimTrackContainer> & simTracks )
+std::pair<lorentzVector, lorentzVector> MuScleFitContext::findSimMuFromRes( const edm::Handle<edm::HepMCProduct> & evtMC,
+									    const edm::Handle<edm::SimTrackContainer> & simTracks )
 {
   //Loop on simulated tracks
   std::pair<lorentzVector, lorentzVector> simMuFromRes;
@@ -2214,7 +2462,7 @@ std::pair<lorentzVector, lorentzVector> MuScleFitUtils::findSimMuFromRes( const
   return simMuFromRes;
 }
 
-std::pair<lorentzVector, lorentzVector> MuScleFitUtils::findGenMuFromRes( const edm::HepMCProduct* evtMC )
+std::pair<lorentzVector, lorentzVector> MuScleFitContext::findGenMuFromRes( const edm::HepMCProduct* evtMC )
 {
   const HepMC::GenEvent* Evt = evtMC->GetEvent();
   std::pair<lorentzVector,lorentzVector> muFromRes;
@@ -2252,7 +2500,7 @@ std::pair<lorentzVector, lorentzVector> MuScleFitUtils::findGenMuFromRes( const
   return muFromRes;
 }
 
-std::pair<lorentzVector, lorentzVector> MuScleFitUtils::findGenMuFromRes( const reco::GenParticleCollection* genParticles)
+std::pair<lorentzVector, lorentzVector> MuScleFitContext::findGenMuFromRes( const reco::GenParticleCollection* genParticles)
 {
   std::pair<lorentzVector,lorentzVector> muFromRes;
 
@@ -2286,3 +2534,115 @@ std::pair<lorentzVector, lorentzVector> MuScleFitUtils::findGenMuFromRes( const
   }
   return muFromRes;
 }
+
+// Static interface: the methods of the default context
+// ----------------------------------------------------
+std::pair<SimTrack,SimTrack> MuScleFitUtils::findBestSimuRes( const std::vector<SimTrack>& simMuons )
+{
+  return MuScleFitContext::defaultContext().findBestSimuRes(simMuons);
+}
+
+std::pair<lorentzVector,lorentzVector> MuScleFitUtils::findBestRecoRes( const std::vector<reco::LeafCandidate>& muons )
+{
+  return MuScleFitContext::defaultContext().findBestRecoRes(muons);
+}
+
+std::pair<lorentzVector, lorentzVector> MuScleFitUtils::findGenMuFromRes( const reco::GenParticleCollection* genParticles )
+{
+  return MuScleFitContext::defaultContext().findGenMuFromRes(genParticles);
+}
+
+std::pair<lorentzVector, lorentzVector> MuScleFitUtils::findGenMuFromRes( const edm::HepMCProduct* evtMC )
+{
+  return MuScleFitContext::defaultContext().findGenMuFromRes(evtMC);
+}
+
+std::pair<lorentzVector, lorentzVector> MuScleFitUtils::findSimMuFromRes( const edm::Handle<edm::HepMCProduct> & evtMC,
+                                                                          const edm::Handle<edm::SimTrackContainer> & simTracks )
+{
+  return MuScleFitContext::defaultContext().findSimMuFromRes(evtMC, simTracks);
+}
+
+std::vector<TGraphErrors*> MuScleFitUtils::fitMass( TH2F* histo )
+{
+  return MuScleFitContext::defaultContext().fitMass(histo);
+}
+
+lorentzVector MuScleFitUtils::applyScale( const lorentzVector& muon, const std::vector<double> & parval, const int chg )
+{
+  return MuScleFitContext::defaultContext().applyScale(muon, parval, chg);
+}
+
+lorentzVector MuScleFitUtils::applyScale( const lorentzVector& muon, double* parval, const int chg )
+{
+  return MuScleFitContext::defaultContext().applyScale(muon, parval, chg);
+}
+
+lorentzVector MuScleFitUtils::applyBias( const lorentzVector& muon, const int chg )
+{
+  return MuScleFitContext::defaultContext().applyBias(muon, chg);
+}
+
+lorentzVector MuScleFitUtils::applySmearing( const lorentzVector& muon )
+{
+  return MuScleFitContext::defaultContext().applySmearing(muon);
+}
+
+void MuScleFitUtils::minimizeLikelihood()
+{
+  MuScleFitContext::defaultContext().minimizeLikelihood();
+}
+
+double MuScleFitUtils::massResolution( const lorentzVector& mu1, const lorentzVector& mu2, const std::vector<double> & parval )
+{
+  return MuScleFitContext::defaultContext().massResolution(mu1, mu2, parval);
+}
+
+double MuScleFitUtils::massResolution( const lorentzVector& mu1, const lorentzVector& mu2, double* parval )
+{
+  return MuScleFitContext::defaultContext().massResolution(mu1, mu2, parval);
+}
+
+double MuScleFitUtils::massResolution( const lorentzVector& mu1, const lorentzVector& mu2, const ResolutionFunction & resolFunc )
+{
+  return MuScleFitContext::defaultContext().massResolution(mu1, mu2, resolFunc);
+}
+
+double MuScleFitUtils::massProb( const double & mass, const double & rapidity, const int ires, const double & massResol )
+{
+  return MuScleFitContext::defaultContext().massProb(mass, rapidity, ires, massResol);
+}
+
+double MuScleFitUtils::massProb( const double & mass, const double & resEta, const double & rapidity, const double & massResol,
+                                 const std::vector<double> & parval, const bool doUseBkgrWindow, const double & eta1, const double & eta2 )
+{
+  return MuScleFitContext::defaultContext().massProb(mass, resEta, rapidity, massResol, parval, doUseBkgrWindow, eta1, eta2);
+}
+
+double MuScleFitUtils::massProb( const double & mass, const double & resEta, const double & rapidity, const double & massResol,
+                                 double * parval, const bool doUseBkgrWindow, const double & eta1, const double & eta2 )
+{
+  return MuScleFitContext::defaultContext().massProb(mass, resEta, rapidity, massResol, parval, doUseBkgrWindow, eta1, eta2);
+}
+
+double MuScleFitUtils::computeWeight( const double & mass, const int iev, const bool doUseBkgrWindow )
+{
+  return MuScleFitContext::defaultContext().computeWeight(mass, iev, doUseBkgrWindow);
+}
+
+void MuScleFitUtils::buildMassSortedIndex()
+{
+  MuScleFitContext::defaultContext().buildMassSortedIndex();
+}
+
+void MuScleFitUtils::selectPairsInWindows( std::vector<std::pair<double, double> > windows )
+{
+  MuScleFitContext::defaultContext().selectPairsInWindows(windows);
+}
+
+double MuScleFitUtils::probability( const double & mass, const double & massResol,
+                                    const double GLvalue[][1001][1001], const double GLnorm[][1001],
+                                    const int iRes, const int iY )
+{
+  return MuScleFitContext::defaultContext().probability(mass, massResol, GLvalue, GLnorm, iRes, iY);
+}
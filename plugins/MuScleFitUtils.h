@@ -24,8 +24,10 @@
 
 #include "MuonAnalysis/MomentumScaleCalibration/interface/CrossSectionHandler.h"
 #include "MuonAnalysis/MomentumScaleCalibration/interface/BackgroundHandler.h"
+#include "MuonAnalysis/MomentumScaleCalibration/interface/MuonPairEvents.h"
 #include "MuonAnalysis/MomentumScaleCalibration/interface/ResolutionFunction.h"
 
+#include <string>
 #include <vector>
 
 // #include "Functions.h"
@@ -39,6 +41,7 @@ class backgroundFunctionBase;
 class BackgroundHandler;
 
 class SimTrack;
+class TDirectory;
 class TString;
 class TTree;
 
@@ -57,6 +60,7 @@ public:
 
   // Operations
   // ----------
+  // The methods using the state of the fit call the same method of the default context (see MuScleFitContext)
   static std::pair<SimTrack, SimTrack> findBestSimuRes( const std::vector<SimTrack>& simMuons );
   static std::pair<lorentzVector, lorentzVector> findBestRecoRes( const std::vector<reco::LeafCandidate>& muons );
   static std::pair <lorentzVector, lorentzVector> findGenMuFromRes( const reco::GenParticleCollection* genParticles);
@@ -83,6 +87,8 @@ public:
   static double massResolution( const lorentzVector& mu1, const lorentzVector& mu2, const ResolutionFunction & resolFunc );
 
   static double massProb( const double & mass, const double & rapidity, const int ires, const double & massResol );
+  /// Upper bound of massProb( mass, rapidity, ires, massResol ), for any rapidity
+  static double massProbUpperBound( const double & mass, const int ires, const double & massResol );
   /* static double massProb( const double & mass, const double & resEta, const double & rapidity, const double & massResol, const std::vector<double> & parval, const bool doUseBkgrWindow = false ); */
   /* static double massProb( const double & mass, const double & resEta, const double & rapidity, const double & massResol, double * parval, const bool doUseBkgrWindow = false ); */
   static double massProb( const double & mass, const double & resEta, const double & rapidity, const double & massResol, const std::vector<double> & parval, const bool doUseBkgrWindow, const double & eta1, const double & eta2 );
@@ -109,14 +115,12 @@ public:
     return sqrt( std::pow( eta1-eta2, 2 ) + std::pow( deltaPhi(phi1, phi2), 2 ) );
   }
 
-  static int debug;       // debug option set by MuScleFit
-  static bool ResFound;   // bool flag true if best resonance found (cuts on pt and eta)
-
+  // Constants and tables shared by all the fits. The tables are filled once (the probability
+  // matrices by MuScleFitBase, the smearing values by MuScleFit) and then only read.
+  // ----------------------------------------------------------------------------------------
   static const int totalResNum; // Total number of resonance: 6
-  static double massWindowHalfWidth[3][6]; // parameter set by MuScleFitUtils
   static double ResGamma[6];     // parameter set by MuScleFitUtils
   static double ResMass[6];      // parameter set by MuScleFitUtils
-  static double ResMinMass[6];      // parameter set by MuScleFitBase
   static double crossSection[6];
   static const double mMu2;
   static const double muMass;
@@ -124,20 +128,6 @@ public:
   // Array of the pdgId of resonances
   static const unsigned int motherPdgIdArray[6];
 
-  static unsigned int loopCounter; // parameter set by MuScleFit
-
-  static int SmearType;
-  static smearFunctionBase * smearFunction;
-  static int BiasType;
-  // No error, we take functions from the same group for scale and bias.
-  static scaleFunctionBase<std::vector<double> > * biasFunction;
-  static int ResolFitType;
-  static resolutionFunctionBase<double *> * resolutionFunction;
-  static resolutionFunctionBase<std::vector<double> > * resolutionFunctionForVec;
-  static int ScaleFitType;
-  static scaleFunctionBase<double*> * scaleFunction;
-  static scaleFunctionBase<std::vector<double> > * scaleFunctionForVec;
-  static int BgrFitType;
   // Three background regions:
   // - one for the Z
   // - one for the Upsilons
@@ -147,54 +137,7 @@ public:
   // A background function for each resonance
   // static backgroundFunctionBase * backgroundFunction[];
 
-  // The Cross section handler takes care of computing the relative cross
-  // sections to be used depending on the resonances that are being fitted.
-  // This corresponds to a normalization of the signal pdf.
-  static CrossSectionHandler * crossSectionHandler;
-
-  // The background handler takes care of using the correct function in each
-  // window, use regions or resonance windows and rescale the fractions when needed
-  static BackgroundHandler * backgroundHandler;
-
-  // Parameters used to select whether to do a fit
-  static std::vector<int> doResolFit;
-  static std::vector<int> doScaleFit;
-  static std::vector<int> doCrossSectionFit;
-  static std::vector<int> doBackgroundFit;
-
-  static int minuitLoop_;
-  static TH1D* likelihoodInLoop_;
-  static TH1D* signalProb_;
-  static TH1D* backgroundProb_;
-
-  static bool duringMinos_;
-
-  static std::vector<double> parSmear;
-  static std::vector<double> parBias;
-  static std::vector<double> parResol;
-  static std::vector<double> parResolStep;
-  static std::vector<double> parResolMin;
-  static std::vector<double> parResolMax;
-  static std::vector<double> parScale;
-  static std::vector<double> parScaleStep;
-  static std::vector<double> parScaleMin;
-  static std::vector<double> parScaleMax;
-  static std::vector<double> parCrossSection;
-  static std::vector<double> parBgr;
-  static std::vector<int> parResolFix;
-  static std::vector<int> parScaleFix;
-  static std::vector<int> parCrossSectionFix;
-  static std::vector<int> parBgrFix;
-  static std::vector<int> parResolOrder;
-  static std::vector<int> parScaleOrder;
-  static std::vector<int> parCrossSectionOrder;
-  static std::vector<int> parBgrOrder;
-  static std::vector<int> resfind;
-  static int FitStrategy;
-  static bool speedup;       // parameter set by MuScleFit - whether to speedup processing
   static double x[7][10000]; // smearing values set by MuScleFit constructor
-  static int goodmuon;       // number of events with a usable resonance
-  static int counter_resprob;// number of times there are resolution problems
   static double GLZValue[40][1001][1001]; // matrix with integral values of Lorentz * Gaussian
   static double GLZNorm[40][1001];        // normalization values per each sigma
   static double GLValue[6][1001][1001]; // matrix with integral values of Lorentz * Gaussian
@@ -202,51 +145,11 @@ public:
   static double ResMaxSigma[6];         // max sigma of matrix
   static double ResHalfWidth[6];        // halfwidth in matrix
   static int nbins;                     // number of bins in matrix
-  static int MuonType; // 0, 1, 2 - 0 is GM, 1 is SM, 2 is track
-  static int MuonTypeForCheckMassWindow; // Reduced to be 0, 1 or 2. It is = MuonType when MuonType < 3, = 2 otherwise.
 
-  static std::vector<std::vector<double> > parvalue;
-  // static std::map<unsigned int,std::vector<double> > parvalue;
   static std::vector<int> parfix;
   static std::vector<int> parorder;
 
-  static std::vector<std::pair<lorentzVector,lorentzVector> > SavedPair;
-  static std::vector<std::pair<lorentzVector,lorentzVector> > ReducedSavedPair;
-  static std::vector<std::pair<lorentzVector,lorentzVector> > genPair;
-  static std::vector<std::pair<lorentzVector,lorentzVector> > simPair;
-
-  static bool scaleFitNotDone_;
-
-  static bool normalizeLikelihoodByEventNumber_;
-  // Pointer to the minuit object
-  static TMinuit * rminPtr_;
-  // Value stored to check whether to apply a new normalization to the likelihood
-  static double oldNormalization_;
-  static unsigned int normalizationChanged_;
-
-  // This must be set to true if using events generated with Sherpa
-  static bool sherpa_;
-
-  // Decide whether to use the rapidity bins for the Z
-  static bool rapidityBinsForZ_;
-
-  static int iev_;
-
-  static bool useProbsFile_;
-
-  // Cuts on the muons to use in the fit
-  static bool separateRanges_;
-  static double minMuonPt_;
-  static double maxMuonPt_;
-  static double minMuonEtaFirstRange_;
-  static double maxMuonEtaFirstRange_;
-  static double minMuonEtaSecondRange_;
-  static double maxMuonEtaSecondRange_;
-  static double deltaPhiMinCut_;
-  static double deltaPhiMaxCut_;
-
-  static bool debugMassResol_;
-  static struct massResolComponentsStruct
+  struct massResolComponentsStruct
   {
     double dmdpt1;
     double dmdpt2;
@@ -254,17 +157,104 @@ public:
     double dmdphi2;
     double dmdcotgth1;
     double dmdcotgth2;
-  } massResolComponents;
-
-  // Fit accuracy and debug parameters
-  static bool startWithSimplex_;
-  static bool computeMinosErrors_;
-  static bool minimumShapePlots_;
+  };
+
+  // State of the fit: these are the members of the default context (see MuScleFitContext for their description)
+  // -------------------------------------------------------------------------------------------------------
+  static int & debug;
+  static bool & ResFound;
+  static double (&massWindowHalfWidth)[3][6];
+  static double (&ResMinMass)[6];
+  static unsigned int & loopCounter;
+  static int & SmearType;
+  static smearFunctionBase * & smearFunction;
+  static int & BiasType;
+  static scaleFunctionBase<std::vector<double> > * & biasFunction;
+  static int & ResolFitType;
+  static resolutionFunctionBase<double *> * & resolutionFunction;
+  static resolutionFunctionBase<std::vector<double> > * & resolutionFunctionForVec;
+  static int & ScaleFitType;
+  static scaleFunctionBase<double*> * & scaleFunction;
+  static scaleFunctionBase<std::vector<double> > * & scaleFunctionForVec;
+  static int & BgrFitType;
+  static CrossSectionHandler * & crossSectionHandler;
+  static BackgroundHandler * & backgroundHandler;
+  static std::vector<int> & doResolFit;
+  static std::vector<int> & doScaleFit;
+  static std::vector<int> & doCrossSectionFit;
+  static std::vector<int> & doBackgroundFit;
+  static int & minuitLoop_;
+  static TH1D* & likelihoodInLoop_;
+  static TH1D* & signalProb_;
+  static TH1D* & backgroundProb_;
+  static bool & duringMinos_;
+  static std::vector<double> & parSmear;
+  static std::vector<double> & parBias;
+  static std::vector<double> & parResol;
+  static std::vector<double> & parResolStep;
+  static std::vector<double> & parResolMin;
+  static std::vector<double> & parResolMax;
+  static std::vector<double> & parScale;
+  static std::vector<double> & parScaleStep;
+  static std::vector<double> & parScaleMin;
+  static std::vector<double> & parScaleMax;
+  static std::vector<double> & parCrossSection;
+  static std::vector<double> & parBgr;
+  static std::vector<int> & parResolFix;
+  static std::vector<int> & parScaleFix;
+  static std::vector<int> & parCrossSectionFix;
+  static std::vector<int> & parBgrFix;
+  static std::vector<int> & parResolOrder;
+  static std::vector<int> & parScaleOrder;
+  static std::vector<int> & parCrossSectionOrder;
+  static std::vector<int> & parBgrOrder;
+  static std::vector<int> & resfind;
+  static int & FitStrategy;
+  static bool & speedup;
+  static int & goodmuon;
+  static int & counter_resprob;
+  static int & MuonType;
+  static int & MuonTypeForCheckMassWindow;
+  static std::vector<std::vector<double> > & parvalue;
+  static MuonPairEvents & SavedPair;
+  static std::vector<unsigned int> & ReducedSavedPairIndex;
+  static std::vector<std::pair<double, unsigned int> > & massSortedIndex_;
+  static std::vector<unsigned char> & resonanceWindowMask_;
+  static MuonPairEvents & genPair;
+  static std::vector<std::pair<lorentzVector,lorentzVector> > & simPair;
+  static bool & scaleFitNotDone_;
+  static bool & normalizeLikelihoodByEventNumber_;
+  static TMinuit * & rminPtr_;
+  static double & oldNormalization_;
+  static unsigned int & normalizationChanged_;
+  static bool & sherpa_;
+  static bool & rapidityBinsForZ_;
+  static int & iev_;
+  static bool & useProbsFile_;
+  static bool & separateRanges_;
+  static double & minMuonPt_;
+  static double & maxMuonPt_;
+  static double & minMuonEtaFirstRange_;
+  static double & maxMuonEtaFirstRange_;
+  static double & minMuonEtaSecondRange_;
+  static double & maxMuonEtaSecondRange_;
+  static double & deltaPhiMinCut_;
+  static double & deltaPhiMaxCut_;
+  static bool & debugMassResol_;
+  static massResolComponentsStruct & massResolComponents;
+  static bool & startWithSimplex_;
+  static bool & computeMinosErrors_;
+  static bool & minimumShapePlots_;
 
   /// Method to check if the mass value is within the mass window of the i-th resonance.
   // static bool checkMassWindow( const double & mass, const int ires, const double & resMass, const double & leftFactor = 1., const double & rightFactor = 1. );
   static bool checkMassWindow( const double & mass, const double & leftBorder, const double & rightBorder );
 
+  /// Fills massSortedIndex_ and resonanceWindowMask_ from the current SavedPair
+  static void buildMassSortedIndex();
+  /// Fills ReducedSavedPairIndex (in event order) with the pairs whose mass is inside any of the given (open) windows
+  static void selectPairsInWindows( std::vector<std::pair<double, double> > windows );
+
   /// Computes the probability given the mass, mass resolution and the arrays with the probabilities and the normalizations.
   static double probability( const double & mass, const double & massResol,
                              const double GLvalue[][1001][1001], const double GLnorm[][1001],
@@ -282,6 +272,202 @@ private:
 
 };
 
+/**
+ * State of a fit: configuration, parameters, selected pairs and status of the minimization. <br>
+ * The methods of a context only use its own state and the constants and tables of MuScleFitUtils, which
+ * are shared by all the contexts and only read during the fits. Several independent fits can then exist in
+ * the same process and contexts used in different threads can be minimized at the same time: the likelihood
+ * uses the context being minimized in the current thread. <br>
+ * The pointers to the functions and to the handlers are not owned: contexts that are minimized at the same
+ * time must use their own handlers, since these are modified during the fit. <br>
+ * The pairs are not copied for each context: shareEvents gives a context a read-only view on the pairs of another
+ * context (or of a MuonPairSharedStore segment), and a context gets its private copy only when it modifies them,
+ * e.g. when a loop applies its corrections (see MuonPairEvents). N fits of the same pairs keep them once in memory
+ * until they start correcting them. <br>
+ * Contexts minimized at the same time must also use their own outputs (fitParametersFileName_ and outputDirectory_).
+ * The TMinuit of each fit sets the global gMinuit: the creation and deletion of the TMinuit objects and of the
+ * histograms of the fits are serialized, but gMinuit must not be used by other code while contexts are minimized. <br>
+ * The static interface of MuScleFitUtils uses the context returned by defaultContext.
+ */
+class MuScleFitContext : public MuScleFitUtils
+{
+public:
+  MuScleFitContext();
+
+  /// The context used by the static interface of MuScleFitUtils
+  static MuScleFitContext & defaultContext();
+
+  /**
+   * Uses the given pairs (genPair can be empty) without copying them: they are copied to this context only when
+   * it modifies them. The indexes built on the previous pairs are cleared.
+   */
+  void shareEvents( const MuonPairEvents & savedPair, const MuonPairEvents & genPairs );
+  /// Shares the pairs of another context, e.g. the default one after MuScleFit has read and selected them
+  void shareEvents( const MuScleFitContext & other ) { shareEvents(other.SavedPair, other.genPair); }
+
+  std::pair<SimTrack, SimTrack> findBestSimuRes( const std::vector<SimTrack>& simMuons );
+  std::pair<lorentzVector, lorentzVector> findBestRecoRes( const std::vector<reco::LeafCandidate>& muons );
+  std::pair <lorentzVector, lorentzVector> findGenMuFromRes( const reco::GenParticleCollection* genParticles);
+  std::pair<lorentzVector, lorentzVector> findGenMuFromRes( const edm::HepMCProduct* evtMC );
+  std::pair<lorentzVector, lorentzVector> findSimMuFromRes( const edm::Handle<edm::HepMCProduct> & evtMC,
+							    const edm::Handle<edm::SimTrackContainer> & simTracks);
+
+  std::vector<TGraphErrors*> fitMass (TH2F* histo);
+
+  lorentzVector applyScale( const lorentzVector & muon, const std::vector<double> & parval, const int charge );
+  lorentzVector applyScale( const lorentzVector & muon, double* parval, const int charge );
+  lorentzVector applyBias( const lorentzVector & muon, const int charge );
+  lorentzVector applySmearing( const lorentzVector & muon );
+
+  void minimizeLikelihood();
+
+  double massResolution( const lorentzVector & mu1, const lorentzVector & mu2, const std::vector<double> & parval );
+  double massResolution( const lorentzVector & mu1, const lorentzVector & mu2, double* parval );
+  double massResolution( const lorentzVector& mu1, const lorentzVector& mu2, const ResolutionFunction & resolFunc );
+
+  double massProb( const double & mass, const double & rapidity, const int ires, const double & massResol );
+  double massProb( const double & mass, const double & resEta, const double & rapidity, const double & massResol, const std::vector<double> & parval, const bool doUseBkgrWindow, const double & eta1, const double & eta2 );
+  double massProb( const double & mass, const double & resEta, const double & rapidity, const double & massResol, double * parval, const bool doUseBkgrWindow, const double & eta1, const double & eta2 );
+  double computeWeight( const double & mass, const int iev, const bool doUseBkgrWindow = false );
+
+  /// Fills massSortedIndex_ and resonanceWindowMask_ from the current SavedPair
+  void buildMassSortedIndex();
+  /// Fills ReducedSavedPairIndex (in event order) with the pairs whose mass is inside any of the given (open) windows
+  void selectPairsInWindows( std::vector<std::pair<double, double> > windows );
+
+  /// Computes the probability given the mass, mass resolution and the arrays with the probabilities and the normalizations.
+  double probability( const double & mass, const double & massResol,
+                      const double GLvalue[][1001][1001], const double GLnorm[][1001],
+                      const int iRes, const int iY );
+
+  int debug;       // debug option set by MuScleFit
+  bool ResFound;   // bool flag true if best resonance found (cuts on pt and eta)
+
+  double massWindowHalfWidth[3][6]; // parameter set by MuScleFitUtils
+  double ResMinMass[6];      // parameter set by MuScleFitBase
+
+  unsigned int loopCounter; // parameter set by MuScleFit
+
+  int SmearType;
+  smearFunctionBase * smearFunction;
+  int BiasType;
+  // No error, we take functions from the same group for scale and bias.
+  scaleFunctionBase<std::vector<double> > * biasFunction;
+  int ResolFitType;
+  resolutionFunctionBase<double *> * resolutionFunction;
+  resolutionFunctionBase<std::vector<double> > * resolutionFunctionForVec;
+  int ScaleFitType;
+  scaleFunctionBase<double*> * scaleFunction;
+  scaleFunctionBase<std::vector<double> > * scaleFunctionForVec;
+  int BgrFitType;
+
+  // The Cross section handler takes care of computing the relative cross
+  // sections to be used depending on the resonances that are being fitted.
+  // This corresponds to a normalization of the signal pdf.
+  CrossSectionHandler * crossSectionHandler;
+
+  // The background handler takes care of using the correct function in each
+  // window, use regions or resonance windows and rescale the fractions when needed
+  BackgroundHandler * backgroundHandler;
+
+  // Parameters used to select whether to do a fit
+  std::vector<int> doResolFit;
+  std::vector<int> doScaleFit;
+  std::vector<int> doCrossSectionFit;
+  std::vector<int> doBackgroundFit;
+
+  int minuitLoop_;
+  TH1D* likelihoodInLoop_;
+  TH1D* signalProb_;
+  TH1D* backgroundProb_;
+
+  bool duringMinos_;
+
+  std::vector<double> parSmear;
+  std::vector<double> parBias;
+  std::vector<double> parResol;
+  std::vector<double> parResolStep;
+  std::vector<double> parResolMin;
+  std::vector<double> parResolMax;
+  std::vector<double> parScale;
+  std::vector<double> parScaleStep;
+  std::vector<double> parScaleMin;
+  std::vector<double> parScaleMax;
+  std::vector<double> parCrossSection;
+  std::vector<double> parBgr;
+  std::vector<int> parResolFix;
+  std::vector<int> parScaleFix;
+  std::vector<int> parCrossSectionFix;
+  std::vector<int> parBgrFix;
+  std::vector<int> parResolOrder;
+  std::vector<int> parScaleOrder;
+  std::vector<int> parCrossSectionOrder;
+  std::vector<int> parBgrOrder;
+  std::vector<int> resfind;
+  int FitStrategy;
+  bool speedup;       // parameter set by MuScleFit - whether to speedup processing
+  int goodmuon;       // number of events with a usable resonance
+  int counter_resprob;// number of times there are resolution problems
+  int MuonType; // 0, 1, 2 - 0 is GM, 1 is SM, 2 is track
+  int MuonTypeForCheckMassWindow; // Reduced to be 0, 1 or 2. It is = MuonType when MuonType < 3, = 2 otherwise.
+
+  std::vector<std::vector<double> > parvalue;
+
+  // The pairs can be shared with other contexts (see shareEvents): they are copied only when the fit of this
+  // context applies the corrections of a loop to them (see MuonPairEvents)
+  MuonPairEvents SavedPair;
+  std::vector<unsigned int> ReducedSavedPairIndex;
+  // Invariant mass and index of the pairs in SavedPair, sorted by mass. Built once per loop by buildMassSortedIndex.
+  std::vector<std::pair<double, unsigned int> > massSortedIndex_;
+  // For each pair in SavedPair, bit ires is set if its mass is inside the window of resonance ires (as in computeWeight)
+  std::vector<unsigned char> resonanceWindowMask_;
+  MuonPairEvents genPair;
+  std::vector<std::pair<lorentzVector,lorentzVector> > simPair;
+
+  bool scaleFitNotDone_;
+
+  bool normalizeLikelihoodByEventNumber_;
+  // Pointer to the minuit object
+  TMinuit * rminPtr_;
+  // Value stored to check whether to apply a new normalization to the likelihood
+  double oldNormalization_;
+  unsigned int normalizationChanged_;
+
+  // This must be set to true if using events generated with Sherpa
+  bool sherpa_;
+
+  // Decide whether to use the rapidity bins for the Z
+  bool rapidityBinsForZ_;
+
+  int iev_;
+
+  bool useProbsFile_;
+
+  // Cuts on the muons to use in the fit
+  bool separateRanges_;
+  double minMuonPt_;
+  double maxMuonPt_;
+  double minMuonEtaFirstRange_;
+  double maxMuonEtaFirstRange_;
+  double minMuonEtaSecondRange_;
+  double maxMuonEtaSecondRange_;
+  double deltaPhiMinCut_;
+  double deltaPhiMaxCut_;
+
+  bool debugMassResol_;
+  massResolComponentsStruct massResolComponents;
+
+  // Fit accuracy and debug parameters
+  bool startWithSimplex_;
+  bool computeMinosErrors_;
+  bool minimumShapePlots_;
+
+  // Outputs of minimizeLikelihood: the fit parameters are appended to the file fitParametersFileName_ and the
+  // histograms are written to outputDirectory_ (the current directory when minimizeLikelihood is called if 0)
+  std::string fitParametersFileName_;
+  TDirectory * outputDirectory_;
+};
+
 extern "C" void likelihood (int& npar, double* grad, double& fval, double* xval, int flag);
 
 #endif
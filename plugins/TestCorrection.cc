@@ -235,25 +235,33 @@ void TestCorrection::analyze(const edm::Event& iEvent, const edm::EventSetup& iS
 
     //Fill histograms
     //------------------
-    mapHisto_["hRecBestMu"]->Fill(recMu1);
-    if ((std::abs(recMu1.eta())<2.5) && (recMu1.pt()>2.5)) {
-      mapHisto_["hRecBestMu_Acc"]->Fill(recMu1);
+    if( histoFamily(kinematics) ) {
+      histo_.hRecBestMu->Fill(recMu1);
+      if ((std::abs(recMu1.eta())<2.5) && (recMu1.pt()>2.5)) {
+        if( histo_.hRecBestMu_Acc != 0 ) histo_.hRecBestMu_Acc->Fill(recMu1);
+      }
+      histo_.hRecBestMu->Fill(recMu2);
+      if ((std::abs(recMu2.eta())<2.5) && (recMu2.pt()>2.5)) {
+        if( histo_.hRecBestMu_Acc != 0 ) histo_.hRecBestMu_Acc->Fill(recMu2);
+      }
+      histo_.hDeltaRecBestMu->Fill(recMu1, recMu2);
+
+      histo_.hRecBestRes->Fill(bestRecRes);
+      if ((std::abs(recMu1.eta())<2.5) && (recMu1.pt()>2.5) && (std::abs(recMu2.eta())<2.5) &&  (recMu2.pt()>2.5)){
+        if( histo_.hRecBestRes_Acc != 0 ) histo_.hRecBestRes_Acc->Fill(bestRecRes);
+      }
     }
-    mapHisto_["hRecBestMu"]->Fill(recMu2);
-    if ((std::abs(recMu2.eta())<2.5) && (recMu2.pt()>2.5)) {
-      mapHisto_["hRecBestMu_Acc"]->Fill(recMu2);
-    }
-    mapHisto_["hDeltaRecBestMu"]->Fill(recMu1, recMu2);
-    
-    mapHisto_["hRecBestRes"]->Fill(bestRecRes);
-    if ((std::abs(recMu1.eta())<2.5) && (recMu1.pt()>2.5) && (std::abs(recMu2.eta())<2.5) &&  (recMu2.pt()>2.5)){
-      mapHisto_["hRecBestRes_Acc"]->Fill(bestRecRes);
+    if( histoFamily(massVSMuon) && (std::abs(recMu1.eta())<2.5) && (recMu1.pt()>2.5) && (std::abs(recMu2.eta())<2.5) &&  (recMu2.pt()>2.5) ) {
       // Fill histogram of Res mass vs muon variable
-      mapHisto_["hRecBestResVSMu"]->Fill (recMu1, bestRecRes, -1);
-      mapHisto_["hRecBestResVSMu"]->Fill (recMu2, bestRecRes, +1);
+      histo_.hRecBestResVSMu->Fill (recMu1, bestRecRes, -1);
+      histo_.hRecBestResVSMu->Fill (recMu2, bestRecRes, +1);
     }
   }
 
+  // Correct all the recMuons at once
+  std::vector<double> correctedPts;
+  corrector_->correct(muons, correctedPts);
+
   // Loop on the recMuons
   std::vector<reco::LeafCandidate>::const_iterator recMuon = muons.begin();
   int muonCount = 0;
@@ -265,7 +273,7 @@ void TestCorrection::analyze(const edm::Event& iEvent, const edm::EventSetup& iS
 
     // Fill the histogram with corrected pt values
     std::cout << "correcting muon["<<muonCount<<"] with pt = " << recMuon->pt() << std::endl;
-    double corrPt = (*corrector_)(*recMuon);
+    double corrPt = correctedPts[muonCount];
     std::cout << "to pt = " << corrPt << std::endl;
     correctedPt_->Fill(corrPt);
     correctedPtVsEta_->Fill(corrPt, recMuon->eta());
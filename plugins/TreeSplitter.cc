@@ -8,7 +8,13 @@ TreeSplitter::TreeSplitter(const edm::ParameterSet& iConfig) :
   outputFileName_( iConfig.getParameter<std::string>("OutputFileName") ),
   maxEvents_( iConfig.getParameter<int32_t>("MaxEvents") ),
   subSampleFirstEvent_( iConfig.getParameter<uint32_t>("SubSampleFirstEvent") ),
-  subSampleMaxEvents_( iConfig.getParameter<uint32_t>("SubSampleMaxEvents") )
+  subSampleMaxEvents_( iConfig.getParameter<uint32_t>("SubSampleMaxEvents") ),
+  splitMode_( iConfig.getUntrackedParameter<std::string>("SplitMode", "range") ),
+  numberOfShards_( iConfig.getUntrackedParameter<uint32_t>("NumberOfShards", 1) ),
+  shardIndex_( iConfig.getUntrackedParameter<uint32_t>("ShardIndex", 0) ),
+  firstRun_( iConfig.getUntrackedParameter<int32_t>("FirstRun", 0) ),
+  lastRun_( iConfig.getUntrackedParameter<int32_t>("LastRun", 0) ),
+  seed_( iConfig.getUntrackedParameter<uint32_t>("Seed", 4357) )
 {
 }
 
@@ -27,21 +33,21 @@ void TreeSplitter::endJob()
   rootTreeHandler.readTree(maxEvents_, treeFileName_, &savedPair, 0);
   // rootTreeHandler.readTree(maxEvents, inputRootTreeFileName_, &savedPair, &(MuScleFitUtils::genPair));
 
-  // Loop on all the pairs
-  std::vector<MuonPair> newSavedPair;
-  // MuonPairVector newSavedPair;
-  unsigned int i = 0;
-  // MuonPairVector::iterator it = savedPair.begin();
-  std::vector<MuonPair>::iterator it = savedPair.begin();
-  std::cout << "Starting loop on " << savedPair.size() << " muons" << std::endl;
-  uint32_t lastEvent = subSampleFirstEvent_ + subSampleMaxEvents_;
-  for( ; it != savedPair.end(); ++it, ++i ) {
-    // Save only events in the selected range
-    if( i >= subSampleFirstEvent_ && i < lastEvent ) {
-      newSavedPair.push_back(*it);
-    }
+  // The shard is selected in memory and written to the output file
+  std::vector<std::pair<int, int> > evtRun;
+  evtRun.reserve(savedPair.size());
+  std::vector<MuonPair>::const_iterator it = savedPair.begin();
+  for( ; it != savedPair.end(); ++it ) {
+    evtRun.push_back(std::make_pair(it->event, it->run));
   }
-  rootTreeHandler.writeTree(outputFileName_, &newSavedPair, 0);
+  std::cout << "Selecting " << splitMode_ << " shard from " << savedPair.size() << " muon pairs" << std::endl;
+  MuonPairShards::View shard;
+  if( !MuonPairShards::build(splitMode_, evtRun, subSampleFirstEvent_, subSampleMaxEvents_, numberOfShards_, shardIndex_,
+                             firstRun_, lastRun_, seed_, shard) ) {
+    exit(1);
+  }
+  MuonPairShards::select(savedPair, shard);
+  rootTreeHandler.writeTree(outputFileName_, &savedPair, 0);
 }
 
 //define this as a plug-in
@@ -25,6 +25,7 @@
 #include "FWCore/Framework/interface/Event.h"
 #include "FWCore/ParameterSet/interface/ParameterSet.h"
 #include <MuonAnalysis/MomentumScaleCalibration/interface/RootTreeHandler.h>
+#include <MuonAnalysis/MomentumScaleCalibration/interface/MuonPairShards.h>
 
 class TreeSplitter : public edm::EDAnalyzer
 {
@@ -41,6 +42,13 @@ private:
   int32_t maxEvents_;
   uint32_t subSampleFirstEvent_;
   uint32_t subSampleMaxEvents_;
+  // Shard written to the output file, see MuonPairShards. The default "range" uses SubSampleFirstEvent and SubSampleMaxEvents.
+  std::string splitMode_;
+  uint32_t numberOfShards_;
+  uint32_t shardIndex_;
+  int32_t firstRun_;
+  int32_t lastRun_;
+  uint32_t seed_;
 };
 
 #endif // TREESPLITTER_HH
@@ -36,6 +36,69 @@ NegateTrigger = cms.untracked.bool(False),
 # Decide whether to discard empty events or not
 SaveAllToTree = cms.untracked.bool(False),
 
+# Size in bytes of the TTreeCache used when reading from InputRootTreeFileName (0 = no cache).
+# The time to read the tree and the time to the first likelihood evaluation are printed in the log,
+# so the two settings can be compared directly.
+TreeCacheSize = cms.untracked.int32(30000000),
+# Decompress the baskets of the input tree in a separate thread
+ParallelUnzip = cms.untracked.bool(False),
+# Read the input tree in a background thread started at the end of the construction, while the framework
+# completes the startup (only with FastLoop). It is joined before the histograms of the first loop are booked,
+# so that it never overlaps the ROOT I/O of MuScleFit. The startup breakdown is printed when the pairs are needed.
+PrefetchInputTree = cms.untracked.bool(False),
+# Compression codec (ZLIB, LZMA, LZ4 or ZSTD, empty for the ROOT default) and level (0-9) of the
+# OutputRootTreeFileName tree and of the N_MuScleFit.root histogram files, and basket size in bytes of the tree.
+# LZ4, where available, is the fastest to write for iteration jobs, LZMA gives the smallest trees for archival.
+# A codec not available in the ROOT release (LZMA needs 5.30, LZ4 6.04, ZSTD 6.20) stops the job, since ROOT
+# would write it as ZLIB. The CompressionBenchmark executable reports the write time and file size of each
+# available setting on a given tree.
+TreeCompression = cms.untracked.string(""),
+TreeCompressionLevel = cms.untracked.int32(1),
+TreeBasketSize = cms.untracked.int32(32000),
+HistogramsCompression = cms.untracked.string(""),
+HistogramsCompressionLevel = cms.untracked.int32(1),
+# Histograms booked and filled in each loop: "fit-only" (muon and resonance kinematics only),
+# "validation" (no likelihood and no mass probability vs muon variables) or "full".
+# The histograms not booked are not filled and the quantities used only to fill them are not computed.
+HistogramsProfile = cms.untracked.string("full"),
+# "perLoop" writes the histograms of each loop in the file N_OutputFileName, "singleFile" writes all the
+# loops in OutputFileName, in a directory loop_N. With AsyncHistogramsWriter the histograms of a loop are
+# written by a separate thread while the events of the next loop are processed, with at most HistogramsWriterQueue
+# loops waiting. The writer waits while MuScleFit does ROOT I/O (booking, minimization, closing the files).
+HistogramsOutput = cms.untracked.string("perLoop"),
+AsyncHistogramsWriter = cms.untracked.bool(False),
+HistogramsWriterQueue = cms.untracked.uint32(1),
+# InputRootTreeFileName can be a list of files separated by commas and can contain wildcards
+# (e.g. "trees/tree_*.root"). The files are read concurrently by this number of threads and
+# the events are kept in the order of the list (wildcards are sorted alphabetically).
+InputRootTreeThreads = cms.untracked.uint32(4),
+# Apply the cuts below while reading the tree: the pairs not passing them are dropped instead of being
+# kept as empty pairs. In this case MaxEventsFromRootTree counts the pairs passing the cuts.
+ApplyCutsWhileReading = cms.untracked.bool(False),
+# Directory of a node-local store of the pairs read from InputRootTreeFileName (e.g. "/dev/shm").
+# The first job publishes the selected pairs in a segment named after the input files and the selection,
+# the following jobs with the same input and selection map it read-only instead of reading the tree.
+# The pages of the segment are shared by the jobs until the pairs are first modified (by the cuts not applied
+# while reading, the smearing or bias, or the corrections of the loops after the first), when each job makes its copy.
+# Empty disables the store.
+SharedStoreDirectory = cms.untracked.string(""),
+# After publishing a segment only the MaxSharedStoreSegments most recent segments of SharedStoreDirectory are kept
+# (and the temporary files older than an hour are removed). The jobs using a removed segment are not affected.
+# 0 never removes them: they must be removed by hand (rm /dev/shm/MuScleFitStore_*).
+MaxSharedStoreSegments = cms.untracked.uint32(0),
+# Fit only a shard of the pairs read from the tree, without splitting the tree on disk with the TreeSplitter.
+# ShardMode can be "range" (ShardFirstEvent, ShardMaxEvents), "modulo" (pairs with index % NumberOfShards == ShardIndex),
+# "run" (ShardFirstRun <= run <= ShardLastRun) or "random" (NumberOfShards, ShardIndex, ShardSeed). Empty means no sharding.
+# The shard is written to OutputRootTreeFileName if it is set.
+ShardMode = cms.untracked.string(""),
+ShardFirstEvent = cms.untracked.uint32(0),
+ShardMaxEvents = cms.untracked.uint32(0),
+NumberOfShards = cms.untracked.uint32(1),
+ShardIndex = cms.untracked.uint32(0),
+ShardFirstRun = cms.untracked.int32(0),
+ShardLastRun = cms.untracked.int32(0),
+ShardSeed = cms.untracked.uint32(4357),
+
 PATmuons = cms.untracked.bool(False),
 GenParticlesName = cms.untracked.string("genParticles"),
 
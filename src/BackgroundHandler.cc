@@ -169,10 +169,10 @@ double BackgroundHandler::resMass( const bool doBackgroundFit, const int ires )
 }
 
 void BackgroundHandler::rescale( std::vector<double> & parBgr, const double * ResMass, const double * massWindowHalfWidth,
-                                 const std::vector<std::pair<reco::Particle::LorentzVector,reco::Particle::LorentzVector> > & muonPairs,
-                                 const double & weight )
+                                 const MuonPairEvents & muonPairs,
+                                 const double & weight, const std::vector<unsigned int> * indexes )
 {
-  countEventsInAllWindows(muonPairs, weight);
+  countEventsInAllWindows(muonPairs, weight, indexes);
 
   // Loop on all regions and on all the resonances of each region and compute the background fraction
   // for each resonance window.
@@ -245,8 +245,8 @@ std::pair<double, double> BackgroundHandler::backgroundFunction( const bool doBa
 			 (*(resonanceWindow_[ires].backgroundFunction()))( &(parval[parNumsResonances_[ires]]), mass, eta1, eta2 ) );
 }
 
-void BackgroundHandler::countEventsInAllWindows(const std::vector<std::pair<reco::Particle::LorentzVector,reco::Particle::LorentzVector> > & muonPairs,
-                                                const double & weight)
+void BackgroundHandler::countEventsInAllWindows(const MuonPairEvents & muonPairs,
+                                                const double & weight, const std::vector<unsigned int> * indexes)
 {
   // First reset all the counters
   BOOST_FOREACH(MassWindow & resonanceWindow, resonanceWindow_) {
@@ -258,15 +258,17 @@ void BackgroundHandler::countEventsInAllWindows(const std::vector<std::pair<reco
   }
 
   // Now count the events in each window
-  std::pair<lorentzVector,lorentzVector> muonPair;
-  BOOST_FOREACH(muonPair, muonPairs) {
+  unsigned int pairsNum = (indexes != 0) ? indexes->size() : muonPairs.size();
+  for( unsigned int i=0; i<pairsNum; ++i ) {
+    const std::pair<lorentzVector,lorentzVector> & muonPair = muonPairs[(indexes != 0) ? (*indexes)[i] : i];
+    double mass = (muonPair.first + muonPair.second).mass();
     // Count events in resonance windows
     BOOST_FOREACH(MassWindow & resonanceWindow, resonanceWindow_) {
-      resonanceWindow.count((muonPair.first + muonPair.second).mass(), weight);
+      resonanceWindow.count(mass, weight);
     }
     // Count events in background windows
     BOOST_FOREACH(MassWindow & backgroundWindow, backgroundWindow_) {
-      backgroundWindow.count((muonPair.first + muonPair.second).mass(), weight);
+      backgroundWindow.count(mass, weight);
     }
   }
 }
@@ -1,4 +1,8 @@
 #include "MuonAnalysis/MomentumScaleCalibration/interface/MomentumScaleCorrector.h"
+#include <cmath>
+#include <limits>
+#include "TMath.h"
+#include "TRandom3.h"
 
 void MomentumScaleCorrector::readParameters( TString fileName )
 {
@@ -88,3 +92,87 @@ void MomentumScaleCorrector::readParameters( TString fileName )
 
   convertToArrays( scaleFunction_, scaleFunctionVec_ );
 }
+
+bool MomentumScaleCorrector::setGrid( const unsigned int ptBins, const double & ptMin, const double & ptMax,
+                                      const unsigned int etaBins, const double & etaMin, const double & etaMax,
+                                      const unsigned int phiBins, const double & maxRelativeError,
+                                      const unsigned int randomSamples )
+{
+  useGrid_ = false;
+  if( ptBins == 0 || etaBins == 0 || phiBins == 0 || !(ptMax > ptMin) || !(etaMax > etaMin) || !(ptMin > 0.) ) {
+    std::cout << "Error: invalid correction grid, the exact correction is used" << std::endl;
+    return false;
+  }
+  gridBins_[0] = ptBins;
+  gridBins_[1] = etaBins;
+  gridBins_[2] = phiBins;
+  gridMin_[0] = ptMin;
+  gridMin_[1] = etaMin;
+  gridMin_[2] = -TMath::Pi();
+  gridStep_[0] = (ptMax - ptMin)/ptBins;
+  gridStep_[1] = (etaMax - etaMin)/etaBins;
+  gridStep_[2] = 2*TMath::Pi()/phiBins;
+
+  // Sample the ratio at the nodes for both charges
+  const int nodes = (ptBins+1)*(etaBins+1)*(phiBins+1);
+  grid_.assign(2*nodes, 1.);
+  for( int iCharge=0; iCharge<2; ++iCharge ) {
+    const int charge = iCharge == 0 ? 1 : -1;
+    for( unsigned int iPt=0; iPt<=ptBins; ++iPt ) {
+      const double pt = gridMin_[0] + iPt*gridStep_[0];
+      for( unsigned int iEta=0; iEta<=etaBins; ++iEta ) {
+        const double eta = gridMin_[1] + iEta*gridStep_[1];
+        for( unsigned int iPhi=0; iPhi<=phiBins; ++iPhi ) {
+          const double phi = gridMin_[2] + iPhi*gridStep_[2];
+          grid_[iCharge*nodes + gridNode(iPt, iEta, iPhi)] = exactCorrection(pt, eta, phi, charge)/pt;
+        }
+      }
+    }
+  }
+
+  // Compare with the exact correction in each cell at the center, at the centers of the 6 faces and of the 12 edges
+  // (the points with at least one fraction of 0.5, the others being 0 or 1: the corners are nodes) and at randomSamples
+  // random points. The seed is fixed, so that the same parameters always give the same estimate.
+  gridMaxError_ = 0.;
+  TRandom3 random(4357);
+  for( int iCharge=0; iCharge<2; ++iCharge ) {
+    const int charge = iCharge == 0 ? 1 : -1;
+    for( unsigned int iPt=0; iPt<ptBins; ++iPt ) {
+      for( unsigned int iEta=0; iEta<etaBins; ++iEta ) {
+        for( unsigned int iPhi=0; iPhi<phiBins; ++iPhi ) {
+          const int index[3] = {int(iPt), int(iEta), int(iPhi)};
+          for( int point=0; point<27; ++point ) {
+            const double frac[3] = {0.5*(point%3), 0.5*((point/3)%3), 0.5*(point/9)};
+            if( frac[0] != 0.5 && frac[1] != 0.5 && frac[2] != 0.5 ) continue;
+            checkGridPoint(charge, index, frac);
+          }
+          for( unsigned int sample=0; sample<randomSamples; ++sample ) {
+            const double frac[3] = {random.Rndm(), random.Rndm(), random.Rndm()};
+            checkGridPoint(charge, index, frac);
+          }
+        }
+      }
+    }
+  }
+  std::cout << "Correction grid of " << 2*nodes << " nodes: estimated maximum relative interpolation error = " << gridMaxError_
+            << " (allowed " << maxRelativeError << ")" << std::endl;
+  if( !(gridMaxError_ <= maxRelativeError) ) {
+    std::cout << "The interpolation error exceeds the allowed value, the exact correction is used" << std::endl;
+    grid_.clear();
+    return false;
+  }
+  useGrid_ = true;
+  return true;
+}
+
+void MomentumScaleCorrector::checkGridPoint( const int charge, const int * index, const double * frac )
+{
+  const double pt = gridMin_[0] + (index[0]+frac[0])*gridStep_[0];
+  const double eta = gridMin_[1] + (index[1]+frac[1])*gridStep_[1];
+  const double phi = gridMin_[2] + (index[2]+frac[2])*gridStep_[2];
+  const double exact = exactCorrection(pt, eta, phi, charge);
+  const double error = fabs(pt*interpolate(charge, index, frac) - exact)/fabs(exact);
+  // A NaN is counted as an infinite error, which no later point can lower
+  if( error != error ) gridMaxError_ = std::numeric_limits<double>::infinity();
+  else if( error > gridMaxError_ ) gridMaxError_ = error;
+}
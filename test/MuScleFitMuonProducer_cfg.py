@@ -34,7 +34,30 @@ process.MuScleFitMuonProducer = cms.EDProducer(
     'MuScleFitMuonProducer',
     MuonLabel = cms.InputTag("muons"),
     DbObjectLabel = cms.untracked.string(""),
-    PatMuons = cms.bool(False)
+    PatMuons = cms.bool(False),
+    # "collection" produces a corrected copy of the muons, "valueMap" only the corrected pt
+    # as a ValueMap<float> (instance "pt") keyed to the input muons
+    OutputMode = cms.untracked.string("collection"),
+    # With valueMap, also store the relative pt resolution (instance "resolution") from the
+    # resolution parameters in MuScleFitDBobjectRcd with this label (required, different from DbObjectLabel)
+    SaveResolution = cms.untracked.bool(False),
+    ResolutionDbObjectLabel = cms.untracked.string(""),
+    # Sample the correction on a (pt, eta, phi, charge) grid when the parameters are loaded and interpolate it.
+    # The grid is used only if the interpolation error (printed) is below MaxRelativeError. The error is estimated
+    # in each cell at the center, at the centers of the faces and of the edges and at RandomSamplesPerCell random
+    # points. Outside the grid the correction functions are evaluated.
+    UseCorrectionGrid = cms.untracked.bool(False),
+    CorrectionGrid = cms.untracked.PSet(
+        PtBins = cms.untracked.uint32(200),
+        PtMin = cms.untracked.double(1.),
+        PtMax = cms.untracked.double(201.),
+        EtaBins = cms.untracked.uint32(48),
+        EtaMin = cms.untracked.double(-2.4),
+        EtaMax = cms.untracked.double(2.4),
+        PhiBins = cms.untracked.uint32(36),
+        MaxRelativeError = cms.untracked.double(0.001),
+        RandomSamplesPerCell = cms.untracked.uint32(4)
+    )
 )
 
 process.out = cms.OutputModule("PoolOutputModule",
@@ -79,6 +79,7 @@ process.looper = cms.Looper(
     MaxEventsFromRootTree = cms.int32(-1),
     # Specify a file if you want to read events from a root tree in a local file.
     # In this case the input source should be an empty source with 0 events.
+    # A list of files separated by commas and wildcards (e.g. "Tree_*.root") are also accepted.
 
     # InputRootTreeFileName = cms.string("/home/castello/7TeV/CMSSW_3_8_5_patch3/src/Tree/Fall10/Tree_MCFall2010_INNtk_CRAFTRealistic_wGEN.root"),
     InputRootTreeFileName = cms.string("/home/castello/7TeV/CMSSW_3_8_5_patch3/src/Tree/Tree_2010AB_INNtk_ICHEPgeom_BS.root"),
@@ -15,6 +15,9 @@ process.TreeSplitterModule = cms.EDAnalyzer(
     MaxEvents = cms.int32(-1),
     SubSampleFirstEvent = cms.uint32(0),
     SubSampleMaxEvents = cms.uint32(1000)
+    # Other shards can be selected with SplitMode = cms.untracked.string("modulo"), "run" or "random"
+    # (see NumberOfShards, ShardIndex, FirstRun, LastRun and Seed in TreeSplitter.cc).
+    # MuScleFit can fit the same shards in memory with the ShardMode parameter, without writing them to disk.
 )
 
 process.p1 = cms.Path(process.TreeSplitterModule)
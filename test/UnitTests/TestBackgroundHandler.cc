@@ -104,6 +104,30 @@ public:
     CPPUNIT_ASSERT( float(result.second) == float(-parval[5]*exp(-parval[5]*mass)/(exp(-parval[5]*upperBound) - exp(-parval[5]*lowerBound))) );
   }
 
+  void testCountEventsInAllWindows()
+  {
+    // Back to back massless muons with invariant mass 3.1, 91 and 3.1
+    std::vector<std::pair<reco::Particle::LorentzVector,reco::Particle::LorentzVector> > muonPairs;
+    double masses[] = {3.1, 91., 3.1};
+    for( unsigned int i=0; i<3; ++i ) {
+      muonPairs.push_back(std::make_pair(reco::Particle::LorentzVector(masses[i]/2., 0., 0., masses[i]/2.),
+                                         reco::Particle::LorentzVector(-masses[i]/2., 0., 0., masses[i]/2.)));
+    }
+    backgroundHandler_->countEventsInAllWindows(MuonPairEvents(muonPairs), 1.);
+    CPPUNIT_ASSERT( backgroundHandler_->resonanceWindow_[0].events() == 1. );
+    CPPUNIT_ASSERT( backgroundHandler_->resonanceWindow_[5].events() == 2. );
+    CPPUNIT_ASSERT( backgroundHandler_->backgroundWindow_[2].events() == 2. );
+
+    // Only the selected pairs are counted
+    std::vector<unsigned int> indexes;
+    indexes.push_back(0);
+    indexes.push_back(1);
+    backgroundHandler_->countEventsInAllWindows(MuonPairEvents(muonPairs), 1., &indexes);
+    CPPUNIT_ASSERT( backgroundHandler_->resonanceWindow_[0].events() == 1. );
+    CPPUNIT_ASSERT( backgroundHandler_->resonanceWindow_[5].events() == 1. );
+    CPPUNIT_ASSERT( backgroundHandler_->backgroundWindow_[2].events() == 1. );
+  }
+
   void testSetParameters()
   {
     //double Start
@@ -124,6 +148,7 @@ public:
   CPPUNIT_TEST( testConstructor );
   CPPUNIT_TEST( testInitializeParNums );
   CPPUNIT_TEST( testBackgroundFunction );
+  CPPUNIT_TEST( testCountEventsInAllWindows );
   CPPUNIT_TEST( testSetParameters );
   CPPUNIT_TEST_SUITE_END();
 };
@@ -0,0 +1,200 @@
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestRunner.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/TextTestProgressListener.h>
+#include <cppunit/CompilerOutputter.h>
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <TRandom3.h>
+#include <TMath.h>
+
+#include "CondFormats/RecoMuonObjects/interface/MuScleFitDBobject.h"
+#include "MuonAnalysis/MomentumScaleCalibration/interface/MomentumScaleCorrector.h"
+
+#ifndef TestMomentumScaleCorrector_cc
+#define TestMomentumScaleCorrector_cc
+
+class TestMomentumScaleCorrector : public CppUnit::TestFixture {
+public:
+  TestMomentumScaleCorrector() {}
+  void setUp()
+  {
+    // Parameters of scale function 50 of the size found in the fits. They are the same in all the eta bins and
+    // the second phi modulation is off, so that the correction is continuous where the bins meet: the interpolation
+    // cannot follow a discontinuity and setGrid would reject the grid.
+    double parameters[27] = { 0.001,
+                              0.0002, 0.5, 0.0001, -2.12,
+                              0.0002, 0.5, 0.0001, -1.52,
+                              0.0002, 0.5, 0.0001, 1.52,
+                              0.0002, 0.5, 0.0001, 2.12,
+                              0.0002, 0.5, 0.0001,
+                              0.00005,
+                              0., 2., 0.,
+                              0., 2., 0. };
+    MuScleFitDBobject dbObject;
+    dbObject.identifiers.push_back(50);
+    dbObject.parameters.assign(parameters, parameters+27);
+    corrector.reset(new MomentumScaleCorrector(&dbObject));
+  }
+
+  void tearDown()
+  {
+    corrector.reset();
+  }
+
+  void testGridCorrection()
+  {
+    CPPUNIT_ASSERT( corrector->setGrid(200, 1., 201., 48, -2.4, 2.4, 36, 0.001) );
+    CPPUNIT_ASSERT( corrector->useGrid() );
+    CPPUNIT_ASSERT( corrector->gridMaxError() <= 0.001 );
+
+    // The interpolation is compared with the functions at random points in the grid, not the ones checked by setGrid
+    TRandom3 random(1234);
+    for( int i=0; i<100000; ++i ) {
+      const double pt = 1. + 200.*random.Rndm();
+      const double eta = -2.4 + 4.8*random.Rndm();
+      const double phi = -TMath::Pi() + 2*TMath::Pi()*random.Rndm();
+      const int charge = (i%2 == 0) ? 1 : -1;
+      const double exact = corrector->exactCorrection(pt, eta, phi, charge);
+      CPPUNIT_ASSERT( fabs(corrector->gridCorrection(pt, eta, phi, charge) - exact) <= 0.001*fabs(exact) );
+    }
+  }
+
+  void testOutsideGrid()
+  {
+    CPPUNIT_ASSERT( corrector->setGrid(200, 1., 201., 48, -2.4, 2.4, 36, 0.001) );
+    // Outside the grid and for a charge different from +-1 the functions are evaluated
+    CPPUNIT_ASSERT( corrector->gridCorrection(500., 0.3, 1., 1) == corrector->exactCorrection(500., 0.3, 1., 1) );
+    CPPUNIT_ASSERT( corrector->gridCorrection(0.5, 0.3, 1., -1) == corrector->exactCorrection(0.5, 0.3, 1., -1) );
+    CPPUNIT_ASSERT( corrector->gridCorrection(50., 2.5, 1., 1) == corrector->exactCorrection(50., 2.5, 1., 1) );
+    CPPUNIT_ASSERT( corrector->gridCorrection(50., 0.3, 1., 0) == corrector->exactCorrection(50., 0.3, 1., 0) );
+  }
+
+  void testRejectedGrid()
+  {
+    // A too coarse grid is not used
+    CPPUNIT_ASSERT( !corrector->setGrid(2, 1., 201., 2, -2.4, 2.4, 2, 0.001) );
+    CPPUNIT_ASSERT( !corrector->useGrid() );
+    CPPUNIT_ASSERT( corrector->gridMaxError() > 0.001 );
+    // An invalid grid is not used
+    CPPUNIT_ASSERT( !corrector->setGrid(0, 1., 201., 48, -2.4, 2.4, 36, 0.001) );
+    CPPUNIT_ASSERT( !corrector->setGrid(200, 0., 201., 48, -2.4, 2.4, 36, 0.001) );
+    CPPUNIT_ASSERT( !corrector->useGrid() );
+
+    // A different phi modulation in the forward bin makes the correction discontinuous at eta = 1.52
+    MuScleFitDBobject dbObject;
+    dbObject.identifiers.push_back(50);
+    dbObject.parameters = corrector->parameters();
+    dbObject.parameters[13] = 0.0005;
+    MomentumScaleCorrector discontinuous(&dbObject);
+    CPPUNIT_ASSERT( !discontinuous.setGrid(200, 1., 201., 48, -2.4, 2.4, 36, 0.001) );
+  }
+
+  void testNaNCorrection()
+  {
+    // An infinite phase in the very backward bin makes the correction NaN for eta < -2.12 only. The points checked
+    // after those must not hide it: the grid is rejected and the error stays infinite.
+    MuScleFitDBobject dbObject;
+    dbObject.identifiers.push_back(50);
+    dbObject.parameters = corrector->parameters();
+    dbObject.parameters[2] = std::numeric_limits<double>::infinity();
+    MomentumScaleCorrector nanCorrector(&dbObject);
+    const double nanCorrection = nanCorrector.exactCorrection(50., -2.3, 1., 1);
+    CPPUNIT_ASSERT( nanCorrection != nanCorrection );
+    CPPUNIT_ASSERT( nanCorrector.exactCorrection(50., 0.3, 1., 1) == corrector->exactCorrection(50., 0.3, 1., 1) );
+    CPPUNIT_ASSERT( !nanCorrector.setGrid(200, 1., 201., 48, -2.4, 2.4, 36, 0.001) );
+    CPPUNIT_ASSERT( !nanCorrector.useGrid() );
+    CPPUNIT_ASSERT( nanCorrector.gridMaxError() == std::numeric_limits<double>::infinity() );
+  }
+
+  void testBatchCorrection()
+  {
+    // The functions overriding scaleBatch (types 1, 50, 51 and 52), each alone and applied one after the other
+    const double parameters1[2] = { 1.001, -0.00002 };
+    const double parameters51[23] = { 0.001,
+                                      0.0002, 0.5, 0.0001, -2.12,
+                                      0.0002, 0.5, 0.0001, -1.52,
+                                      0.0002, 0.5, 0.0003, 1.2,
+                                      0.0001, 1.52,
+                                      0.0002, 0.5, 0.0001, 2.12,
+                                      0.0002, 0.5, 0.0001,
+                                      0.00005 };
+    const double parameters52[31] = { 0.001,
+                                      0.0002, 0.5, 0.0001, -2.12,
+                                      0.0002, 0.5, 0.0001, -1.52,
+                                      0.0002, 0.5, 0.0001, 1.52,
+                                      0.0002, 0.5, 0.0001, 2.12,
+                                      0.0002, 0.5, 0.0001,
+                                      0.00005,
+                                      0.0001, 1., 0.0001, 1., 0.0001, 1., 0.0001, 1., 0.0001, 1. };
+    std::vector<int> types;
+    std::vector<std::vector<double> > parameters;
+    types.push_back(1);
+    parameters.push_back(std::vector<double>(parameters1, parameters1+2));
+    types.push_back(50);
+    parameters.push_back(corrector->parameters());
+    types.push_back(51);
+    parameters.push_back(std::vector<double>(parameters51, parameters51+23));
+    types.push_back(52);
+    parameters.push_back(std::vector<double>(parameters52, parameters52+31));
+
+    MuScleFitDBobject chain;
+    for( unsigned int i=0; i<types.size(); ++i ) {
+      MuScleFitDBobject dbObject;
+      dbObject.identifiers.push_back(types[i]);
+      dbObject.parameters = parameters[i];
+      MomentumScaleCorrector single(&dbObject);
+      checkBatchCorrection(single);
+      chain.identifiers.push_back(types[i]);
+      chain.parameters.insert(chain.parameters.end(), parameters[i].begin(), parameters[i].end());
+    }
+    MomentumScaleCorrector iterations(&chain);
+    checkBatchCorrection(iterations);
+  }
+
+  /// Compares the batch correction of random muons of both charges with the correction of each muon
+  void checkBatchCorrection( MomentumScaleCorrector & scaleCorrector )
+  {
+    const unsigned int n = 10000;
+    std::vector<double> pt(n), eta(n), phi(n), correctedPt(n);
+    std::vector<int> charge(n);
+    TRandom3 random(4321);
+    for( unsigned int k=0; k<n; ++k ) {
+      pt[k] = 1. + 200.*random.Rndm();
+      eta[k] = -2.4 + 4.8*random.Rndm();
+      phi[k] = -TMath::Pi() + 2*TMath::Pi()*random.Rndm();
+      charge[k] = (random.Rndm() < 0.5) ? 1 : -1;
+    }
+    correctedPt = pt;
+    scaleCorrector.correct(n, &(correctedPt[0]), &(eta[0]), &(phi[0]), &(charge[0]));
+    for( unsigned int k=0; k<n; ++k ) {
+      const double exact = scaleCorrector.exactCorrection(pt[k], eta[k], phi[k], charge[k]);
+      // Same operations: only a different contraction of the loops by the compiler could change the last bits
+      CPPUNIT_ASSERT( fabs(correctedPt[k] - exact) <= 1.e-12*fabs(exact) );
+    }
+  }
+
+  std::auto_ptr<MomentumScaleCorrector> corrector;
+
+  // Declare and build the test suite
+  CPPUNIT_TEST_SUITE( TestMomentumScaleCorrector );
+  CPPUNIT_TEST( testGridCorrection );
+  CPPUNIT_TEST( testOutsideGrid );
+  CPPUNIT_TEST( testRejectedGrid );
+  CPPUNIT_TEST( testNaNCorrection );
+  CPPUNIT_TEST( testBatchCorrection );
+  CPPUNIT_TEST_SUITE_END();
+};
+
+// Register the test suite in the registry.
+// This way we will have to only pass the registry to the runner
+// and it will contain all the registered test suites.
+CPPUNIT_TEST_SUITE_REGISTRATION( TestMomentumScaleCorrector );
+
+#endif
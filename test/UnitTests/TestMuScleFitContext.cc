@@ -0,0 +1,205 @@
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestRunner.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/TextTestProgressListener.h>
+#include <cppunit/CompilerOutputter.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <TFile.h>
+#include <TMath.h>
+#include <TRandom3.h>
+#include <TROOT.h>
+#include <TThread.h>
+
+// The fit is in the plugin library, which cannot be linked: its code is compiled with the test
+#include "MuonAnalysis/MomentumScaleCalibration/plugins/MuScleFitUtils.cc"
+
+#ifndef TestMuScleFitContext_cc
+#define TestMuScleFitContext_cc
+
+class TestMuScleFitContext : public CppUnit::TestFixture {
+public:
+  TestMuScleFitContext() {}
+  void setUp()
+  {
+    TThread::Initialize();
+
+    // Probability table of the Z in the central rapidity bin: Lorentzian convoluted with a gaussian
+    MuScleFitUtils::ResHalfWidth[0] = 25.;
+    MuScleFitUtils::ResMaxSigma[0] = 10.;
+    const int nbins = MuScleFitUtils::nbins;
+    for( int iy=0; iy<=nbins; ++iy ) {
+      const double sigma = MuScleFitUtils::ResMaxSigma[0]*iy/nbins;
+      MuScleFitUtils::GLZNorm[0][iy] = 0.;
+      for( int ix=0; ix<=nbins; ++ix ) {
+        const double mass = MuScleFitUtils::ResMass[0] - MuScleFitUtils::ResHalfWidth[0] + 2*MuScleFitUtils::ResHalfWidth[0]*ix/nbins;
+        MuScleFitUtils::GLZValue[0][ix][iy] = TMath::Voigt(mass - MuScleFitUtils::ResMass[0], sigma, MuScleFitUtils::ResGamma[0]);
+        MuScleFitUtils::GLZNorm[0][iy] += MuScleFitUtils::GLZValue[0][ix][iy]*(2*MuScleFitUtils::ResHalfWidth[0])/nbins;
+      }
+    }
+
+    // Z decaying at rest (rapidity 0), with the momenta of the muons scaled by 1.005
+    const double muonMass = 0.105658;
+    TRandom3 random(1234);
+    for( int i=0; i<2000; ++i ) {
+      const double mass = random.Gaus(random.BreitWigner(MuScleFitUtils::ResMass[0], MuScleFitUtils::ResGamma[0]), 1.);
+      const double p = 1.005*sqrt(mass*mass/4 - muonMass*muonMass);
+      const double eta = -2.4 + 4.8*random.Rndm();
+      const double phi = -TMath::Pi() + 2*TMath::Pi()*random.Rndm();
+      const double pt = p/cosh(eta);
+      const double energy = sqrt(p*p + muonMass*muonMass);
+      pairs_.push_back(std::make_pair(lorentzVector(pt*cos(phi), pt*sin(phi), pt*sinh(eta), energy),
+                                      lorentzVector(-pt*cos(phi), -pt*sin(phi), -pt*sinh(eta), energy)));
+    }
+  }
+
+  void tearDown()
+  {
+    pairs_.clear();
+  }
+
+  void testSharedPairs()
+  {
+    // Reference: a fit alone
+    MuScleFitContext reference;
+    configure(reference, "reference");
+    reference.shareEvents(MuonPairEvents(pairs_), MuonPairEvents());
+    reference.minimizeLikelihood();
+    // Only the first scale parameter is free: it must correct the scale of the muons
+    CPPUNIT_ASSERT( fabs(reference.parvalue[0][3] - 1./1.005) < 0.002 );
+
+    // Two fits of the same shared pairs at the same time
+    MuScleFitContext first;
+    configure(first, "first");
+    first.shareEvents(MuonPairEvents(pairs_), MuonPairEvents());
+    MuScleFitContext second;
+    configure(second, "second");
+    second.shareEvents(MuonPairEvents(pairs_), MuonPairEvents());
+    boost::thread firstThread(boost::bind(&MuScleFitContext::minimizeLikelihood, &first));
+    boost::thread secondThread(boost::bind(&MuScleFitContext::minimizeLikelihood, &second));
+    firstThread.join();
+    secondThread.join();
+
+    // The pairs were not copied and the results are those of the fit alone
+    CPPUNIT_ASSERT( &(first.SavedPair[0]) == &(pairs_[0]) );
+    CPPUNIT_ASSERT( &(second.SavedPair[0]) == &(pairs_[0]) );
+    CPPUNIT_ASSERT( first.parvalue == reference.parvalue );
+    CPPUNIT_ASSERT( second.parvalue == reference.parvalue );
+
+    // Each context wrote its own outputs
+    const std::string referenceParameters = readFile(reference.fitParametersFileName_);
+    CPPUNIT_ASSERT( !referenceParameters.empty() );
+    CPPUNIT_ASSERT( readFile(first.fitParametersFileName_) == referenceParameters );
+    CPPUNIT_ASSERT( readFile(second.fitParametersFileName_) == referenceParameters );
+    CPPUNIT_ASSERT( reference.outputDirectory_->GetKey("likelihoodInLoop_0_0") != 0 );
+    CPPUNIT_ASSERT( first.outputDirectory_->GetKey("likelihoodInLoop_0_0") != 0 );
+    CPPUNIT_ASSERT( second.outputDirectory_->GetKey("likelihoodInLoop_0_0") != 0 );
+
+    release(reference);
+    release(first);
+    release(second);
+  }
+
+  /// Scale fit of the Z with fixed resolution and no background, as configured by MuScleFit
+  void configure( MuScleFitContext & context, const std::string & name )
+  {
+    context.loopCounter = 0;
+    context.doResolFit.push_back(0);
+    context.doScaleFit.push_back(1);
+    context.doCrossSectionFit.push_back(0);
+    context.doBackgroundFit.push_back(0);
+
+    context.ResolFitType = 1;
+    context.resolutionFunction = resolutionFunctionService(1);
+    context.resolutionFunctionForVec = resolutionFunctionVecService(1);
+    double parResol[] = {0.01, 0.001, 0.001};
+    context.parResol.assign(parResol, parResol+3);
+    context.parResolFix.assign(3, 1);
+    context.parResolOrder.assign(3, 0);
+
+    context.ScaleFitType = 1;
+    context.scaleFunction = scaleFunctionService(1);
+    context.scaleFunctionForVec = scaleFunctionVecService(1);
+    double parScale[] = {1., 0.};
+    context.parScale.assign(parScale, parScale+2);
+    context.parScaleFix.push_back(0);
+    context.parScaleFix.push_back(1);
+    context.parScaleOrder.assign(2, 0);
+
+    int resfind[] = {1, 0, 0, 0, 0, 0};
+    context.resfind.assign(resfind, resfind+6);
+    double parCrossSection[] = {1.233, 2.07, 6.33, 13.9, 2.169, 127.2};
+    context.parCrossSection.assign(parCrossSection, parCrossSection+6);
+    context.parCrossSectionFix.assign(6, 0);
+    context.parCrossSectionOrder.assign(6, 0);
+    context.crossSectionHandler = new CrossSectionHandler(context.parCrossSection, context.resfind);
+
+    context.MuonType = 2;
+    context.MuonTypeForCheckMassWindow = 2;
+    double massWindowHalfWidth[] = {20., 0.35, 0.35, 0.35, 0.2, 0.2};
+    std::copy(massWindowHalfWidth, massWindowHalfWidth+6, context.massWindowHalfWidth[2]);
+    context.ResMinMass[0] = MuScleFitUtils::ResMass[0] - MuScleFitUtils::ResHalfWidth[0];
+    context.BgrFitType = 2;
+    double leftWindowBorders[] = {70., 8., 1.391495};
+    double rightWindowBorders[] = {110., 12., 5.391495};
+    context.backgroundHandler = new BackgroundHandler(std::vector<int>(3, 2),
+                                                      std::vector<double>(leftWindowBorders, leftWindowBorders+3),
+                                                      std::vector<double>(rightWindowBorders, rightWindowBorders+3),
+                                                      MuScleFitUtils::ResMass, context.massWindowHalfWidth[2]);
+    // No background: the parameters of the resonance regions are fixed
+    context.parBgr.assign(18, 0.);
+    context.parBgrFix.assign(6, 0);
+    context.parBgrFix.insert(context.parBgrFix.end(), 12, 1);
+    context.parBgrOrder.assign(18, 0);
+
+    context.fitParametersFileName_ = "TestMuScleFitContext_"+name+"_FitParameters.txt";
+    std::remove(context.fitParametersFileName_.c_str());
+    context.outputDirectory_ = new TFile(("TestMuScleFitContext_"+name+".root").c_str(), "RECREATE");
+    gROOT->cd();
+  }
+
+  void release( MuScleFitContext & context )
+  {
+    delete context.resolutionFunction;
+    delete context.resolutionFunctionForVec;
+    delete context.scaleFunction;
+    delete context.scaleFunctionForVec;
+    delete context.crossSectionHandler;
+    delete context.backgroundHandler;
+    std::string outputFileName(context.outputDirectory_->GetName());
+    delete context.outputDirectory_;
+    std::remove(outputFileName.c_str());
+    std::remove(context.fitParametersFileName_.c_str());
+  }
+
+  std::string readFile( const std::string & fileName )
+  {
+    std::ifstream file(fileName.c_str());
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+  }
+
+  std::vector<MuonPairEvents::value_type> pairs_;
+
+  // Declare and build the test suite
+  CPPUNIT_TEST_SUITE( TestMuScleFitContext );
+  CPPUNIT_TEST( testSharedPairs );
+  CPPUNIT_TEST_SUITE_END();
+};
+
+// Register the test suite in the registry.
+// This way we will have to only pass the registry to the runner
+// and it will contain all the registered test suites.
+CPPUNIT_TEST_SUITE_REGISTRATION( TestMuScleFitContext );
+
+#endif
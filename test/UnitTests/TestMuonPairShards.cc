@@ -0,0 +1,169 @@
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestRunner.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/TextTestProgressListener.h>
+#include <cppunit/CompilerOutputter.h>
+
+#include <vector>
+#include <utility>
+
+#include "MuonAnalysis/MomentumScaleCalibration/interface/MuonPairShards.h"
+
+#ifndef TestMuonPairShards_cc
+#define TestMuonPairShards_cc
+
+class TestMuonPairShards : public CppUnit::TestFixture {
+public:
+  TestMuonPairShards() {}
+  void setUp()
+  {
+    // Ten events, the runs are not ordered in the store
+    int runs[10] = {3, 1, 2, 3, 1, 5, 2, 4, 1, 3};
+    for( int i=0; i<10; ++i ) {
+      evtRun.push_back(std::make_pair(100+i, runs[i]));
+    }
+  }
+
+  void tearDown()
+  {
+    evtRun.clear();
+  }
+
+  void testByIndexRange()
+  {
+    MuonPairShards::View view = MuonPairShards::byIndexRange(10, 2, 3);
+    CPPUNIT_ASSERT( view.size() == 3 );
+    CPPUNIT_ASSERT( view[0] == 2 );
+    CPPUNIT_ASSERT( view[2] == 4 );
+
+    // The last shard of a split in shards of 4 pairs has only the remaining 2
+    view = MuonPairShards::byIndexRange(10, 8, 4);
+    CPPUNIT_ASSERT( view.size() == 2 );
+    CPPUNIT_ASSERT( view[0] == 8 );
+    CPPUNIT_ASSERT( view[1] == 9 );
+
+    // A shard starting at the end of the store is empty
+    CPPUNIT_ASSERT( MuonPairShards::byIndexRange(10, 10, 4).empty() );
+    CPPUNIT_ASSERT( MuonPairShards::byIndexRange(10, 12, 4).empty() );
+    CPPUNIT_ASSERT( MuonPairShards::byIndexRange(0, 0, 4).empty() );
+    CPPUNIT_ASSERT( MuonPairShards::byIndexRange(10, 0, 0).empty() );
+  }
+
+  void testByModulo()
+  {
+    MuonPairShards::View view = MuonPairShards::byModulo(10, 3, 1);
+    CPPUNIT_ASSERT( view.size() == 3 );
+    CPPUNIT_ASSERT( view[0] == 1 );
+    CPPUNIT_ASSERT( view[1] == 4 );
+    CPPUNIT_ASSERT( view[2] == 7 );
+
+    // All the shards together contain each pair once
+    unsigned int total = 0;
+    for( unsigned int shard=0; shard<3; ++shard ) total += MuonPairShards::byModulo(10, 3, shard).size();
+    CPPUNIT_ASSERT( total == 10 );
+
+    // With more shards than pairs the last shards have no events
+    CPPUNIT_ASSERT( MuonPairShards::byModulo(3, 5, 2).size() == 1 );
+    CPPUNIT_ASSERT( MuonPairShards::byModulo(3, 5, 3).empty() );
+    CPPUNIT_ASSERT( MuonPairShards::byModulo(3, 5, 4).empty() );
+    CPPUNIT_ASSERT( MuonPairShards::byModulo(10, 0, 0).empty() );
+  }
+
+  void testByRunRange()
+  {
+    // The pairs are in the order of the store, not in the order of the runs
+    MuonPairShards::View view = MuonPairShards::byRunRange(evtRun, 2, 3);
+    CPPUNIT_ASSERT( view.size() == 5 );
+    CPPUNIT_ASSERT( view[0] == 0 );
+    CPPUNIT_ASSERT( view[1] == 2 );
+    CPPUNIT_ASSERT( view[2] == 3 );
+    CPPUNIT_ASSERT( view[3] == 6 );
+    CPPUNIT_ASSERT( view[4] == 9 );
+
+    // The range includes both ends
+    CPPUNIT_ASSERT( MuonPairShards::byRunRange(evtRun, 5, 5).size() == 1 );
+    CPPUNIT_ASSERT( MuonPairShards::byRunRange(evtRun, 1, 5).size() == 10 );
+    // An inverted range or a range without runs is empty
+    CPPUNIT_ASSERT( MuonPairShards::byRunRange(evtRun, 3, 2).empty() );
+    CPPUNIT_ASSERT( MuonPairShards::byRunRange(evtRun, 6, 10).empty() );
+  }
+
+  void testByRandom()
+  {
+    std::vector<MuonPairShards::View> views = MuonPairShards::byRandom(1000, 4, 1234);
+    CPPUNIT_ASSERT( views.size() == 4 );
+    // Each pair is in exactly one shard and the shards are ordered
+    std::vector<int> count(1000, 0);
+    for( unsigned int shard=0; shard<views.size(); ++shard ) {
+      for( unsigned int i=0; i<views[shard].size(); ++i ) {
+        ++count[views[shard][i]];
+        if( i > 0 ) CPPUNIT_ASSERT( views[shard][i] > views[shard][i-1] );
+      }
+    }
+    for( unsigned int i=0; i<count.size(); ++i ) CPPUNIT_ASSERT( count[i] == 1 );
+
+    // The same seed gives the same shards
+    std::vector<MuonPairShards::View> sameViews = MuonPairShards::byRandom(1000, 4, 1234);
+    for( unsigned int shard=0; shard<views.size(); ++shard ) CPPUNIT_ASSERT( views[shard] == sameViews[shard] );
+
+    CPPUNIT_ASSERT( MuonPairShards::byRandom(1000, 0, 1234).empty() );
+  }
+
+  void testBuild()
+  {
+    MuonPairShards::View view;
+    CPPUNIT_ASSERT( MuonPairShards::build("range", evtRun, 8, 4, 0, 0, 0, 0, 0, view) );
+    CPPUNIT_ASSERT( view == MuonPairShards::byIndexRange(10, 8, 4) );
+    CPPUNIT_ASSERT( MuonPairShards::build("modulo", evtRun, 0, 0, 3, 2, 0, 0, 0, view) );
+    CPPUNIT_ASSERT( view == MuonPairShards::byModulo(10, 3, 2) );
+    CPPUNIT_ASSERT( MuonPairShards::build("run", evtRun, 0, 0, 0, 0, 1, 1, 0, view) );
+    CPPUNIT_ASSERT( view == MuonPairShards::byRunRange(evtRun, 1, 1) );
+    CPPUNIT_ASSERT( MuonPairShards::build("random", evtRun, 0, 0, 3, 1, 0, 0, 7, view) );
+    CPPUNIT_ASSERT( view == MuonPairShards::byRandom(10, 3, 7)[1] );
+
+    // A random shard index outside the shards gives an empty view
+    CPPUNIT_ASSERT( MuonPairShards::build("random", evtRun, 0, 0, 3, 3, 0, 0, 7, view) );
+    CPPUNIT_ASSERT( view.empty() );
+
+    CPPUNIT_ASSERT( !MuonPairShards::build("byRun", evtRun, 0, 0, 0, 0, 0, 0, 0, view) );
+  }
+
+  void testSelect()
+  {
+    std::vector<std::pair<int, int> > selected(evtRun);
+    MuonPairShards::View view;
+    view.push_back(7);
+    view.push_back(2);
+    // Indexes outside the store are skipped
+    view.push_back(15);
+    MuonPairShards::select(selected, view);
+    CPPUNIT_ASSERT( selected.size() == 2 );
+    CPPUNIT_ASSERT( selected[0] == evtRun[7] );
+    CPPUNIT_ASSERT( selected[1] == evtRun[2] );
+
+    MuonPairShards::select(selected, MuonPairShards::View());
+    CPPUNIT_ASSERT( selected.empty() );
+  }
+
+  std::vector<std::pair<int, int> > evtRun;
+
+  // Declare and build the test suite
+  CPPUNIT_TEST_SUITE( TestMuonPairShards );
+  CPPUNIT_TEST( testByIndexRange );
+  CPPUNIT_TEST( testByModulo );
+  CPPUNIT_TEST( testByRunRange );
+  CPPUNIT_TEST( testByRandom );
+  CPPUNIT_TEST( testBuild );
+  CPPUNIT_TEST( testSelect );
+  CPPUNIT_TEST_SUITE_END();
+};
+
+// Register the test suite in the registry.
+// This way we will have to only pass the registry to the runner
+// and it will contain all the registered test suites.
+CPPUNIT_TEST_SUITE_REGISTRATION( TestMuonPairShards );
+
+#endif